@@ -0,0 +1,297 @@
+/****************************************************************************
+ *
+ * Multiedia Controller Module(MCM).
+ *
+ * Copyright (c) 2017 by Grandstream Networks, Inc.
+ * All rights reserved.
+ *
+ * This material is proprietary to Grandstream Networks, Inc. and,
+ * in addition to the above mentioned Copyright, may be
+ * subject to protection under other intellectual property
+ * regimes, including patents, trade secrets, designs and/or
+ * trademarks.
+ *
+ * Any use of this material for any purpose, except with an
+ * express license from Grandstream Networks, Inc. is strictly
+ * prohibited.
+ *
+ *
+ * \brief Bump arenas and counted heap calls.
+ *
+ *	An arena is a list of blocks, the arena itself is carved out of the
+ *  first one. A request bigger than a block gets a block of its own,
+ *  rounded up to a multiple of ARENA_BLOCK_SIZE, which is cached too.
+ *  A thread caches ARENA_LOCAL_MAX blocks without a lock, the blocks
+ *  over that go to the shared cache, and the ones over ARENA_SHARED_MAX
+ *  are freed. The cache of a thread goes to the shared one when it exits.
+ *
+ ***************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "avs_arena.h"
+#include "avs_stats.h"
+
+#define ARENA_BLOCK_SIZE	(64 * 1024)	/* Bytes of a block, header included. */
+#define ARENA_LOCAL_MAX		4	/* Blocks cached by a thread. */
+#define ARENA_SHARED_MAX	16	/* Blocks of the shared cache. */
+#define ARENA_ALIGN		16	/* Alignment of arena_alloc(), enough for any type. */
+
+#define ALIGN_UP(n, a)	(((n) + (a) - 1) & ~((size_t)(a) - 1))
+
+struct arena_block
+{
+	struct arena_block *next;	/* Next block of the arena, or of a cache. */
+	size_t size;	/* Bytes of "data". */
+	size_t used;
+	char data[] __attribute__((aligned(ARENA_ALIGN)));
+};
+
+struct arena
+{
+	struct arena_block *head;	/* The block the arena is carved out of. */
+	struct arena_block *cur;	/* The block being carved. */
+};
+
+static __thread struct arena_block *local_cache = NULL;
+static __thread unsigned int local_count = 0;
+static __thread int local_armed = 0;	/* "local_key" is set, the cache is handed over when the thread exits. */
+
+static pthread_mutex_t shared_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct arena_block *shared_cache = NULL;
+static unsigned int shared_count = 0;
+
+static pthread_once_t local_once = PTHREAD_ONCE_INIT;
+static pthread_key_t local_key;
+
+void *heap_alloc(size_t size)
+{
+	void *ptr = malloc(size);
+
+	if (ptr)
+	{
+		stats_count_alloc();
+	}
+
+	return ptr;
+}
+
+void *heap_calloc(size_t num, size_t size)
+{
+	void *ptr = calloc(num, size);
+
+	if (ptr)
+	{
+		stats_count_alloc();
+	}
+
+	return ptr;
+}
+
+void heap_free(void *ptr)
+{
+	if (ptr)
+	{
+		stats_count_free();
+		free(ptr);
+	}
+}
+
+/* Give a block to the shared cache, or free it if the cache is full. */
+static void shared_give(struct arena_block *b)
+{
+	pthread_mutex_lock(&shared_lock);
+	if (shared_count < ARENA_SHARED_MAX)
+	{
+		b->next = shared_cache;
+		shared_cache = b;
+		shared_count++;
+		b = NULL;
+	}
+	pthread_mutex_unlock(&shared_lock);
+
+	heap_free(b);
+}
+
+/* Destructor of "local_key": the cache of an exiting thread goes to the shared one. */
+static void local_release(void *unused)
+{
+	struct arena_block *b;
+
+	(void)unused;
+
+	while ((b = local_cache))
+	{
+		local_cache = b->next;
+		shared_give(b);
+	}
+
+	local_count = 0;
+	local_armed = 0;
+}
+
+static void local_key_create(void)
+{
+	pthread_key_create(&local_key, local_release);
+}
+
+/* First block of a cache list with at least "min" bytes, unlinked. */
+static struct arena_block *cache_take(struct arena_block **list, size_t min)
+{
+	struct arena_block **pp, *b;
+
+	for (pp = list; (b = *pp); pp = &b->next)
+	{
+		if (b->size >= min)
+		{
+			*pp = b->next;
+			return b;
+		}
+	}
+
+	return NULL;
+}
+
+/* An empty block of at least "min" bytes: from the cache of the thread, then the shared one, then the heap. */
+static struct arena_block *block_get(size_t min)
+{
+	struct arena_block *b;
+	size_t total;
+
+	if ((b = cache_take(&local_cache, min)))
+	{
+		local_count--;
+	}
+	else
+	{
+		pthread_mutex_lock(&shared_lock);
+		if ((b = cache_take(&shared_cache, min)))
+		{
+			shared_count--;
+		}
+		pthread_mutex_unlock(&shared_lock);
+	}
+
+	if (!b)
+	{
+		total = ALIGN_UP(sizeof(*b) + min, ARENA_BLOCK_SIZE);
+
+		if (!(b = heap_alloc(total)))
+		{
+			return NULL;
+		}
+
+		b->size = total - sizeof(*b);
+	}
+
+	b->next = NULL;
+	b->used = 0;
+
+	return b;
+}
+
+/* Give a block back to the cache of the thread, or to the shared one if it is full. */
+static void block_put(struct arena_block *b)
+{
+	if (local_count >= ARENA_LOCAL_MAX)
+	{
+		shared_give(b);
+		return;
+	}
+
+	if (!local_armed)
+	{
+		pthread_once(&local_once, local_key_create);
+		pthread_setspecific(local_key, (void *)1);
+		local_armed = 1;
+	}
+
+	b->next = local_cache;
+	local_cache = b;
+	local_count++;
+}
+
+struct arena *arena_get(void)
+{
+	struct arena_block *b;
+	struct arena *a;
+
+	if (!(b = block_get(ARENA_BLOCK_SIZE - sizeof(*b))))
+	{
+		return NULL;
+	}
+
+	a = (struct arena *)b->data;
+	a->head = b;
+	a->cur = b;
+	b->used = ALIGN_UP(sizeof(*a), ARENA_ALIGN);
+
+	return a;
+}
+
+void *arena_alloc(struct arena *a, size_t size)
+{
+	struct arena_block *b = a->cur;
+	void *ptr;
+
+	size = ALIGN_UP(size ? size : 1, ARENA_ALIGN);
+
+	if (b->size - b->used < size)
+	{
+		if (!(b = block_get(size)))
+		{
+			return NULL;
+		}
+
+		a->cur->next = b;
+		a->cur = b;
+	}
+
+	ptr = b->data + b->used;
+	b->used += size;
+
+	return ptr;
+}
+
+void arena_put(struct arena *a)
+{
+	struct arena_block *b, *next;
+
+	if (!a)
+	{
+		return;
+	}
+
+	/* "a" lives in its first block, it is read before that block is given back. */
+	for (b = a->head; b; b = next)
+	{
+		next = b->next;
+		block_put(b);
+	}
+}
+
+void arena_trim(void)
+{
+	struct arena_block *list, *b;
+
+	pthread_mutex_lock(&shared_lock);
+	list = shared_cache;
+	shared_cache = NULL;
+	shared_count = 0;
+	pthread_mutex_unlock(&shared_lock);
+
+	while ((b = list))
+	{
+		list = b->next;
+		heap_free(b);
+	}
+
+	while ((b = local_cache))
+	{
+		local_cache = b->next;
+		heap_free(b);
+	}
+
+	local_count = 0;
+}
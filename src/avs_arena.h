@@ -0,0 +1,74 @@
+/****************************************************************************
+ *
+ * Multiedia Controller Module(MCM).
+ *
+ * Copyright (c) 2017 by Grandstream Networks, Inc.
+ * All rights reserved.
+ *
+ * This material is proprietary to Grandstream Networks, Inc. and,
+ * in addition to the above mentioned Copyright, may be
+ * subject to protection under other intellectual property
+ * regimes, including patents, trade secrets, designs and/or
+ * trademarks.
+ *
+ * Any use of this material for any purpose, except with an
+ * express license from Grandstream Networks, Inc. is strictly
+ * prohibited.
+ *
+ *
+ * \brief Bump arenas for the transient memory of an operation, and the
+ *  counted heap calls of avs_controller.
+ *
+ *	An operation made of several commands (a bulk setup, a teardown, a
+ *  fan-out) takes an arena, carves its state out of it with a pointer
+ *  bump, and gives the whole arena back when it completes. Arena blocks
+ *  are recycled through a cache of the thread which gave them back, and
+ *  a shared cache behind it: an operation is usually started by a caller
+ *  and completed by the receiving thread.
+ *
+ *  Every heap call of the controller goes through heap_alloc(),
+ *  heap_calloc() and heap_free(), which count them in the statistics.
+ *
+ ***************************************************************************/
+
+#ifndef AVS_ARENA_H
+#define AVS_ARENA_H
+
+#include <stddef.h>
+
+struct arena;
+
+/**
+ * heap_alloc, heap_calloc, heap_free - malloc(), calloc() and free() counted in "heap_allocs" and "heap_frees" of struct avs_stats.
+ */
+void *heap_alloc(size_t size);
+void *heap_calloc(size_t num, size_t size);
+void heap_free(void *ptr);
+
+/**
+ * arena_get - Take an empty arena.
+ *
+ * Return: The arena, NULL if it could not be allocated.
+ */
+struct arena *arena_get(void);
+
+/**
+ * arena_alloc - Carve memory out of an arena, aligned for any type. It is not cleared.
+ * @a:  The arena.
+ * @size:  Bytes.
+ *
+ * Return: The memory, valid until arena_put(). NULL if a block could not be allocated.
+ */
+void *arena_alloc(struct arena *a, size_t size);
+
+/**
+ * arena_put - Give an arena back with all the memory carved out of it. Any thread may give it back.
+ */
+void arena_put(struct arena *a);
+
+/**
+ * arena_trim - Free the blocks cached by the calling thread and the shared cache, e.g. at shutdown.
+ */
+void arena_trim(void);
+
+#endif /* AVS_ARENA_H */
@@ -0,0 +1,584 @@
+/****************************************************************************
+ *
+ * Multiedia Controller Module(MCM).
+ *
+ * Copyright (c) 2017 by Grandstream Networks, Inc.
+ * All rights reserved.
+ *
+ * This material is proprietary to Grandstream Networks, Inc. and,
+ * in addition to the above mentioned Copyright, may be
+ * subject to protection under other intellectual property
+ * regimes, including patents, trade secrets, designs and/or
+ * trademarks.
+ *
+ * Any use of this material for any purpose, except with an
+ * express license from Grandstream Networks, Inc. is strictly
+ * prohibited.
+ *
+ *
+ * \brief Benchmark of encoding the commands sent to AVS.
+ *
+ *	Compares the direct encoder of avs_json_enc.c with the jansson encoder
+ *  it replaced: checks the output is byte-identical, then times both.
+ *  Then times the binary frames of avs_tlv.c against JSON, encoding the
+ *  commands and decoding the responses the way avs_controller does.
+ *
+ ***************************************************************************/
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <jansson.h>
+#include "avs_controller.h"
+#include "avs_json_enc.h"
+#include "avs_json_dec.h"
+#include "avs_tlv.h"
+
+#define BENCH_LOOPS		200000	/* Encodes of each command per measurement. */
+
+static int ref_corrected = 0;	/* 0: the output of the jansson encoders, 1: with the corrections listed in avs_json_enc.c. */
+
+/* Name of a transmode in the reference output. The jansson encoders indexed the table { sendOnly, recvOnly, sendRecv } with it. */
+static const char *ref_transmode_name(unsigned int mode)
+{
+	static const char *const indexed[] = { "sendOnly", "recvOnly", "sendRecv" };
+
+	if (ref_corrected)
+	{
+		return transmode_name(mode);
+	}
+
+	return (mode < sizeof(indexed) / sizeof(indexed[0])) ? indexed[mode] : NULL;
+}
+
+/* The jansson encoders as they were in avs_controller.c, the reference output. */
+static char *jansson_set_global_param(const struct avs_global_param *param)
+{
+	json_t *obj_top = json_object();
+	json_t *obj_setparam = json_object();
+	json_t *obj_stun = json_object();
+	json_t *obj_turn = json_object();
+	json_t *array_stun = json_array();
+	json_t *array_turn = json_array();
+	char stun_port[12], turn_port[12];
+	char *json_s;
+
+	sprintf(stun_port, "%d", param->stun_port);
+	sprintf(turn_port, "%d", param->turn_port);
+
+	json_object_set_new(obj_stun, "address", json_string(param->stun_ipaddr));
+	json_object_set_new(obj_stun, "port", json_string(stun_port));
+	json_object_set_new(obj_turn, "address", json_string(param->turn_ipaddr));
+	json_object_set_new(obj_turn, "port", json_string(turn_port));
+	json_object_set_new(obj_turn, "username", json_string(param->turn_username));
+	json_object_set_new(obj_turn, "password", json_string(ref_corrected ? param->turn_password : param->turn_username));
+
+	json_array_insert_new(array_stun, 0, obj_stun);
+	json_array_insert_new(array_turn, 0, obj_turn);
+
+	json_object_set_new(obj_setparam, "stunserver", array_stun);
+	json_object_set_new(obj_setparam, "turnserver", array_turn);
+
+	json_object_set_new(obj_top, "setParam", obj_setparam);
+	json_object_set_new(obj_top, "id", json_string(param->comm_id));
+
+	json_s = json_dumps(obj_top, JSON_COMPACT);
+	json_decref(obj_top);
+
+	return json_s;
+}
+
+static char *jansson_alloc_port_normal(const struct avs_alloc_port_normal_param *param)
+{
+	json_t *obj_top = json_object();
+	json_t *obj_addport = json_object();
+	char dtls[12];
+	char *json_s;
+
+	sprintf(dtls, "%d", param->enable_dtls);
+
+	json_object_set_new(obj_addport, "conf_id", json_string(param->conf_id));
+	json_object_set_new(obj_addport, "chan_id", json_string(param->chan_id));
+	json_object_set_new(obj_addport, "ICE", json_string("0"));
+	json_object_set_new(obj_addport, "DTLS", json_string(dtls));
+
+	json_object_set_new(obj_top, "addPort", obj_addport);
+	json_object_set_new(obj_top, "id", json_string(param->comm_id));
+
+	json_s = json_dumps(obj_top, JSON_COMPACT);
+	json_decref(obj_top);
+
+	return json_s;
+}
+
+static char *jansson_del_port(const struct avs_dealloc_port_param *param)
+{
+	json_t *obj_top = json_object();
+	json_t *obj_delport = json_object();
+	char *json_s;
+
+	json_object_set_new(obj_delport, "conf_id", json_string(param->conf_id));
+	json_object_set_new(obj_delport, "chan_id", json_string(param->chan_id));
+	json_object_set_new(obj_delport, "port_id", json_string(param->port_id));
+
+	json_object_set_new(obj_top, "delPort", obj_delport);
+	json_object_set_new(obj_top, "id", json_string(param->comm_id));
+
+	json_s = json_dumps(obj_top, JSON_COMPACT);
+	json_decref(obj_top);
+
+	return json_s;
+}
+
+static char *jansson_set_peerport_normal(const struct avs_set_peerport_normal_param *param)
+{
+	json_t *obj_top = json_object();
+	json_t *obj_setportparam = json_object();
+	json_t *obj_infoport = json_object();
+	char rtcpmux[12], symrtp[12], qos[12], srtpmode[12];
+	char *json_s;
+
+	sprintf(rtcpmux, "%d", param->rtcpmux);
+	sprintf(symrtp, "%d", param->symrtp);
+	sprintf(qos, "%d", param->qos);
+	sprintf(srtpmode, "%d", param->srtpmode);
+
+	json_object_set_new(obj_infoport, "targetAddr", json_string(param->targetaddr));
+	json_object_set_new(obj_infoport, "RtcpMux", json_string(rtcpmux));
+	json_object_set_new(obj_infoport, "SymRTP", json_string(symrtp));
+	json_object_set_new(obj_infoport, "Qos", json_string(qos));
+	json_object_set_new(obj_infoport, "srtpMode", json_string(srtpmode));
+	json_object_set_new(obj_infoport, "srtpSendKey", json_string(param->srtpsendkey));
+	json_object_set_new(obj_infoport, "srtpRecvKey", json_string(param->srtprecvkey));
+	json_object_set_new(obj_infoport, "fingerprint", json_string(param->fingerprint));
+
+	json_object_set_new(obj_setportparam, "conf_id", json_string(param->conf_id));
+	json_object_set_new(obj_setportparam, "chan_id", json_string(param->chan_id));
+	json_object_set_new(obj_setportparam, "port_id", json_string(param->port_id));
+	json_object_set_new(obj_setportparam, "InfoPort", obj_infoport);
+
+	json_object_set_new(obj_top, "setPortParam", obj_setportparam);
+	json_object_set_new(obj_top, "id", json_string(param->comm_id));
+
+	json_s = json_dumps(obj_top, JSON_COMPACT);
+	json_decref(obj_top);
+
+	return json_s;
+}
+
+static char *jansson_set_peerport_ice(const struct avs_set_peerport_ice_param *param)
+{
+	json_t *obj_top = json_object();
+	json_t *obj_setportparam = json_object();
+	json_t *obj_infoice = json_object();
+	char icerole[12], sslrole[12];
+	char *json_s;
+
+	sprintf(icerole, "%d", param->icerole);
+	sprintf(sslrole, "%d", param->sslrole);
+
+	json_object_set_new(obj_infoice, "IceRole", json_string(icerole));
+	json_object_set_new(obj_infoice, "SslRole", json_string(sslrole));
+	json_object_set_new(obj_infoice, "fingerprint", json_string(param->fingerprint));
+	json_object_set_new(obj_infoice, "ice_ufrag", json_string(param->ice_ufrag));
+	json_object_set_new(obj_infoice, "ice_pwd", json_string(param->ice_pwd));
+	json_object_set_new(obj_infoice, "candidate", json_string(param->candidate));
+
+	json_object_set_new(obj_setportparam, "conf_id", json_string(param->conf_id));
+	json_object_set_new(obj_setportparam, "chan_id", json_string(param->chan_id));
+	json_object_set_new(obj_setportparam, "port_id", json_string(param->port_id));
+	json_object_set_new(obj_setportparam, "InfoICE", obj_infoice);
+
+	json_object_set_new(obj_top, "setPortParam", obj_setportparam);
+	json_object_set_new(obj_top, "id", json_string(param->comm_id));
+
+	json_s = json_dumps(obj_top, JSON_COMPACT);
+	json_decref(obj_top);
+
+	return json_s;
+}
+
+static char *jansson_set_audio_codec(const struct avs_codec_audio_param *param)
+{
+	json_t *obj_top = json_object();
+	json_t *obj_addtrack = json_object();
+	json_t *obj_a_tx_param = json_object();
+	json_t *obj_a_rx_param = json_object();
+	json_t *audio_transport = json_object();
+	char a_payloadtype[12], a_ptime[12];
+	char *json_s;
+
+	sprintf(a_payloadtype, "%d", param->audio_payloadtype);
+	sprintf(a_ptime, "%d", param->ptime);
+
+	json_object_set_new(obj_a_tx_param, "MainCoder", json_string(codec_audio_name(param->a_codec)));
+	json_object_set_new(obj_a_tx_param, "PayloadType", json_string(a_payloadtype));
+	json_object_set_new(obj_a_tx_param, "Ptime", json_string(a_ptime));
+
+	json_object_set_new(obj_a_rx_param, "Codecs", json_string(codec_audio_name(param->a_codec)));
+	json_object_set_new(obj_a_rx_param, "PayloadType", json_string(a_payloadtype));
+
+	json_object_set_new(audio_transport, "audio_transport", json_string(ref_transmode_name(param->audio_transmode)));
+
+	json_object_set_new(obj_addtrack, "conf_id", json_string(param->conf_id));
+	json_object_set_new(obj_addtrack, "chan_id", json_string(param->chan_id));
+	json_object_set_new(obj_addtrack, "port_id", json_string(param->port_id));
+	json_object_set_new(obj_addtrack, "track_id", json_string("222222222222222"));
+	json_object_set_new(obj_addtrack, "mediaType", json_string("audio"));
+	json_object_set_new(obj_addtrack, "audio_tx_param", obj_a_tx_param);
+	json_object_set_new(obj_addtrack, "audio_rx_param", obj_a_rx_param);
+	json_object_set_new(obj_addtrack, "audio_transport", audio_transport);
+
+	json_object_set_new(obj_top, "addTrack", obj_addtrack);
+	json_object_set_new(obj_top, "id", json_string(param->comm_id));
+
+	json_s = json_dumps(obj_top, JSON_COMPACT);
+	json_decref(obj_top);
+
+	return json_s;
+}
+
+static char *jansson_set_video_codec(const struct avs_codec_video_param *param)
+{
+	json_t *obj_top = json_object();
+	json_t *obj_addtrack = json_object();
+	json_t *obj_v_tx_param = json_object();
+	json_t *obj_v_rx_param = json_object();
+	json_t *video_transport = json_object();
+	char v_payloadtype[12];
+	char *json_s;
+
+	sprintf(v_payloadtype, "%d", param->video_payloadtype);
+
+	json_object_set_new(obj_v_tx_param, "MainCoder", json_string(codec_video_name(param->v_codec)));
+	json_object_set_new(obj_v_tx_param, "PayloadType", json_string(v_payloadtype));
+
+	json_object_set_new(obj_v_rx_param, "Codecs", json_string(codec_video_name(param->v_codec)));
+	json_object_set_new(obj_v_rx_param, "PayloadType", json_string(v_payloadtype));
+
+	json_object_set_new(video_transport, "video_transport", json_string(ref_transmode_name(param->video_transmode)));
+
+	json_object_set_new(obj_addtrack, "conf_id", json_string(param->conf_id));
+	json_object_set_new(obj_addtrack, "chan_id", json_string(param->chan_id));
+	json_object_set_new(obj_addtrack, "port_id", json_string(param->port_id));
+	json_object_set_new(obj_addtrack, "track_id", json_string("222222222222222"));
+	json_object_set_new(obj_addtrack, "mediaType", json_string("video"));
+	json_object_set_new(obj_addtrack, "video_tx_param", obj_v_tx_param);
+	json_object_set_new(obj_addtrack, "video_rx_param", obj_v_rx_param);
+	json_object_set_new(obj_addtrack, "video_transport", video_transport);
+
+	json_object_set_new(obj_top, "addTrack", obj_addtrack);
+	json_object_set_new(obj_top, "id", json_string(param->comm_id));
+
+	json_s = json_dumps(obj_top, JSON_COMPACT);
+	json_decref(obj_top);
+
+	return json_s;
+}
+
+/* Parameters of every command, filled like a real conference does. */
+static struct avs_global_param global_param;
+static struct avs_alloc_port_normal_param alloc_param;
+static struct avs_dealloc_port_param del_param;
+static struct avs_set_peerport_normal_param peer_normal_param;
+static struct avs_set_peerport_ice_param peer_ice_param;
+static struct avs_codec_audio_param audio_param;
+static struct avs_codec_video_param video_param;
+
+/* The encoders of one command, behind the same signature. */
+struct bench_case
+{
+	const char *name;
+	const void *param;
+	char *(*jansson_enc)(const void *param);
+	int (*direct_enc)(char *buf, size_t size, const void *param);
+	int (*tlv_enc)(char *buf, size_t size, const void *param);
+};
+
+static const struct bench_case cases[] = {
+	{ "setParam", &global_param, (char *(*)(const void *))jansson_set_global_param, (int (*)(char *, size_t, const void *))enc_json_set_global_param,
+		(int (*)(char *, size_t, const void *))enc_tlv_set_global_param },
+	{ "addPort", &alloc_param, (char *(*)(const void *))jansson_alloc_port_normal, (int (*)(char *, size_t, const void *))enc_json_alloc_port_normal,
+		(int (*)(char *, size_t, const void *))enc_tlv_alloc_port_normal },
+	{ "delPort", &del_param, (char *(*)(const void *))jansson_del_port, (int (*)(char *, size_t, const void *))enc_json_del_port,
+		(int (*)(char *, size_t, const void *))enc_tlv_del_port },
+	{ "setPortParam/normal", &peer_normal_param, (char *(*)(const void *))jansson_set_peerport_normal, (int (*)(char *, size_t, const void *))enc_json_set_peerport_normal,
+		(int (*)(char *, size_t, const void *))enc_tlv_set_peerport_normal },
+	{ "setPortParam/ICE", &peer_ice_param, (char *(*)(const void *))jansson_set_peerport_ice, (int (*)(char *, size_t, const void *))enc_json_set_peerport_ice,
+		(int (*)(char *, size_t, const void *))enc_tlv_set_peerport_ice },
+	{ "addTrack/audio", &audio_param, (char *(*)(const void *))jansson_set_audio_codec, (int (*)(char *, size_t, const void *))enc_json_set_audio_codec,
+		(int (*)(char *, size_t, const void *))enc_tlv_set_audio_codec },
+	{ "addTrack/video", &video_param, (char *(*)(const void *))jansson_set_video_codec, (int (*)(char *, size_t, const void *))enc_json_set_video_codec,
+		(int (*)(char *, size_t, const void *))enc_tlv_set_video_codec },
+};
+
+/* What avs_controller keeps of a response. */
+struct bench_resp
+{
+	char id[MAX_UNIQUE_ID];
+	unsigned int code;
+	char message[MAX_MESSAGE_REPONSE];
+	char port_id[MAX_PORTID_LEN];
+	unsigned int rtp_port;
+	unsigned int rtcp_port;
+	char fingerprint[MAX_FINGERPRINT_LEN];
+};
+
+/* The fields avs_controller decodes from an "addPort" response with normal mode. */
+static const struct json_field resp_fields[] = {
+	{ .parent = -1, .key = "error", .type = JSON_FIELD_OBJECT, .missing = "" },
+	{ .parent = 0, .key = "code", .type = JSON_FIELD_INTEGER, .offset = offsetof(struct bench_resp, code), .mistyped = "" },
+	{ .parent = 0, .key = "message", .type = JSON_FIELD_STRING, .offset = offsetof(struct bench_resp, message), .size = MAX_MESSAGE_REPONSE },
+	{ .parent = -1, .key = "port_id", .type = JSON_FIELD_STRING, .offset = offsetof(struct bench_resp, port_id), .size = MAX_PORTID_LEN, .mistyped = "" },
+	{ .parent = -1, .key = "InfoPort", .type = JSON_FIELD_OBJECT, .missing = "" },
+	{ .parent = 4, .key = "rtp_port", .type = JSON_FIELD_STRING_UINT, .offset = offsetof(struct bench_resp, rtp_port), .mistyped = "" },
+	{ .parent = 4, .key = "rtcp_port", .type = JSON_FIELD_STRING_UINT, .offset = offsetof(struct bench_resp, rtcp_port), .mistyped = "" },
+	{ .parent = 4, .key = "fingerprint", .type = JSON_FIELD_STRING, .offset = offsetof(struct bench_resp, fingerprint), .size = MAX_FINGERPRINT_LEN },
+};
+
+static const char json_resp[] = "{\"id\":\"1234567891\",\"error\":{\"code\":0,\"message\":\"OK\"},\"port_id\":\"port-0001\","
+	"\"InfoPort\":{\"rtp_port\":\"20000\",\"rtcp_port\":\"20001\",\"fingerprint\":\"sha-256 4A:AD:B9:B1:3F:82:18:3B:54:02:12:DF:3E:5D:49:6B\"}}";
+
+static int dec_json(const char *msg, size_t len, struct bench_resp *resp)
+{
+	static struct json_doc doc;
+	struct json_error error;
+	int tok;
+
+	if (json_doc_parse(&doc, msg, len, &error) != 0 || (tok = json_doc_get(&doc, 0, "id")) < 0)
+	{
+		return -1;
+	}
+	json_tok_copy(&doc, tok, resp->id, sizeof(resp->id));
+
+	return json_dec_fields(&doc, 0, resp_fields, sizeof(resp_fields) / sizeof(resp_fields[0]), resp);
+}
+
+static int dec_tlv(const char *msg, size_t len, struct bench_resp *resp)
+{
+	struct tlv_resp tr;
+
+	if (dec_tlv_resp(msg, len, &tr) != 0)
+	{
+		return -1;
+	}
+
+	strcpy(resp->id, tr.id);
+	resp->code = tr.code;
+	strcpy(resp->message, tr.message);
+	strcpy(resp->port_id, tr.port_id);
+	resp->rtp_port = tr.rtp_port;
+	resp->rtcp_port = tr.rtcp_port;
+	strcpy(resp->fingerprint, tr.fingerprint);
+
+	return 0;
+}
+
+/* The same response as "json_resp", as a frame. */
+static int tlv_resp_init(char *buf, size_t size)
+{
+	struct tlv_resp tr;
+
+	memset(&tr, 0, sizeof(tr));
+	strcpy(tr.id, "1234567891");
+	strcpy(tr.message, "OK");
+	strcpy(tr.port_id, "port-0001");
+	tr.rtp_port = 20000;
+	tr.rtcp_port = 20001;
+	strcpy(tr.fingerprint, "sha-256 4A:AD:B9:B1:3F:82:18:3B:54:02:12:DF:3E:5D:49:6B");
+	tr.present = ((uint64_t)1 << TLV_TAG_CODE) | ((uint64_t)1 << TLV_TAG_MESSAGE) | ((uint64_t)1 << TLV_TAG_PORT_ID)
+		| ((uint64_t)1 << TLV_TAG_RTP_PORT) | ((uint64_t)1 << TLV_TAG_RTCP_PORT) | ((uint64_t)1 << TLV_TAG_FINGERPRINT);
+
+	return enc_tlv_resp(buf, size, &tr);
+}
+
+static void params_init(void)
+{
+	strcpy(global_param.stun_ipaddr, "192.168.120.2");
+	global_param.stun_port = 3478;
+	strcpy(global_param.turn_ipaddr, "192.168.120.3");
+	global_param.turn_port = 3478;
+	strcpy(global_param.turn_username, "turn\"user\\1");
+	strcpy(global_param.turn_password, "turn\\pass\"2");
+	strcpy(global_param.comm_id, "1234567890");
+
+	strcpy(alloc_param.conf_id, "6001");
+	strcpy(alloc_param.chan_id, "PJSIP/1000-00000001\t\x01");
+	alloc_param.enable_dtls = 1;
+	strcpy(alloc_param.comm_id, "1234567891");
+
+	strcpy(del_param.conf_id, "6001");
+	strcpy(del_param.chan_id, "PJSIP/1000-00000001");
+	strcpy(del_param.port_id, "port-0001");
+	strcpy(del_param.comm_id, "1234567892");
+
+	strcpy(peer_normal_param.conf_id, "6001");
+	strcpy(peer_normal_param.chan_id, "PJSIP/\xe4\xbc\x9a\xe8\xae\xae-00000001");
+	strcpy(peer_normal_param.port_id, "port-0001");
+	strcpy(peer_normal_param.targetaddr, "192.168.120.10:10000");
+	peer_normal_param.rtcpmux = 1;
+	peer_normal_param.symrtp = 1;
+	peer_normal_param.qos = 46;
+	peer_normal_param.srtpmode = 1;
+	strcpy(peer_normal_param.srtpsendkey, "AES_CM_128_HMAC_SHA1_80 inline:WVNfX19semk5Nm5SYmR0aFBHUmQ3V2RWc0N2b0p3");
+	strcpy(peer_normal_param.srtprecvkey, "AES_CM_128_HMAC_SHA1_80 inline:d0RmdmcmVCspeEc3QGZiNWpVLFJhQX1cfHAwJSoj");
+	strcpy(peer_normal_param.fingerprint, "sha-256 4A:AD:B9:B1:3F:82:18:3B:54:02:12:DF:3E:5D:49:6B");
+	strcpy(peer_normal_param.comm_id, "1234567893");
+
+	peer_ice_param.icerole = 1;
+	peer_ice_param.sslrole = 0;
+	strcpy(peer_ice_param.fingerprint, "sha-256 4A:AD:B9:B1:3F:82:18:3B:54:02:12:DF:3E:5D:49:6B");
+	strcpy(peer_ice_param.ice_ufrag, "8hhY");
+	strcpy(peer_ice_param.ice_pwd, "asd88fgpdd777uzjYhagZg");
+	strcpy(peer_ice_param.candidate, "candidate:1 1 UDP 2130706431 192.168.120.10 10000 typ host\r\n"
+		"candidate:2 1 UDP 1694498815 203.0.113.7 10000 typ srflx raddr 192.168.120.10 rport 10000\r\n");
+	strcpy(peer_ice_param.conf_id, "6001");
+	strcpy(peer_ice_param.chan_id, "PJSIP/1000-00000001");
+	strcpy(peer_ice_param.port_id, "port-0001");
+	strcpy(peer_ice_param.comm_id, "1234567894");
+
+	audio_param.a_codec = AVS_AUDIO_CODEC_OPUS;
+	audio_param.audio_payloadtype = 111;
+	audio_param.ptime = 20;
+	audio_param.audio_transmode = 1;
+	strcpy(audio_param.conf_id, "6001");
+	strcpy(audio_param.chan_id, "PJSIP/1000-00000001");
+	strcpy(audio_param.port_id, "port-0001");
+	strcpy(audio_param.comm_id, "1234567895");
+
+	video_param.v_codec = AVS_VIDEO_CODEC_H264;
+	video_param.video_payloadtype = 96;
+	video_param.video_transmode = 2;
+	strcpy(video_param.conf_id, "6001");
+	strcpy(video_param.chan_id, "PJSIP/1000-00000001");
+	strcpy(video_param.port_id, "port-0001");
+	strcpy(video_param.comm_id, "1234567896");
+}
+
+static double now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+int main(void)
+{
+	char buf[AVS_CMD_MAX_LEN], frame[AVS_CMD_MAX_LEN];
+	const struct bench_case *c;
+	struct bench_resp json_r, tlv_r;
+	char *json_s;
+	double start, jansson_ns, direct_ns, tlv_ns;
+	unsigned int i, n;
+	int len, tlv_len, failed = 0;
+
+	params_init();
+
+	printf("%-20s %12s %12s %8s %12s %8s %10s\n", "command", "jansson ns", "direct ns", "speedup", "tlv ns", "vs json", "bytes");
+
+	for (n = 0; n < sizeof(cases) / sizeof(cases[0]); n++)
+	{
+		c = &cases[n];
+
+		/* AVS must see the same bytes. */
+		json_s = c->jansson_enc(c->param);
+		len = c->direct_enc(buf, sizeof(buf), c->param);
+
+		if (!json_s || len < 0 || (size_t)len != strlen(json_s) || memcmp(buf, json_s, len))
+		{
+			/* The corrections are the expected differences, the rest must still be the same. */
+			free(json_s);
+			ref_corrected = 1;
+			json_s = c->jansson_enc(c->param);
+			ref_corrected = 0;
+
+			if (!json_s || len < 0 || (size_t)len != strlen(json_s) || memcmp(buf, json_s, len))
+			{
+				printf("%s: output differs\n  jansson: %s\n  direct:  %s\n", c->name, json_s ? json_s : "(null)", len < 0 ? "(failed)" : buf);
+				failed = 1;
+			}
+			else
+			{
+				printf("%s: differs by the corrections listed in avs_json_enc.c only\n", c->name);
+			}
+		}
+		free(json_s);
+
+		start = now_ns();
+		for (i = 0; i < BENCH_LOOPS; i++)
+		{
+			free(c->jansson_enc(c->param));
+		}
+		jansson_ns = (now_ns() - start) / BENCH_LOOPS;
+
+		start = now_ns();
+		for (i = 0; i < BENCH_LOOPS; i++)
+		{
+			len += c->direct_enc(buf, sizeof(buf), c->param);
+		}
+		direct_ns = (now_ns() - start) / BENCH_LOOPS;
+
+		if ((tlv_len = c->tlv_enc(frame, sizeof(frame), c->param)) < 0)
+		{
+			printf("%s: frame encoding failed\n", c->name);
+			failed = 1;
+		}
+
+		start = now_ns();
+		for (i = 0; i < BENCH_LOOPS; i++)
+		{
+			len += c->tlv_enc(frame, sizeof(frame), c->param);
+		}
+		tlv_ns = (now_ns() - start) / BENCH_LOOPS;
+
+		printf("%-20s %12.1f %12.1f %7.1fx %12.1f %7.1fx %4d/%-5d\n", c->name, jansson_ns, direct_ns, jansson_ns / direct_ns,
+			tlv_ns, direct_ns / tlv_ns, tlv_len, c->direct_enc(buf, sizeof(buf), c->param));
+	}
+
+	/* Both decoders must give the controller the same response. */
+	tlv_len = tlv_resp_init(frame, sizeof(frame));
+	memset(&json_r, 0, sizeof(json_r));
+	memset(&tlv_r, 0, sizeof(tlv_r));
+	if (tlv_len < 0 || dec_json(json_resp, sizeof(json_resp) - 1, &json_r) != 0 || dec_tlv(frame, tlv_len, &tlv_r) != 0
+		|| memcmp(&json_r, &tlv_r, sizeof(json_r)))
+	{
+		printf("addPort response: decoded responses differ\n");
+		failed = 1;
+	}
+
+	start = now_ns();
+	for (i = 0; i < BENCH_LOOPS; i++)
+	{
+		dec_json(json_resp, sizeof(json_resp) - 1, &json_r);
+	}
+	direct_ns = (now_ns() - start) / BENCH_LOOPS;
+
+	start = now_ns();
+	for (i = 0; i < BENCH_LOOPS; i++)
+	{
+		dec_tlv(frame, tlv_len, &tlv_r);
+	}
+	tlv_ns = (now_ns() - start) / BENCH_LOOPS;
+
+	printf("\n%-20s %12s %12s %8s %10s\n", "response", "json ns", "tlv ns", "speedup", "bytes");
+	printf("%-20s %12.1f %12.1f %7.1fx %4d/%-5d\n", "addPort decode", direct_ns, tlv_ns, direct_ns / tlv_ns, tlv_len, (int)sizeof(json_resp) - 1);
+
+	/* A frame which overruns its length must be rejected. */
+	if (dec_tlv_resp(frame, tlv_len - 1, &(struct tlv_resp){0}) != -1)
+	{
+		printf("truncated frame is not detected\n");
+		failed = 1;
+	}
+
+	/* A message which does not fit must fail instead of being cut. */
+	if (enc_json_set_peerport_ice(buf, 64, &peer_ice_param) != -1)
+	{
+		printf("short buffer is not detected\n");
+		failed = 1;
+	}
+
+	return failed;
+}
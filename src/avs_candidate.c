@@ -0,0 +1,334 @@
+/****************************************************************************
+ *
+ * Multiedia Controller Module(MCM).
+ *
+ * Copyright (c) 2017 by Grandstream Networks, Inc.
+ * All rights reserved.
+ *
+ * This material is proprietary to Grandstream Networks, Inc. and,
+ * in addition to the above mentioned Copyright, may be
+ * subject to protection under other intellectual property
+ * regimes, including patents, trade secrets, designs and/or
+ * trademarks.
+ *
+ * Any use of this material for any purpose, except with an
+ * express license from Grandstream Networks, Inc. is strictly
+ * prohibited.
+ *
+ *
+ * \brief ICE candidates, between the attribute text and struct avs_candidate.
+ *
+ *	The grammar is the one of rfc5245 section 15.1:
+ *  candidate:<foundation> <component> <transport> <priority> <address>
+ *  <port> typ <type> [raddr <address>] [rport <port>] *(<name> <value>)
+ *  Only "generation" of the extensions is kept. Lines are formatted by
+ *  hand instead of by snprintf(), they are built for every answer.
+ *
+ ***************************************************************************/
+
+#include <string.h>
+#include <strings.h>
+#include "avs_controller.h"
+
+#define CAND_PREFIX		"candidate:"
+#define SDP_PREFIX		"a="
+
+/* A field of the attribute, delimited by spaces. */
+struct cand_field
+{
+	const char *s;
+	unsigned long len;
+};
+
+static const char *const cand_transports[] = { "udp", "tcp" };
+static const char *const cand_types[] = { "host", "srflx", "prflx", "relay" };
+
+/* Take the next field of [*pos, end), return 0 if there is none. */
+static int cand_next(const char **pos, const char *end, struct cand_field *f)
+{
+	const char *p = *pos;
+
+	while (p < end && (' ' == *p || '\t' == *p || '\r' == *p || '\n' == *p))
+	{
+		p++;
+	}
+
+	f->s = p;
+
+	while (p < end && ' ' != *p && '\t' != *p && '\r' != *p && '\n' != *p)
+	{
+		p++;
+	}
+
+	f->len = p - f->s;
+	*pos = p;
+
+	return f->len != 0;
+}
+
+static int cand_is(const struct cand_field *f, const char *word)
+{
+	return strlen(word) == f->len && !strncasecmp(f->s, word, f->len);
+}
+
+/* Decimal number no greater than @max. */
+static int cand_number(const struct cand_field *f, unsigned long max, unsigned long *out)
+{
+	unsigned long i, v = 0;
+
+	if (!f->len || f->len > 10)
+	{
+		return -1;
+	}
+
+	for (i = 0; i < f->len; i++)
+	{
+		if (f->s[i] < '0' || f->s[i] > '9')
+		{
+			return -1;
+		}
+		v = v * 10 + (f->s[i] - '0');
+	}
+
+	if (v > max)
+	{
+		return -1;
+	}
+
+	*out = v;
+
+	return 0;
+}
+
+/* Index of the word of @f in @words, -1 if it is not there. */
+static int cand_lookup(const struct cand_field *f, const char *const *words, int num)
+{
+	int i;
+
+	for (i = 0; i < num; i++)
+	{
+		if (cand_is(f, words[i]))
+		{
+			return i;
+		}
+	}
+
+	return -1;
+}
+
+static int cand_copy(const struct cand_field *f, char *dst, unsigned long size)
+{
+	if (f->len >= size)
+	{
+		return -1;
+	}
+
+	memcpy(dst, f->s, f->len);
+	dst[f->len] = '\0';
+
+	return 0;
+}
+
+int avs_candidate_parse(const char *str, unsigned long len, struct avs_candidate *cand)
+{
+	const char *pos = str, *end = str + len;
+	struct cand_field f, v;
+	unsigned long n;
+	int i;
+
+	memset(cand, 0, sizeof(*cand));
+
+	if (len >= sizeof(SDP_PREFIX) - 1 && !strncmp(pos, SDP_PREFIX, sizeof(SDP_PREFIX) - 1))
+	{
+		pos += sizeof(SDP_PREFIX) - 1;
+	}
+	if ((unsigned long)(end - pos) >= sizeof(CAND_PREFIX) - 1 && !strncasecmp(pos, CAND_PREFIX, sizeof(CAND_PREFIX) - 1))
+	{
+		pos += sizeof(CAND_PREFIX) - 1;
+	}
+
+	if (!cand_next(&pos, end, &f) || cand_copy(&f, cand->foundation, sizeof(cand->foundation)))
+	{
+		return -1;
+	}
+
+	if (!cand_next(&pos, end, &f) || cand_number(&f, 255, &n) || !n)
+	{
+		return -1;
+	}
+	cand->component = (unsigned char)n;
+
+	if (!cand_next(&pos, end, &f) || (i = cand_lookup(&f, cand_transports, 2)) < 0)
+	{
+		return -1;
+	}
+	cand->transport = (unsigned char)i;
+
+	if (!cand_next(&pos, end, &f) || cand_number(&f, 0xFFFFFFFFUL, &n))
+	{
+		return -1;
+	}
+	cand->priority = (unsigned int)n;
+
+	if (!cand_next(&pos, end, &f) || cand_copy(&f, cand->addr, sizeof(cand->addr)))
+	{
+		return -1;
+	}
+
+	if (!cand_next(&pos, end, &f) || cand_number(&f, 65535, &n))
+	{
+		return -1;
+	}
+	cand->port = (unsigned short)n;
+
+	if (!cand_next(&pos, end, &f) || !cand_is(&f, "typ")
+		|| !cand_next(&pos, end, &f) || (i = cand_lookup(&f, cand_types, 4)) < 0)
+	{
+		return -1;
+	}
+	cand->type = (unsigned char)i;
+
+	/* Name and value pairs. */
+	while (cand_next(&pos, end, &f))
+	{
+		if (!cand_next(&pos, end, &v))
+		{
+			return -1;
+		}
+
+		if (cand_is(&f, "raddr"))
+		{
+			if (cand_copy(&v, cand->rel_addr, sizeof(cand->rel_addr)))
+			{
+				return -1;
+			}
+		}
+		else if (cand_is(&f, "rport"))
+		{
+			if (cand_number(&v, 65535, &n))
+			{
+				return -1;
+			}
+			cand->rel_port = (unsigned short)n;
+		}
+		else if (cand_is(&f, "generation"))
+		{
+			if (cand_number(&v, 0xFFFFFFFFUL, &n))
+			{
+				return -1;
+			}
+			cand->generation = (unsigned int)n;
+		}
+	}
+
+	return 0;
+}
+
+/* Output of avs_candidate_to_sdp(), it stops growing once @buf is full. */
+struct sdp_writer
+{
+	char *buf;
+	unsigned long size;
+	unsigned long len;
+	int full;
+};
+
+static void sw_mem(struct sdp_writer *w, const char *s, unsigned long n)
+{
+	if (w->full || w->len + n >= w->size)
+	{
+		w->full = 1;
+		return;
+	}
+
+	memcpy(w->buf + w->len, s, n);
+	w->len += n;
+}
+
+static void sw_str(struct sdp_writer *w, const char *s)
+{
+	sw_mem(w, s, strlen(s));
+}
+
+static void sw_uint(struct sdp_writer *w, unsigned long v)
+{
+	char digits[20];
+	int n = sizeof(digits);
+
+	do
+	{
+		digits[--n] = '0' + v % 10;
+		v /= 10;
+	} while (v);
+
+	sw_mem(w, digits + n, sizeof(digits) - n);
+}
+
+int avs_candidate_to_sdp(const struct avs_candidate *cand, char *buf, unsigned long size)
+{
+	struct sdp_writer w = { buf, size, 0, 0 };
+
+	if (cand->transport > AVS_CAND_TRANSPORT_TCP || cand->type > AVS_CAND_TYPE_RELAY)
+	{
+		return -1;
+	}
+
+	sw_mem(&w, SDP_PREFIX CAND_PREFIX, sizeof(SDP_PREFIX CAND_PREFIX) - 1);
+	sw_str(&w, cand->foundation);
+	sw_mem(&w, " ", 1);
+	sw_uint(&w, cand->component);
+	sw_mem(&w, " ", 1);
+	sw_str(&w, cand_transports[cand->transport]);
+	sw_mem(&w, " ", 1);
+	sw_uint(&w, cand->priority);
+	sw_mem(&w, " ", 1);
+	sw_str(&w, cand->addr);
+	sw_mem(&w, " ", 1);
+	sw_uint(&w, cand->port);
+	sw_mem(&w, " typ ", 5);
+	sw_str(&w, cand_types[cand->type]);
+
+	if (AVS_CAND_TYPE_HOST != cand->type && cand->rel_addr[0])
+	{
+		sw_mem(&w, " raddr ", 7);
+		sw_str(&w, cand->rel_addr);
+		sw_mem(&w, " rport ", 7);
+		sw_uint(&w, cand->rel_port);
+	}
+
+	sw_mem(&w, " generation ", 12);
+	sw_uint(&w, cand->generation);
+	sw_mem(&w, "\r\n", 2);
+
+	if (w.full)
+	{
+		return -1;
+	}
+
+	buf[w.len] = '\0';
+
+	return (int)w.len;
+}
+
+int avs_candidates_to_sdp(const struct avs_candidate *cands, unsigned int num, char *buf, unsigned long size)
+{
+	unsigned long len = 0;
+	unsigned int i;
+	int n;
+
+	if (size)
+	{
+		buf[0] = '\0';
+	}
+
+	for (i = 0; i < num; i++)
+	{
+		if ((n = avs_candidate_to_sdp(&cands[i], buf + len, size - len)) < 0)
+		{
+			return -1;
+		}
+		len += n;
+	}
+
+	return (int)len;
+}
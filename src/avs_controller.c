@@ -25,9 +25,10 @@
  *
  ***************************************************************************/
 
+#define _GNU_SOURCE	/* sendmmsg(), recvmmsg() */
 #include <string.h>
 #include <stdio.h>
-#include <jansson.h>
+#include <stdlib.h>
 #include <pthread.h>
 #include <sys/types.h>
 #include <sys/socket.h>
@@ -36,24 +37,59 @@
 #include <pthread.h>
 #include <time.h>
 #include <errno.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <sys/mman.h>
+#include <poll.h>
 #include "avs_controller.h"
+#include "avs_json_enc.h"
+#include "avs_json_dec.h"
+#include "avs_event.h"
+#include "avs_queue.h"
+#include "avs_stats.h"
+#include "avs_timer.h"
+#include "avs_state.h"
+#include "avs_shm.h"
+#include "avs_tlv.h"
+#include "avs_shard.h"
+#include "avs_arena.h"
+#include "avs_log.h"
 
 #define AVS_SERVER_SOCKET_PATH		"/tmp/GSSFUSrv"	/* Unix socket file path. Server. */
 #define AVS_CLIENT_SOCKET_PATH		"/tmp/GSTmp"	/* Unix socket file path. Client. */
 
-#define RECV_BUFFER_SIZE		2000	/* Buffer size for receiving AVS messages. */
+#define RECV_SLAB_SIZE		(64 * 1024)	/* Bytes of a receiving slab, the longest datagram taken by recvmmsg(). A longer one is received alone. */
 
-#define MAXIMUM_CMD_TIMEOUT		5	/* Timeout waiting for AVS to response. */
+#define REACTOR_MAX_SOURCES		8	/* Maximum file descriptors watched by the receiving thread. */
+#define REACTOR_MAX_EVENTS		8	/* Maximum events handled by one epoll_wait(). */
 
-static char *recv_buffer = NULL;
+#define MMSG_BATCH			32	/* Maximum datagrams sent by one sendmmsg() or received by one recvmmsg(). */
+#define TX_RETRY_INTERVAL		5	/* Milliseconds to wait before sending again when the AVS socket queue is full. */
+#define HANDSHAKE_TIMEOUT		1000	/* Milliseconds to wait for AVS to answer a capability command of avs_create_conn_ex(). */
+
+#define STR_COPY(dst, src)	str_copy((dst), sizeof(dst), (src))	/* Copy a string into a char array member, see str_copy(). */
+
+#define MAX_PENDING_CMDS		256	/* Maximum number of commands waiting for AVS responses at the same time, a run control window fits. */
+#define PENDING_HASH_SIZE		512	/* Buckets of the pending command table, must be a power of 2. */
+#define SETUP_BATCH_WINDOW		32	/* Maximum channels of one bulk setup in flight at the same time. */
+#define TEARDOWN_BATCH_WINDOW	16	/* Maximum channels of one conference teardown in flight at the same time, each sends 2 commands. */
+#define RUNCTRL_BATCH_WINDOW	256	/* Maximum channels of one conference run control in flight at the same time, a conference up to it takes one round trip. */
+
+static char *recv_slabs = MAP_FAILED;	/* MMSG_BATCH receiving slabs of RECV_SLAB_SIZE bytes, only the touched pages are backed. */
 
 static int sockfd = -1;	/* Unix socket for communication with AVS. */
 
 static pthread_t recv_thread;	/* A thread used to receive messages sent by AVS. May be responses or notifications. */
-static pthread_cond_t cond_v;	/* Conditional variable between the receiving thread and the sending command thread. */
-static pthread_mutex_t p_mutex;	/* Mutual exclusion for synchronization. avs_controller handles commands in a serial way. */
+static int epfd = -1;	/* epoll instance of the receiving thread. */
+static int wakeup_fd = -1;	/* eventfd to wake up the receiving thread, e.g. for shutdown. */
+static int timer_fd = -1;	/* timerfd which expires at the earliest deadline of the pending commands. */
+static uint64_t timer_deadline = 0;	/* Deadline in milliseconds "timer_fd" is armed to, 0 if it is disarmed. Owned by the receiving thread. */
+static volatile int reactor_running = 0;
 
-/* Command type. */
+/* Command type. In the order of the public enum avs_cmd_type, which indexes the statistics. */
 typedef enum command_type
 {
 	ST_AVS_SET_GLOBAL_PARAM,
@@ -110,180 +146,488 @@ struct resp_alloc_port_ice_info
 	char fingerprint[MAX_FINGERPRINT_LEN];
 	char port_id[MAX_PORTID_LEN];
 	char comm_id[MAX_UNIQUE_ID];
-	struct candidate *candidates;
+	struct arena *arena;	/* The candidates are carved out of it, it goes to the caller's response. */
+	struct avs_candidate *candidates;
+	unsigned int num_candidates;
+	unsigned int max_candidates;	/* Entries "candidates" has room for. */
+	unsigned int dropped_candidates;
 	struct resp_common_info common_resp;
 };
 
+/* Data area for storing a response received from AVS, the member in use depends on the command type. */
+union resp_storage
+{
+	struct resp_common_info common;
+	struct resp_alloc_port_normal_info alloc_port_normal;
+	struct resp_alloc_port_ice_info alloc_port_ice;
+};
+
+/* Conference, channel and port a command applies to, and the settings the state index records once AVS accepts it. */
+struct cmd_target
+{
+	char conf_id[MAX_CONFID_LEN];
+	char chan_id[MAX_CHANID_LEN];
+	char port_id[MAX_PORTID_LEN];
+	unsigned int codec;
+	unsigned int payloadtype;
+	unsigned int transmode;
+	unsigned int ptime;
+	enum avs_runctrl_chan_opt opt;	/* Of "runctrl". */
+	enum avs_runctrl_chan_mtype mtype;	/* Of "runctrl". */
+	enum state_setting setting;	/* STATE_SETTING_NONE for commands which are always sent. */
+	unsigned int setting_hash;	/* Hash of all the parameters of the setting, except "comm_id". */
+	unsigned int key_hash;	/* Hash of the ids and the setting, to compare targets quickly. */
+};
+
+/* A command which has been sent to AVS and is waiting for its response. Keyed by "comm_id". */
+struct pending_cmd
+{
+	int in_use;
+	int waiting;	/* Still in the pending table, no response and no timeout yet. */
+	char comm_id[MAX_UNIQUE_ID];
+	CMD_TYPE_STATE cmd_type;	/* Context of the command. */
+	MSG_PARSE_RESULT parse_result;	/* Parsing result of the response received from AVS. */
+	union resp_storage data;	/* Response storage owned by this command. */
+	void *resp;	/* Response structure of the requester, filled before calling "cb". */
+	avs_cmd_cb cb;	/* Completion callback of the requester. */
+	void *user_data;	/* Passed to "cb". */
+	struct cmd_target target;
+	struct pending_cmd *coalesced;	/* Older command of the same setting replaced by this one, it completes with the result of this one. */
+	int superseded;	/* Replaced by a newer command, it is not sent. */
+	struct timer_node timer;	/* The command fails if AVS does not respond before "timer.expires". */
+	uint64_t sent_us;	/* stats_now_us() when the command was sent, 0 until then. */
+	unsigned int seq;	/* Changes each time the slot is taken, so stale messages in the send queue are detected. */
+	unsigned int inst;	/* AVS instance it is sent to. */
+	int placed;	/* It holds a placement of its conference, given back by shard_release() when it completes. */
+	struct pending_cmd *next;	/* Next command in the same hash bucket. */
+	struct pending_cmd *key_next;	/* Next command in the same bucket of "pending_keys". */
+};
+
+/* A command submitted by a caller, an element of the submission queue. The caller fills it, then the receiving thread owns it. */
+struct cmd_submission
+{
+	CMD_TYPE_STATE cmd_type;	/* ST_AVS_IDLE if encoding failed, the receiving thread skips it. */
+	char comm_id[MAX_UNIQUE_ID];
+	void *resp;
+	avs_cmd_cb cb;
+	void *user_data;
+	struct cmd_target target;
+	struct pending_cmd *cmd;	/* Wait slot taken by the receiving thread, NULL if the message has been dropped. */
+	unsigned int seq;	/* "seq" of the command when it was taken into the pending table. */
+	unsigned int inst;	/* AVS instance it is sent to, its message is encoded for it. */
+	int placed;	/* Placement of its conference taken by the caller, see shard_acquire(). */
+	size_t len;
+	char json_s[AVS_CMD_MAX_LEN];	/* Encoded command, the cell is reused once the message has been sent. */
+};
+
+/* A thread blocked in a synchronous "avs_" API waits on it. */
+struct sync_waiter
+{
+	int done;
+	AVS_CMD_RESULT result;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+};
+
+/* A channel of a batch whose command was refused with QUEUE_FULL. The receiving thread resumes it once it has freed cells. */
+struct batch_retry
+{
+	void (*resume)(void *chan);
+	void *chan;
+	struct batch_retry *next;
+};
+
+struct setup_batch;
+
+/* State of one channel in a bulk setup. */
+struct setup_chan
+{
+	struct setup_batch *batch;
+	struct avs_chan_setup_desc *desc;
+	enum avs_chan_setup_step step;	/* The step waiting for AVS, or to be sent again if deferred. */
+	struct avs_common_resp_info resp;	/* Response of the steps after allocating port. */
+	struct batch_retry retry;
+};
+
+/* A bulk setup of channels in one conference. Channels go through their steps independently. */
+struct setup_batch
+{
+	struct arena *arena;	/* The batch is carved out of it. */
+	char conf_id[MAX_CONFID_LEN];
+	unsigned int num;
+	unsigned int started;	/* Channels which have been started. */
+	unsigned int remaining;	/* Channels which have not finished. */
+	AVS_CMD_RESULT result;
+	avs_setup_cb cb;
+	void *user_data;
+	pthread_mutex_t lock;
+	struct setup_chan chans[];
+};
+
+struct teardown_batch;
+
+/* State of one channel in a conference teardown. Its "runctrl" reset and "delPort" are in flight together. */
+struct teardown_chan
+{
+	struct teardown_batch *batch;
+	const struct state_chan_ref *ref;
+	int pending;	/* Commands which have not completed. */
+	int failed;
+	int sent;	/* Commands which have been submitted, "runctrl" reset first. */
+	struct avs_common_resp_info reset_resp;
+	struct avs_common_resp_info del_resp;
+	struct batch_retry retry;
+};
+
+/* A teardown of all the channels the state index knows in one conference. */
+struct teardown_batch
+{
+	struct arena *arena;	/* The batch and the copy of the channels are carved out of it. */
+	char conf_id[MAX_CONFID_LEN];
+	unsigned int num;
+	unsigned int started;	/* Channels which have been started. */
+	unsigned int remaining;	/* Channels which have not finished. */
+	unsigned int failed;	/* Channels of which a command failed. */
+	avs_teardown_cb cb;
+	void *user_data;
+	pthread_mutex_t lock;
+	struct teardown_chan chans[];
+};
+
+struct runctrl_batch;
+
+/* State of one channel in a conference run control. */
+struct runctrl_chan
+{
+	struct runctrl_batch *batch;
+	const struct state_chan_ref *ref;
+	struct avs_common_resp_info resp;
+	struct batch_retry retry;
+};
+
+/* A "runctrl" sent to the channels the state index knows in one conference, except some of them. */
+struct runctrl_batch
+{
+	struct arena *arena;	/* The batch and the copy of the channels are carved out of it. */
+	char conf_id[MAX_CONFID_LEN];
+	enum avs_runctrl_chan_opt opt;
+	enum avs_runctrl_chan_mtype mtype;
+	unsigned int num;
+	unsigned int started;	/* Channels which have been started. */
+	unsigned int remaining;	/* Channels which have not finished. */
+	unsigned int failed;	/* Channels of which the command failed. */
+	avs_runctrl_conf_cb cb;
+	void *user_data;
+	pthread_mutex_t lock;
+	struct runctrl_chan chans[];
+};
+
+/* avs_set_global_param() sent to every AVS instance, the requester gets one result. */
+struct global_fanout
+{
+	struct arena *arena;	/* The fan-out is carved out of it. */
+	unsigned int remaining;	/* Instances which have not answered. */
+	AVS_CMD_RESULT result;
+	struct avs_common_resp_info *resp;	/* Of the requester, the first refusal or else the first answer. */
+	avs_cmd_cb cb;
+	void *user_data;
+	char comm_id[MAX_UNIQUE_ID];	/* Of the requester, each instance gets a command with its own id. */
+	int answered;	/* "resp" holds an answer. */
+	int refused;	/* "resp" holds an answer with a non-zero code. */
+	pthread_mutex_t lock;
+	struct avs_common_resp_info resps[AVS_MAX_INSTANCES];
+};
+
+/* An AVS process. Conferences are placed on one of them, see avs_shard.h. */
+struct avs_instance
+{
+	struct sockaddr_un addr;	/* Its socket. */
+	struct shm_link shm;	/* Shared memory link, used instead of the socket once it has taken it. */
+	int shm_active;
+	int wire_tlv;	/* It accepted binary frames, its commands are encoded by avs_tlv.c. Set before any caller submits. */
+	unsigned long tx_msgs;	/* Counters written by the receiving thread only. */
+	unsigned long responses;
+	unsigned long timeouts;
+};
+
+/* Handler of a file descriptor watched by the receiving thread. */
+typedef void (*reactor_handler)(int fd, void *arg);
+
+/* A file descriptor watched by the receiving thread. */
+struct reactor_source
+{
+	int fd;
+	reactor_handler handler;
+	void *arg;
+};
+
 /* Global data area section. */
-static CMD_TYPE_STATE cmd_current_state = ST_AVS_IDLE;	/* Context of the current command. */
-static MSG_PARSE_RESULT msg_parse_result = MSG_PARSE_RESULT_SUCCESS;	/* Parsing result of message received from AVS. */
-static struct resp_common_info g_data_storage_resp_common;	/* Global data area for storing common response received from AVS. */
-static struct resp_alloc_port_normal_info g_data_storage_resp_alloc_port_normal;	/* Global data area for storing "alloc_port_normal" response received from AVS. */
-static struct resp_alloc_port_ice_info g_data_storage_resp_alloc_port_ice;	/* Global data area for storing "alloc_port_ice" response received from AVS. */
+static struct mpsc_queue sq;	/* Submission queue, caller threads push encoded commands and the receiving thread drains it. */
+static unsigned int sq_registered = 0;	/* Queue position of the first command not taken into the pending table yet. */
+static int io_sleeping = 0;	/* The receiving thread is going to block in epoll_wait(), a caller submitting a command must wake it up. */
+static int pending_used = 0;	/* Wait slots in use. */
+static int tx_backlog = 0;	/* AVS could not take all the queued commands, try again later. */
+static unsigned int pending_seq = 0;
+static struct avs_io_counters io_counters;	/* Batching counters, written by the receiving thread only, except "tx_queue_full" which callers increment atomically. */
+static struct reactor_source reactor_sources[REACTOR_MAX_SOURCES];	/* Sources registered to "epfd". */
+static unsigned int comm_id_seq = 0;	/* Sequence for generating unique IDs of internal commands. */
+static struct pending_cmd pending_cmds[MAX_PENDING_CMDS];	/* Wait slots of the commands in flight. */
+static struct pending_cmd *pending_free[MAX_PENDING_CMDS];	/* Free wait slots from index "pending_used" on, taken and given back on top. */
+static struct pending_cmd *pending_hash[PENDING_HASH_SIZE];	/* Commands in flight, hashed by "comm_id". */
+static struct pending_cmd *pending_keys[PENDING_HASH_SIZE];	/* Settings in flight, hashed by "target.key_hash", for the duplicate checks. */
+static struct timer_wheel pending_timers;	/* Deadlines of the commands in flight, owned by the receiving thread. */
+static unsigned int cmd_timeouts[AVS_CMD_MAX];	/* Milliseconds to wait for the response, per command type. */
+static int keep_duplicates = 0;	/* Send every setting, even identical or replaced ones. */
+static struct avs_instance instances[AVS_MAX_INSTANCES];	/* AVS processes commands are sent to. */
+static unsigned int num_instances = 1;
+static __thread int on_recv_thread = 0;	/* Set in the receiving thread, which must never wait for AVS. */
+static pthread_mutex_t retry_lock = PTHREAD_MUTEX_INITIALIZER;	/* Protects the list of deferred batch channels. */
+static struct batch_retry *retry_head = NULL;	/* Deferred batch channels, resumed in the order they were deferred. */
+static struct batch_retry **retry_tail = &retry_head;
 /* */
 
 /* Generel abstract functions section. */
-static FUNC_RETURN general_action(void *param, void *resp, CMD_TYPE_STATE cmd_type);
-static void *general_json_dec(char *msg);
-static const char *general_json_enc(void *param, CMD_TYPE_STATE cmd_type);
-static void *general_fill_resp(void *resp, CMD_TYPE_STATE cmd_type);
+static AVS_CMD_RESULT general_action(void *param, void *resp, CMD_TYPE_STATE cmd_type);
+static AVS_CMD_RESULT general_action_async(void *param, void *resp, CMD_TYPE_STATE cmd_type, avs_cmd_cb cb, void *user_data);
+static AVS_CMD_RESULT sync_action(void *param, const void *ref, void *resp, CMD_TYPE_STATE cmd_type);
+static void *general_json_dec(const char *msg, size_t len);
+static int general_tlv_enc(void *param, CMD_TYPE_STATE cmd_type, char *buf, size_t size);
+static void *general_tlv_dec(const char *msg, size_t len);
+static struct pending_cmd *resp_take_cmd(const char *id);
+static void resp_done(struct pending_cmd *cmd);
+static int general_json_enc(void *param, CMD_TYPE_STATE cmd_type, char *buf, size_t size);
+static void *general_fill_resp(struct pending_cmd *cmd, void *resp);
+static void general_cmd_target(void *param, CMD_TYPE_STATE cmd_type, struct cmd_target *target);
+static void cmd_target_hash(struct cmd_target *target, unsigned int h);
+static void general_state_update(struct pending_cmd *cmd);
+static AVS_CMD_RESULT playsound_unsupported(void);
+/* */
+
+/* Pending command table section. */
+static const char *general_comm_id(void *param, CMD_TYPE_STATE cmd_type);
+static unsigned int comm_id_hash(const char *comm_id);
+static struct pending_cmd *pending_register(const char *comm_id, CMD_TYPE_STATE cmd_type);
+static struct pending_cmd *pending_lookup(const char *comm_id);
+static void pending_unlink(struct pending_cmd *cmd);
+static void pending_complete(struct pending_cmd *cmd, AVS_CMD_RESULT result);
+static void pending_expire(void);
+static void pending_fail_all(AVS_CMD_RESULT result);
+/* */
+
+/* Duplicate settings section. */
+static unsigned int hash_str_more(unsigned int h, const char *str, size_t size);
+static unsigned int hash_uint_more(unsigned int h, unsigned int v);
+static int same_target(const struct cmd_target *a, const struct cmd_target *b);
+static void pending_key_add(struct pending_cmd *cmd);
+static void pending_key_del(struct pending_cmd *cmd);
+static int cmd_suppress(struct cmd_submission *sub);
+static void cmd_coalesce(struct pending_cmd *cmd);
+/* */
+
+/* Reactor section. */
+static FUNC_RETURN reactor_init(void);
+static FUNC_RETURN reactor_add(int fd, reactor_handler handler, void *arg);
+static void reactor_wakeup(void);
+static void reactor_arm_timer(uint64_t deadline);
+static void io_count(unsigned long *c, unsigned long n);
+static void io_count_max(unsigned long *c, unsigned long n);
+static void io_counters_get(struct avs_io_counters *out);
+static void sock_recv_long(int fd, size_t len);
+static void sock_readable(int fd, void *arg);
+static void wakeup_readable(int fd, void *arg);
+static void timer_readable(int fd, void *arg);
+/* */
+
+/* Capability negotiation and shared memory transport section. */
+static int conn_handshake(struct avs_instance *inst, const char *method, const char *params, const int *fds, int nfds, const char *key, const char *val);
+static void wire_connect(struct avs_instance *inst);
+static void shm_connect(struct avs_instance *inst);
+static int shm_sendmmsg(struct avs_instance *inst, struct mmsghdr *msgs, unsigned int n);
+static void shm_drain(struct avs_instance *inst);
+/* */
+
+/* AVS instances section. */
+static FUNC_RETURN instance_init(const struct avs_conn_config *config);
+static int instance_route(unsigned int inst);
+static void conf_ports_update(const char *conf_id);
+static AVS_CMD_RESULT cmd_submit(void *param, const void *ref, void *resp, CMD_TYPE_STATE cmd_type, int inst, avs_cmd_cb cb, void *user_data);
+static AVS_CMD_RESULT global_fanout_start(struct avs_global_param *param, struct avs_common_resp_info *resp, avs_cmd_cb cb, void *user_data);
+static void global_fanout_done(struct global_fanout *fan, unsigned int n, AVS_CMD_RESULT result, const struct avs_common_resp_info *resp);
+static void global_fanout_cb(AVS_CMD_RESULT result, void *resp, void *user_data);
+/* */
+
+/* Deferred batch channel section. */
+static void batch_defer(struct batch_retry *retry, void (*resume)(void *chan), void *chan);
+static void batch_resume_all(void);
+/* */
+
+/* Bulk setup section. */
+static void general_gen_comm_id(char *comm_id);
+static void setup_chan_next_step(struct setup_chan *chan);
+static void setup_chan_resume(void *chan);
+static struct setup_chan *setup_chan_finish(struct setup_chan *chan, AVS_CMD_RESULT result);
+static void setup_step_cb(AVS_CMD_RESULT result, void *resp, void *user_data);
+static void sync_setup_cb(AVS_CMD_RESULT result, struct avs_chan_setup_desc *descs, unsigned int num, void *user_data);
+/* */
+
+/* Conference teardown section. */
+static void teardown_chan_send(struct teardown_chan *chan);
+static void teardown_chan_resume(void *chan);
+static struct teardown_chan *teardown_chan_done(struct teardown_chan *chan, AVS_CMD_RESULT result);
+static struct teardown_chan *teardown_chan_finish(struct teardown_chan *chan);
+static void teardown_step_cb(AVS_CMD_RESULT result, void *resp, void *user_data);
+static void sync_teardown_cb(AVS_CMD_RESULT result, unsigned int num_chans, unsigned int failed, void *user_data);
+/* */
+
+/* Conference run control section. */
+static void runctrl_chan_start(struct runctrl_chan *chan);
+static void runctrl_chan_resume(void *chan);
+static struct runctrl_chan *runctrl_chan_finish(struct runctrl_chan *chan, AVS_CMD_RESULT result);
+static void runctrl_step_cb(AVS_CMD_RESULT result, void *resp, void *user_data);
+static void sync_runctrl_cb(AVS_CMD_RESULT result, unsigned int num_chans, unsigned int failed, void *user_data);
+/* */
+
+/* Interned ID section. */
+static struct avs_str ref_id(struct avs_id id, size_t size);
+static int ref_chan(const struct avs_chan_ref *ref, CMD_TYPE_STATE cmd_type, struct enc_chan *chan);
+static void ref_copy(char *dst, size_t size, struct avs_str str);
+static void ref_cmd_target(const void *ref, CMD_TYPE_STATE cmd_type, const struct enc_chan *chan, struct cmd_target *target);
+static int ref_json_enc(const void *ref, CMD_TYPE_STATE cmd_type, const struct enc_chan *chan, char *buf, size_t size);
+static int ref_tlv_enc(const void *ref, CMD_TYPE_STATE cmd_type, const struct enc_chan *chan, char *buf, size_t size);
+static AVS_CMD_RESULT ref_action(const void *ref, void *resp, CMD_TYPE_STATE cmd_type);
+static AVS_CMD_RESULT ref_action_async(const void *ref, void *resp, CMD_TYPE_STATE cmd_type, avs_cmd_cb cb, void *user_data);
+static struct avs_id ref_intern(const char *str, size_t size);
 /* */
 
 /* Synchronism section.*/
-static int wait_on_socket();
-static void *wakeup_intruder();
-static FUNC_RETURN wait_for_avs();
+static void sync_action_cb(AVS_CMD_RESULT result, void *resp, void *user_data);
+static void *wakeup_intruder(struct sync_waiter *waiter, AVS_CMD_RESULT result);
+static FUNC_RETURN wait_for_avs(struct sync_waiter *waiter);
+static int sync_refused(void);
 static void *recv_task(void *data);
 /* */
 
 /* Module init section. */
 static void *data_init();
 static FUNC_RETURN sock_init(void);
-static FUNC_RETURN cmd_send(const char *cmd);
-static FUNC_RETURN msg_recv_process(char *msg);
-/* */
-
-/* Encode JSON section. */
-static const char *enc_json_set_global_param(struct avs_global_param *param);
-static const char *enc_json_alloc_port_normal(struct avs_alloc_port_normal_param *param);
-static const char *enc_json_alloc_port_ice(struct avs_alloc_port_ice_param *param);
-static const char *enc_json_del_port(struct avs_dealloc_port_param *param);
-static const char *enc_json_set_peerport_normal(struct avs_set_peerport_normal_param *param);
-static const char *enc_json_set_peerport_ice(struct avs_set_peerport_ice_param *param);
-static const char *enc_json_set_audio_codec(struct avs_codec_audio_param *param);
-static const char *enc_json_set_video_codec(struct avs_codec_video_param *param);
+static void cmd_register(void);
+static int cmd_ready(void);
+static void cmd_flush(void);
+static void cmd_fail(struct pending_cmd *cmd, unsigned int seq);
+static FUNC_RETURN msg_recv_process(const char *msg, size_t len);
 /* */
 
 /* Decode and fillback section. */
-static FUNC_RETURN dec_json_common_resp(json_t *root, struct resp_common_info *resp);
-static FUNC_RETURN dec_json_alloc_port_normal_resp(json_t *root, struct resp_alloc_port_normal_info *resp);
-static FUNC_RETURN dec_json_alloc_port_ice_resp(json_t *root, struct resp_alloc_port_ice_info *resp);
-static void *fill_common_resp(struct avs_common_resp_info *resp);
-static void *fill_alloc_port_normal_resp(struct avs_alloc_port_normal_resp_info *resp);
-static void *fill_alloc_port_ice_resp(struct avs_alloc_port_ice_resp_info *resp);
+static FUNC_RETURN dec_json_common_resp(const struct json_doc *doc, struct resp_common_info *resp);
+static FUNC_RETURN dec_json_alloc_port_normal_resp(const struct json_doc *doc, struct resp_alloc_port_normal_info *resp);
+static FUNC_RETURN dec_json_alloc_port_ice_resp(const struct json_doc *doc, struct resp_alloc_port_ice_info *resp);
+static int dec_json_candidates(const struct json_doc *doc, int tok, void *out);
+static void candidates_reserve(struct resp_alloc_port_ice_info *resp, unsigned int num);
+static void candidate_add(struct resp_alloc_port_ice_info *resp, const char *str, size_t len);
+static void *fill_common_resp(struct resp_common_info *data, struct avs_common_resp_info *resp);
+static void *fill_alloc_port_normal_resp(struct resp_alloc_port_normal_info *data, struct avs_alloc_port_normal_resp_info *resp);
+static void *fill_alloc_port_ice_resp(struct resp_alloc_port_ice_info *data, struct avs_alloc_port_ice_resp_info *resp);
+static void str_copy(char *dst, size_t size, const char *src);
 /* */
 
-static const struct codec_audio_tran {
-	enum avs_audio_codec codec;
-	const char *name;
-} codec_audio_trans[] = {
-	{ AVS_AUDIO_CODEC_PCMU, "audio/pcmu" },
-	{ AVS_AUDIO_CODEC_PCMA, "audio/pcma" },
-	{ AVS_AUDIO_CODEC_GSM, "audio/gsm" },
-	{ AVS_AUDIO_CODEC_ILBC, "audio/ilbc" },
-	{ AVS_AUDIO_CODEC_G722, "audio/g722" },
-	{ AVS_AUDIO_CODEC_G722_1, "audio/g722.1" },
-	{ AVS_AUDIO_CODEC_G722_1C, "audio/g722.1c" },
-	{ AVS_AUDIO_CODEC_G729, "audio/g729"},
-	{ AVS_AUDIO_CODEC_G723_1, "audio/g723.1"},
-	{ AVS_AUDIO_CODEC_G726, "audio/adpcm32"},
-	{ AVS_AUDIO_CODEC_OPUS, "audio/opus"},
-};
-
-static const struct codec_video_tran {
-	enum avs_video_codec codec;
-	const char *name;
-} codec_video_trans[] = {
-	{ AVS_VIDEO_CODEC_H264, "video/avc" },
-	{ AVS_VIDEO_CODEC_H265, "video/hevc" },
-	{ AVS_VIDEO_CODEC_VP8, "video/vp8" },
-	{ AVS_VIDEO_CODEC_VP9, "video/vp9" },
-};
-
-enum media_transmode
+/* Copy a string into a buffer of "size" bytes, truncated and always terminated. */
+static void str_copy(char *dst, size_t size, const char *src)
 {
-	MEDIA_TRANSMODE_SENDRECV = 1,
-	MEDIA_TRANSMODE_SENDONLY,
-	MEDIA_TRANSMODE_RECVONLY
-};
-
-static const struct transmode {
-	enum media_transmode mode;
-	const char *name;
-} transmodes[] = {
-	{ MEDIA_TRANSMODE_SENDONLY, "sendOnly" },
-	{ MEDIA_TRANSMODE_RECVONLY, "recvOnly" },
-	{ MEDIA_TRANSMODE_SENDRECV, "sendRecv" },
-};
+	size_t len = strnlen(src, size - 1);
+	
+	memcpy(dst, src, len);
+	dst[len] = '\0';
+}
 
 /* Fill the common type response data to the command requester. */
-static void *fill_common_resp(struct avs_common_resp_info *resp)
+static void *fill_common_resp(struct resp_common_info *data, struct avs_common_resp_info *resp)
 {
-	resp->code = g_data_storage_resp_common.code;
-	strncpy(resp->message, g_data_storage_resp_common.message, sizeof(resp->message));
-	strncpy(resp->comm_id, g_data_storage_resp_common.comm_id, sizeof(resp->comm_id) - 1);
+	resp->code = data->code;
+	STR_COPY(resp->message, data->message);
+	STR_COPY(resp->comm_id, data->comm_id);
 	
 	return NULL;
 }
 
 /* Fill the "alloc_port_normal" type response data to the command requester. */
-static void *fill_alloc_port_normal_resp(struct avs_alloc_port_normal_resp_info *resp)
+static void *fill_alloc_port_normal_resp(struct resp_alloc_port_normal_info *data, struct avs_alloc_port_normal_resp_info *resp)
 {
-	resp->rtp_port = g_data_storage_resp_alloc_port_normal.rtp_port;
-	resp->rtcp_port = g_data_storage_resp_alloc_port_normal.rtcp_port;
-	strncpy(resp->port_id, g_data_storage_resp_alloc_port_normal.port_id, sizeof(resp->port_id) - 1);
-	strncpy(resp->fingerprint, g_data_storage_resp_alloc_port_normal.fingerprint, sizeof(resp->fingerprint) - 1);
-	strncpy(resp->comm_id, g_data_storage_resp_alloc_port_normal.comm_id, sizeof(resp->comm_id) - 1);
+	resp->rtp_port = data->rtp_port;
+	resp->rtcp_port = data->rtcp_port;
+	STR_COPY(resp->port_id, data->port_id);
+	STR_COPY(resp->fingerprint, data->fingerprint);
+	STR_COPY(resp->comm_id, data->comm_id);
 	
-	resp->resp.code = g_data_storage_resp_alloc_port_normal.common_resp.code;
-	strncpy(resp->resp.message, g_data_storage_resp_alloc_port_normal.common_resp.message, sizeof(resp->resp.message) - 1);
+	resp->resp.code = data->common_resp.code;
+	STR_COPY(resp->resp.message, data->common_resp.message);
 	
 	return NULL;
 }
 
-static void *fill_alloc_port_ice_resp(struct avs_alloc_port_ice_resp_info *resp)
+static void *fill_alloc_port_ice_resp(struct resp_alloc_port_ice_info *data, struct avs_alloc_port_ice_resp_info *resp)
 {
-	strncpy(resp->port_id, g_data_storage_resp_alloc_port_ice.port_id, sizeof(resp->port_id) - 1);
-	strncpy(resp->ice_ufrag, g_data_storage_resp_alloc_port_ice.ice_ufrag, sizeof(resp->ice_ufrag) - 1);
-	strncpy(resp->ice_pwd, g_data_storage_resp_alloc_port_ice.ice_ufrag, sizeof(resp->ice_pwd) - 1);
-	strncpy(resp->fingerprint, g_data_storage_resp_alloc_port_ice.fingerprint, sizeof(resp->fingerprint) - 1);
+	STR_COPY(resp->port_id, data->port_id);
+	STR_COPY(resp->ice_ufrag, data->ice_ufrag);
+	STR_COPY(resp->ice_pwd, data->ice_pwd);
+	STR_COPY(resp->fingerprint, data->fingerprint);
+	STR_COPY(resp->comm_id, data->comm_id);
+	resp->arena = data->arena;	/* The candidates go to the requester with their memory. */
+	resp->candidates = data->candidates;
+	resp->num_candidates = data->num_candidates;
+	resp->dropped_candidates = data->dropped_candidates;
+	data->arena = NULL;
 	
-	resp->resp.code = g_data_storage_resp_alloc_port_ice.common_resp.code;
-	strncpy(resp->resp.message, g_data_storage_resp_alloc_port_ice.common_resp.message, sizeof(resp->resp.message) - 1);
+	resp->resp.code = data->common_resp.code;
+	STR_COPY(resp->resp.message, data->common_resp.message);
 		
 	return NULL;	
 }
 
+/* Members of the "error" object in every response: {"error":{"code":0,"message":"OK"},"id":"..."}. */
+static const struct json_field common_resp_fields[] = {
+	{ .parent = -1, .key = "error", .type = JSON_FIELD_OBJECT,
+		.missing = "decode error oject failed\n", .mistyped = "error: error is not an object\n" },
+	{ .parent = 0, .key = "code", .type = JSON_FIELD_INTEGER, .offset = offsetof(struct resp_common_info, code),
+		.echo = "resp code: %d\n", .mistyped = "error: code is not an integer\n" },
+	{ .parent = 0, .key = "message", .type = JSON_FIELD_STRING, .offset = offsetof(struct resp_common_info, message), .size = MAX_MESSAGE_REPONSE,
+		.echo = "resp message: %.*s\n", .fallback = "Nothing to Say! Fuck U!!!!!!!!!!!!!!!!!!!!!!!!!!!!" },
+};
+
+/* Members of the "addPort" response with normal mode, besides the "error" object. */
+static const struct json_field alloc_port_normal_resp_fields[] = {
+	{ .parent = -1, .key = "port_id", .type = JSON_FIELD_STRING, .offset = offsetof(struct resp_alloc_port_normal_info, port_id), .size = MAX_PORTID_LEN,
+		.echo = "port_id: %.*s\n", .mistyped = "error: port_id is not an string\n" },
+	{ .parent = -1, .key = "InfoPort", .type = JSON_FIELD_OBJECT,
+		.missing = "decode InfoPort object failed.\n", .mistyped = "error: infoport is not an object\n" },
+	{ .parent = 1, .key = "rtp_port", .type = JSON_FIELD_STRING_UINT, .offset = offsetof(struct resp_alloc_port_normal_info, rtp_port),
+		.echo = "rtp_port: %.*s\n", .mistyped = "error: rtp_port is not an string\n" },
+	{ .parent = 1, .key = "rtcp_port", .type = JSON_FIELD_STRING_UINT, .offset = offsetof(struct resp_alloc_port_normal_info, rtcp_port),
+		.echo = "rtcp_port: %.*s\n", .mistyped = "error: rtcp_port is not an string\n" },
+	{ .parent = 1, .key = "fingerprint", .type = JSON_FIELD_STRING, .offset = offsetof(struct resp_alloc_port_normal_info, fingerprint), .size = MAX_FINGERPRINT_LEN,
+		.echo = "resp fingerprint: %.*s\n", .fallback = "don't need fingerprint.\n" },
+};
+
+/* Members of the "addPort" response with ICE mode, besides the "error" object. */
+static const struct json_field alloc_port_ice_resp_fields[] = {
+	{ .parent = -1, .key = "port_id", .type = JSON_FIELD_STRING, .offset = offsetof(struct resp_alloc_port_ice_info, port_id), .size = MAX_PORTID_LEN,
+		.echo = "port_id: %.*s\n", .mistyped = "error: port_id is not an string\n" },
+	{ .parent = -1, .key = "InfoICE", .type = JSON_FIELD_OBJECT,
+		.missing = "decode infoice object failed.\n", .mistyped = "error: InfoICE is not an object\n" },
+	{ .parent = 1, .key = "candidate", .type = JSON_FIELD_ARRAY,
+		.mistyped = "error: candidate is not an array\n", .handler = dec_json_candidates },
+	{ .parent = 1, .key = "fingerprint", .type = JSON_FIELD_STRING, .offset = offsetof(struct resp_alloc_port_ice_info, fingerprint), .size = MAX_FINGERPRINT_LEN,
+		.echo = "resp fingerprint: %.*s\n", .fallback = "don't need fingerprint.\n" },
+	{ .parent = 1, .key = "ice_ufrag", .type = JSON_FIELD_STRING, .offset = offsetof(struct resp_alloc_port_ice_info, ice_ufrag), .size = MAX_ICE_UFRAG,
+		.echo = "resp ice_ufrag: %.*s\n", .fallback = "don't need ice_ufrag.\n" },
+	{ .parent = 1, .key = "ice_pwd", .type = JSON_FIELD_STRING, .offset = offsetof(struct resp_alloc_port_ice_info, ice_pwd), .size = MAX_ICE_PASSWROD,
+		.echo = "resp ice_pwd: %.*s\n", .fallback = "don't need ice_pwd.\n" },
+};
+
 /* Parse a common type of JSON message. */
-static FUNC_RETURN dec_json_common_resp(json_t *root, struct resp_common_info *resp)
+static FUNC_RETURN dec_json_common_resp(const struct json_doc *doc, struct resp_common_info *resp)
 {
-	json_t *error, *code, *message;
-	
-	if ((error = json_object_get(root, "error")))
-	{
-		if (!json_is_object(error))
-		{
-			printf("error: error is not an object\n");
-			return R_FAIL;
-		}
-
-		if ((code = json_object_get(error, "code")))
-		{
-			if (!json_is_integer(code))
-			{
-				printf("error: code is not an integer\n");
-				return R_FAIL;
-			}
-			printf("resp code: %d\n", (int)json_integer_value(code));
-			resp->code = (unsigned int)json_integer_value(code);
-		}
-		
-		if ((message = json_object_get(error, "message")))
-		{
-			printf("resp message: %s\n", json_string_value(message));
-			if (json_is_string(message))
-			{
-				strncpy(resp->message, json_string_value(message), sizeof(resp->message) - 1);
-			}
-			else
-			{
-				strcpy(resp->message, "Nothing to Say! Fuck U!!!!!!!!!!!!!!!!!!!!!!!!!!!!");
-			}
-		}
-	}
-	else
+	if (json_dec_fields(doc, 0, common_resp_fields, sizeof(common_resp_fields) / sizeof(common_resp_fields[0]), resp) != 0)
 	{
-		printf("decode error oject failed\n");
 		return R_FAIL;
 	}
 
@@ -291,946 +635,3942 @@ static FUNC_RETURN dec_json_common_resp(json_t *root, struct resp_common_info *r
 }
 
 /* Parse a "alloc_port_normal" type of JSON message. */
-static FUNC_RETURN dec_json_alloc_port_normal_resp(json_t *root, struct resp_alloc_port_normal_info *resp)
+static FUNC_RETURN dec_json_alloc_port_normal_resp(const struct json_doc *doc, struct resp_alloc_port_normal_info *resp)
 {
-	json_t *infoport, *port_id, *rtp_port, *rtcp_port, *fingerprint;
-	
-	if (dec_json_common_resp(root, &(resp->common_resp)) != R_SUCCESS)
+	if (dec_json_common_resp(doc, &(resp->common_resp)) != R_SUCCESS)
 	{
-		printf("decode JSON from AVS failed (\"common\" resp in \"alloc_port_normal\").\n");
-		msg_parse_result = MSG_PARSE_RESULT_FAIL;
+		log_err("decode JSON from AVS failed (\"common\" resp in \"alloc_port_normal\").\n");
 		return R_FAIL;
 	}
 	
-	if ((port_id = json_object_get(root, "port_id")))
+	if (json_dec_fields(doc, 0, alloc_port_normal_resp_fields, sizeof(alloc_port_normal_resp_fields) / sizeof(alloc_port_normal_resp_fields[0]), resp) != 0)
 	{
-		if (!json_is_string(port_id))
-		{
-			printf("error: port_id is not an string\n");
-			return R_FAIL;
-		}
-		printf("port_id: %s\n", json_string_value(port_id));
-		strncpy(resp->port_id, json_string_value(port_id), sizeof(resp->port_id) - 1);
+		return R_FAIL;
 	}
 	
-	if ((infoport = json_object_get(root, "InfoPort")))
+	return R_SUCCESS;
+}
+
+/* Parse a "alloc_port_ice" type of JSON message. */
+static FUNC_RETURN dec_json_alloc_port_ice_resp(const struct json_doc *doc, struct resp_alloc_port_ice_info *resp)
+{
+	if (dec_json_common_resp(doc, &(resp->common_resp)) != R_SUCCESS)
 	{
-		if (!json_is_object(infoport))
-		{
-			printf("error: infoport is not an object\n");
-			return R_FAIL;
-		}
-		
-		if ((rtp_port = json_object_get(infoport, "rtp_port")))
-		{
-			if (!json_is_string(rtp_port))
-			{
-				printf("error: rtp_port is not an string\n");
-				return R_FAIL;
-			}
-			printf("rtp_port: %s\n", json_string_value(rtp_port));
-			resp->rtp_port = (unsigned int)atoi(json_string_value(rtp_port));
-		}
-		
-		if ((rtcp_port = json_object_get(infoport, "rtcp_port")))
-		{
-			if (!json_is_string(rtcp_port))
-			{
-				printf("error: rtcp_port is not an string\n");
-				return R_FAIL;
-			}
-			printf("rtcp_port: %s\n", json_string_value(rtcp_port));
-			resp->rtcp_port = (unsigned int)atoi(json_string_value(rtcp_port));
-		}
-		if ((fingerprint = json_object_get(infoport, "fingerprint")))
-		{
-			if (json_is_string(fingerprint))
-			{
-				strncpy(resp->fingerprint, json_string_value(fingerprint), sizeof(resp->fingerprint) - 1);
-			}
-			else
-			{
-				strcpy(resp->fingerprint, "don't need fingerprint.\n");
-			}
-			printf("resp fingerprint: %s\n", json_string_value(fingerprint));
-		}
-		
+		log_err("decode JSON from AVS failed (\"common\" resp in \"alloc_port_ice\").\n");
+		return R_FAIL;
 	}
-	else
+	
+	if (json_dec_fields(doc, 0, alloc_port_ice_resp_fields, sizeof(alloc_port_ice_resp_fields) / sizeof(alloc_port_ice_resp_fields[0]), resp) != 0)
 	{
-		printf("decode InfoPort object failed.\n");
-		return R_FAIL;		
+		return R_FAIL;
 	}
 	
 	return R_SUCCESS;
 }
 
-/* Parse a "alloc_port_ice" type of JSON message. */
-static FUNC_RETURN dec_json_alloc_port_ice_resp(json_t *root, struct resp_alloc_port_ice_info *resp)
+/* Carve room for "num" candidates of "alloc_port_ice" response out of its arena. Without memory they are counted as dropped when added. */
+static void candidates_reserve(struct resp_alloc_port_ice_info *resp, unsigned int num)
 {
-	json_t *infoice, *port_id, *candidate, *fingerprint, *ice_ufrag, *ice_pwd;
+	if (!num || resp->candidates)
+	{
+		return;
+	}
 	
-	if (dec_json_common_resp(root, &(resp->common_resp)) != R_SUCCESS)
+	if ((!resp->arena && !(resp->arena = arena_get())) || !(resp->candidates = arena_alloc(resp->arena, num * sizeof(resp->candidates[0]))))
 	{
-		printf("decode JSON from AVS failed (\"common\" resp in \"alloc_port_ice\").\n");
-		msg_parse_result = MSG_PARSE_RESULT_FAIL;
-		return R_FAIL;
+		log_err("no memory for %u candidates of port %s.\n", num, resp->port_id);
+		return;
 	}
 	
-	if ((port_id = json_object_get(root, "port_id")))
+	resp->max_candidates = num;
+}
+
+/* Parse a candidate of "alloc_port_ice" response into the next entry of its array. A malformed one is counted as dropped. */
+static void candidate_add(struct resp_alloc_port_ice_info *resp, const char *str, size_t len)
+{
+	log_dbg("candidate: %.*s\n", (int)len, str);
+	
+	if (resp->num_candidates >= resp->max_candidates)
 	{
-		if (!json_is_string(port_id))
-		{
-			printf("error: port_id is not an string\n");
-			return R_FAIL;
-		}
-		printf("port_id: %s\n", json_string_value(port_id));
-		strncpy(resp->port_id, json_string_value(port_id), sizeof(resp->port_id) - 1);
+		resp->dropped_candidates++;
+		return;
 	}
 	
-	if ((infoice = json_object_get(root, "InfoICE")))
+	if (!str || avs_candidate_parse(str, len, &resp->candidates[resp->num_candidates]) != 0)
 	{
-		if (!json_is_object(infoice))
-		{
-			printf("error: InfoICE is not an object\n");
-			return R_FAIL;
-		}
-		
-		if ((candidate = json_object_get(infoice, "candidate")))
+		log_warn("error: malformed candidate, skip it\n");
+		resp->dropped_candidates++;
+		return;
+	}
+	
+	resp->num_candidates++;
+}
+
+/* Handler of the "candidate" array of "alloc_port_ice" response, its strings are parsed one by one. */
+static int dec_json_candidates(const struct json_doc *doc, int tok, void *out)
+{
+	struct resp_alloc_port_ice_info *resp = (struct resp_alloc_port_ice_info *)out;
+	const struct json_tok *t;
+	unsigned int i, n;
+	size_t len, size;
+	char *cand;
+	
+	candidates_reserve(resp, doc->toks[tok].size);
+	
+	for (i = tok + 1, n = 0; i < doc->num && n < (unsigned int)doc->toks[tok].size; i++)
+	{
+		t = &doc->toks[i];
+		if (t->parent != tok)
 		{
-			if (!json_is_array(candidate))
-			{
-				printf("error: candidate is not an array\n");
-				return R_FAIL;
-			}
-			strcpy(resp->candidates->cands_str, "candidate:190205851 0 udp 2122260224 192.168.124.110 57391 typ host generation 0 ufrag XY1f network-id 1 network-cost 50");
-			resp->candidates->next = NULL;
-			//printf("candidate: %s\n", json_string_value(candidate));
+			continue;
 		}
+		n++;
 		
-		if ((fingerprint = json_object_get(infoice, "fingerprint")))
+		if (JSON_TOK_STRING != t->type)
 		{
-			if (json_is_string(fingerprint))
-			{
-				strncpy(resp->fingerprint, json_string_value(fingerprint), sizeof(resp->fingerprint) - 1);
-			}
-			else
-			{
-				strcpy(resp->fingerprint, "don't need fingerprint.\n");
-			}
-			printf("resp fingerprint: %s\n", json_string_value(fingerprint));
+			log_warn("error: candidate is not an string\n");
+			resp->dropped_candidates++;
+			continue;
 		}
 		
-		if ((ice_ufrag = json_object_get(infoice, "ice_ufrag")))
+		if (t->escaped)
 		{
-			if (json_is_string(ice_ufrag))
+			/* Unescaping never lengthens a string, a copy which fills the buffer has failed. */
+			size = t->end - t->start + 1;
+			if (resp->arena && (cand = arena_alloc(resp->arena, size)) && (len = json_tok_copy(doc, i, cand, size)) + 1 < size)
 			{
-				strncpy(resp->ice_ufrag, json_string_value(ice_ufrag), sizeof(resp->ice_ufrag) - 1);
+				candidate_add(resp, cand, len);
 			}
 			else
 			{
-				strcpy(resp->ice_ufrag, "don't need ice_ufrag.\n");
+				candidate_add(resp, NULL, 0);
 			}
-			printf("resp ice_ufrag: %s\n", json_string_value(ice_ufrag));
 		}
-		
-		if ((ice_pwd = json_object_get(infoice, "ice_pwd")))
+		else
 		{
-			if (json_is_string(ice_pwd))
-			{
-				strncpy(resp->ice_pwd, json_string_value(ice_pwd), sizeof(resp->ice_pwd) - 1);
-			}
-			else
-			{
-				strcpy(resp->ice_pwd, "don't need ice_pwd.\n");
-			}
-			printf("resp ice_pwd: %s\n", json_string_value(ice_pwd));
+			candidate_add(resp, doc->js + t->start, t->end - t->start);
 		}
 	}
-	else
-	{
-		printf("decode infoice object failed.\n");
-		return R_FAIL;		
-	}
 	
-	return R_SUCCESS;
+	return 0;
 }
 
-/* Encapsulating "setParam" JSON object and return it's string shape. */
-static const char *enc_json_set_global_param(struct avs_global_param *param)
+/* Initialize data. */
+static void *data_init()
 {
-	json_t *obj_top = json_object();
-	json_t *obj_setparam = json_object();
-	json_t *obj_stun = json_object();
-	json_t *obj_turn = json_object();
-	json_t *array_stun = json_array();
-	json_t *array_turn = json_array();
-	char stun_port[6], turn_port[6];
+	int i;
 	
-	sprintf(stun_port, "%d", param->stun_port);
-	sprintf(turn_port, "%d", param->turn_port);
+	memset(pending_hash, 0, sizeof(pending_hash));
+	memset(pending_keys, 0, sizeof(pending_keys));
+	wheel_init(&pending_timers, wheel_now_ms());
+	pending_used = 0;
 	
-	json_object_set_new(obj_stun, "address", json_string(param->stun_ipaddr));
-	json_object_set_new(obj_stun, "port", json_string(stun_port));
-	json_object_set_new(obj_turn, "address", json_string(param->turn_ipaddr));
-	json_object_set_new(obj_turn, "port", json_string(turn_port));
-	json_object_set_new(obj_turn, "username", json_string(param->turn_username));
-	json_object_set_new(obj_turn, "password", json_string(param->turn_username));
+	for (i = 0; i < MAX_PENDING_CMDS; i++)
+	{
+		pending_cmds[i].in_use = 0;
+		pending_cmds[i].waiting = 0;
+		pending_cmds[i].next = NULL;
+		pending_cmds[i].key_next = NULL;
+		pending_cmds[i].timer.pprev = NULL;
+		pending_cmds[i].coalesced = NULL;
+		pending_free[i] = &pending_cmds[i];
+	}
 	
-	json_array_insert_new(array_stun, 0, obj_stun);
-	json_array_insert_new(array_turn, 0, obj_turn);
+	return NULL;
+}
 
-	json_object_set_new(obj_setparam, "stunserver", array_stun);
-	json_object_set_new(obj_setparam, "turnserver", array_turn);
-	
-	json_object_set_new(obj_top, "setParam", obj_setparam);
-	json_object_set_new(obj_top, "id", json_string(param->comm_id));
-	
-	return json_dumps(obj_top, JSON_COMPACT);
+/* Get the unique ID of a command from its parameters. */
+static const char *general_comm_id(void *param, CMD_TYPE_STATE cmd_type)
+{
+	switch (cmd_type)
+	{
+		case ST_AVS_SET_GLOBAL_PARAM:
+			return ((struct avs_global_param *)param)->comm_id;
+			
+		case ST_AVS_ALLOC_PORT_NORMAL:
+			return ((struct avs_alloc_port_normal_param *)param)->comm_id;
+			
+		case ST_AVS_ALLOC_PORT_ICE:
+			return ((struct avs_alloc_port_ice_param *)param)->comm_id;
+			
+		case ST_AVS_DEALLOC_PORT:
+			return ((struct avs_dealloc_port_param *)param)->comm_id;
+			
+		case ST_AVS_SET_PEERPORT_PARAM_NORMAL:
+			return ((struct avs_set_peerport_normal_param *)param)->comm_id;
+			
+		case ST_AVS_SET_PEERPORT_PARAM_ICE:
+			return ((struct avs_set_peerport_ice_param *)param)->comm_id;
+			
+		case ST_AVS_SET_AUDIO_CODEC_PARAM:
+			return ((struct avs_codec_audio_param *)param)->comm_id;
+			
+		case ST_AVS_SET_VIDEO_CODEC_PARAM:
+			return ((struct avs_codec_video_param *)param)->comm_id;
+			
+		case ST_AVS_RUNCTRL_CHAN:
+			return ((struct avs_runctrl_chan_param *)param)->comm_id;
+			
+		case ST_AVS_PLAYSOUND:
+			return ((struct avs_playsound_chan_param *)param)->comm_id;
+			
+		default:
+			return NULL;
+	}
 }
 
-/* Encapsulating "addPort" JSON object with normal mode and return it's string shape. */
-static const char *enc_json_alloc_port_normal(struct avs_alloc_port_normal_param *param)
+/* FNV-1a hash of a command unique ID. */
+static unsigned int comm_id_hash(const char *comm_id)
 {
-	json_t *obj_top = json_object();
-	json_t *obj_addport = json_object();
-	char dtls[2] = {0};
-	
-	sprintf(dtls, "%d", param->enable_dtls);
-	
-	json_object_set_new(obj_addport, "conf_id", json_string(param->conf_id));
-	json_object_set_new(obj_addport, "chan_id", json_string(param->chan_id));
-	json_object_set_new(obj_addport, "ICE", json_string("0"));	/* set to "0" */
-	json_object_set_new(obj_addport, "DTLS", json_string(dtls));
+	unsigned int h = 2166136261u;
 	
-	json_object_set_new(obj_top, "addPort", obj_addport);
-	json_object_set_new(obj_top, "id", json_string(param->comm_id));
+	while (*comm_id)
+	{
+		h ^= (unsigned char)*comm_id++;
+		h *= 16777619u;
+	}
 	
-	return json_dumps(obj_top, JSON_COMPACT);
+	return h & (PENDING_HASH_SIZE - 1);
 }
 
-/* Encapsulating "addPort" JSON object with ICE mode and return it's string shape. */
-static const char *enc_json_alloc_port_ice(struct avs_alloc_port_ice_param *param)
+/* Take a free wait slot for a command and insert it into the pending table. The table belongs to the receiving thread, it is not locked. */
+static struct pending_cmd *pending_register(const char *comm_id, CMD_TYPE_STATE cmd_type)
 {
-	json_t *obj_top = json_object();
-	json_t *obj_addport = json_object();
-	char dtls[2] = {0};
+	struct pending_cmd *cmd;
+	unsigned int h;
 	
-	sprintf(dtls, "%d", param->enable_dtls);
+	if (pending_lookup(comm_id))
+	{
+		log_warn("command id %s is already waiting for AVS.\n", comm_id);
+		return NULL;
+	}
 	
-	json_object_set_new(obj_addport, "conf_id", json_string(param->conf_id));
-	json_object_set_new(obj_addport, "chan_id", json_string(param->chan_id));
-	json_object_set_new(obj_addport, "ICE", json_string("1"));	/* set to "1" */
-	json_object_set_new(obj_addport, "DTLS", json_string(dtls));
+	if (pending_used >= MAX_PENDING_CMDS)
+	{
+		log_warn("too many commands waiting for AVS.\n");
+		return NULL;
+	}
 	
-	json_object_set_new(obj_top, "addPort", obj_addport);
-	json_object_set_new(obj_top, "id", json_string(param->comm_id));
+	cmd = pending_free[pending_used];
+	cmd->in_use = 1;
+	cmd->waiting = 1;
+	stats_set_in_flight(++pending_used);
+	STR_COPY(cmd->comm_id, comm_id);
+	cmd->cmd_type = cmd_type;
+	cmd->parse_result = MSG_PARSE_RESULT_SUCCESS;
+	memset(&cmd->data, 0, sizeof(cmd->data));
+	cmd->data.common.code = -1;
+	cmd->resp = NULL;
+	cmd->cb = NULL;
+	cmd->user_data = NULL;
+	cmd->coalesced = NULL;
+	cmd->superseded = 0;
+	cmd->sent_us = 0;
+	cmd->seq = ++pending_seq;
 	
-	return json_dumps(obj_top, JSON_COMPACT);
-}
-
-/* Encapsulating "delPort" JSON object and return it's string shape. */
-static const char *enc_json_del_port(struct avs_dealloc_port_param *param)
-{
-	json_t *obj_top = json_object();
-	json_t *obj_delport = json_object();
+	h = comm_id_hash(cmd->comm_id);
+	cmd->next = pending_hash[h];
+	pending_hash[h] = cmd;
 	
-	json_object_set_new(obj_delport, "conf_id", json_string(param->conf_id));
-	json_object_set_new(obj_delport, "chan_id", json_string(param->chan_id));
-	json_object_set_new(obj_delport, "port_id", json_string(param->port_id));
+	wheel_add(&pending_timers, &cmd->timer, wheel_now_ms() + cmd_timeouts[cmd_type]);
 	
-	json_object_set_new(obj_top, "delPort", obj_delport);
-	json_object_set_new(obj_top, "id", json_string(param->comm_id));
+	if (!timer_deadline || cmd->timer.expires < timer_deadline)
+	{
+		reactor_arm_timer(cmd->timer.expires);
+	}
 	
-	return json_dumps(obj_top, JSON_COMPACT);
+	return cmd;
 }
 
-/* Encapsulating "setPortParam" JSON object with normal mode and return it's string shape. */
-static const char *enc_json_set_peerport_normal(struct avs_set_peerport_normal_param *param)
+/* Find the command waiting for the response with the unique ID. */
+static struct pending_cmd *pending_lookup(const char *comm_id)
 {
-	json_t *obj_top = json_object();
-	json_t *obj_setportparam = json_object();
-	json_t *obj_infoport = json_object();
-	char rtcpmux[2] = {0};
-	char symrtp[2] = {0};
-	char qos[6] = {0};
-	char srtpmode[2] = {0};
-	
-	sprintf(rtcpmux, "%d", param->rtcpmux);
-	sprintf(symrtp, "%d", param->symrtp);
-	sprintf(qos, "%d", param->qos);
-	sprintf(srtpmode, "%d", param->srtpmode);
+	struct pending_cmd *cmd;
 	
-	json_object_set_new(obj_infoport, "targetAddr", json_string(param->targetaddr));
-	json_object_set_new(obj_infoport, "RtcpMux", json_string(rtcpmux));
-	json_object_set_new(obj_infoport, "SymRTP", json_string(symrtp));
-	json_object_set_new(obj_infoport, "Qos", json_string(qos));
-	json_object_set_new(obj_infoport, "srtpMode", json_string(srtpmode));
-	json_object_set_new(obj_infoport, "srtpSendKey", json_string(param->srtpsendkey));
-	json_object_set_new(obj_infoport, "srtpRecvKey", json_string(param->srtprecvkey));
-	json_object_set_new(obj_infoport, "fingerprint", json_string(param->fingerprint));
-	
-	json_object_set_new(obj_setportparam, "conf_id", json_string(param->conf_id));
-	json_object_set_new(obj_setportparam, "chan_id", json_string(param->chan_id));
-	json_object_set_new(obj_setportparam, "port_id", json_string(param->port_id));
-	json_object_set_new(obj_setportparam, "InfoPort", obj_infoport);
-
-	json_object_set_new(obj_top, "setPortParam", obj_setportparam);
-	json_object_set_new(obj_top, "id", json_string(param->comm_id));
+	for (cmd = pending_hash[comm_id_hash(comm_id)]; cmd; cmd = cmd->next)
+	{
+		if (!strncmp(cmd->comm_id, comm_id, sizeof(cmd->comm_id) - 1))
+		{
+			return cmd;
+		}
+	}
 	
-	return json_dumps(obj_top, JSON_COMPACT);
+	return NULL;
 }
 
-/* Encapsulating "setPortParam" JSON object with ICE mode and return it's string shape. */
-static const char *enc_json_set_peerport_ice(struct avs_set_peerport_ice_param *param)
+/* Remove a command from the pending table, no more responses are matched to it. */
+static void pending_unlink(struct pending_cmd *cmd)
 {
-	json_t *obj_top = json_object();
-	json_t *obj_setportparam = json_object();
-	json_t *obj_infoice = json_object();
-	char icerole[2] = {0};
-	char sslrole[2] = {0};
-
-	sprintf(icerole, "%d", param->icerole);
-	sprintf(sslrole, "%d", param->sslrole);
+	struct pending_cmd **pp;
 	
-	json_object_set_new(obj_infoice, "IceRole", json_string(icerole));
-	json_object_set_new(obj_infoice, "SslRole", json_string(sslrole));
-	json_object_set_new(obj_infoice, "fingerprint", json_string(param->fingerprint));
-	json_object_set_new(obj_infoice, "ice_ufrag", json_string(param->ice_ufrag));
-	json_object_set_new(obj_infoice, "ice_pwd", json_string(param->ice_pwd));
-	json_object_set_new(obj_infoice, "candidate", json_string(param->candidate));
-	
-	json_object_set_new(obj_setportparam, "conf_id", json_string(param->conf_id));
-	json_object_set_new(obj_setportparam, "chan_id", json_string(param->chan_id));
-	json_object_set_new(obj_setportparam, "port_id", json_string(param->port_id));
-	json_object_set_new(obj_setportparam, "InfoICE", obj_infoice);
-
+	for (pp = &pending_hash[comm_id_hash(cmd->comm_id)]; *pp; pp = &(*pp)->next)
+	{
+		if (*pp == cmd)
+		{
+			*pp = cmd->next;
+			break;
+		}
+	}
 	
-	json_object_set_new(obj_top, "setPortParam", obj_setportparam);
-	json_object_set_new(obj_top, "id", json_string(param->comm_id));
+	cmd->next = NULL;
+	cmd->waiting = 0;
+	pending_key_del(cmd);
 	
-	return json_dumps(obj_top, JSON_COMPACT);
+	/* The timer stays armed to its deadline, which expires nothing if it was the earliest one. */
+	wheel_del(&pending_timers, &cmd->timer);
 }
 
-/* Encapsulating "addTrack" JSON object with audio param and return it's string shape. */
-static const char *enc_json_set_audio_codec(struct avs_codec_audio_param *param)
+/* Finish an unlinked command: backfill the response, give back its wait slot and notify the requester. */
+static void pending_complete(struct pending_cmd *cmd, AVS_CMD_RESULT result)
 {
-	json_t *obj_top = json_object();
-	json_t *obj_addtrack = json_object();
-	json_t *obj_a_tx_param = json_object();
-	json_t *obj_a_rx_param = json_object();
-	json_t *audio_transport = json_object();
-	
-	char a_payloadtype[6] = {0};
-	char a_ptime[6] = {0};
+	avs_cmd_cb cb = cmd->cb;
+	void *resp = cmd->resp;
+	void *user_data = cmd->user_data;
+	struct pending_cmd *older = cmd->coalesced;
 	
-	sprintf(a_payloadtype, "%d", param->audio_payloadtype);
-	sprintf(a_ptime, "%d", param->ptime);
+	/* The commands this one replaced finish first, in the order they were submitted, with its result. */
+	if (older)
+	{
+		cmd->coalesced = NULL;
+		older->parse_result = cmd->parse_result;
+		older->data.common.code = cmd->data.common.code;
+		memcpy(older->data.common.message, cmd->data.common.message, sizeof(older->data.common.message));
+		STR_COPY(older->data.common.comm_id, older->comm_id);
+		pending_complete(older, result);
+	}
 	
-	json_object_set_new(obj_a_tx_param, "MainCoder", json_string(codec_audio_trans[param->a_codec].name));
-	json_object_set_new(obj_a_tx_param, "PayloadType", json_string(a_payloadtype));
-	json_object_set_new(obj_a_tx_param, "Ptime", json_string(a_ptime));
+	/* If parse the JSON format error, return ERROR.  */
+	if (SUCCESS == result && MSG_PARSE_RESULT_FAIL == cmd->parse_result)
+	{
+		result = ERROR;
+	}
 	
-	json_object_set_new(obj_a_rx_param, "Codecs", json_string(codec_audio_trans[param->a_codec].name));
-	json_object_set_new(obj_a_rx_param, "PayloadType", json_string(a_payloadtype));
+	if (SUCCESS == result)
+	{
+		if (!cmd->superseded)
+		{
+			general_state_update(cmd);
+		}
+		general_fill_resp(cmd, resp);
+	}
 	
-	json_object_set_new(audio_transport, "audio_transport", json_string(transmodes[param->audio_transmode].name));
+	/* Candidates which did not go to a response. */
+	if (ST_AVS_ALLOC_PORT_ICE == cmd->cmd_type && cmd->data.alloc_port_ice.arena)
+	{
+		arena_put(cmd->data.alloc_port_ice.arena);
+		cmd->data.alloc_port_ice.arena = NULL;
+	}
 	
-	json_object_set_new(obj_addtrack, "conf_id", json_string(param->conf_id));
-	json_object_set_new(obj_addtrack, "chan_id", json_string(param->chan_id));
-	json_object_set_new(obj_addtrack, "port_id", json_string(param->port_id));
-	json_object_set_new(obj_addtrack, "track_id", json_string("222222222222222"));
-	json_object_set_new(obj_addtrack, "mediaType", json_string("audio"));
-	json_object_set_new(obj_addtrack, "audio_tx_param", obj_a_tx_param);
-	json_object_set_new(obj_addtrack, "audio_rx_param", obj_a_rx_param);
-	json_object_set_new(obj_addtrack, "audio_transport", audio_transport);
+	/* The ports it changed are counted before the conference may leave its instance. */
+	if (cmd->placed)
+	{
+		shard_release(cmd->target.conf_id);
+	}
 	
-	json_object_set_new(obj_top, "addTrack", obj_addtrack);
-	json_object_set_new(obj_top, "id", json_string(param->comm_id));
+	cmd->in_use = 0;
+	pending_free[--pending_used] = cmd;
+	stats_set_in_flight(pending_used);
 	
-	return json_dumps(obj_top, JSON_COMPACT);
+	if (cb)
+	{
+		cb(result, resp, user_data);
+	}
 }
 
-/* Encapsulating "addTrack" JSON object with video param and return it's string shape. */
-static const char *enc_json_set_video_codec(struct avs_codec_video_param *param)
+/* Fail the commands whose deadline has passed, and arm the timer to the next deadline. Other commands are not touched. */
+static void pending_expire(void)
 {
-	json_t *obj_top = json_object();
-	json_t *obj_addtrack = json_object();
-	json_t *obj_v_tx_param = json_object();
-	json_t *obj_v_rx_param = json_object();
-	json_t *video_transport = json_object();
+	struct pending_cmd *expired[MAX_PENDING_CMDS];
+	struct timer_node *node;
+	uint64_t now = wheel_now_ms();
+	int i, n = 0;
+	
+	while (n < MAX_PENDING_CMDS && (node = wheel_expire(&pending_timers, now)))
+	{
+		expired[n] = (struct pending_cmd *)((char *)node - offsetof(struct pending_cmd, timer));
+		pending_unlink(expired[n++]);
+	}
 	
-	char v_payloadtype[6] = {0};
+	/* Nothing in flight: leave the timer disarmed, no idle wakeups. */
+	reactor_arm_timer(wheel_next(&pending_timers));
 	
-	sprintf(v_payloadtype, "%d", param->video_payloadtype);
+	for (i = 0; i < n; i++)
+	{
+		log_warn("avs response timeout (id %s).\n", expired[i]->comm_id);
+		stats_count_timeout(expired[i]->cmd_type);
+		instances[expired[i]->inst].timeouts++;
+		pending_complete(expired[i], ERROR);
+	}
+}
+
+/* Fail all the commands in flight, e.g. when the connection is shut down. */
+static void pending_fail_all(AVS_CMD_RESULT result)
+{
+	struct pending_cmd *failed[MAX_PENDING_CMDS];
+	int i, n = 0;
 	
-	json_object_set_new(obj_v_tx_param, "MainCoder", json_string(codec_video_trans[param->v_codec].name));
-	json_object_set_new(obj_v_tx_param, "PayloadType", json_string(v_payloadtype));
+	for (i = 0; i < MAX_PENDING_CMDS; i++)
+	{
+		if (pending_cmds[i].waiting)
+		{
+			pending_unlink(&pending_cmds[i]);
+			failed[n++] = &pending_cmds[i];
+		}
+	}
 	
-	json_object_set_new(obj_v_rx_param, "Codecs", json_string(codec_video_trans[param->v_codec].name));
-	json_object_set_new(obj_v_rx_param, "PayloadType", json_string(v_payloadtype));
+	reactor_arm_timer(0);
 	
-	json_object_set_new(video_transport, "video_transport", json_string(transmodes[param->video_transmode].name));
+	for (i = 0; i < n; i++)
+	{
+		pending_complete(failed[i], result);
+	}
+}
+
+/* FNV-1a of a string member of the parameters, continuing from "h". The member may fill its array without a '\0'. */
+static unsigned int hash_str_more(unsigned int h, const char *str, size_t size)
+{
+	size_t i;
 	
-	json_object_set_new(obj_addtrack, "conf_id", json_string(param->conf_id));
-	json_object_set_new(obj_addtrack, "chan_id", json_string(param->chan_id));
-	json_object_set_new(obj_addtrack, "port_id", json_string(param->port_id));
-	json_object_set_new(obj_addtrack, "track_id", json_string("222222222222222"));
-	json_object_set_new(obj_addtrack, "mediaType", json_string("video"));
-	json_object_set_new(obj_addtrack, "video_tx_param", obj_v_tx_param);
-	json_object_set_new(obj_addtrack, "video_rx_param", obj_v_rx_param);
-	json_object_set_new(obj_addtrack, "video_transport", video_transport);
+	for (i = 0; i < size && str[i]; i++)
+	{
+		h ^= (unsigned char)str[i];
+		h *= 16777619u;
+	}
 	
-	json_object_set_new(obj_top, "addTrack", obj_addtrack);
-	json_object_set_new(obj_top, "id", json_string(param->comm_id));
+	/* The terminator separates the members, "ab" + "c" differs from "a" + "bc". */
+	h *= 16777619u;
 	
-	return json_dumps(obj_top, JSON_COMPACT);
+	return h;
 }
 
-/* Initialize data. */
-static void *data_init()
+static unsigned int hash_uint_more(unsigned int h, unsigned int v)
 {
-	memset(&g_data_storage_resp_common, 0, sizeof(g_data_storage_resp_common));
-	g_data_storage_resp_common.code = -1;
+	int i;
+	
+	for (i = 0; i < 4; i++, v >>= 8)
+	{
+		h ^= v & 0xff;
+		h *= 16777619u;
+	}
 	
-	memset(&g_data_storage_resp_alloc_port_normal, 0, sizeof(g_data_storage_resp_alloc_port_normal));
+	return h;
+}
+
+/* Whether two commands change the same setting of the same port. */
+static int same_target(const struct cmd_target *a, const struct cmd_target *b)
+{
+	return a->key_hash == b->key_hash && a->setting == b->setting && !strcmp(a->port_id, b->port_id)
+		&& !strcmp(a->chan_id, b->chan_id) && !strcmp(a->conf_id, b->conf_id);
+}
 
-	memset(&g_data_storage_resp_alloc_port_ice, 0, sizeof(g_data_storage_resp_alloc_port_ice));
+/* Index a waiting command by the setting it changes, so the duplicate checks only compare commands of the same bucket. */
+static void pending_key_add(struct pending_cmd *cmd)
+{
+	unsigned int h = cmd->target.key_hash & (PENDING_HASH_SIZE - 1);
 	
-	return NULL;
+	if (keep_duplicates || STATE_SETTING_NONE == cmd->target.setting)
+	{
+		return;
+	}
+	
+	cmd->key_next = pending_keys[h];
+	pending_keys[h] = cmd;
 }
 
-/* socket Initialization */
-static FUNC_RETURN sock_init(void)
+/* Remove a command from "pending_keys", nothing is done if it is not indexed. */
+static void pending_key_del(struct pending_cmd *cmd)
 {
-	struct sockaddr_un sock_addr;
+	struct pending_cmd **pp;
 	
-	sockfd = socket(AF_UNIX, SOCK_DGRAM, 0);
+	if (keep_duplicates || STATE_SETTING_NONE == cmd->target.setting)
+	{
+		return;
+	}
 	
-	if (sockfd < 0)
+	for (pp = &pending_keys[cmd->target.key_hash & (PENDING_HASH_SIZE - 1)]; *pp; pp = &(*pp)->key_next)
 	{
-		printf("Open a socket failed\n");
-		return R_FAIL;
+		if (*pp == cmd)
+		{
+			*pp = cmd->key_next;
+			break;
+		}
 	}
 	
-	unlink(AVS_CLIENT_SOCKET_PATH);
+	cmd->key_next = NULL;
+}
+
+/* Complete a setting which AVS has already accepted for the port, without sending it. Not done while a command of the same setting
+ * is in flight, its result is not known yet. Return 1 if the command has been completed.
+ */
+static int cmd_suppress(struct cmd_submission *sub)
+{
+	struct resp_common_info data;
+	struct pending_cmd *cmd;
 	
-	memset(&sock_addr, 0, sizeof(struct sockaddr_un));
+	if (keep_duplicates || STATE_SETTING_NONE == sub->target.setting)
+	{
+		return 0;
+	}
 	
-	sock_addr.sun_family = AF_UNIX;
-	strncpy(sock_addr.sun_path, AVS_CLIENT_SOCKET_PATH, sizeof(sock_addr.sun_path) - 1);
+	for (cmd = pending_keys[sub->target.key_hash & (PENDING_HASH_SIZE - 1)]; cmd; cmd = cmd->key_next)
+	{
+		if (same_target(&cmd->target, &sub->target))
+		{
+			return 0;
+		}
+	}
 	
-	if (bind(sockfd, (const struct sockaddr *) &sock_addr, sizeof(struct sockaddr_un)) == -1)
+	if (!state_setting_applied(sub->target.conf_id, sub->target.chan_id, sub->target.port_id, sub->target.setting, sub->target.setting_hash))
 	{
-		perror("bind socket failed");
-		close(sockfd);
-		return R_FAIL;
+		return 0;
 	}
 	
-	return R_SUCCESS;
+	memset(&data, 0, sizeof(data));
+	STR_COPY(data.message, "OK");
+	STR_COPY(data.comm_id, sub->comm_id);
+	
+	stats_count_suppressed();
+	
+	if (sub->resp)
+	{
+		fill_common_resp(&data, (struct avs_common_resp_info *)sub->resp);
+	}
+	
+	if (sub->cb)
+	{
+		sub->cb(SUCCESS, sub->resp, sub->user_data);
+	}
+	
+	return 1;
 }
 
-/* Send the command to AVS */
-static FUNC_RETURN cmd_send(const char *cmd)
+/* A newer setting replaces an older one of the same port which has not been sent yet: only the newer one is sent. */
+static void cmd_coalesce(struct pending_cmd *cmd)
 {
-	int sent_num = 0;
-	struct sockaddr_un sock_addr;
+	struct pending_cmd *old;
 	
-	if (sockfd)
+	if (keep_duplicates || STATE_SETTING_NONE == cmd->target.setting)
 	{
-		memset(&sock_addr, 0, sizeof(struct sockaddr_un));
-		
-		sock_addr.sun_family = AF_UNIX;
-		strncpy(sock_addr.sun_path, AVS_SERVER_SOCKET_PATH, sizeof(sock_addr.sun_path) - 1);
-		
-		printf("sent cmd is %s\n", cmd);
-		
-		sent_num = sendto(sockfd, cmd, strlen(cmd), 0, (struct sockaddr *)(&sock_addr), sizeof(struct sockaddr_un));
-		
-		if (sent_num <= 0) {
-			printf("send commands to AVS failed\n");
-			return R_FAIL;	
-		}
-		
-		return R_SUCCESS;
+		return;
 	}
-	else
+	
+	/* Only waiting commands are indexed, and "cmd" is not yet. */
+	for (old = pending_keys[cmd->target.key_hash & (PENDING_HASH_SIZE - 1)]; old; old = old->key_next)
 	{
-		printf("Socket is closed\na");	
-		return R_FAIL;
+		if (old->sent_us || !same_target(&old->target, &cmd->target))
+		{
+			continue;
+		}
+		
+		/* Its message is skipped by cmd_flush() once it is no longer waiting. Older ones were already replaced by it. */
+		pending_unlink(old);
+		old->superseded = 1;
+		cmd->coalesced = old;
+		stats_count_coalesced();
+		break;
 	}
 }
 
-/* Processing messages received from AVS.
- * 1. Parse JSON and store into the global data area.
- * 2. Wake up the thread which send the command.
- */
-static FUNC_RETURN msg_recv_process(char *msg)
+/* Create the epoll instance with the wakeup eventfd and the deadline timerfd. */
+static FUNC_RETURN reactor_init(void)
 {
-    printf("recv msg: %s\n", msg);
+	memset(reactor_sources, 0, sizeof(reactor_sources));
+	
+	if ((epfd = epoll_create1(EPOLL_CLOEXEC)) < 0)
+	{
+		perror("epoll_create1 failed");
+		return R_FAIL;
+	}
+	
+	if ((wakeup_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0)
+	{
+		perror("eventfd failed");
+		return R_FAIL;
+	}
 	
-	general_json_dec(msg);
+	/* Same clock as the timer wheel, deadlines do not move when the wall clock is set. */
+	if ((timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC)) < 0)
+	{
+		perror("timerfd_create failed");
+		return R_FAIL;
+	}
 	
-	memset(msg, 0, RECV_BUFFER_SIZE);
+	timer_deadline = 0;
 	
-	wakeup_intruder();
+	if (reactor_add(wakeup_fd, wakeup_readable, NULL) != R_SUCCESS 
+		|| reactor_add(timer_fd, timer_readable, NULL) != R_SUCCESS)
+	{
+		return R_FAIL;
+	}
 	
 	return R_SUCCESS;
 }
 
-/* Send single to wake up the thread which sent command to AVS. */
-static void *wakeup_intruder()
+/* Watch a file descriptor for reading in the receiving thread. More AVS sockets may be hosted in the same way. */
+static FUNC_RETURN reactor_add(int fd, reactor_handler handler, void *arg)
 {
-	pthread_mutex_lock(&p_mutex);
+	struct epoll_event ev;
+	int i;
+	
+	for (i = 0; i < REACTOR_MAX_SOURCES; i++)
+	{
+		if (!reactor_sources[i].handler)
+		{
+			break;
+		}
+	}
+	
+	if (REACTOR_MAX_SOURCES == i)
+	{
+		log_err("too many file descriptors in reactor.\n");
+		return R_FAIL;
+	}
 	
-	pthread_cond_signal(&cond_v);
+	reactor_sources[i].fd = fd;
+	reactor_sources[i].handler = handler;
+	reactor_sources[i].arg = arg;
 	
-	pthread_mutex_unlock(&p_mutex);
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN;
+	ev.data.ptr = &reactor_sources[i];
 	
-	return NULL;
+	if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) < 0)
+	{
+		perror("epoll_ctl failed");
+		reactor_sources[i].handler = NULL;
+		return R_FAIL;
+	}
+	
+	return R_SUCCESS;
 }
 
-/* Using "pthread_cond_wait" to wait for the response of the AVS. */
-static FUNC_RETURN wait_for_avs()
+/* Wake up the receiving thread. */
+static void reactor_wakeup(void)
 {
-	time_t tm;
-	struct timespec timeout;
-	FUNC_RETURN result = R_SUCCESS;
-	int ret = 0;
-
-	time(&tm);
-	timeout.tv_sec = tm + MAXIMUM_CMD_TIMEOUT;
-	timeout.tv_nsec = 0;
+	uint64_t one = 1;
+	
+	if (write(wakeup_fd, &one, sizeof(one)) < 0 && EAGAIN != errno)
+	{
+		perror("write eventfd failed");
+	}
+}
 
-	ret = pthread_cond_timedwait(&cond_v, &p_mutex, &timeout);
+/* Arm the deadline timer to an absolute time in milliseconds, 0 to disarm it. */
+static void reactor_arm_timer(uint64_t deadline)
+{
+	struct itimerspec its;
 	
-	if (ret != 0)
+	if (deadline == timer_deadline)
 	{
-		if (EAGAIN == ret)
-		{
-			printf("avs response timeout.\n");
-		}
-		else if (EINVAL == ret)
-		{
-			printf("pthread_cond_timedwait: invalid arguments.\n");
-		}
-		else
-		{
-			printf("pthread_cond_timewait error, return value: %d\n", ret);	
-		}
-		result = R_FAIL;
+		return;
+	}
+	
+	memset(&its, 0, sizeof(its));
+	its.it_value.tv_sec = deadline / 1000;
+	its.it_value.tv_nsec = (deadline % 1000) * 1000000;
+	
+	if (timerfd_settime(timer_fd, TFD_TIMER_ABSTIME, &its, NULL) < 0)
+	{
+		perror("timerfd_settime failed");
+		return;
 	}
 	
-	return result;
+	timer_deadline = deadline;
 }
 
-/* Monitor file descriptor(sockfd). Waiting until the file descriptors become "ready" for some class of I/O operation (e.g., output possible.). */
-static int wait_on_socket()
+/* Add to a counter of "io_counters". Only the receiving thread writes them, a store is enough for readers not to see it torn. */
+static void io_count(unsigned long *c, unsigned long n)
 {
-	struct timeval tv;
-	fd_set rds;
-	int res;
-
-	tv.tv_sec = 10;	/* 10 sec??? */
-	tv.tv_usec = 0;
-
-	FD_ZERO(&rds);
-	FD_SET(sockfd, &rds);
-	
-	res = select((int)sockfd + 1, &rds, NULL, NULL, &tv); 
+	__atomic_store_n(c, *c + n, __ATOMIC_RELAXED);
+}
 
-	return res;
+/* Raise a maximum of "io_counters", from the receiving thread only. */
+static void io_count_max(unsigned long *c, unsigned long n)
+{
+	if (n > *c)
+	{
+		__atomic_store_n(c, n, __ATOMIC_RELAXED);
+	}
 }
 
-/* Main loop to receive and process messages from AVS. */
-static void *recv_task(void *data)
+/* Snapshot of "io_counters" for another thread, each counter is read whole while the receiving thread goes on. */
+static void io_counters_get(struct avs_io_counters *out)
 {
-	struct sockaddr_un peer_addr;
-	socklen_t peer_addr_len;
-	int ret = 0;
-	ssize_t recv_num = 0;;
+	out->tx_msgs = __atomic_load_n(&io_counters.tx_msgs, __ATOMIC_RELAXED);
+	out->tx_batches = __atomic_load_n(&io_counters.tx_batches, __ATOMIC_RELAXED);
+	out->tx_max_batch = __atomic_load_n(&io_counters.tx_max_batch, __ATOMIC_RELAXED);
+	out->tx_retries = __atomic_load_n(&io_counters.tx_retries, __ATOMIC_RELAXED);
+	out->rx_msgs = __atomic_load_n(&io_counters.rx_msgs, __ATOMIC_RELAXED);
+	out->rx_batches = __atomic_load_n(&io_counters.rx_batches, __ATOMIC_RELAXED);
+	out->rx_max_batch = __atomic_load_n(&io_counters.rx_max_batch, __ATOMIC_RELAXED);
+	out->rx_events = __atomic_load_n(&io_counters.rx_events, __ATOMIC_RELAXED);
+	out->rx_events_dropped = __atomic_load_n(&io_counters.rx_events_dropped, __ATOMIC_RELAXED);
+	out->rx_truncated = __atomic_load_n(&io_counters.rx_truncated, __ATOMIC_RELAXED);
+	out->tx_queue_full = __atomic_load_n(&io_counters.tx_queue_full, __ATOMIC_RELAXED);
+	out->transport = __atomic_load_n(&io_counters.transport, __ATOMIC_RELAXED);
+	out->tx_bells = __atomic_load_n(&io_counters.tx_bells, __ATOMIC_RELAXED);
+	out->wire = __atomic_load_n(&io_counters.wire, __ATOMIC_RELAXED);
+}
 
-	for (;;)
+/* Receive the datagram at the head of the socket queue, "len" bytes longer than a slab, into memory of its length. */
+static void sock_recv_long(int fd, size_t len)
+{
+	ssize_t n;
+	char *buf;
+	
+	if (!(buf = heap_alloc(len)))
 	{
-		if ((ret = wait_on_socket()) == 0) {
-			printf("recv msg timeout\n");
-		}
-		else if (ret == -1)
-		{
-			printf("socket fd is not work\n");		
-		}
-		else
+		log_err("no memory for a message of %lu bytes from AVS, dropped\n", (unsigned long)len);
+		io_count(&io_counters.rx_truncated, 1);
+		recv(fd, recv_slabs, RECV_SLAB_SIZE, MSG_DONTWAIT);
+		return;
+	}
+	
+	if ((n = recv(fd, buf, len, MSG_DONTWAIT)) >= 0)
+	{
+		io_count(&io_counters.rx_batches, 1);
+		io_count(&io_counters.rx_msgs, 1);
+		stats_add_bytes(0, n);
+		
+		if (msg_recv_process(buf, n) != R_SUCCESS)
 		{
-			peer_addr_len = sizeof(struct sockaddr_un);
-			recv_num = recvfrom(sockfd, recv_buffer, RECV_BUFFER_SIZE, 0, (struct sockaddr *) &peer_addr, &peer_addr_len);
-			if (recv_num == -1) {
-				printf("Receive data failed\n");
-			}
-			else
-			{
-				recv_buffer[recv_num] = '\0';
-				if (msg_recv_process(recv_buffer) != R_SUCCESS)
-				{
-					printf("process responses from AVS failed\n");		
-				}
-			}
-				
+			log_err("process responses from AVS failed\n");		
 		}
 	}
 	
-	return NULL;
+	heap_free(buf);
 }
 
-/* General function of encapsulating JSON data. */
-static const char *general_json_enc(void *param, CMD_TYPE_STATE cmd_type)
+/* The AVS socket is readable: drain all the queued datagrams, MMSG_BATCH of them per recvmmsg().
+ * recvmmsg() cuts a datagram longer than a slab and it is lost, so the length of the one at the head is peeked first. */
+static void sock_readable(int fd, void *arg)
 {
-	const char *json_s = NULL;
+	struct mmsghdr msgs[MMSG_BATCH];
+	struct iovec iovs[MMSG_BATCH];
+	ssize_t len;
+	int i, n;
 	
-	switch (cmd_type)
+	(void)arg;
+	
+	for (;;)
 	{
-		case ST_AVS_SET_GLOBAL_PARAM:
-			{
-				struct avs_global_param *p = (struct avs_global_param *)param;
-				json_s = enc_json_set_global_param(p);
-			}
-			break;
-
-		case ST_AVS_ALLOC_PORT_NORMAL:
-			{
-				struct avs_alloc_port_normal_param *p = (struct avs_alloc_port_normal_param *)param;
-				json_s = enc_json_alloc_port_normal(p);
-			}
-			break;
-			
-		case ST_AVS_ALLOC_PORT_ICE:
+		if ((len = recv(fd, NULL, 0, MSG_PEEK | MSG_TRUNC | MSG_DONTWAIT)) > RECV_SLAB_SIZE)
+		{
+			sock_recv_long(fd, len);
+			continue;
+		}
+		
+		if (len < 0)
+		{
+			if (EINTR == errno)
 			{
-				struct avs_alloc_port_ice_param *p = (struct avs_alloc_port_ice_param *)param;
-				json_s = enc_json_alloc_port_ice(p);
+				continue;
 			}
-			break;
-			
-		case ST_AVS_DEALLOC_PORT:
+			if (EAGAIN != errno && EWOULDBLOCK != errno)
 			{
-				struct avs_dealloc_port_param  *p = (struct avs_dealloc_port_param *)param;
-				json_s = enc_json_del_port(p);
+				log_err("Receive data failed\n");
 			}
 			break;
-			
-		case ST_AVS_SET_PEERPORT_PARAM_NORMAL:
+		}
+		
+		memset(msgs, 0, sizeof(msgs));
+		
+		for (i = 0; i < MMSG_BATCH; i++)
+		{
+			iovs[i].iov_base = recv_slabs + i * RECV_SLAB_SIZE;
+			iovs[i].iov_len = RECV_SLAB_SIZE;
+			msgs[i].msg_hdr.msg_iov = &iovs[i];
+			msgs[i].msg_hdr.msg_iovlen = 1;
+		}
+		
+		if ((n = recvmmsg(fd, msgs, MMSG_BATCH, MSG_DONTWAIT | MSG_TRUNC, NULL)) < 0)
+		{
+			if (EINTR == errno)
 			{
-				struct avs_set_peerport_normal_param *p = (struct avs_set_peerport_normal_param *)param;
-				json_s = enc_json_set_peerport_normal(p);
+				continue;
 			}
-			break;
-			
-		case ST_AVS_SET_PEERPORT_PARAM_ICE:
+			if (EAGAIN != errno && EWOULDBLOCK != errno)
 			{
-				struct avs_set_peerport_ice_param *p = (struct avs_set_peerport_ice_param *)param;
-				json_s = enc_json_set_peerport_ice(p);
+				log_err("Receive data failed\n");
 			}
 			break;
+		}
+		
+		io_count(&io_counters.rx_batches, 1);
+		io_count(&io_counters.rx_msgs, n);
+		io_count_max(&io_counters.rx_max_batch, n);
+		
+		for (i = 0; i < n; i++)
+		{
+			stats_add_bytes(0, msgs[i].msg_len);
 			
-		case ST_AVS_SET_AUDIO_CODEC_PARAM:
+			/* With MSG_TRUNC msg_len is the real length of the datagram, the slab only holds its head.
+			 * Only one queued behind the peeked head, longer than a slab, is cut. */
+			if (msgs[i].msg_hdr.msg_flags & MSG_TRUNC)
 			{
-				struct avs_codec_audio_param *p = (struct avs_codec_audio_param *)param;
-				json_s = enc_json_set_audio_codec(p);
+				log_err("message of %u bytes from AVS was cut in a batch, dropped\n", msgs[i].msg_len);
+				io_count(&io_counters.rx_truncated, 1);
+				continue;
 			}
-			break;
 			
-		case ST_AVS_SET_VIDEO_CODEC_PARAM:
+			if (msg_recv_process(iovs[i].iov_base, msgs[i].msg_len) != R_SUCCESS)
 			{
-				struct avs_codec_video_param *p = (struct avs_codec_video_param *)param;
-				json_s = enc_json_set_video_codec(p);
+				log_err("process responses from AVS failed\n");		
 			}
+		}
+		
+		if (n < MMSG_BATCH)
+		{
 			break;
-			
-		default:
-			break;
+		}
 	}
-	
-	return json_s;
 }
 
-/* General function of decoding JSON data. */
-void *general_json_dec(char *msg)
+/* Someone woke up the receiving thread. */
+static void wakeup_readable(int fd, void *arg)
 {
-	json_t *root;
-	json_error_t error;
-	json_t *id;
+	uint64_t val;
 	
-	root = json_loads(msg, 0, &error);
-
-	if (!root)
-	{
-		printf("json load error: on line %d: %s\n", error.line, error.text);
-		msg_parse_result = MSG_PARSE_RESULT_FAIL;
-		return NULL;
-	}
+	(void)arg;
 	
-	if ((id = json_object_get(root, "id")))
+	if (read(fd, &val, sizeof(val)) < 0 && EAGAIN != errno)
 	{
-		if (!json_is_string(id))
-		{
-			printf("error: id is not a string\n");
-			msg_parse_result = MSG_PARSE_RESULT_FAIL;
-			return NULL;
-		}
-		printf("resp id: %s\n", json_string_value(id));
+		perror("read eventfd failed");
 	}
-	else
+	
+	/* The queued commands are flushed at the end of the loop. */
+}
+
+/* The earliest deadline of the pending commands has come. */
+static void timer_readable(int fd, void *arg)
+{
+	uint64_t val;
+	
+	(void)arg;
+	
+	if (read(fd, &val, sizeof(val)) < 0 && EAGAIN != errno)
 	{
-		printf("Maybe, It's a notification from AVS.....!");
-		msg_parse_result = MSG_PARSE_RESULT_FAIL;
-		return NULL;	
+		perror("read timerfd failed");
 	}
 	
-	switch (cmd_current_state)
-	{
-		case ST_AVS_IDLE:
-			/* do nothing. */
-			break;
-			
-		case ST_AVS_SET_GLOBAL_PARAM:
-		case ST_AVS_SET_PEERPORT_PARAM_NORMAL:
-		case ST_AVS_SET_PEERPORT_PARAM_ICE:
-			if (dec_json_common_resp(root, &g_data_storage_resp_common) != R_SUCCESS)
+	timer_deadline = 0;
+	
+	pending_expire();
+}
+
+/* socket Initialization */
+static FUNC_RETURN sock_init(void)
+{
+	struct sockaddr_un sock_addr;
+	
+	sockfd = socket(AF_UNIX, SOCK_DGRAM, 0);
+	
+	if (sockfd < 0)
+	{
+		log_err("Open a socket failed\n");
+		return R_FAIL;
+	}
+	
+	unlink(AVS_CLIENT_SOCKET_PATH);
+	
+	memset(&sock_addr, 0, sizeof(struct sockaddr_un));
+	
+	sock_addr.sun_family = AF_UNIX;
+	STR_COPY(sock_addr.sun_path, AVS_CLIENT_SOCKET_PATH);
+	
+	if (bind(sockfd, (const struct sockaddr *) &sock_addr, sizeof(struct sockaddr_un)) == -1)
+	{
+		perror("bind socket failed");
+		close(sockfd);
+		sockfd = -1;
+		return R_FAIL;
+	}
+	
+	return R_SUCCESS;
+}
+
+/* Send a capability command to an AVS instance on the socket, with file descriptors attached if "nfds", and wait for the answer.
+ * AVS accepts by answering code 0 and echoing "key":"val" in an object named after the command,
+ * e.g. {"hello":{"wire":"tlv"},"error":{"code":0,"message":"OK"},"id":"..."}. An AVS which does not know the command does not.
+ * Runs before the receiving thread starts, messages of other kinds received meanwhile are processed as usual.
+ * Return 1 if AVS accepted.
+ */
+static int conn_handshake(struct avs_instance *inst, const char *method, const char *params, const int *fds, int nfds, const char *key, const char *val)
+{
+	char msg[256], id[MAX_UNIQUE_ID], resp_id[MAX_UNIQUE_ID], echo[32];
+	struct pollfd pfd;
+	struct json_doc doc;
+	struct json_error error;
+	struct resp_common_info resp;
+	uint64_t deadline;
+	int len, tok, obj, wait, accepted = 0, answered = 0;
+	
+	general_gen_comm_id(id);
+	len = snprintf(msg, sizeof(msg), "{\"%s\":{%s},\"id\":\"%s\"}", method, params, id);
+	
+	if ((nfds ? shm_send_fds(sockfd, &inst->addr, msg, len, fds, nfds)
+		: sendto(sockfd, msg, len, 0, (struct sockaddr *)&inst->addr, sizeof(inst->addr))) < 0)
+	{
+		log_err("send %s to AVS %s failed: %s\n", method, inst->addr.sun_path, strerror(errno));
+		return 0;
+	}
+	log_dbg("sent cmd is %s\n", msg);
+	
+	pfd.fd = sockfd;
+	pfd.events = POLLIN;
+	deadline = wheel_now_ms() + HANDSHAKE_TIMEOUT;
+	
+	while (!answered && (wait = (int)(deadline - wheel_now_ms())) > 0)
+	{
+		if (poll(&pfd, 1, wait) <= 0 || (len = recv(sockfd, recv_slabs, RECV_SLAB_SIZE, MSG_DONTWAIT)) < 0)
+		{
+			continue;
+		}
+		
+		if (json_doc_parse(&doc, recv_slabs, len, &error) == 0 && (tok = json_doc_get(&doc, 0, "id")) >= 0
+			&& JSON_TOK_STRING == doc.toks[tok].type && json_tok_copy(&doc, tok, resp_id, sizeof(resp_id)) && !strcmp(resp_id, id))
+		{
+			answered = 1;
+			accepted = (dec_json_common_resp(&doc, &resp) == R_SUCCESS && 0 == resp.code
+				&& (obj = json_doc_get(&doc, 0, method)) >= 0 && (tok = json_doc_get(&doc, obj, key)) >= 0
+				&& JSON_TOK_STRING == doc.toks[tok].type && json_tok_copy(&doc, tok, echo, sizeof(echo))
+				&& !strcmp(echo, val));
+			continue;
+		}
+		
+		msg_recv_process(recv_slabs, len);
+	}
+	
+	return accepted;
+}
+
+/* Ask AVS for binary frames with a "hello" command. JSON stays the encoding unless AVS echoes {"hello":{"wire":"tlv"}}. */
+static void wire_connect(struct avs_instance *inst)
+{
+	char params[64];
+	
+	snprintf(params, sizeof(params), "\"wire\":\"tlv\",\"version\":\"%d\"", TLV_VERSION);
+	
+	if (!conn_handshake(inst, TLV_HELLO_METHOD, params, NULL, 0, "wire", "tlv"))
+	{
+		log_warn("AVS %s does not take binary frames, using JSON.\n", inst->addr.sun_path);
+		return;
+	}
+	
+	inst->wire_tlv = 1;
+	log_info("commands go to AVS %s as binary frames.\n", inst->addr.sun_path);
+}
+
+/* Offer the shared memory link to AVS with a "shmAttach" command carrying its file descriptors.
+ * AVS takes the link by echoing the version it attached, {"shmAttach":{"version":"1"}}. Otherwise the socket stays the transport.
+ */
+static void shm_connect(struct avs_instance *inst)
+{
+	char params[64], version[12];
+	
+	if (shm_link_create(&inst->shm) != 0)
+	{
+		log_warn("create shared memory link failed, using the socket.\n");
+		return;
+	}
+	
+	snprintf(params, sizeof(params), "\"version\":\"%d\",\"ringSize\":\"%d\"", SHM_VERSION, SHM_RING_SIZE);
+	snprintf(version, sizeof(version), "%d", SHM_VERSION);
+	
+	if (!conn_handshake(inst, SHM_ATTACH_METHOD, params, inst->shm.fds, SHM_FD_MAX, "version", version))
+	{
+		log_warn("AVS %s did not take the shared memory link, using the socket.\n", inst->addr.sun_path);
+		shm_link_close(&inst->shm);
+		return;
+	}
+	
+	if (reactor_add(inst->shm.rx_bell, wakeup_readable, NULL) != R_SUCCESS)
+	{
+		shm_link_close(&inst->shm);
+		return;
+	}
+	
+	inst->shm_active = 1;
+	log_info("commands go to AVS %s through shared memory.\n", inst->addr.sun_path);
+}
+
+/* sendmmsg() on the shared memory link of an instance: the same return value, and EAGAIN if the ring is full. AVS is woken up once per batch if it sleeps. */
+static int shm_sendmmsg(struct avs_instance *inst, struct mmsghdr *msgs, unsigned int n)
+{
+	unsigned int i;
+	
+	for (i = 0; i < n; i++)
+	{
+		if (shm_send(&inst->shm, msgs[i].msg_hdr.msg_iov->iov_base, msgs[i].msg_hdr.msg_iov->iov_len) != 0)
+		{
+			break;
+		}
+		msgs[i].msg_len = msgs[i].msg_hdr.msg_iov->iov_len;
+	}
+	
+	if (!i)
+	{
+		errno = EAGAIN;
+		return -1;
+	}
+	
+	if (shm_ring_bell(&inst->shm))
+	{
+		io_count(&io_counters.tx_bells, 1);
+	}
+	
+	return (int)i;
+}
+
+/* Process the messages an instance published in its shared memory ring, MMSG_BATCH of them counted as one batch like recvmmsg().
+ * They are decoded where they are in the ring, which is given back to AVS message by message. */
+static void shm_drain(struct avs_instance *inst)
+{
+	const char *msg;
+	int i, len;
+	
+	do
+	{
+		for (i = 0; i < MMSG_BATCH && (len = shm_recv_ref(&inst->shm, &msg)) >= 0; i++)
+		{
+			stats_add_bytes(0, len);
+			if (msg_recv_process(msg, len) != R_SUCCESS)
 			{
-				printf("decode json from AVS failed (\"common\" resp).\n");
-				msg_parse_result = MSG_PARSE_RESULT_FAIL;
+				log_err("process responses from AVS failed\n");		
 			}
-			strncpy(g_data_storage_resp_common.comm_id, json_string_value(id), sizeof(g_data_storage_resp_common.comm_id) - 1);
+			shm_recv_release(&inst->shm);
+		}
+		
+		if (!i)
+		{
 			break;
+		}
+		
+		io_count(&io_counters.rx_batches, 1);
+		io_count(&io_counters.rx_msgs, i);
+		io_count_max(&io_counters.rx_max_batch, i);
+	} while (MMSG_BATCH == i);
+}
+
+/* Set the addresses of the AVS instances, the default socket path if none is configured. */
+static FUNC_RETURN instance_init(const struct avs_conn_config *config)
+{
+	const char *path;
+	unsigned int i;
+	
+	num_instances = (config && config->num_instances) ? config->num_instances : 1;
+	
+	if (num_instances > AVS_MAX_INSTANCES)
+	{
+		log_err("too many AVS instances: %u.\n", num_instances);
+		num_instances = 1;
+		return R_FAIL;
+	}
+	
+	memset(instances, 0, sizeof(instances));
+	
+	for (i = 0; i < num_instances; i++)
+	{
+		path = (config && config->num_instances) ? config->instance_paths[i] : AVS_SERVER_SOCKET_PATH;
+		
+		if (!path || !path[0] || strlen(path) >= sizeof(instances[i].addr.sun_path))
+		{
+			log_err("invalid socket path of AVS instance %u.\n", i);
+			return R_FAIL;
+		}
+		
+		instances[i].addr.sun_family = AF_UNIX;
+		STR_COPY(instances[i].addr.sun_path, path);
+	}
+	
+	return R_SUCCESS;
+}
+
+/* Route of the commands to an instance: the index of its shared memory ring, or -1 for the socket all the other instances share. */
+static int instance_route(unsigned int inst)
+{
+	return instances[inst].shm_active ? (int)inst : -1;
+}
+
+/* The state index changed the ports of a conference, they count in the load of its instance. */
+static void conf_ports_update(const char *conf_id)
+{
+	unsigned int ports = 0;
+	
+	avs_query_conference(conf_id, &ports);
+	shard_set_ports(conf_id, ports);
+}
+
+/* Take the commands published in the submission queue into the pending table, as long as wait slots are free.
+ * The others stay queued until some commands complete.
+ */
+static void cmd_register(void)
+{
+	struct cmd_submission *sub;
+	struct pending_cmd *cmd;
+	
+	while (pending_used < MAX_PENDING_CMDS && (sub = mpsc_peek(&sq, sq_registered)))
+	{
+		sq_registered++;
+		sub->cmd = NULL;
+		
+		if (ST_AVS_IDLE == sub->cmd_type)
+		{
+			continue;
+		}
+		
+		if (cmd_suppress(sub))
+		{
+			if (sub->placed)
+			{
+				shard_release(sub->target.conf_id);
+			}
+			continue;
+		}
+		
+		/* The caller has already returned SUCCESS, so a refused command is reported by "cb". */
+		if (!(cmd = pending_register(sub->comm_id, sub->cmd_type)))
+		{
+			if (sub->placed)
+			{
+				shard_release(sub->target.conf_id);
+			}
+			if (sub->cb)
+			{
+				sub->cb(ERROR, sub->resp, sub->user_data);
+			}
+			continue;
+		}
+		
+		cmd->inst = sub->inst;
+		cmd->placed = sub->placed;
+		cmd->resp = sub->resp;
+		cmd->cb = sub->cb;
+		cmd->user_data = sub->user_data;
+		cmd->target = sub->target;
+		cmd_coalesce(cmd);
+		pending_key_add(cmd);
+		
+		sub->cmd = cmd;
+		sub->seq = cmd->seq;
+	}
+}
+
+/* Whether the receiving thread has a submitted command it can take at once. */
+static int cmd_ready(void)
+{
+	return pending_used < MAX_PENDING_CMDS && mpsc_peek(&sq, sq_registered) != NULL;
+}
+
+/* A queued command could not be sent: fail it if it is still waiting for AVS. */
+static void cmd_fail(struct pending_cmd *cmd, unsigned int seq)
+{
+	if (!cmd->waiting || cmd->seq != seq)
+	{
+		return;
+	}
+	
+	pending_unlink(cmd);
+	pending_complete(cmd, ERROR);
+}
+
+/* Send the submitted commands to AVS, MMSG_BATCH of them per sendmmsg(). Only the receiving thread takes commands out of the queue,
+ * a cell goes back to the callers once its message has been sent or dropped. A batch is a run of commands of the same route:
+ * commands to instances on the socket go together, each datagram has its own address, and a shared memory ring takes its own.
+ */
+static void cmd_flush(void)
+{
+	struct mmsghdr msgs[MMSG_BATCH];
+	struct iovec iovs[MMSG_BATCH];
+	unsigned int pos[MMSG_BATCH];
+	struct cmd_submission *sub;
+	struct avs_instance *inst;
+	unsigned int i, end;
+	int n, sent, route = 0;
+	uint64_t now;
+	size_t bytes;
+	
+	tx_backlog = 0;
+	
+	for (;;)
+	{
+		/* Completion callbacks may have submitted more commands or freed wait slots. */
+		cmd_register();
+		
+		/* Collect the live messages, drop the ones whose command has completed (e.g. timeout). */
+		for (n = 0, end = sq.dequeue_pos; end != sq_registered && n < MMSG_BATCH; end++)
+		{
+			sub = mpsc_peek(&sq, end);
 			
-		case ST_AVS_ALLOC_PORT_NORMAL:
-			if (dec_json_alloc_port_normal_resp(root, &g_data_storage_resp_alloc_port_normal) != R_SUCCESS)
+			if (!sub->cmd || !sub->cmd->waiting || sub->cmd->seq != sub->seq)
 			{
-				printf("decode json from AVS failed (\"alloc_port_normal\").\n");
-				msg_parse_result = MSG_PARSE_RESULT_FAIL;
+				sub->cmd = NULL;
+				continue;
 			}
-			strncpy(g_data_storage_resp_alloc_port_normal.comm_id, json_string_value(id), sizeof(g_data_storage_resp_alloc_port_normal.comm_id) - 1);
-			break;
 			
-		case ST_AVS_ALLOC_PORT_ICE:
-			if (dec_json_alloc_port_ice_resp(root, &g_data_storage_resp_alloc_port_ice) != R_SUCCESS)
+			if (!n)
 			{
-				printf("decode json from AVS failed (\"alloc_port_ice\").\n");
-				msg_parse_result = MSG_PARSE_RESULT_FAIL;
+				route = instance_route(sub->inst);
+			}
+			else if (instance_route(sub->inst) != route)
+			{
+				break;
 			}
-			strncpy(g_data_storage_resp_alloc_port_ice.comm_id, json_string_value(id), sizeof(g_data_storage_resp_alloc_port_ice.comm_id) - 1);
-			break;
 			
-		default:
+			pos[n++] = end;
+		}
+		
+		if (!n)
+		{
+			mpsc_release(&sq, end);
+			
+			if (end == sq_registered && !cmd_ready())
+			{
+				break;
+			}
+			continue;
+		}
+		
+		memset(msgs, 0, n * sizeof(msgs[0]));
+		
+		for (i = 0; i < (unsigned int)n; i++)
+		{
+			sub = mpsc_peek(&sq, pos[i]);
+			inst = &instances[sub->inst];
+			if (inst->wire_tlv)
+			{
+				log_dbg("sent frame of cmd %s: %zu bytes\n", sub->comm_id, sub->len);
+			}
+			else
+			{
+				log_dbg("sent cmd is %s\n", sub->json_s);
+			}
+			iovs[i].iov_base = sub->json_s;
+			iovs[i].iov_len = sub->len;
+			msgs[i].msg_hdr.msg_name = &inst->addr;
+			msgs[i].msg_hdr.msg_namelen = sizeof(inst->addr);
+			msgs[i].msg_hdr.msg_iov = &iovs[i];
+			msgs[i].msg_hdr.msg_iovlen = 1;
+		}
+		
+		sent = (route >= 0) ? shm_sendmmsg(&instances[route], msgs, n) : sendmmsg(sockfd, msgs, n, MSG_DONTWAIT);
+		
+		if (sent < 0)
+		{
+			if (EINTR == errno)
+			{
+				continue;
+			}
+			
+			if (EAGAIN == errno || EWOULDBLOCK == errno)
+			{
+				/* AVS is busy, keep the messages queued. */
+				io_count(&io_counters.tx_retries, 1);
+				tx_backlog = 1;
+				break;
+			}
+			
+			/* The first message failed, e.g. AVS is not running. */
+			log_err("send commands to AVS failed: %s\n", strerror(errno));
+			sub = mpsc_peek(&sq, pos[0]);
+			cmd_fail(sub->cmd, sub->seq);
+			sent = 1;
+		}
+		else
+		{
+			io_count(&io_counters.tx_batches, 1);
+			io_count(&io_counters.tx_msgs, sent);
+			io_count_max(&io_counters.tx_max_batch, sent);
+			
+			/* One timestamp for the whole batch, the messages left together. */
+			now = stats_now_us();
+			for (i = 0, bytes = 0; i < (unsigned int)sent; i++)
+			{
+				sub = mpsc_peek(&sq, pos[i]);
+				sub->cmd->sent_us = now;
+				instances[sub->inst].tx_msgs++;
+				bytes += msgs[i].msg_len;
+			}
+			stats_add_bytes(bytes, 0);
+		}
+		
+		for (i = 0; i < (unsigned int)sent; i++)
+		{
+			((struct cmd_submission *)mpsc_peek(&sq, pos[i]))->cmd = NULL;
+		}
+		mpsc_release(&sq, (sent < n) ? pos[sent] : end);
+	}
+}
+
+/* Processing messages received from AVS.
+ * 1. Parse JSON, or a binary frame, and store into the storage of the command waiting for it.
+ * 2. Wake up the thread which send the command.
+ */
+static FUNC_RETURN msg_recv_process(const char *msg, size_t len)
+{
+	if (len && TLV_MAGIC == (unsigned char)msg[0])
+	{
+		log_dbg("recv frame: %zu bytes\n", len);
+		general_tlv_dec(msg, len);
+	}
+	else
+	{
+		log_dbg("recv msg: %.*s\n", (int)len, msg);
+		general_json_dec(msg, len);
+	}
+	
+	return R_SUCCESS;
+}
+
+/* Completion callback of the synchronous "avs_" APIs. */
+static void sync_action_cb(AVS_CMD_RESULT result, void *resp, void *user_data)
+{
+	(void)resp;
+	
+	wakeup_intruder((struct sync_waiter *)user_data, result);
+}
+
+/* Send single to wake up the thread which sent the command to AVS. */
+static void *wakeup_intruder(struct sync_waiter *waiter, AVS_CMD_RESULT result)
+{
+	pthread_mutex_lock(&waiter->mutex);
+	
+	waiter->result = result;
+	waiter->done = 1;
+	pthread_cond_signal(&waiter->cond);
+	
+	pthread_mutex_unlock(&waiter->mutex);
+	
+	return NULL;
+}
+
+/* A blocking API called from the receiving thread, i.e. from a completion callback, would wait for itself forever. */
+static int sync_refused(void)
+{
+	if (on_recv_thread)
+	{
+		log_err("blocking API called from a completion callback, use the \"_async\" one.\n");
+		return 1;
+	}
+	
+	return 0;
+}
+
+/* Using "pthread_cond_wait" to wait for the response of the AVS. The receiving thread always completes the command, by a response or a timeout. */
+static FUNC_RETURN wait_for_avs(struct sync_waiter *waiter)
+{
+	int ret = 0;
+
+	pthread_mutex_lock(&waiter->mutex);
+	
+	while (!waiter->done)
+	{
+		if ((ret = pthread_cond_wait(&waiter->cond, &waiter->mutex)) != 0)
+		{
+			log_err("pthread_cond_wait error, return value: %d\n", ret);
 			break;
+		}
+	}
+	
+	pthread_mutex_unlock(&waiter->mutex);
+	
+	return waiter->done ? R_SUCCESS : R_FAIL;
+}
+
+/* Main loop to receive and process messages from AVS. It sleeps in epoll_wait() until a watched file descriptor is readable. */
+static void *recv_task(void *data)
+{
+	struct epoll_event events[REACTOR_MAX_EVENTS];
+	struct reactor_source *src;
+	int i, n, timeout, ready;
+
+	(void)data;
+	
+	on_recv_thread = 1;
+
+	while (reactor_running)
+	{
+		/* Announce the sleep before the last look at the submission queue, a command published after it sees "io_sleeping" and wakes the thread up. */
+		__atomic_store_n(&io_sleeping, 1, __ATOMIC_SEQ_CST);
+		__atomic_thread_fence(__ATOMIC_SEQ_CST);
+		
+		/* Every shared memory ring is told before looking at it, so a message published after the look rings the doorbell. */
+		ready = cmd_ready();
+		for (i = 0; i < (int)num_instances; i++)
+		{
+			if (instances[i].shm_active && shm_prepare_sleep(&instances[i].shm))
+			{
+				ready = 1;
+			}
+		}
+		
+		/* Sleep until an event comes. If AVS was too busy to take all the commands, try again a bit later. */
+		timeout = ready ? 0 : (tx_backlog ? TX_RETRY_INTERVAL : -1);
+		n = epoll_wait(epfd, events, REACTOR_MAX_EVENTS, timeout);
+		
+		__atomic_store_n(&io_sleeping, 0, __ATOMIC_RELAXED);
+		for (i = 0; i < (int)num_instances; i++)
+		{
+			if (instances[i].shm_active)
+			{
+				shm_wake(&instances[i].shm);
+			}
+		}
+		
+		if (n < 0)
+		{
+			if (EINTR != errno)
+			{
+				log_err("epoll_wait failed: %s\n", strerror(errno));
+			}
+			continue;
+		}
+		
+		for (i = 0; i < n; i++)
+		{
+			src = (struct reactor_source *)events[i].data.ptr;
+			src->handler(src->fd, src->arg);
+		}
+		
+		/* AVS does not ring the doorbell while this thread is awake, look at the rings every time. */
+		for (i = 0; i < (int)num_instances; i++)
+		{
+			if (instances[i].shm_active)
+			{
+				shm_drain(&instances[i]);
+			}
+		}
+		
+		cmd_flush();
+		batch_resume_all();
+	}
+	
+	return NULL;
+}
+
+/* General function of encapsulating JSON data into "buf". Return the length of the message, -1 on failure. */
+static int general_json_enc(void *param, CMD_TYPE_STATE cmd_type, char *buf, size_t size)
+{
+	int len = -1;
+	
+	switch (cmd_type)
+	{
+		case ST_AVS_SET_GLOBAL_PARAM:
+			{
+				struct avs_global_param *p = (struct avs_global_param *)param;
+				len = enc_json_set_global_param(buf, size, p);
+			}
+			break;
+
+		case ST_AVS_ALLOC_PORT_NORMAL:
+			{
+				struct avs_alloc_port_normal_param *p = (struct avs_alloc_port_normal_param *)param;
+				len = enc_json_alloc_port_normal(buf, size, p);
+			}
+			break;
+			
+		case ST_AVS_ALLOC_PORT_ICE:
+			{
+				struct avs_alloc_port_ice_param *p = (struct avs_alloc_port_ice_param *)param;
+				len = enc_json_alloc_port_ice(buf, size, p);
+			}
+			break;
+			
+		case ST_AVS_DEALLOC_PORT:
+			{
+				struct avs_dealloc_port_param  *p = (struct avs_dealloc_port_param *)param;
+				len = enc_json_del_port(buf, size, p);
+			}
+			break;
+			
+		case ST_AVS_RUNCTRL_CHAN:
+			{
+				struct avs_runctrl_chan_param *p = (struct avs_runctrl_chan_param *)param;
+				len = enc_json_runctrl_chan(buf, size, p);
+			}
+			break;
+			
+		case ST_AVS_SET_PEERPORT_PARAM_NORMAL:
+			{
+				struct avs_set_peerport_normal_param *p = (struct avs_set_peerport_normal_param *)param;
+				len = enc_json_set_peerport_normal(buf, size, p);
+			}
+			break;
+			
+		case ST_AVS_SET_PEERPORT_PARAM_ICE:
+			{
+				struct avs_set_peerport_ice_param *p = (struct avs_set_peerport_ice_param *)param;
+				len = enc_json_set_peerport_ice(buf, size, p);
+			}
+			break;
+			
+		case ST_AVS_SET_AUDIO_CODEC_PARAM:
+			{
+				struct avs_codec_audio_param *p = (struct avs_codec_audio_param *)param;
+				len = enc_json_set_audio_codec(buf, size, p);
+			}
+			break;
+			
+		case ST_AVS_SET_VIDEO_CODEC_PARAM:
+			{
+				struct avs_codec_video_param *p = (struct avs_codec_video_param *)param;
+				len = enc_json_set_video_codec(buf, size, p);
+			}
+			break;
+			
+		default:
+			break;
+	}
+	
+	if (len < 0)
+	{
+		log_err("encode command %d failed!\n", cmd_type);
+	}
+	
+	return len;
+}
+
+/* General function of encapsulating a binary frame into "buf", once AVS accepted them. Return the length of the frame, -1 on failure. */
+static int general_tlv_enc(void *param, CMD_TYPE_STATE cmd_type, char *buf, size_t size)
+{
+	int len = -1;
+	
+	switch (cmd_type)
+	{
+		case ST_AVS_SET_GLOBAL_PARAM:
+			len = enc_tlv_set_global_param(buf, size, (struct avs_global_param *)param);
+			break;
+			
+		case ST_AVS_ALLOC_PORT_NORMAL:
+			len = enc_tlv_alloc_port_normal(buf, size, (struct avs_alloc_port_normal_param *)param);
+			break;
+			
+		case ST_AVS_ALLOC_PORT_ICE:
+			len = enc_tlv_alloc_port_ice(buf, size, (struct avs_alloc_port_ice_param *)param);
+			break;
+			
+		case ST_AVS_DEALLOC_PORT:
+			len = enc_tlv_del_port(buf, size, (struct avs_dealloc_port_param *)param);
+			break;
+			
+		case ST_AVS_RUNCTRL_CHAN:
+			len = enc_tlv_runctrl_chan(buf, size, (struct avs_runctrl_chan_param *)param);
+			break;
+			
+		case ST_AVS_PLAYSOUND:
+			len = enc_tlv_playsound_chan(buf, size, (struct avs_playsound_chan_param *)param);
+			break;
+			
+		case ST_AVS_SET_PEERPORT_PARAM_NORMAL:
+			len = enc_tlv_set_peerport_normal(buf, size, (struct avs_set_peerport_normal_param *)param);
+			break;
+			
+		case ST_AVS_SET_PEERPORT_PARAM_ICE:
+			len = enc_tlv_set_peerport_ice(buf, size, (struct avs_set_peerport_ice_param *)param);
+			break;
+			
+		case ST_AVS_SET_AUDIO_CODEC_PARAM:
+			len = enc_tlv_set_audio_codec(buf, size, (struct avs_codec_audio_param *)param);
+			break;
+			
+		case ST_AVS_SET_VIDEO_CODEC_PARAM:
+			len = enc_tlv_set_video_codec(buf, size, (struct avs_codec_video_param *)param);
+			break;
+			
+		default:
+			break;
+	}
+	
+	if (len < 0)
+	{
+		log_err("encode command %d failed!\n", cmd_type);
+	}
+	
+	return len;
+}
+
+/* General function of decoding JSON data. */
+static void *general_json_dec(const char *msg, size_t len)
+{
+	struct json_doc doc;
+	struct json_error error;
+	char id[MAX_UNIQUE_ID];
+	int tok;
+	struct pending_cmd *cmd;
+	
+	if (json_doc_parse(&doc, msg, len, &error) != 0)
+	{
+		log_err("json load error: on line %d: %s\n", error.line, error.text);
+		stats_count_parse_failure();
+		return NULL;
+	}
+	
+	if ((tok = json_doc_get(&doc, 0, "id")) >= 0)
+	{
+		if (JSON_TOK_STRING != doc.toks[tok].type)
+		{
+			log_err("error: id is not a string\n");
+			stats_count_parse_failure();
+			return NULL;
+		}
+		log_dbg("resp id: %.*s\n", doc.toks[tok].end - doc.toks[tok].start, msg + doc.toks[tok].start);
+		json_tok_copy(&doc, tok, id, sizeof(id));
+	}
+	else
+	{
+		/* A notification from AVS, no command is waiting for it. */
+		if (event_post(&doc) == EVENT_POST_QUEUED)
+		{
+			io_count(&io_counters.rx_events, 1);
+		}
+		else
+		{
+			io_count(&io_counters.rx_events_dropped, 1);
+		}
+		return NULL;	
+	}
+	
+	if (!(cmd = resp_take_cmd(id)))
+	{
+		return NULL;
+	}
+	
+	switch (cmd->cmd_type)
+	{
+		case ST_AVS_IDLE:
+			/* do nothing. */
+			break;
+			
+		case ST_AVS_SET_GLOBAL_PARAM:
+		case ST_AVS_DEALLOC_PORT:
+		case ST_AVS_SET_PEERPORT_PARAM_NORMAL:
+		case ST_AVS_SET_PEERPORT_PARAM_ICE:
+		case ST_AVS_SET_AUDIO_CODEC_PARAM:
+		case ST_AVS_SET_VIDEO_CODEC_PARAM:
+		case ST_AVS_RUNCTRL_CHAN:
+		case ST_AVS_PLAYSOUND:
+			if (dec_json_common_resp(&doc, &cmd->data.common) != R_SUCCESS)
+			{
+				log_err("decode json from AVS failed (\"common\" resp).\n");
+				cmd->parse_result = MSG_PARSE_RESULT_FAIL;
+			}
+			STR_COPY(cmd->data.common.comm_id, id);
+			break;
+			
+		case ST_AVS_ALLOC_PORT_NORMAL:
+			if (dec_json_alloc_port_normal_resp(&doc, &cmd->data.alloc_port_normal) != R_SUCCESS)
+			{
+				log_err("decode json from AVS failed (\"alloc_port_normal\").\n");
+				cmd->parse_result = MSG_PARSE_RESULT_FAIL;
+			}
+			STR_COPY(cmd->data.alloc_port_normal.comm_id, id);
+			break;
+			
+		case ST_AVS_ALLOC_PORT_ICE:
+			if (dec_json_alloc_port_ice_resp(&doc, &cmd->data.alloc_port_ice) != R_SUCCESS)
+			{
+				log_err("decode json from AVS failed (\"alloc_port_ice\").\n");
+				cmd->parse_result = MSG_PARSE_RESULT_FAIL;
+			}
+			STR_COPY(cmd->data.alloc_port_ice.comm_id, id);
+			break;
+			
+		default:
+			break;
+	}
+	
+	resp_done(cmd);
+	
+	return NULL;
+
+}
+
+/* Take the command waiting for the response of "id" out of the pending table. NULL if none is waiting. */
+static struct pending_cmd *resp_take_cmd(const char *id)
+{
+	struct pending_cmd *cmd;
+	
+	if (!(cmd = pending_lookup(id)))
+	{
+		log_warn("no command is waiting for id %s, drop it.\n", id);
+		return NULL;
+	}
+	
+	pending_unlink(cmd);
+	instances[cmd->inst].responses++;
+	
+	if (cmd->sent_us)
+	{
+		stats_record_latency(cmd->cmd_type, stats_now_us() - cmd->sent_us);
+	}
+	
+	return cmd;
+}
+
+/* The response of a command taken by resp_take_cmd() has been decoded into its storage, complete it. */
+static void resp_done(struct pending_cmd *cmd)
+{
+	if (MSG_PARSE_RESULT_FAIL == cmd->parse_result)
+	{
+		stats_count_parse_failure();
+	}
+	
+	pending_complete(cmd, SUCCESS);
+}
+
+/* Copy the fields of a binary response shared by every command. Fails like the JSON decoder if the code is missing. */
+static FUNC_RETURN dec_tlv_common_resp(const struct tlv_resp *tr, struct resp_common_info *resp)
+{
+	if (!TLV_HAS(tr, TLV_TAG_CODE))
+	{
+		log_err("decode error code failed\n");
+		return R_FAIL;
+	}
+	
+	resp->code = tr->code;
+	STR_COPY(resp->message, tr->message);
+	
+	return R_SUCCESS;
+}
+
+/* General function of decoding a binary response frame. AVS sends notifications as JSON only. */
+static void *general_tlv_dec(const char *msg, size_t len)
+{
+	static struct tlv_resp tr;	/* Only the receiving thread decodes. */
+	struct pending_cmd *cmd;
+	
+	if (dec_tlv_resp(msg, len, &tr) != 0 || !TLV_HAS(&tr, TLV_TAG_ID))
+	{
+		log_err("malformed frame from AVS, drop it.\n");
+		stats_count_parse_failure();
+		return NULL;
+	}
+	
+	log_dbg("resp id: %s\n", tr.id);
+	
+	if (!(cmd = resp_take_cmd(tr.id)))
+	{
+		return NULL;
+	}
+	
+	switch (cmd->cmd_type)
+	{
+		case ST_AVS_SET_GLOBAL_PARAM:
+		case ST_AVS_DEALLOC_PORT:
+		case ST_AVS_SET_PEERPORT_PARAM_NORMAL:
+		case ST_AVS_SET_PEERPORT_PARAM_ICE:
+		case ST_AVS_SET_AUDIO_CODEC_PARAM:
+		case ST_AVS_SET_VIDEO_CODEC_PARAM:
+		case ST_AVS_RUNCTRL_CHAN:
+		case ST_AVS_PLAYSOUND:
+			if (dec_tlv_common_resp(&tr, &cmd->data.common) != R_SUCCESS)
+			{
+				cmd->parse_result = MSG_PARSE_RESULT_FAIL;
+			}
+			STR_COPY(cmd->data.common.comm_id, tr.id);
+			break;
+			
+		case ST_AVS_ALLOC_PORT_NORMAL:
+			{
+				struct resp_alloc_port_normal_info *r = &cmd->data.alloc_port_normal;
+				
+				if (dec_tlv_common_resp(&tr, &r->common_resp) != R_SUCCESS || !TLV_HAS(&tr, TLV_TAG_PORT_ID))
+				{
+					log_err("decode frame from AVS failed (\"alloc_port_normal\").\n");
+					cmd->parse_result = MSG_PARSE_RESULT_FAIL;
+				}
+				STR_COPY(r->port_id, tr.port_id);
+				STR_COPY(r->fingerprint, tr.fingerprint);
+				r->rtp_port = tr.rtp_port;
+				r->rtcp_port = tr.rtcp_port;
+				STR_COPY(r->comm_id, tr.id);
+			}
+			break;
+			
+		case ST_AVS_ALLOC_PORT_ICE:
+			{
+				struct resp_alloc_port_ice_info *r = &cmd->data.alloc_port_ice;
+				
+				if (dec_tlv_common_resp(&tr, &r->common_resp) != R_SUCCESS || !TLV_HAS(&tr, TLV_TAG_PORT_ID))
+				{
+					log_err("decode frame from AVS failed (\"alloc_port_ice\").\n");
+					cmd->parse_result = MSG_PARSE_RESULT_FAIL;
+				}
+				STR_COPY(r->port_id, tr.port_id);
+				STR_COPY(r->fingerprint, tr.fingerprint);
+				STR_COPY(r->ice_ufrag, tr.ice_ufrag);
+				STR_COPY(r->ice_pwd, tr.ice_pwd);
+				if (TLV_HAS(&tr, TLV_TAG_CANDIDATE))
+				{
+					size_t off = TLV_HDR_LEN;
+					unsigned int tag, vlen, num = 0;
+					const char *val;
+					
+					/* dec_tlv_resp() keeps the first candidate only, count then take all their records. */
+					while (tlv_next(msg, len, &off, &tag, &val, &vlen) > 0)
+					{
+						num += (TLV_TAG_CANDIDATE == tag);
+					}
+					candidates_reserve(r, num);
+					
+					off = TLV_HDR_LEN;
+					while (tlv_next(msg, len, &off, &tag, &val, &vlen) > 0)
+					{
+						if (TLV_TAG_CANDIDATE == tag)
+						{
+							candidate_add(r, val, vlen);
+						}
+					}
+				}
+				STR_COPY(r->comm_id, tr.id);
+			}
+			break;
+			
+		default:
+			break;
+	}
+	
+	resp_done(cmd);
+	
+	return NULL;
+}
+
+/* General function of backfilling response data to the caller */
+static void *general_fill_resp(struct pending_cmd *cmd, void *resp)
+{
+	switch (cmd->cmd_type)
+	{
+		case ST_AVS_SET_GLOBAL_PARAM:
+		case ST_AVS_DEALLOC_PORT:
+		case ST_AVS_SET_PEERPORT_PARAM_NORMAL:
+		case ST_AVS_SET_PEERPORT_PARAM_ICE:
+		case ST_AVS_SET_AUDIO_CODEC_PARAM:
+		case ST_AVS_SET_VIDEO_CODEC_PARAM:
+		case ST_AVS_RUNCTRL_CHAN:
+		case ST_AVS_PLAYSOUND:
+			{
+				struct avs_common_resp_info *r = (struct avs_common_resp_info *)resp;
+				fill_common_resp(&cmd->data.common, r);	/* Fill the message returned from the AVS to the command requester. */
+			}
+			break;
+		
+		case ST_AVS_ALLOC_PORT_NORMAL:
+			{
+				struct avs_alloc_port_normal_resp_info *r = (struct avs_alloc_port_normal_resp_info *)resp;
+				fill_alloc_port_normal_resp(&cmd->data.alloc_port_normal, r);	/* Fill the message returned from the AVS to the command requester. */
+			}
+			break;
+			
+		case ST_AVS_ALLOC_PORT_ICE:
+			{
+				struct avs_alloc_port_ice_resp_info *r = (struct avs_alloc_port_ice_resp_info *)resp;
+				fill_alloc_port_ice_resp(&cmd->data.alloc_port_ice, r);	
+			}
+			break;
+			
+		default:
+			break;
+	}
+	
+	return NULL;
+}
+
+/* Get the conference, channel and port of a command, and the settings the state index records. Empty for commands of no channel. */
+static void general_cmd_target(void *param, CMD_TYPE_STATE cmd_type, struct cmd_target *target)
+{
+	const char *conf_id = "", *chan_id = "", *port_id = "";
+	unsigned int h = hash_uint_more(2166136261u, cmd_type);
+	
+	target->codec = target->payloadtype = target->transmode = target->ptime = 0;
+	target->opt = AVS_RUNCTRL_CHAN_OPT_START;
+	target->setting = STATE_SETTING_NONE;
+	
+	switch (cmd_type)
+	{
+		case ST_AVS_ALLOC_PORT_NORMAL:
+			{
+				struct avs_alloc_port_normal_param *p = (struct avs_alloc_port_normal_param *)param;
+				conf_id = p->conf_id;
+				chan_id = p->chan_id;
+			}
+			break;
+			
+		case ST_AVS_ALLOC_PORT_ICE:
+			{
+				struct avs_alloc_port_ice_param *p = (struct avs_alloc_port_ice_param *)param;
+				conf_id = p->conf_id;
+				chan_id = p->chan_id;
+			}
+			break;
+			
+		case ST_AVS_DEALLOC_PORT:
+			{
+				struct avs_dealloc_port_param *p = (struct avs_dealloc_port_param *)param;
+				conf_id = p->conf_id;
+				chan_id = p->chan_id;
+				port_id = p->port_id;
+			}
+			break;
+			
+		case ST_AVS_RUNCTRL_CHAN:
+			{
+				struct avs_runctrl_chan_param *p = (struct avs_runctrl_chan_param *)param;
+				conf_id = p->conf_id;
+				chan_id = p->chan_id;
+				target->opt = p->opt;
+				target->mtype = p->mtype;
+			}
+			break;
+			
+		case ST_AVS_PLAYSOUND:
+			{
+				struct avs_playsound_chan_param *p = (struct avs_playsound_chan_param *)param;
+				conf_id = p->conf_id;
+				chan_id = p->chan_id;
+			}
+			break;
+			
+		case ST_AVS_SET_PEERPORT_PARAM_NORMAL:
+			{
+				struct avs_set_peerport_normal_param *p = (struct avs_set_peerport_normal_param *)param;
+				conf_id = p->conf_id;
+				chan_id = p->chan_id;
+				port_id = p->port_id;
+				target->setting = STATE_SETTING_PEER;
+				h = hash_uint_more(h, p->rtcpmux | p->symrtp << 1);
+				h = hash_uint_more(h, p->srtpmode);
+				h = hash_uint_more(h, p->qos);
+				h = hash_str_more(h, p->fingerprint, sizeof(p->fingerprint));
+				h = hash_str_more(h, p->srtpsendkey, sizeof(p->srtpsendkey));
+				h = hash_str_more(h, p->srtprecvkey, sizeof(p->srtprecvkey));
+				h = hash_str_more(h, p->targetaddr, sizeof(p->targetaddr));
+			}
+			break;
+			
+		case ST_AVS_SET_PEERPORT_PARAM_ICE:
+			{
+				struct avs_set_peerport_ice_param *p = (struct avs_set_peerport_ice_param *)param;
+				conf_id = p->conf_id;
+				chan_id = p->chan_id;
+				port_id = p->port_id;
+				target->setting = STATE_SETTING_PEER;
+				h = hash_uint_more(h, p->icerole | p->sslrole << 1);
+				h = hash_str_more(h, p->fingerprint, sizeof(p->fingerprint));
+				h = hash_str_more(h, p->ice_ufrag, sizeof(p->ice_ufrag));
+				h = hash_str_more(h, p->ice_pwd, sizeof(p->ice_pwd));
+				h = hash_str_more(h, p->candidate, sizeof(p->candidate));
+			}
+			break;
+			
+		case ST_AVS_SET_AUDIO_CODEC_PARAM:
+			{
+				struct avs_codec_audio_param *p = (struct avs_codec_audio_param *)param;
+				conf_id = p->conf_id;
+				chan_id = p->chan_id;
+				port_id = p->port_id;
+				target->codec = p->a_codec;
+				target->payloadtype = p->audio_payloadtype;
+				target->transmode = p->audio_transmode;
+				target->ptime = p->ptime;
+				target->setting = STATE_SETTING_AUDIO;
+			}
+			break;
+			
+		case ST_AVS_SET_VIDEO_CODEC_PARAM:
+			{
+				struct avs_codec_video_param *p = (struct avs_codec_video_param *)param;
+				conf_id = p->conf_id;
+				chan_id = p->chan_id;
+				port_id = p->port_id;
+				target->codec = p->v_codec;
+				target->payloadtype = p->video_payloadtype;
+				target->transmode = p->video_transmode;
+				target->setting = STATE_SETTING_VIDEO;
+			}
+			break;
+			
+		default:
+			break;
+	}
+	
+	snprintf(target->conf_id, sizeof(target->conf_id), "%s", conf_id);
+	snprintf(target->chan_id, sizeof(target->chan_id), "%s", chan_id);
+	snprintf(target->port_id, sizeof(target->port_id), "%s", port_id);
+	
+	cmd_target_hash(target, h);
+}
+
+/* Complete the hashes of a target with its IDs and codecs, "h" has hashed the other members of the setting. */
+static void cmd_target_hash(struct cmd_target *target, unsigned int h)
+{
+	/* Codecs are all in the target already. */
+	h = hash_uint_more(h, target->codec);
+	h = hash_uint_more(h, target->payloadtype);
+	h = hash_uint_more(h, target->transmode);
+	h = hash_uint_more(h, target->ptime);
+	target->setting_hash = h;
+	
+	h = hash_uint_more(2166136261u, target->setting);
+	h = hash_str_more(h, target->conf_id, sizeof(target->conf_id));
+	h = hash_str_more(h, target->chan_id, sizeof(target->chan_id));
+	target->key_hash = hash_str_more(h, target->port_id, sizeof(target->port_id));
+}
+
+/* Record in the state index a command AVS has answered with code 0. */
+static void general_state_update(struct pending_cmd *cmd)
+{
+	struct cmd_target *t = &cmd->target;
+	struct avs_chan_state port;
+	
+	switch (cmd->cmd_type)
+	{
+		case ST_AVS_ALLOC_PORT_NORMAL:
+			{
+				struct resp_alloc_port_normal_info *d = &cmd->data.alloc_port_normal;
+				
+				if (d->common_resp.code)
+				{
+					break;
+				}
+				
+				memset(&port, 0, sizeof(port));
+				port.mode = AVS_CHAN_PORT_NORMAL;
+				port.port_id = ref_intern(d->port_id, sizeof(d->port_id));
+				port.rtp_port = d->rtp_port;
+				port.rtcp_port = d->rtcp_port;
+				port.fingerprint = ref_intern(d->fingerprint, sizeof(d->fingerprint));
+				state_port_add(t->conf_id, t->chan_id, &port);
+				conf_ports_update(t->conf_id);
+			}
+			break;
+			
+		case ST_AVS_ALLOC_PORT_ICE:
+			{
+				struct resp_alloc_port_ice_info *d = &cmd->data.alloc_port_ice;
+				
+				if (d->common_resp.code)
+				{
+					break;
+				}
+				
+				memset(&port, 0, sizeof(port));
+				port.mode = AVS_CHAN_PORT_ICE;
+				port.port_id = ref_intern(d->port_id, sizeof(d->port_id));
+				port.fingerprint = ref_intern(d->fingerprint, sizeof(d->fingerprint));
+				port.ice_ufrag = ref_intern(d->ice_ufrag, sizeof(d->ice_ufrag));
+				port.ice_pwd = ref_intern(d->ice_pwd, sizeof(d->ice_pwd));
+				state_port_add(t->conf_id, t->chan_id, &port);
+				conf_ports_update(t->conf_id);
+			}
+			break;
+			
+		case ST_AVS_DEALLOC_PORT:
+			if (!cmd->data.common.code)
+			{
+				state_port_del(t->conf_id, t->chan_id, t->port_id);
+				conf_ports_update(t->conf_id);
+			}
+			break;
+			
+		case ST_AVS_RUNCTRL_CHAN:
+			if (!cmd->data.common.code && AVS_RUNCTRL_CHAN_OPT_RESET == t->opt)
+			{
+				state_chan_del(t->conf_id, t->chan_id);
+				conf_ports_update(t->conf_id);
+			}
+			else if (!cmd->data.common.code && (AVS_RUNCTRL_CHAN_OPT_SUSPEND == t->opt || AVS_RUNCTRL_CHAN_OPT_RESUME == t->opt))
+			{
+				state_media_suspend(t->conf_id, t->chan_id, t->mtype, AVS_RUNCTRL_CHAN_OPT_SUSPEND == t->opt);
+			}
+			break;
+			
+		case ST_AVS_SET_PEERPORT_PARAM_NORMAL:
+		case ST_AVS_SET_PEERPORT_PARAM_ICE:
+			if (!cmd->data.common.code)
+			{
+				state_peer_set(t->conf_id, t->chan_id, t->port_id, t->setting_hash, cmd->seq);
+			}
+			break;
+			
+		case ST_AVS_SET_AUDIO_CODEC_PARAM:
+			if (!cmd->data.common.code)
+			{
+				state_audio_set(t->conf_id, t->chan_id, t->port_id, (enum avs_audio_codec)t->codec, t->payloadtype, t->transmode, t->ptime, t->setting_hash, cmd->seq);
+			}
+			break;
+			
+		case ST_AVS_SET_VIDEO_CODEC_PARAM:
+			if (!cmd->data.common.code)
+			{
+				state_video_set(t->conf_id, t->chan_id, t->port_id, (enum avs_video_codec)t->codec, t->payloadtype, t->transmode, t->setting_hash, cmd->seq);
+			}
+			break;
+			
+		default:
+			break;
+	}
+}
+
+/* Generate a unique ID for a command issued by avs_controller itself. */
+static void general_gen_comm_id(char *comm_id)
+{
+	snprintf(comm_id, MAX_UNIQUE_ID, "mcm-%08x", __sync_add_and_fetch(&comm_id_seq, 1));
+}
+
+/* Reference the string of an interned ID, NULL if it is not a handle. It is cut to the longest ID of a parameter, as before
+ * interning: the state index and the targets of the commands keep no more.
+ */
+static struct avs_str ref_id(struct avs_id id, size_t size)
+{
+	struct avs_str str;
+	
+	str.s = avs_id_str(id);
+	str.len = id.len < size ? id.len : size - 1;
+	
+	return str;
+}
+
+/* Reference the IDs of a "_ref" parameter where they are interned. The port is not read for the commands which have none. */
+static int ref_chan(const struct avs_chan_ref *ref, CMD_TYPE_STATE cmd_type, struct enc_chan *chan)
+{
+	chan->conf_id = ref_id(ref->conf_id, MAX_CONFID_LEN);
+	chan->chan_id = ref_id(ref->chan_id, MAX_CHANID_LEN);
+	chan->port_id.s = "";
+	chan->port_id.len = 0;
+	
+	if (ST_AVS_ALLOC_PORT_NORMAL != cmd_type && ST_AVS_ALLOC_PORT_ICE != cmd_type && ST_AVS_RUNCTRL_CHAN != cmd_type)
+	{
+		chan->port_id = ref_id(ref->port_id, MAX_PORTID_LEN);
+	}
+	
+	if (!chan->conf_id.s || !chan->chan_id.s || !chan->port_id.s)
+	{
+		log_err("Command parameter with an ID not interned\n");
+		return -1;
+	}
+	
+	return 0;
+}
+
+/* Copy a referenced string into a char array of a target, cut to it. */
+static void ref_copy(char *dst, size_t size, struct avs_str str)
+{
+	size_t len = str.len < size ? str.len : size - 1;
+	
+	if (len)
+	{
+		memcpy(dst, str.s, len);
+	}
+	dst[len] = '\0';
+}
+
+/* The same as general_cmd_target(), from a "_ref" parameter and its IDs. Equal settings hash the same by either API. */
+static void ref_cmd_target(const void *ref, CMD_TYPE_STATE cmd_type, const struct enc_chan *chan, struct cmd_target *target)
+{
+	unsigned int h = hash_uint_more(2166136261u, cmd_type);
+	
+	target->codec = target->payloadtype = target->transmode = target->ptime = 0;
+	target->opt = AVS_RUNCTRL_CHAN_OPT_START;
+	target->setting = STATE_SETTING_NONE;
+	
+	switch (cmd_type)
+	{
+		case ST_AVS_RUNCTRL_CHAN:
+			{
+				const struct avs_runctrl_chan_ref_param *p = (const struct avs_runctrl_chan_ref_param *)ref;
+				target->opt = p->opt;
+				target->mtype = p->mtype;
+			}
+			break;
+			
+		case ST_AVS_SET_PEERPORT_PARAM_NORMAL:
+			{
+				const struct avs_set_peerport_normal_ref_param *p = (const struct avs_set_peerport_normal_ref_param *)ref;
+				target->setting = STATE_SETTING_PEER;
+				h = hash_uint_more(h, p->rtcpmux | p->symrtp << 1);
+				h = hash_uint_more(h, p->srtpmode);
+				h = hash_uint_more(h, p->qos);
+				h = hash_str_more(h, p->fingerprint.s, p->fingerprint.len);
+				h = hash_str_more(h, p->srtpsendkey.s, p->srtpsendkey.len);
+				h = hash_str_more(h, p->srtprecvkey.s, p->srtprecvkey.len);
+				h = hash_str_more(h, p->targetaddr.s, p->targetaddr.len);
+			}
+			break;
+			
+		case ST_AVS_SET_PEERPORT_PARAM_ICE:
+			{
+				const struct avs_set_peerport_ice_ref_param *p = (const struct avs_set_peerport_ice_ref_param *)ref;
+				target->setting = STATE_SETTING_PEER;
+				h = hash_uint_more(h, p->icerole | p->sslrole << 1);
+				h = hash_str_more(h, p->fingerprint.s, p->fingerprint.len);
+				h = hash_str_more(h, p->ice_ufrag.s, p->ice_ufrag.len);
+				h = hash_str_more(h, p->ice_pwd.s, p->ice_pwd.len);
+				h = hash_str_more(h, p->candidate.s, p->candidate.len);
+			}
+			break;
+			
+		case ST_AVS_SET_AUDIO_CODEC_PARAM:
+			{
+				const struct avs_codec_audio_ref_param *p = (const struct avs_codec_audio_ref_param *)ref;
+				target->codec = p->a_codec;
+				target->payloadtype = p->audio_payloadtype;
+				target->transmode = p->audio_transmode;
+				target->ptime = p->ptime;
+				target->setting = STATE_SETTING_AUDIO;
+			}
+			break;
+			
+		case ST_AVS_SET_VIDEO_CODEC_PARAM:
+			{
+				const struct avs_codec_video_ref_param *p = (const struct avs_codec_video_ref_param *)ref;
+				target->codec = p->v_codec;
+				target->payloadtype = p->video_payloadtype;
+				target->transmode = p->video_transmode;
+				target->setting = STATE_SETTING_VIDEO;
+			}
+			break;
+			
+		default:
+			break;
+	}
+	
+	ref_copy(target->conf_id, sizeof(target->conf_id), chan->conf_id);
+	ref_copy(target->chan_id, sizeof(target->chan_id), chan->chan_id);
+	ref_copy(target->port_id, sizeof(target->port_id), chan->port_id);
+	
+	cmd_target_hash(target, h);
+}
+
+/* The same as general_json_enc(), from a "_ref" parameter and its IDs. */
+static int ref_json_enc(const void *ref, CMD_TYPE_STATE cmd_type, const struct enc_chan *chan, char *buf, size_t size)
+{
+	int len = -1;
+	
+	switch (cmd_type)
+	{
+		case ST_AVS_ALLOC_PORT_NORMAL:
+			len = enc_json_alloc_port_ref(buf, size, chan, (const struct avs_alloc_port_ref_param *)ref, 0);
+			break;
+			
+		case ST_AVS_ALLOC_PORT_ICE:
+			len = enc_json_alloc_port_ref(buf, size, chan, (const struct avs_alloc_port_ref_param *)ref, 1);
+			break;
+			
+		case ST_AVS_DEALLOC_PORT:
+			len = enc_json_del_port_ref(buf, size, chan);
+			break;
+			
+		case ST_AVS_RUNCTRL_CHAN:
+			len = enc_json_runctrl_chan_ref(buf, size, chan, (const struct avs_runctrl_chan_ref_param *)ref);
+			break;
+			
+		case ST_AVS_SET_PEERPORT_PARAM_NORMAL:
+			len = enc_json_set_peerport_normal_ref(buf, size, chan, (const struct avs_set_peerport_normal_ref_param *)ref);
+			break;
+			
+		case ST_AVS_SET_PEERPORT_PARAM_ICE:
+			len = enc_json_set_peerport_ice_ref(buf, size, chan, (const struct avs_set_peerport_ice_ref_param *)ref);
+			break;
+			
+		case ST_AVS_SET_AUDIO_CODEC_PARAM:
+			len = enc_json_set_audio_codec_ref(buf, size, chan, (const struct avs_codec_audio_ref_param *)ref);
+			break;
+			
+		case ST_AVS_SET_VIDEO_CODEC_PARAM:
+			len = enc_json_set_video_codec_ref(buf, size, chan, (const struct avs_codec_video_ref_param *)ref);
+			break;
+			
+		default:
+			break;
+	}
+	
+	if (len < 0)
+	{
+		log_err("encode command %d failed!\n", cmd_type);
+	}
+	
+	return len;
+}
+
+/* The same as general_tlv_enc(), from a "_ref" parameter and its IDs. */
+static int ref_tlv_enc(const void *ref, CMD_TYPE_STATE cmd_type, const struct enc_chan *chan, char *buf, size_t size)
+{
+	int len = -1;
+	
+	switch (cmd_type)
+	{
+		case ST_AVS_ALLOC_PORT_NORMAL:
+			len = enc_tlv_alloc_port_ref(buf, size, chan, (const struct avs_alloc_port_ref_param *)ref, 0);
+			break;
+			
+		case ST_AVS_ALLOC_PORT_ICE:
+			len = enc_tlv_alloc_port_ref(buf, size, chan, (const struct avs_alloc_port_ref_param *)ref, 1);
+			break;
+			
+		case ST_AVS_DEALLOC_PORT:
+			len = enc_tlv_del_port_ref(buf, size, chan);
+			break;
+			
+		case ST_AVS_RUNCTRL_CHAN:
+			len = enc_tlv_runctrl_chan_ref(buf, size, chan, (const struct avs_runctrl_chan_ref_param *)ref);
+			break;
+			
+		case ST_AVS_SET_PEERPORT_PARAM_NORMAL:
+			len = enc_tlv_set_peerport_normal_ref(buf, size, chan, (const struct avs_set_peerport_normal_ref_param *)ref);
+			break;
+			
+		case ST_AVS_SET_PEERPORT_PARAM_ICE:
+			len = enc_tlv_set_peerport_ice_ref(buf, size, chan, (const struct avs_set_peerport_ice_ref_param *)ref);
+			break;
+			
+		case ST_AVS_SET_AUDIO_CODEC_PARAM:
+			len = enc_tlv_set_audio_codec_ref(buf, size, chan, (const struct avs_codec_audio_ref_param *)ref);
+			break;
+			
+		case ST_AVS_SET_VIDEO_CODEC_PARAM:
+			len = enc_tlv_set_video_codec_ref(buf, size, chan, (const struct avs_codec_video_ref_param *)ref);
+			break;
+			
+		default:
+			break;
+	}
+	
+	if (len < 0)
+	{
+		log_err("encode command %d failed!\n", cmd_type);
+	}
+	
+	return len;
+}
+
+/* Intern a string of a response for the state index. The handle is empty if the string is, or if it cannot be interned. */
+static struct avs_id ref_intern(const char *str, size_t size)
+{
+	struct avs_id id = { 0, 0 };
+	size_t len = strnlen(str, size);
+	
+	if (len && avs_id_intern(str, (unsigned int)len, &id) != SUCCESS)
+	{
+		log_err("Intern \"%.*s\" failed\n", (int)len, str);
+	}
+	
+	return id;
+}
+
+/* Defer a channel of a batch until the receiving thread frees cells of the submission queue. Its command is sent again by "resume",
+ * a channel which is waiting there is neither finished nor failed.
+ */
+static void batch_defer(struct batch_retry *retry, void (*resume)(void *chan), void *chan)
+{
+	retry->resume = resume;
+	retry->chan = chan;
+	retry->next = NULL;
+	
+	pthread_mutex_lock(&retry_lock);
+	*retry_tail = retry;
+	retry_tail = &retry->next;
+	pthread_mutex_unlock(&retry_lock);
+	
+	/* The receiving thread may have freed the cells and gone to sleep meanwhile. It looks at the list on each loop by itself. */
+	if (!on_recv_thread)
+	{
+		reactor_wakeup();
+	}
+}
+
+/* Resume the deferred batch channels, once per loop of the receiving thread. The queue was full, so a response or the retry
+ * of a busy AVS comes later and frees cells: once a channel is refused again, it and the ones after it wait for the next loop.
+ */
+static void batch_resume_all(void)
+{
+	struct batch_retry *list, *retry, **last;
+	unsigned long full;
+	
+	if (!__atomic_load_n(&retry_head, __ATOMIC_RELAXED))
+	{
+		return;
+	}
+	
+	pthread_mutex_lock(&retry_lock);
+	list = retry_head;
+	retry_head = NULL;
+	retry_tail = &retry_head;
+	pthread_mutex_unlock(&retry_lock);
+	
+	while ((retry = list))
+	{
+		list = retry->next;
+		full = __atomic_load_n(&io_counters.tx_queue_full, __ATOMIC_RELAXED);
+		retry->resume(retry->chan);
+		
+		if (list && full != __atomic_load_n(&io_counters.tx_queue_full, __ATOMIC_RELAXED))
+		{
+			break;
+		}
+	}
+	
+	if (!list)
+	{
+		return;
+	}
+	
+	/* The channels not tried keep their place in front of the ones deferred meanwhile. */
+	for (last = &list->next; *last; last = &(*last)->next)
+	{
+	}
+	
+	pthread_mutex_lock(&retry_lock);
+	*last = retry_head;
+	if (!retry_head)
+	{
+		retry_tail = last;
+	}
+	retry_head = list;
+	pthread_mutex_unlock(&retry_lock);
+}
+
+/* Send the command of the current step of a channel, or skip to the following one if it is not required.
+ * The channels which finish here are followed by the next ones of the batch in the same loop.
+ */
+static void setup_chan_next_step(struct setup_chan *chan)
+{
+	struct avs_chan_setup_desc *desc;
+	const char *conf_id;
+	const char *port_id;
+	AVS_CMD_RESULT ret;
+	
+	while (chan)
+	{
+		desc = chan->desc;
+		conf_id = chan->batch->conf_id;
+		port_id = (AVS_CHAN_PORT_ICE == desc->mode) ? desc->port.ice.port_id : desc->port.normal.port_id;
+		
+		switch (chan->step)
+		{
+			case AVS_CHAN_SETUP_ALLOC_PORT:
+				if (AVS_CHAN_PORT_ICE == desc->mode)
+				{
+					struct avs_alloc_port_ice_param p;
+					
+					memset(&p, 0, sizeof(p));
+					p.enable_dtls = desc->enable_dtls;
+					STR_COPY(p.conf_id, conf_id);
+					STR_COPY(p.chan_id, desc->chan_id);
+					general_gen_comm_id(p.comm_id);
+					ret = general_action_async(&p, &desc->port.ice, ST_AVS_ALLOC_PORT_ICE, setup_step_cb, chan);
+				}
+				else
+				{
+					struct avs_alloc_port_normal_param p;
+					
+					memset(&p, 0, sizeof(p));
+					p.enable_dtls = desc->enable_dtls;
+					STR_COPY(p.conf_id, conf_id);
+					STR_COPY(p.chan_id, desc->chan_id);
+					general_gen_comm_id(p.comm_id);
+					ret = general_action_async(&p, &desc->port.normal, ST_AVS_ALLOC_PORT_NORMAL, setup_step_cb, chan);
+				}
+				break;
+				
+			case AVS_CHAN_SETUP_PEER:
+				if (!desc->set_peer)
+				{
+					chan->step = AVS_CHAN_SETUP_AUDIO;
+					continue;
+				}
+				
+				if (AVS_CHAN_PORT_ICE == desc->mode)
+				{
+					struct avs_set_peerport_ice_param *p = &desc->peer.ice;
+					
+					STR_COPY(p->conf_id, conf_id);
+					STR_COPY(p->chan_id, desc->chan_id);
+					STR_COPY(p->port_id, port_id);
+					general_gen_comm_id(p->comm_id);
+					ret = general_action_async(p, &chan->resp, ST_AVS_SET_PEERPORT_PARAM_ICE, setup_step_cb, chan);
+				}
+				else
+				{
+					struct avs_set_peerport_normal_param *p = &desc->peer.normal;
+					
+					STR_COPY(p->conf_id, conf_id);
+					STR_COPY(p->chan_id, desc->chan_id);
+					STR_COPY(p->port_id, port_id);
+					general_gen_comm_id(p->comm_id);
+					ret = general_action_async(p, &chan->resp, ST_AVS_SET_PEERPORT_PARAM_NORMAL, setup_step_cb, chan);
+				}
+				break;
+				
+			case AVS_CHAN_SETUP_AUDIO:
+				if (!desc->set_audio)
+				{
+					chan->step = AVS_CHAN_SETUP_VIDEO;
+					continue;
+				}
+				
+				STR_COPY(desc->audio.conf_id, conf_id);
+				STR_COPY(desc->audio.chan_id, desc->chan_id);
+				STR_COPY(desc->audio.port_id, port_id);
+				general_gen_comm_id(desc->audio.comm_id);
+				ret = general_action_async(&desc->audio, &chan->resp, ST_AVS_SET_AUDIO_CODEC_PARAM, setup_step_cb, chan);
+				break;
+				
+			case AVS_CHAN_SETUP_VIDEO:
+				if (!desc->set_video)
+				{
+					chan->step = AVS_CHAN_SETUP_DONE;
+					continue;
+				}
+				
+				STR_COPY(desc->video.conf_id, conf_id);
+				STR_COPY(desc->video.chan_id, desc->chan_id);
+				STR_COPY(desc->video.port_id, port_id);
+				general_gen_comm_id(desc->video.comm_id);
+				ret = general_action_async(&desc->video, &chan->resp, ST_AVS_SET_VIDEO_CODEC_PARAM, setup_step_cb, chan);
+				break;
+				
+			default:
+				chan = setup_chan_finish(chan, SUCCESS);
+				continue;
+		}
+		
+		/* "chan" may have completed already. */
+		if (SUCCESS == ret)
+		{
+			return;
+		}
+		
+		/* The step is sent again from its beginning, with a new unique ID. */
+		if (QUEUE_FULL == ret)
+		{
+			batch_defer(&chan->retry, setup_chan_resume, chan);
+			return;
+		}
+		
+		chan = setup_chan_finish(chan, ret);
+	}
+}
+
+/* Send the deferred step of a channel of a bulk setup again. */
+static void setup_chan_resume(void *chan)
+{
+	setup_chan_next_step((struct setup_chan *)chan);
+}
+
+/* A channel of a bulk setup has finished (or failed) all its steps. The last channel completes the batch.
+ * Return the next channel of the batch to start, NULL if there is none.
+ */
+static struct setup_chan *setup_chan_finish(struct setup_chan *chan, AVS_CMD_RESULT result)
+{
+	struct setup_batch *batch = chan->batch;
+	struct setup_chan *next = NULL;
+	int last;
+	
+	chan->desc->result = result;
+	chan->desc->failed_step = (SUCCESS == result) ? AVS_CHAN_SETUP_DONE : chan->step;
+	
+	/* Pick the next channel under the lock, the batch stays alive until that channel finishes. */
+	pthread_mutex_lock(&batch->lock);
+	if (SUCCESS != result)
+	{
+		batch->result = ERROR;
+	}
+	last = (0 == --batch->remaining);
+	if (batch->started < batch->num)
+	{
+		next = &batch->chans[batch->started++];
+	}
+	pthread_mutex_unlock(&batch->lock);
+	
+	if (!last)
+	{
+		return next;
+	}
+	
+	pthread_mutex_destroy(&batch->lock);
+	
+	if (batch->cb)
+	{
+		batch->cb(batch->result, batch->chans[0].desc, batch->num, batch->user_data);
+	}
+	
+	arena_put(batch->arena);
+	
+	return NULL;
+}
+
+/* Completion of one step of a channel in a bulk setup. AVS refusing the command fails the channel too. */
+static void setup_step_cb(AVS_CMD_RESULT result, void *resp, void *user_data)
+{
+	struct setup_chan *chan = (struct setup_chan *)user_data;
+	struct avs_chan_setup_desc *desc = chan->desc;
+	
+	(void)resp;
+	
+	if (SUCCESS == result)
+	{
+		if (AVS_CHAN_SETUP_ALLOC_PORT == chan->step)
+		{
+			struct avs_response_common_sub_info *r = (AVS_CHAN_PORT_ICE == desc->mode) ? &desc->port.ice.resp : &desc->port.normal.resp;
+			
+			desc->resp.code = r->code;
+			STR_COPY(desc->resp.message, r->message);
+		}
+		else
+		{
+			desc->resp.code = chan->resp.code;
+			STR_COPY(desc->resp.message, chan->resp.message);
+		}
+		
+		if (0 != desc->resp.code)
+		{
+			result = ERROR;
+		}
+	}
+	
+	if (SUCCESS != result)
+	{
+		setup_chan_next_step(setup_chan_finish(chan, result));
+		return;
+	}
+	
+	chan->step++;
+	setup_chan_next_step(chan);
+}
+
+/* Completion callback of the synchronous bulk setup. */
+static void sync_setup_cb(AVS_CMD_RESULT result, struct avs_chan_setup_desc *descs, unsigned int num, void *user_data)
+{
+	(void)descs;
+	(void)num;
+	
+	wakeup_intruder((struct sync_waiter *)user_data, result);
+}
+
+/* Send "runctrl" reset and "delPort" of a channel back to back, the ones which have not been submitted yet. The port is released
+ * even if the reset fails. The channels which finish here are followed by the next ones of the batch in the same loop.
+ */
+static void teardown_chan_send(struct teardown_chan *chan)
+{
+	struct avs_runctrl_chan_param reset;
+	struct avs_dealloc_port_param del;
+	AVS_CMD_RESULT ret;
+	
+	while (chan)
+	{
+		if (!chan->sent)
+		{
+			memset(&reset, 0, sizeof(reset));
+			reset.opt = AVS_RUNCTRL_CHAN_OPT_RESET;
+			reset.mtype = AVS_RUNCTRL_CHAN_TYPE_ALL;
+			STR_COPY(reset.conf_id, chan->batch->conf_id);
+			STR_COPY(reset.chan_id, chan->ref->chan_id);
+			general_gen_comm_id(reset.comm_id);
+			
+			if (QUEUE_FULL == (ret = general_action_async(&reset, &chan->reset_resp, ST_AVS_RUNCTRL_CHAN, teardown_step_cb, chan)))
+			{
+				batch_defer(&chan->retry, teardown_chan_resume, chan);
+				return;
+			}
+			
+			/* "delPort" is still to come, the channel does not finish here. */
+			chan->sent = 1;
+			if (SUCCESS != ret)
+			{
+				teardown_chan_done(chan, ret);
+			}
+		}
+		
+		memset(&del, 0, sizeof(del));
+		STR_COPY(del.conf_id, chan->batch->conf_id);
+		STR_COPY(del.chan_id, chan->ref->chan_id);
+		STR_COPY(del.port_id, chan->ref->port_id);
+		general_gen_comm_id(del.comm_id);
+		
+		/* Once both are queued, "chan" may have completed already. */
+		if (SUCCESS == (ret = general_action_async(&del, &chan->del_resp, ST_AVS_DEALLOC_PORT, teardown_step_cb, chan)))
+		{
+			return;
+		}
+		
+		if (QUEUE_FULL == ret)
+		{
+			batch_defer(&chan->retry, teardown_chan_resume, chan);
+			return;
+		}
+		
+		chan = teardown_chan_done(chan, ret);
+	}
+}
+
+/* Submit the deferred commands of a channel of a teardown again. */
+static void teardown_chan_resume(void *chan)
+{
+	teardown_chan_send((struct teardown_chan *)chan);
+}
+
+/* One command of a channel in a teardown has completed. The last one finishes the channel.
+ * Return the next channel of the batch to start, NULL if there is none.
+ */
+static struct teardown_chan *teardown_chan_done(struct teardown_chan *chan, AVS_CMD_RESULT result)
+{
+	if (SUCCESS != result)
+	{
+		__sync_fetch_and_or(&chan->failed, 1);
+	}
+	
+	if (__sync_sub_and_fetch(&chan->pending, 1) == 0)
+	{
+		return teardown_chan_finish(chan);
+	}
+	
+	return NULL;
+}
+
+/* A channel of a teardown has finished. The last channel completes the batch. Return the next channel of the batch to start, NULL if there is none. */
+static struct teardown_chan *teardown_chan_finish(struct teardown_chan *chan)
+{
+	struct teardown_batch *batch = chan->batch;
+	struct teardown_chan *next = NULL;
+	int last;
+	
+	pthread_mutex_lock(&batch->lock);
+	if (chan->failed)
+	{
+		batch->failed++;
+	}
+	last = (0 == --batch->remaining);
+	if (batch->started < batch->num)
+	{
+		next = &batch->chans[batch->started++];
+	}
+	pthread_mutex_unlock(&batch->lock);
+	
+	if (!last)
+	{
+		return next;
+	}
+	
+	pthread_mutex_destroy(&batch->lock);
+	
+	if (batch->cb)
+	{
+		batch->cb(batch->failed ? ERROR : SUCCESS, batch->num, batch->failed, batch->user_data);
+	}
+	
+	arena_put(batch->arena);
+	
+	return NULL;
+}
+
+/* Completion of "runctrl" reset or "delPort" of a channel in a teardown. AVS refusing the command fails the channel too. */
+static void teardown_step_cb(AVS_CMD_RESULT result, void *resp, void *user_data)
+{
+	if (SUCCESS == result && 0 != ((struct avs_common_resp_info *)resp)->code)
+	{
+		result = ERROR;
+	}
+	
+	teardown_chan_send(teardown_chan_done((struct teardown_chan *)user_data, result));
+}
+
+/* Completion callback of the synchronous conference teardown. */
+static void sync_teardown_cb(AVS_CMD_RESULT result, unsigned int num_chans, unsigned int failed, void *user_data)
+{
+	(void)num_chans;
+	(void)failed;
+	
+	wakeup_intruder((struct sync_waiter *)user_data, result);
+}
+
+/* Send "runctrl" to a channel of a conference run control. The channels which fail here are followed by the next ones of the batch in the same loop. */
+static void runctrl_chan_start(struct runctrl_chan *chan)
+{
+	struct avs_runctrl_chan_param param;
+	AVS_CMD_RESULT ret;
+	
+	while (chan)
+	{
+		memset(&param, 0, sizeof(param));
+		param.opt = chan->batch->opt;
+		param.mtype = chan->batch->mtype;
+		STR_COPY(param.conf_id, chan->batch->conf_id);
+		STR_COPY(param.chan_id, chan->ref->chan_id);
+		general_gen_comm_id(param.comm_id);
+		
+		/* "chan" may have completed already. */
+		if (SUCCESS == (ret = general_action_async(&param, &chan->resp, ST_AVS_RUNCTRL_CHAN, runctrl_step_cb, chan)))
+		{
+			return;
+		}
+		
+		if (QUEUE_FULL == ret)
+		{
+			batch_defer(&chan->retry, runctrl_chan_resume, chan);
+			return;
+		}
+		
+		chan = runctrl_chan_finish(chan, ret);
+	}
+}
+
+/* Send the deferred "runctrl" of a channel of a conference run control again. */
+static void runctrl_chan_resume(void *chan)
+{
+	runctrl_chan_start((struct runctrl_chan *)chan);
+}
+
+/* A channel of a conference run control has finished. The last channel completes the batch.
+ * Return the next channel of the batch to start, NULL if there is none.
+ */
+static struct runctrl_chan *runctrl_chan_finish(struct runctrl_chan *chan, AVS_CMD_RESULT result)
+{
+	struct runctrl_batch *batch = chan->batch;
+	struct runctrl_chan *next = NULL;
+	int last;
+	
+	pthread_mutex_lock(&batch->lock);
+	if (SUCCESS != result)
+	{
+		batch->failed++;
+	}
+	last = (0 == --batch->remaining);
+	if (batch->started < batch->num)
+	{
+		next = &batch->chans[batch->started++];
+	}
+	pthread_mutex_unlock(&batch->lock);
+	
+	if (!last)
+	{
+		return next;
+	}
+	
+	pthread_mutex_destroy(&batch->lock);
+	
+	if (batch->cb)
+	{
+		batch->cb(batch->failed ? ERROR : SUCCESS, batch->num, batch->failed, batch->user_data);
+	}
+	
+	arena_put(batch->arena);
+	
+	return NULL;
+}
+
+/* Completion of "runctrl" of a channel in a conference run control. AVS refusing it fails the channel too. */
+static void runctrl_step_cb(AVS_CMD_RESULT result, void *resp, void *user_data)
+{
+	if (SUCCESS == result && 0 != ((struct avs_common_resp_info *)resp)->code)
+	{
+		result = ERROR;
+	}
+	
+	runctrl_chan_start(runctrl_chan_finish((struct runctrl_chan *)user_data, result));
+}
+
+/* Completion callback of the synchronous conference run control. */
+static void sync_runctrl_cb(AVS_CMD_RESULT result, unsigned int num_chans, unsigned int failed, void *user_data)
+{
+	(void)num_chans;
+	(void)failed;
+	
+	wakeup_intruder((struct sync_waiter *)user_data, result);
+}
+
+/* "n" instances of a "setParam" fan-out are done. The last one completes the requester. */
+static void global_fanout_done(struct global_fanout *fan, unsigned int n, AVS_CMD_RESULT result, const struct avs_common_resp_info *resp)
+{
+	int last;
+	
+	pthread_mutex_lock(&fan->lock);
+	if (SUCCESS != result && SUCCESS == fan->result)
+	{
+		fan->result = result;
+	}
+	if (resp && SUCCESS == result && fan->resp && (!fan->answered || (resp->code && !fan->refused)))
+	{
+		*fan->resp = *resp;
+		fan->answered = 1;
+		fan->refused = (0 != resp->code);
+	}
+	fan->remaining -= n;
+	last = (0 == fan->remaining);
+	pthread_mutex_unlock(&fan->lock);
+	
+	if (!last)
+	{
+		return;
+	}
+	
+	pthread_mutex_destroy(&fan->lock);
+	
+	if (fan->answered)
+	{
+		STR_COPY(fan->resp->comm_id, fan->comm_id);
+	}
+	
+	if (fan->cb)
+	{
+		fan->cb(fan->result, fan->resp, fan->user_data);
+	}
+	
+	arena_put(fan->arena);
+}
+
+/* Completion of "setParam" on one instance of a fan-out. */
+static void global_fanout_cb(AVS_CMD_RESULT result, void *resp, void *user_data)
+{
+	global_fanout_done((struct global_fanout *)user_data, 1, result, (struct avs_common_resp_info *)resp);
+}
+
+/* Send "setParam" to every instance, each command with an id of its own. The requester is completed once, when all of them have. */
+static AVS_CMD_RESULT global_fanout_start(struct avs_global_param *param, struct avs_common_resp_info *resp, avs_cmd_cb cb, void *user_data)
+{
+	struct global_fanout *fan;
+	struct arena *arena;
+	struct avs_global_param copy;
+	AVS_CMD_RESULT ret = SUCCESS;
+	unsigned int i;
+	
+	if (!param->comm_id[0])
+	{
+		log_err("command id is empty!\n");
+		return ERROR;
+	}
+	
+	if (!(arena = arena_get()) || !(fan = arena_alloc(arena, sizeof(*fan))))
+	{
+		log_err("Malloc setParam fan-out failed\n");
+		arena_put(arena);
+		return ERROR;
+	}
+	
+	memset(fan, 0, sizeof(*fan));
+	fan->arena = arena;
+	fan->remaining = num_instances + 1;	/* One is held until all the commands have been submitted. */
+	fan->result = SUCCESS;
+	fan->resp = resp;
+	fan->cb = cb;
+	fan->user_data = user_data;
+	STR_COPY(fan->comm_id, param->comm_id);
+	pthread_mutex_init(&fan->lock, NULL);
+	
+	for (i = 0; i < num_instances; i++)
+	{
+		copy = *param;
+		general_gen_comm_id(copy.comm_id);
+		
+		if ((ret = cmd_submit(&copy, NULL, &fan->resps[i], ST_AVS_SET_GLOBAL_PARAM, (int)i, global_fanout_cb, fan)) != SUCCESS)
+		{
+			break;
+		}
+	}
+	
+	/* Nothing was submitted, the requester gets the error now. */
+	if (!i)
+	{
+		pthread_mutex_destroy(&fan->lock);
+		arena_put(arena);
+		return ret;
+	}
+	
+	/* The instances it could not be submitted to fail it through "cb", like a command which could not be sent. */
+	global_fanout_done(fan, num_instances - i + 1, ret, NULL);
+	
+	return SUCCESS;
+}
+
+/* General processing function of asynchronous command request. A command of a conference goes to the instance the conference
+ * is placed on, "setParam" to every instance and the other commands to the first one.
+ */
+static AVS_CMD_RESULT general_action_async(void *param, void *resp, CMD_TYPE_STATE cmd_type, avs_cmd_cb cb, void *user_data)
+{
+	if (ST_AVS_SET_GLOBAL_PARAM == cmd_type && num_instances > 1)
+	{
+		return global_fanout_start((struct avs_global_param *)param, (struct avs_common_resp_info *)resp, cb, user_data);
+	}
+	
+	return cmd_submit(param, NULL, resp, cmd_type, -1, cb, user_data);
+}
+
+/* Submit a command to the AVS instance "inst", -1 for the instance of its conference. It is given by "param", or by the
+ * compact parameter "ref" of the "avs_*_ref" APIs whose IDs and strings are encoded from where they are referenced.
+ * 1. Reserve a cell of the submission queue, it is never waited for: QUEUE_FULL if none is free.
+ * 2. Place the command: a conference which is not placed yet goes to the least loaded instance.
+ * 3. Encapsulate JSON, or a frame if the instance takes them, straight into the cell and publish it.
+ * 4. The receiving thread takes a wait slot keyed by the command unique ID and sends the JSON to AVS in batches.
+ * The receiving thread completes the command later: it backfills "resp" and calls "cb". A failure of sending is reported by "cb" as well.
+ *
+ * Several commands may be in flight at the same time, responses are matched by their "id".
+ */
+static AVS_CMD_RESULT cmd_submit(void *param, const void *ref, void *resp, CMD_TYPE_STATE cmd_type, int inst, avs_cmd_cb cb, void *user_data)
+{
+	struct cmd_submission *sub;
+	struct enc_chan chan;
+	unsigned int pos;
+	int len;
+	const char *comm_id = NULL;
+	
+	/* The response holds no candidates until the command fills it, even if it fails. */
+	if (ST_AVS_ALLOC_PORT_ICE == cmd_type && resp)
+	{
+		struct avs_alloc_port_ice_resp_info *ice = (struct avs_alloc_port_ice_resp_info *)resp;
+		
+		ice->arena = NULL;
+		ice->candidates = NULL;
+		ice->num_candidates = ice->dropped_candidates = 0;
+	}
+	
+	if (-1 == sockfd)
+	{
+		log_err("socket is not created!\n");
+		return ERROR;		
+	}
+	
+	/* Every compact parameter starts with its struct avs_chan_ref. */
+	if (ref)
+	{
+		if (ref_chan((const struct avs_chan_ref *)ref, cmd_type, &chan) != 0)
+		{
+			return ERROR;
+		}
+	}
+	else if (!(comm_id = general_comm_id(param, cmd_type)) || !comm_id[0])
+	{
+		log_err("command id is empty!\n");
+		return ERROR;
+	}
+	
+	if (!(sub = mpsc_reserve(&sq, &pos)))
+	{
+		__atomic_fetch_add(&io_counters.tx_queue_full, 1, __ATOMIC_RELAXED);
+		return QUEUE_FULL;
+	}
+	
+	/* A reserved cell must be published even if the command fails here, the receiving thread takes the cells in order. */
+	if (ref)
+	{
+		general_gen_comm_id(sub->comm_id);
+		chan.comm_id.s = sub->comm_id;
+		chan.comm_id.len = strlen(sub->comm_id);
+		ref_cmd_target(ref, cmd_type, &chan, &sub->target);
+	}
+	else
+	{
+		general_cmd_target(param, cmd_type, &sub->target);
+	}
+	sub->placed = 0;
+	
+	if (inst < 0 && sub->target.conf_id[0])
+	{
+		if ((inst = shard_acquire(sub->target.conf_id)) < 0)
+		{
+			sub->cmd_type = ST_AVS_IDLE;
+			mpsc_commit(&sq, pos);
+			return ERROR;
+		}
+		sub->placed = 1;
+	}
+	sub->inst = (inst < 0) ? 0 : (unsigned int)inst;
+	
+	if (ref)
+	{
+		len = (instances[sub->inst].wire_tlv ? ref_tlv_enc : ref_json_enc)(ref, cmd_type, &chan, sub->json_s, sizeof(sub->json_s));
+	}
+	else
+	{
+		len = (instances[sub->inst].wire_tlv ? general_tlv_enc : general_json_enc)(param, cmd_type, sub->json_s, sizeof(sub->json_s));
+	}
+	
+	if (len < 0)
+	{
+		if (sub->placed)
+		{
+			shard_release(sub->target.conf_id);
+		}
+		sub->cmd_type = ST_AVS_IDLE;
+		mpsc_commit(&sq, pos);
+		return ERROR;
+	}
+	
+	sub->cmd_type = cmd_type;
+	if (!ref)
+	{
+		STR_COPY(sub->comm_id, comm_id);
+	}
+	sub->resp = resp;
+	sub->cb = cb;
+	sub->user_data = user_data;
+	sub->len = (size_t)len;
+	
+	mpsc_commit(&sq, pos);
+	
+	/* Pairs with the fence of recv_task(): either it sees the command before sleeping, or this thread sees it sleeping. */
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	
+	if (__atomic_load_n(&io_sleeping, __ATOMIC_RELAXED) && __atomic_exchange_n(&io_sleeping, 0, __ATOMIC_RELAXED))
+	{
+		reactor_wakeup();
+	}
+	
+	return SUCCESS;
+}
+
+/* General processing function of command request. It waits until the asynchronous command completes. */
+static AVS_CMD_RESULT general_action(void *param, void *resp, CMD_TYPE_STATE cmd_type)
+{
+	return sync_action(param, NULL, resp, cmd_type);
+}
+
+/* Issue a command given by "param", or by the compact parameter "ref", and wait until it completes. */
+static AVS_CMD_RESULT sync_action(void *param, const void *ref, void *resp, CMD_TYPE_STATE cmd_type)
+{
+	struct sync_waiter waiter;
+	AVS_CMD_RESULT ret;
+	
+	if (sync_refused())
+	{
+		return ERROR;
+	}
+	
+	waiter.done = 0;
+	waiter.result = ERROR;
+	pthread_mutex_init(&waiter.mutex, NULL);
+	pthread_cond_init(&waiter.cond, NULL);
+	
+	if (ref)
+	{
+		ret = ref_action_async(ref, resp, cmd_type, sync_action_cb, &waiter);
+	}
+	else
+	{
+		ret = general_action_async(param, resp, cmd_type, sync_action_cb, &waiter);
+	}
+	
+	/* waiting here... */
+	if (SUCCESS == ret && wait_for_avs(&waiter) == R_SUCCESS)
+	{
+		ret = waiter.result;
+	}
+	
+	pthread_cond_destroy(&waiter.cond);
+	pthread_mutex_destroy(&waiter.mutex);
+	
+	return ret;
+}
+
+/* The keys of "playSound" are not defined by the AVS interface protocol, a guessed message is not sent until they are. */
+static AVS_CMD_RESULT playsound_unsupported(void)
+{
+	log_warn("playSound is not supported yet.\n");
+	return NOT_SUPPORTED;
+}
+
+AVS_CMD_RESULT avs_playsound(struct avs_playsound_chan_param *param, struct avs_common_resp_info *resp)
+{
+	(void)param;
+	(void)resp;
+	
+	return playsound_unsupported();
+}
+
+AVS_CMD_RESULT avs_playsound_async(struct avs_playsound_chan_param *param, struct avs_common_resp_info *resp, avs_cmd_cb cb, void *user_data)
+{
+	(void)param;
+	(void)resp;
+	(void)cb;
+	(void)user_data;
+	
+	return playsound_unsupported();
+}
+
+AVS_CMD_RESULT avs_runctrl_chan(struct avs_runctrl_chan_param *param, struct avs_common_resp_info *resp)
+{
+	return general_action(param, resp, ST_AVS_RUNCTRL_CHAN);
+}
+
+AVS_CMD_RESULT avs_runctrl_chan_async(struct avs_runctrl_chan_param *param, struct avs_common_resp_info *resp, avs_cmd_cb cb, void *user_data)
+{
+	return general_action_async(param, resp, ST_AVS_RUNCTRL_CHAN, cb, user_data);
+}
+
+AVS_CMD_RESULT avs_set_audio_codec_param_async(struct avs_codec_audio_param *param, struct avs_common_resp_info *resp, avs_cmd_cb cb, void *user_data)
+{
+	return general_action_async(param, resp, ST_AVS_SET_AUDIO_CODEC_PARAM, cb, user_data);
+}
+
+AVS_CMD_RESULT avs_set_video_codec_param_async(struct avs_codec_video_param *param, struct avs_common_resp_info *resp, avs_cmd_cb cb, void *user_data)
+{
+	return general_action_async(param, resp, ST_AVS_SET_VIDEO_CODEC_PARAM, cb, user_data);
+}
+
+AVS_CMD_RESULT avs_set_audio_codec_param(struct avs_codec_audio_param *param, struct avs_common_resp_info *resp)
+{
+	return general_action(param, resp, ST_AVS_SET_AUDIO_CODEC_PARAM);
+}
+
+AVS_CMD_RESULT avs_set_video_codec_param(struct avs_codec_video_param *param, struct avs_common_resp_info *resp)
+{
+	return general_action(param, resp, ST_AVS_SET_VIDEO_CODEC_PARAM);
+}
+
+AVS_CMD_RESULT avs_set_peerport_param_normal_async(struct avs_set_peerport_normal_param *param, struct avs_common_resp_info *resp, avs_cmd_cb cb, void *user_data)
+{
+	return general_action_async(param, resp, ST_AVS_SET_PEERPORT_PARAM_NORMAL, cb, user_data);
+}
+
+AVS_CMD_RESULT avs_set_peerport_param_ice_async(struct avs_set_peerport_ice_param *param, struct avs_common_resp_info *resp, avs_cmd_cb cb, void *user_data)
+{
+	return general_action_async(param, resp, ST_AVS_SET_PEERPORT_PARAM_ICE, cb, user_data);
+}
+
+AVS_CMD_RESULT avs_alloc_port_normal_async(struct avs_alloc_port_normal_param *param, struct avs_alloc_port_normal_resp_info *resp, avs_cmd_cb cb, void *user_data)
+{
+	return general_action_async(param, resp, ST_AVS_ALLOC_PORT_NORMAL, cb, user_data);
+}
+
+AVS_CMD_RESULT avs_alloc_port_ice_async(struct avs_alloc_port_ice_param *param, struct avs_alloc_port_ice_resp_info *resp, avs_cmd_cb cb, void *user_data)
+{
+	return general_action_async(param, resp, ST_AVS_ALLOC_PORT_ICE, cb, user_data);
+}
+
+AVS_CMD_RESULT avs_set_global_param_async(struct avs_global_param *param, struct avs_common_resp_info *resp, avs_cmd_cb cb, void *user_data)
+{
+	return general_action_async(param, resp, ST_AVS_SET_GLOBAL_PARAM, cb, user_data);
+}
+
+AVS_CMD_RESULT avs_set_peerport_param_normal(struct avs_set_peerport_normal_param *param, struct avs_common_resp_info *resp)
+{
+	return general_action(param, resp, ST_AVS_SET_PEERPORT_PARAM_NORMAL);
+}
+
+AVS_CMD_RESULT avs_set_peerport_param_ice(struct avs_set_peerport_ice_param *param, struct avs_common_resp_info *resp)
+{
+	return general_action(param, resp, ST_AVS_SET_PEERPORT_PARAM_ICE);
+}
+
+AVS_CMD_RESULT avs_alloc_port_normal(struct avs_alloc_port_normal_param *param, struct avs_alloc_port_normal_resp_info *resp)
+{
+	return general_action(param, resp, ST_AVS_ALLOC_PORT_NORMAL);
+}
+
+AVS_CMD_RESULT avs_alloc_port_ice(struct avs_alloc_port_ice_param *param, struct avs_alloc_port_ice_resp_info *resp)
+{
+	return general_action(param, resp, ST_AVS_ALLOC_PORT_ICE);
+}
+
+void avs_alloc_port_ice_resp_release(struct avs_alloc_port_ice_resp_info *resp)
+{
+	if (resp->arena)
+	{
+		arena_put(resp->arena);
+	}
+	
+	resp->arena = NULL;
+	resp->candidates = NULL;
+	resp->num_candidates = resp->dropped_candidates = 0;
+}
+
+AVS_CMD_RESULT avs_dealloc_port(struct avs_dealloc_port_param *param, struct avs_common_resp_info *resp)
+{
+	return general_action(param, resp, ST_AVS_DEALLOC_PORT);
+}
+
+AVS_CMD_RESULT avs_dealloc_port_async(struct avs_dealloc_port_param *param, struct avs_common_resp_info *resp, avs_cmd_cb cb, void *user_data)
+{
+	return general_action_async(param, resp, ST_AVS_DEALLOC_PORT, cb, user_data);
+}
+
+AVS_CMD_RESULT avs_set_global_param(struct avs_global_param *param, struct avs_common_resp_info *resp)
+{
+	return general_action(param, resp, ST_AVS_SET_GLOBAL_PARAM);
+}
+
+/* Issue a command given by its compact parameter, and wait until it completes. */
+static AVS_CMD_RESULT ref_action(const void *ref, void *resp, CMD_TYPE_STATE cmd_type)
+{
+	if (!ref)
+	{
+		log_err("invalid command parameters!\n");
+		return ERROR;
+	}
+	
+	return sync_action(NULL, ref, resp, cmd_type);
+}
+
+/* Issue a command given by its compact parameter. It goes to the instance of its conference, no compact command is global. */
+static AVS_CMD_RESULT ref_action_async(const void *ref, void *resp, CMD_TYPE_STATE cmd_type, avs_cmd_cb cb, void *user_data)
+{
+	if (!ref)
+	{
+		log_err("invalid command parameters!\n");
+		return ERROR;
+	}
+	
+	return cmd_submit(NULL, ref, resp, cmd_type, -1, cb, user_data);
+}
+
+AVS_CMD_RESULT avs_alloc_port_normal_ref(const struct avs_alloc_port_ref_param *param, struct avs_alloc_port_normal_resp_info *resp)
+{
+	return ref_action(param, resp, ST_AVS_ALLOC_PORT_NORMAL);
+}
+
+AVS_CMD_RESULT avs_alloc_port_normal_ref_async(const struct avs_alloc_port_ref_param *param, struct avs_alloc_port_normal_resp_info *resp, avs_cmd_cb cb, void *user_data)
+{
+	return ref_action_async(param, resp, ST_AVS_ALLOC_PORT_NORMAL, cb, user_data);
+}
+
+AVS_CMD_RESULT avs_alloc_port_ice_ref(const struct avs_alloc_port_ref_param *param, struct avs_alloc_port_ice_resp_info *resp)
+{
+	return ref_action(param, resp, ST_AVS_ALLOC_PORT_ICE);
+}
+
+AVS_CMD_RESULT avs_alloc_port_ice_ref_async(const struct avs_alloc_port_ref_param *param, struct avs_alloc_port_ice_resp_info *resp, avs_cmd_cb cb, void *user_data)
+{
+	return ref_action_async(param, resp, ST_AVS_ALLOC_PORT_ICE, cb, user_data);
+}
+
+AVS_CMD_RESULT avs_dealloc_port_ref(const struct avs_chan_ref *param, struct avs_common_resp_info *resp)
+{
+	return ref_action(param, resp, ST_AVS_DEALLOC_PORT);
+}
+
+AVS_CMD_RESULT avs_dealloc_port_ref_async(const struct avs_chan_ref *param, struct avs_common_resp_info *resp, avs_cmd_cb cb, void *user_data)
+{
+	return ref_action_async(param, resp, ST_AVS_DEALLOC_PORT, cb, user_data);
+}
+
+AVS_CMD_RESULT avs_set_peerport_param_normal_ref(const struct avs_set_peerport_normal_ref_param *param, struct avs_common_resp_info *resp)
+{
+	return ref_action(param, resp, ST_AVS_SET_PEERPORT_PARAM_NORMAL);
+}
+
+AVS_CMD_RESULT avs_set_peerport_param_normal_ref_async(const struct avs_set_peerport_normal_ref_param *param, struct avs_common_resp_info *resp, avs_cmd_cb cb, void *user_data)
+{
+	return ref_action_async(param, resp, ST_AVS_SET_PEERPORT_PARAM_NORMAL, cb, user_data);
+}
+
+AVS_CMD_RESULT avs_set_peerport_param_ice_ref(const struct avs_set_peerport_ice_ref_param *param, struct avs_common_resp_info *resp)
+{
+	return ref_action(param, resp, ST_AVS_SET_PEERPORT_PARAM_ICE);
+}
+
+AVS_CMD_RESULT avs_set_peerport_param_ice_ref_async(const struct avs_set_peerport_ice_ref_param *param, struct avs_common_resp_info *resp, avs_cmd_cb cb, void *user_data)
+{
+	return ref_action_async(param, resp, ST_AVS_SET_PEERPORT_PARAM_ICE, cb, user_data);
+}
+
+AVS_CMD_RESULT avs_set_audio_codec_param_ref(const struct avs_codec_audio_ref_param *param, struct avs_common_resp_info *resp)
+{
+	return ref_action(param, resp, ST_AVS_SET_AUDIO_CODEC_PARAM);
+}
+
+AVS_CMD_RESULT avs_set_audio_codec_param_ref_async(const struct avs_codec_audio_ref_param *param, struct avs_common_resp_info *resp, avs_cmd_cb cb, void *user_data)
+{
+	return ref_action_async(param, resp, ST_AVS_SET_AUDIO_CODEC_PARAM, cb, user_data);
+}
+
+AVS_CMD_RESULT avs_set_video_codec_param_ref(const struct avs_codec_video_ref_param *param, struct avs_common_resp_info *resp)
+{
+	return ref_action(param, resp, ST_AVS_SET_VIDEO_CODEC_PARAM);
+}
+
+AVS_CMD_RESULT avs_set_video_codec_param_ref_async(const struct avs_codec_video_ref_param *param, struct avs_common_resp_info *resp, avs_cmd_cb cb, void *user_data)
+{
+	return ref_action_async(param, resp, ST_AVS_SET_VIDEO_CODEC_PARAM, cb, user_data);
+}
+
+AVS_CMD_RESULT avs_runctrl_chan_ref(const struct avs_runctrl_chan_ref_param *param, struct avs_common_resp_info *resp)
+{
+	return ref_action(param, resp, ST_AVS_RUNCTRL_CHAN);
+}
+
+AVS_CMD_RESULT avs_runctrl_chan_ref_async(const struct avs_runctrl_chan_ref_param *param, struct avs_common_resp_info *resp, avs_cmd_cb cb, void *user_data)
+{
+	return ref_action_async(param, resp, ST_AVS_RUNCTRL_CHAN, cb, user_data);
+}
+
+AVS_CMD_RESULT avs_playsound_ref(const struct avs_playsound_chan_ref_param *param, struct avs_common_resp_info *resp)
+{
+	(void)param;
+	(void)resp;
+	
+	return playsound_unsupported();
+}
+
+AVS_CMD_RESULT avs_playsound_ref_async(const struct avs_playsound_chan_ref_param *param, struct avs_common_resp_info *resp, avs_cmd_cb cb, void *user_data)
+{
+	(void)param;
+	(void)resp;
+	(void)cb;
+	(void)user_data;
+	
+	return playsound_unsupported();
+}
+
+AVS_CMD_RESULT avs_setup_conference_async(const char *conf_id, struct avs_chan_setup_desc *descs, unsigned int num, avs_setup_cb cb, void *user_data)
+{
+	struct setup_batch *batch;
+	struct arena *arena;
+	unsigned int i, window;
+	
+	if (-1 == sockfd)
+	{
+		log_err("socket is not created!\n");
+		return ERROR;		
 	}
 	
-	json_decref(root);
+	if (!conf_id || !conf_id[0] || !descs || !num)
+	{
+		log_err("invalid bulk setup parameters!\n");
+		return ERROR;
+	}
 	
-	return NULL;
+	if (!(arena = arena_get()) || !(batch = arena_alloc(arena, sizeof(*batch) + num * sizeof(batch->chans[0]))))
+	{
+		log_err("Malloc bulk setup failed\n");
+		arena_put(arena);
+		return ERROR;
+	}
+	
+	memset(batch, 0, sizeof(*batch));
+	batch->arena = arena;
+	STR_COPY(batch->conf_id, conf_id);
+	batch->num = num;
+	batch->remaining = num;
+	batch->result = SUCCESS;
+	batch->cb = cb;
+	batch->user_data = user_data;
+	pthread_mutex_init(&batch->lock, NULL);
+	
+	for (i = 0; i < num; i++)
+	{
+		batch->chans[i].batch = batch;
+		batch->chans[i].desc = &descs[i];
+		batch->chans[i].step = AVS_CHAN_SETUP_ALLOC_PORT;
+		descs[i].result = ERROR;
+		descs[i].failed_step = AVS_CHAN_SETUP_DONE;
+		memset(&descs[i].resp, 0, sizeof(descs[i].resp));
+	}
+	
+	/* Start a window of channels, the others start when one of them finishes. */
+	window = (num < SETUP_BATCH_WINDOW) ? num : SETUP_BATCH_WINDOW;
+	batch->started = window;
+	
+	for (i = 0; i < window; i++)
+	{
+		setup_chan_next_step(&batch->chans[i]);
+	}
+	
+	return SUCCESS;
+}
 
-}// lalalala
-//merge testing.
-/* General function of backfilling response data to the caller */
-static void *general_fill_resp(void *resp, CMD_TYPE_STATE cmd_type)
+AVS_CMD_RESULT avs_setup_conference(const char *conf_id, struct avs_chan_setup_desc *descs, unsigned int num)
 {
-	switch (cmd_type)
+	struct sync_waiter waiter;
+	AVS_CMD_RESULT ret;
+	
+	if (sync_refused())
 	{
-		case ST_AVS_SET_GLOBAL_PARAM:
-		case ST_AVS_SET_PEERPORT_PARAM_NORMAL:
-		case ST_AVS_SET_PEERPORT_PARAM_ICE:
-			{
-				struct avs_common_resp_info *r = (struct avs_common_resp_info *)resp;
-				fill_common_resp(r);	/* Fill the message returned from the AVS to the command requester. */
-			}
-			break;
-		
-		case ST_AVS_ALLOC_PORT_NORMAL:
-			{
-				struct avs_alloc_port_normal_resp_info *r = (struct avs_alloc_port_normal_resp_info *)resp;
-				fill_alloc_port_normal_resp(r);	/* Fill the message returned from the AVS to the command requester. */
-			}
-			break;
-			
-		case ST_AVS_ALLOC_PORT_ICE:
-			{
-				struct avs_alloc_port_ice_resp_info *r = (struct avs_alloc_port_ice_resp_info *)resp;
-				fill_alloc_port_ice_resp(r);	
-			}
-			break;
-			
-		default:
-			break;
+		return ERROR;
 	}
 	
-	int c = 0;
-	char ccc = NULL;
+	waiter.done = 0;
+	waiter.result = ERROR;
+	pthread_mutex_init(&waiter.mutex, NULL);
+	pthread_cond_init(&waiter.cond, NULL);
 	
-	return NULL;
+	ret = avs_setup_conference_async(conf_id, descs, num, sync_setup_cb, &waiter);
+	
+	if (SUCCESS == ret && wait_for_avs(&waiter) == R_SUCCESS)
+	{
+		ret = waiter.result;
+	}
+	
+	pthread_cond_destroy(&waiter.cond);
+	pthread_mutex_destroy(&waiter.mutex);
+	
+	return ret;
 }
-//hzdev-----testing
-/* General processing function of command request.
- * 1. Encapsulate JSON.
- * 2. Send JSON to AVS.
- * 3. Set the current context of command request.
- * 4. Wait for response from AVS(Conditional variable).
- * 5. Backfill response data to the caller.
- */
-static FUNC_RETURN general_action(void *param, void *resp, CMD_TYPE_STATE cmd_type)
+
+AVS_CMD_RESULT avs_destroy_conference_async(const char *conf_id, avs_teardown_cb cb, void *user_data)
 {
-	const char *json_s = NULL;
-	FUNC_RETURN ret = R_SUCCESS;
+	struct teardown_batch *batch;
+	struct state_chan_ref *refs;
+	struct arena *arena;
+	unsigned int i, num, window;
 	
 	if (-1 == sockfd)
 	{
-		printf("socket is not created!\n");
+		log_err("socket is not created!\n");
 		return ERROR;		
 	}
 	
-	pthread_mutex_lock(&p_mutex);
+	if (!conf_id || !conf_id[0])
+	{
+		log_err("invalid conference id!\n");
+		return ERROR;
+	}
 	
-	if (!(json_s = general_json_enc(param, cmd_type)))
+	if (!(arena = arena_get()))
 	{
-		pthread_mutex_unlock(&p_mutex);
+		log_err("Malloc conference teardown failed\n");
 		return ERROR;
 	}
 	
-	int a = 0;
+	if (!(refs = state_conf_chans(conf_id, arena, &num)))
+	{
+		log_warn("conference %s has no channel.\n", conf_id);
+		arena_put(arena);
+		return ERROR;
+	}
 	
-	/* Send JSON message to AVS. */
-	if (cmd_send(json_s) != R_SUCCESS)
+	if (!(batch = arena_alloc(arena, sizeof(*batch) + num * sizeof(batch->chans[0]))))
 	{
-		pthread_mutex_unlock(&p_mutex);
-		free((void *)json_s);
+		log_err("Malloc conference teardown failed\n");
+		arena_put(arena);
 		return ERROR;
 	}
 	
-	/* "json_s" is pointed to memory which allocated by the JSON Library, then is no longer useful, so we can free it. */
-	free((void *)json_s);
+	memset(batch, 0, sizeof(*batch));
+	batch->arena = arena;
+	STR_COPY(batch->conf_id, conf_id);
+	batch->num = num;
+	batch->remaining = num;
+	batch->cb = cb;
+	batch->user_data = user_data;
+	pthread_mutex_init(&batch->lock, NULL);
 	
-	/* Set current context of command. */
-	cmd_current_state = cmd_type;
+	for (i = 0; i < num; i++)
+	{
+		batch->chans[i].batch = batch;
+		batch->chans[i].ref = &refs[i];
+		batch->chans[i].pending = 2;
+		batch->chans[i].failed = 0;
+		batch->chans[i].sent = 0;
+	}
 	
-	/* waiting here... */
-	ret = wait_for_avs();
+	/* Start a window of channels, the others start when one of them finishes. */
+	window = (num < TEARDOWN_BATCH_WINDOW) ? num : TEARDOWN_BATCH_WINDOW;
+	batch->started = window;
 	
-	if (R_SUCCESS != ret)
+	for (i = 0; i < window; i++)
 	{
-		printf("send command to AVS failed.\n");
-		pthread_mutex_unlock(&p_mutex);
-		return ERROR;	
+		teardown_chan_send(&batch->chans[i]);
 	}
 	
-	/* If parse the JSON format error, return ERROR.  */
-	if (MSG_PARSE_RESULT_FAIL == msg_parse_result)
+	return SUCCESS;
+}
+
+AVS_CMD_RESULT avs_destroy_conference(const char *conf_id)
+{
+	struct sync_waiter waiter;
+	AVS_CMD_RESULT ret;
+	
+	if (sync_refused())
 	{
-		pthread_mutex_unlock(&p_mutex);
 		return ERROR;
 	}
 	
-	/* Backfill response data to the caller. */
-	general_fill_resp(resp, cmd_type);
+	waiter.done = 0;
+	waiter.result = ERROR;
+	pthread_mutex_init(&waiter.mutex, NULL);
+	pthread_cond_init(&waiter.cond, NULL);
+	
+	ret = avs_destroy_conference_async(conf_id, sync_teardown_cb, &waiter);
 	
-	cmd_current_state = ST_AVS_IDLE;
+	if (SUCCESS == ret && wait_for_avs(&waiter) == R_SUCCESS)
+	{
+		ret = waiter.result;
+	}
 	
-	pthread_mutex_unlock(&p_mutex);
+	pthread_cond_destroy(&waiter.cond);
+	pthread_mutex_destroy(&waiter.mutex);
 	
-	return SUCCESS;
+	return ret;
 }
 
-AVS_CMD_RESULT avs_playsound(struct avs_playsound_chan_param *param, struct avs_common_resp_info *resp)
+AVS_CMD_RESULT avs_runctrl_conference_async(const char *conf_id, enum avs_runctrl_chan_opt opt, enum avs_runctrl_chan_mtype mtype,
+	const char *const *except_chan_ids, unsigned int num_except, avs_runctrl_conf_cb cb, void *user_data)
 {
+	struct runctrl_batch *batch;
+	struct state_chan_ref *refs;
+	struct arena *arena;
+	unsigned int i, j, num, kept, window;
+	
+	if (-1 == sockfd)
+	{
+		log_err("socket is not created!\n");
+		return ERROR;		
+	}
+	
+	if (!conf_id || !conf_id[0] || (num_except && !except_chan_ids))
+	{
+		log_err("invalid conference id or excepted channels!\n");
+		return ERROR;
+	}
+	
+	if (!(arena = arena_get()))
+	{
+		log_err("Malloc conference run control failed\n");
+		return ERROR;
+	}
+	
+	if (!(refs = state_conf_chans(conf_id, arena, &num)))
+	{
+		log_warn("conference %s has no channel.\n", conf_id);
+		arena_put(arena);
+		return ERROR;
+	}
+	
+	/* Drop the excepted channels from the copy, like AVS_PLAYSOUND_CHAN_ALL_EXPT_CHAN does for a sound. */
+	for (i = 0, kept = 0; i < num; i++)
+	{
+		for (j = 0; j < num_except && (!except_chan_ids[j] || strcmp(except_chan_ids[j], refs[i].chan_id)); j++)
+		{
+		}
+		
+		if (j == num_except)
+		{
+			refs[kept++] = refs[i];
+		}
+	}
+	num = kept;
+	
+	/* Every channel is excepted, there is nothing to wait for. */
+	if (!num)
+	{
+		arena_put(arena);
+		if (cb)
+		{
+			cb(SUCCESS, 0, 0, user_data);
+		}
+		return SUCCESS;
+	}
+	
+	if (!(batch = arena_alloc(arena, sizeof(*batch) + num * sizeof(batch->chans[0]))))
+	{
+		log_err("Malloc conference run control failed\n");
+		arena_put(arena);
+		return ERROR;
+	}
+	
+	memset(batch, 0, sizeof(*batch));
+	batch->arena = arena;
+	STR_COPY(batch->conf_id, conf_id);
+	batch->opt = opt;
+	batch->mtype = mtype;
+	batch->num = num;
+	batch->remaining = num;
+	batch->cb = cb;
+	batch->user_data = user_data;
+	pthread_mutex_init(&batch->lock, NULL);
+	
+	for (i = 0; i < num; i++)
+	{
+		batch->chans[i].batch = batch;
+		batch->chans[i].ref = &refs[i];
+	}
+	
+	/* Burst a window of channels at once, the others start when one of them finishes. */
+	window = (num < RUNCTRL_BATCH_WINDOW) ? num : RUNCTRL_BATCH_WINDOW;
+	batch->started = window;
+	
+	for (i = 0; i < window; i++)
+	{
+		runctrl_chan_start(&batch->chans[i]);
+	}
+	
 	return SUCCESS;
 }
 
-AVS_CMD_RESULT avs_runctrl_chan(struct avs_runctrl_chan_param *param, struct avs_common_resp_info *resp)
+AVS_CMD_RESULT avs_runctrl_conference(const char *conf_id, enum avs_runctrl_chan_opt opt, enum avs_runctrl_chan_mtype mtype,
+	const char *const *except_chan_ids, unsigned int num_except)
 {
-	return SUCCESS;
+	struct sync_waiter waiter;
+	AVS_CMD_RESULT ret;
+	
+	if (sync_refused())
+	{
+		return ERROR;
+	}
+	
+	waiter.done = 0;
+	waiter.result = ERROR;
+	pthread_mutex_init(&waiter.mutex, NULL);
+	pthread_cond_init(&waiter.cond, NULL);
+	
+	ret = avs_runctrl_conference_async(conf_id, opt, mtype, except_chan_ids, num_except, sync_runctrl_cb, &waiter);
+	
+	if (SUCCESS == ret && wait_for_avs(&waiter) == R_SUCCESS)
+	{
+		ret = waiter.result;
+	}
+	
+	pthread_cond_destroy(&waiter.cond);
+	pthread_mutex_destroy(&waiter.mutex);
+	
+	return ret;
 }
 
-AVS_CMD_RESULT avs_set_audio_codec_param(struct avs_codec_audio_param *param, struct avs_common_resp_info *resp)
+AVS_CMD_RESULT avs_get_io_counters(struct avs_io_counters *counters)
 {
+	if (!counters)
+	{
+		return ERROR;
+	}
+	
+	io_counters_get(counters);
+	
 	return SUCCESS;
 }
 
-AVS_CMD_RESULT avs_set_video_codec_param(struct avs_codec_video_param *param, struct avs_common_resp_info *resp)
+AVS_CMD_RESULT avs_get_stats(struct avs_stats *stats)
 {
+	if (!stats)
+	{
+		return ERROR;
+	}
+	
+	stats_snapshot(stats);
+	io_counters_get(&stats->io);
+	
 	return SUCCESS;
 }
 
-AVS_CMD_RESULT avs_set_peerport_param_normal(struct avs_set_peerport_normal_param *param, struct avs_common_resp_info *resp)
-{
-	return general_action(param, resp, ST_AVS_SET_PEERPORT_PARAM_NORMAL);
-}
-
-AVS_CMD_RESULT avs_set_peerport_param_ice(struct avs_set_peerport_ice_param *param, struct avs_common_resp_info *resp)
-{
-	return general_action(param, resp, ST_AVS_SET_PEERPORT_PARAM_ICE);
-}
-
-AVS_CMD_RESULT avs_alloc_port_normal(struct avs_alloc_port_normal_param *param, struct avs_alloc_port_normal_resp_info *resp)
-{
-	return general_action(param, resp, ST_AVS_ALLOC_PORT_NORMAL);
-}
-
-AVS_CMD_RESULT avs_alloc_port_ice(struct avs_alloc_port_ice_param *param, struct avs_alloc_port_ice_resp_info *resp)
+AVS_CMD_RESULT avs_get_instance_stats(struct avs_instance_stats *stats, unsigned int *num)
 {
-	return general_action(param, resp, ST_AVS_ALLOC_PORT_ICE);
+	struct shard_load load;
+	unsigned int i;
+	
+	if (!stats || !num)
+	{
+		return ERROR;
+	}
+	
+	for (i = 0; i < num_instances; i++)
+	{
+		memset(&stats[i], 0, sizeof(stats[i]));
+		STR_COPY(stats[i].path, instances[i].addr.sun_path);
+		shard_get_load(i, &load);
+		stats[i].confs = load.confs;
+		stats[i].ports = load.ports;
+		stats[i].in_flight = load.in_flight;
+		stats[i].tx_msgs = instances[i].tx_msgs;
+		stats[i].responses = instances[i].responses;
+		stats[i].timeouts = instances[i].timeouts;
+		stats[i].transport = instances[i].shm_active ? AVS_TRANSPORT_SHM : AVS_TRANSPORT_SOCKET;
+		stats[i].wire = instances[i].wire_tlv ? AVS_WIRE_TLV : AVS_WIRE_JSON;
+	}
+	
+	*num = num_instances;
+	
+	return SUCCESS;
 }
 
-AVS_CMD_RESULT avs_dealloc_port(struct avs_dealloc_port_param *param, struct avs_common_resp_info *resp)
+int avs_conference_instance(const char *conf_id)
 {
-	return SUCCESS;	
+	return (conf_id && conf_id[0]) ? shard_lookup(conf_id) : -1;
 }
 
-AVS_CMD_RESULT avs_set_global_param(struct avs_global_param *param, struct avs_common_resp_info *resp)
+AVS_CMD_RESULT avs_create_conn(void)
 {
-	return general_action(param, resp, ST_AVS_SET_GLOBAL_PARAM);
+	return avs_create_conn_ex(NULL);
 }
 
-AVS_CMD_RESULT avs_create_conn(void)
+AVS_CMD_RESULT avs_create_conn_ex(const struct avs_conn_config *config)
 {
+	unsigned int capacity = (config && config->queue_capacity) ? config->queue_capacity : AVS_DEFAULT_QUEUE_CAPACITY;
+	int i;
+	
+	for (i = 0; i < AVS_CMD_MAX; i++)
+	{
+		cmd_timeouts[i] = (config && config->cmd_timeout_ms[i]) ? config->cmd_timeout_ms[i] : AVS_DEFAULT_CMD_TIMEOUT_MS;
+	}
+	keep_duplicates = config ? (config->keep_duplicates != 0) : 0;
+	
+	/* From now on messages go through the rings of the logging thread, the command path does not wait for the console. */
+	log_start();
+	
+	if (instance_init(config) != R_SUCCESS)
+		goto fail_log;
+	
 	if (sock_init() != R_SUCCESS)
-		return ERROR;
+		goto fail_log;
 		
-	if (!(recv_buffer = malloc(RECV_BUFFER_SIZE)))
+	/* Page aligned, and a slab only takes memory once a datagram that long has been received into it. */
+	if (MAP_FAILED == recv_slabs && MAP_FAILED == (recv_slabs = mmap(NULL, MMSG_BATCH * RECV_SLAB_SIZE, PROT_READ | PROT_WRITE,
+		MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0)))
 	{
-		printf("Malloc recv buffer failed\n");
-		return ERROR;	
+		perror("mmap recv slabs");
+		goto fail_sock;
 	}
 	
-	if (pthread_mutex_init(&p_mutex, NULL) != 0)
-    {
-    	printf("mutex init failed.\n");
-        return ERROR;
-    }
-	
-	if (pthread_cond_init(&cond_v, NULL) != 0)
+	if (mpsc_init(&sq, capacity, sizeof(struct cmd_submission)) != 0)
 	{
-		printf("condition variable init failed.\n");
-		return ERROR;
+		log_err("Malloc submission queue failed\n");
+		goto fail_slabs;
 	}
 	
 	data_init();
+	state_reset();
+	shard_reset(num_instances);
+	
+	memset(&io_counters, 0, sizeof(io_counters));
+	stats_reset();
+	sq_registered = 0;
+	io_sleeping = 0;
+	tx_backlog = 0;
+	
+	if (reactor_init() != R_SUCCESS || reactor_add(sockfd, sock_readable, NULL) != R_SUCCESS)
+	{
+		log_err("reactor init failed.\n");
+		goto fail_reactor;
+	}
+	
+	if (event_start() != 0)
+	{
+		goto fail_reactor;
+	}
+	
+	/* Each instance negotiates on its own, e.g. while they are upgraded one by one. */
+	for (i = 0; i < (int)num_instances; i++)
+	{
+		if (config && AVS_WIRE_TLV == config->wire)
+		{
+			wire_connect(&instances[i]);
+		}
+		
+		if (config && AVS_TRANSPORT_SHM == config->transport)
+		{
+			shm_connect(&instances[i]);
+		}
+	}
+	
+	io_counters.wire = instances[0].wire_tlv ? AVS_WIRE_TLV : AVS_WIRE_JSON;
+	io_counters.transport = instances[0].shm_active ? AVS_TRANSPORT_SHM : AVS_TRANSPORT_SOCKET;
+	
+	reactor_running = 1;
 		
 	if (pthread_create(&recv_thread, NULL, recv_task, NULL))
 	{
-		printf("Create recv_thread failed\n");
-		return ERROR;
+		log_err("Create recv_thread failed\n");
+		reactor_running = 0;
+		goto fail_event;
 	}
 	
 	return SUCCESS;
+	
+	/* Undo the setup in reverse order, the controller is left as before the call and may be connected again. */
+fail_event:
+	event_stop();
+	for (i = 0; i < (int)num_instances; i++)
+	{
+		if (instances[i].shm_active)
+		{
+			shm_link_close(&instances[i].shm);
+			instances[i].shm_active = 0;
+		}
+	}
+	
+fail_reactor:
+	if (epfd >= 0)
+		close(epfd);
+	if (wakeup_fd >= 0)
+		close(wakeup_fd);
+	if (timer_fd >= 0)
+		close(timer_fd);
+	epfd = wakeup_fd = timer_fd = -1;
+	memset(reactor_sources, 0, sizeof(reactor_sources));
+	state_reset();
+	shard_reset(num_instances);
+	arena_trim();
+	mpsc_destroy(&sq);
+	
+fail_slabs:
+	munmap(recv_slabs, MMSG_BATCH * RECV_SLAB_SIZE);
+	recv_slabs = MAP_FAILED;
+	
+fail_sock:
+	close(sockfd);
+	sockfd = -1;
+	
+fail_log:
+	log_stop();
+	return ERROR;
 }
 
 void avs_shutdown(void)
 {
-	pthread_cond_destroy(&cond_v);
+	struct cmd_submission *sub;
+	unsigned int i;
+	
+	if (reactor_running)
+	{
+		reactor_running = 0;
+		reactor_wakeup();
+		pthread_join(recv_thread, NULL);
+	}
+	
+	event_stop();
+	
+	pending_fail_all(LINK_DISCONNECT);
+	
+	/* Fail the commands which have not been taken into the pending table, then drop all the queued messages. */
+	while (sq.cells && (sub = mpsc_peek(&sq, sq_registered)))
+	{
+		sq_registered++;
+		
+		if (ST_AVS_IDLE != sub->cmd_type && sub->cb)
+		{
+			sub->cb(LINK_DISCONNECT, sub->resp, sub->user_data);
+		}
+	}
+	if (sq.cells)
+	{
+		mpsc_release(&sq, sq_registered);
+	}
+	
+	close(epfd);
+	close(wakeup_fd);
+	close(timer_fd);
+	epfd = wakeup_fd = timer_fd = -1;
+	
 	close(sockfd);
 	sockfd = -1;
+	
+	/* The deferred batch channels fail now, so do the channels they would have been followed by. */
+	batch_resume_all();
+	
+	for (i = 0; i < num_instances; i++)
+	{
+		if (instances[i].shm_active)
+		{
+			shm_link_close(&instances[i].shm);
+			instances[i].shm_active = 0;
+		}
+	}
+	
+	mpsc_destroy(&sq);
+	state_reset();
+	shard_reset(num_instances);
+	arena_trim();
+	
+	if (MAP_FAILED != recv_slabs)
+	{
+		munmap(recv_slabs, MMSG_BATCH * RECV_SLAB_SIZE);
+		recv_slabs = MAP_FAILED;
+	}
+	
+	log_stop();
 }
 
-#if 1
+#ifndef AVS_NO_DEMO_MAIN	/* Defined when the controller is linked into another program, e.g. avs-loadgen. */
 /* main - Just for testing APIs..*/
 int main(void)
 {
+	avs_set_log_level(AVS_LOG_DEBUG);
 	
 	if (avs_create_conn() != SUCCESS) 
 	{
@@ -37,6 +37,8 @@
 #define MAX_CHANID_LEN 		256
 #define MAX_PORTID_LEN		20
 #define MAX_CANDIDATE_STR_LEN		200	/* one candidate length. */
+#define MAX_CAND_FOUNDATION_LEN	33	/* 1 to 32 ice-chars, ref: rfc5245 */
+#define MAX_CAND_ADDR_LEN	46	/* e.g: 2001:db8::8a2e:370:7334, IPv6 text form. */
 #define MAX_UNIQUE_ID		20
 #define MAX_MESSAGE_REPONSE	50
 #define MAX_FINGERPRINT_LEN	70	/* e.g: sha-512 4A:AD:B9:B1:3F:82:18:3B:54:02:12:DF:3E:5D:49:6B:19:E5:7C:AB */
@@ -44,6 +46,7 @@
 #define MAX_ICE_PASSWROD	23	/* e.g: asd88fgpdd777uzjYhagZg */
 #define MAX_ICE_QOS		3
 #define MAX_SRTP_KEY_LEN	100	/* ref: rfc4568 */
+#define MAX_EVENT_STATE_LEN	32	/* e.g: connected */
 
 /**
  * enum avs_audio_codec - Audio codecs.
@@ -119,17 +122,271 @@ enum avs_playsound_chan_type
 /**
  * enum avs_cmd_result - The return result of "avs_" APIs.
  *
+ * @NOT_SUPPORTED:  The command is not known to work with AVS yet, nothing has been sent.
+ * @QUEUE_FULL:  The submission queue is full, the command has not been taken. Try again once some commands have completed.
  * @LINK_DISCONNECT:  The HTTP connection between AVS and avs_conntroller has been broken.
  * @ERROR:  Maybe socket error???
  * @SUCCESS:  Sending commanders to AVS sucessfully.
  */
 typedef enum avs_cmd_result 
 {
+	NOT_SUPPORTED = -4,
+	QUEUE_FULL = -3,
 	LINK_DISCONNECT = -2,
 	ERROR,
 	SUCCESS
 } AVS_CMD_RESULT;
 
+/**
+ * enum avs_transport - How commands and responses travel between avs_controller and AVS.
+ *
+ * @AVS_TRANSPORT_SOCKET:  Datagrams on the AF_UNIX socket.
+ * @AVS_TRANSPORT_SHM:  Rings in shared memory, offered to AVS through the socket which carries nothing else afterwards.
+ *   The socket is used if AVS does not take them.
+ */
+enum avs_transport
+{
+	AVS_TRANSPORT_SOCKET,
+	AVS_TRANSPORT_SHM
+};
+
+/**
+ * enum avs_wire - How commands and their responses are encoded.
+ *
+ * @AVS_WIRE_JSON:  JSON text, numbers as strings.
+ * @AVS_WIRE_TLV:  Binary frames of avs_tlv.h, asked for with a "hello" command. JSON is used if AVS does not accept them.
+ *   Notifications from AVS stay JSON.
+ */
+enum avs_wire
+{
+	AVS_WIRE_JSON,
+	AVS_WIRE_TLV
+};
+
+/**
+ * struct avs_io_counters - Counters of the batched socket I/O between avs_controller and AVS.
+ *
+ * @tx_msgs:  Commands sent to AVS.
+ * @tx_batches:  sendmmsg() calls which sent at least one command. tx_msgs / tx_batches is the average batch size.
+ * @tx_max_batch:  Most commands sent by one sendmmsg().
+ * @tx_retries:  Times AVS could not take more commands and sending was retried later.
+ * @rx_msgs:  Messages received from AVS.
+ * @rx_batches:  recvmmsg() calls which received at least one message.
+ * @rx_max_batch:  Most messages received by one recvmmsg().
+ * @rx_events:  Notifications received from AVS and queued for their handlers.
+ * @rx_events_dropped:  Notifications dropped because the event queue was full or they were not understood.
+ * @rx_truncated:  Datagrams from AVS dropped: longer than a receiving slab with no memory for them, or cut behind another one in a batch.
+ * @tx_queue_full:  Commands refused with QUEUE_FULL because the submission queue was full.
+ * @transport:  Transport in use with the first instance, see avs_get_instance_stats() for the others.
+ *   With AVS_TRANSPORT_SHM a batch is a run of ring records instead of a system call.
+ * @tx_bells:  Times AVS slept and its shared memory doorbell was rung, at most once per batch sent.
+ * @wire:  Encoding in use with the first instance.
+ */
+struct avs_io_counters
+{
+	unsigned long tx_msgs;
+	unsigned long tx_batches;
+	unsigned long tx_max_batch;
+	unsigned long tx_retries;
+	unsigned long rx_msgs;
+	unsigned long rx_batches;
+	unsigned long rx_max_batch;
+	unsigned long rx_events;
+	unsigned long rx_events_dropped;
+	unsigned long rx_truncated;
+	unsigned long tx_queue_full;
+	enum avs_transport transport;
+	unsigned long tx_bells;
+	enum avs_wire wire;
+};
+
+/**
+ * enum avs_cmd_type - Commands sent to AVS, the index of the per command statistics.
+ */
+enum avs_cmd_type
+{
+	AVS_CMD_SET_GLOBAL_PARAM,
+	AVS_CMD_ALLOC_PORT_NORMAL,
+	AVS_CMD_ALLOC_PORT_ICE,
+	AVS_CMD_DEALLOC_PORT,
+	AVS_CMD_SET_PEERPORT_PARAM_NORMAL,
+	AVS_CMD_SET_PEERPORT_PARAM_ICE,
+	AVS_CMD_SET_AUDIO_CODEC_PARAM,
+	AVS_CMD_SET_VIDEO_CODEC_PARAM,
+	AVS_CMD_RUNCTRL_CHAN,
+	AVS_CMD_PLAYSOUND,
+	AVS_CMD_MAX
+};
+
+#define AVS_DEFAULT_QUEUE_CAPACITY	256	/* Default capacity of the submission queue. */
+#define AVS_DEFAULT_CMD_TIMEOUT_MS	5000	/* Default time to wait for the response of a command. */
+#define AVS_MAX_INSTANCES		4	/* Most AVS processes one avs_controller drives. */
+#define AVS_INSTANCE_PATH_LEN	108	/* Size of a socket path of an AVS instance, sun_path of struct sockaddr_un. */
+
+/**
+ * struct avs_conn_config - Options of avs_create_conn_ex().
+ *
+ * @queue_capacity:  Commands the submission queue holds until the receiving thread takes them, rounded up to a power of 2.
+ *   0 for AVS_DEFAULT_QUEUE_CAPACITY. The "avs_" APIs return QUEUE_FULL when it is full.
+ * @cmd_timeout_ms:  Milliseconds to wait for the response of each enum avs_cmd_type, counted on the monotonic clock from
+ *   taking the command. 0 for AVS_DEFAULT_CMD_TIMEOUT_MS. The command fails with ERROR when it expires.
+ * @keep_duplicates:  Non-zero to send every peer port and codec setting. By default a setting identical to the one AVS last
+ *   accepted for the port completes at once with code 0, and one queued behind a newer setting of the same port is not sent.
+ * @transport:  Transport to try, AVS_TRANSPORT_SOCKET by default.
+ * @wire:  Encoding to ask AVS for, AVS_WIRE_JSON by default.
+ * @num_instances:  AVS processes to spread the conferences on, up to AVS_MAX_INSTANCES. 0 for one AVS at the default socket path.
+ *   A conference goes to the instance with the fewest live ports and commands in flight, and all its commands follow it
+ *   while it has a port or a command in flight. avs_set_global_param() is sent to every instance.
+ * @instance_paths:  Socket path of each instance. The transport and the encoding are negotiated with each of them.
+ */
+struct avs_conn_config
+{
+	unsigned int queue_capacity;
+	unsigned int cmd_timeout_ms[AVS_CMD_MAX];
+	unsigned int keep_duplicates;
+	enum avs_transport transport;
+	enum avs_wire wire;
+	unsigned int num_instances;
+	const char *instance_paths[AVS_MAX_INSTANCES];
+};
+
+/**
+ * struct avs_instance_stats - Load and counters of an AVS instance.
+ *
+ * @path:  Its socket path.
+ * @confs:  Conferences placed on it.
+ * @ports:  Live ports of these conferences, as known by avs_query_conference().
+ * @in_flight:  Commands of these conferences which have not completed.
+ * @tx_msgs:  Commands sent to it.
+ * @responses:  Responses received from it.
+ * @timeouts:  Commands it did not respond to in time.
+ * @transport:  Transport in use with it.
+ * @wire:  Encoding in use with it.
+ */
+struct avs_instance_stats
+{
+	char path[AVS_INSTANCE_PATH_LEN];
+	unsigned int confs;
+	unsigned int ports;
+	unsigned int in_flight;
+	unsigned long tx_msgs;
+	unsigned long responses;
+	unsigned long timeouts;
+	enum avs_transport transport;
+	enum avs_wire wire;
+};
+
+#define AVS_HIST_SUB_BITS	4	/* 2^4 buckets per power of 2, a recorded value is within 1/16 of the real one. */
+#define AVS_HIST_BUCKETS	((32 - AVS_HIST_SUB_BITS + 1) << AVS_HIST_SUB_BITS)	/* Covers every 32 bit value. */
+
+/**
+ * struct avs_latency_hist - HDR style histogram of latencies in microseconds.
+ *   Values under 2^AVS_HIST_SUB_BITS have a bucket each, above that every power of 2 is split into 2^AVS_HIST_SUB_BITS buckets.
+ *
+ * @count:  Recorded values.
+ * @sum_us:  Sum of the recorded values, sum_us / count is the mean.
+ * @max_us:  Largest recorded value.
+ * @buckets:  Recorded values in each bucket, see avs_stats_percentile().
+ */
+struct avs_latency_hist
+{
+	unsigned long count;
+	unsigned long sum_us;
+	unsigned long max_us;
+	unsigned long buckets[AVS_HIST_BUCKETS];
+};
+
+/**
+ * struct avs_stats - Statistics of the commands sent to AVS since avs_create_conn().
+ *
+ * @latency:  Time from sending a command to receiving its response, by enum avs_cmd_type.
+ * @timeouts:  Commands AVS did not respond to in time, by enum avs_cmd_type.
+ * @parse_failures:  Messages from AVS which could not be parsed, or responses missing required members.
+ * @bytes_out:  Bytes of the commands sent to AVS.
+ * @bytes_in:  Bytes of the messages received from AVS.
+ * @in_flight:  Commands waiting for AVS responses when the snapshot was taken.
+ * @in_flight_max:  Most commands waiting for AVS responses at the same time.
+ * @suppressed:  Settings completed without sending them, AVS had accepted the same parameters for the port. Each saved a round trip.
+ * @coalesced:  Settings not sent because a newer one for the same port was queued behind them. Each saved a round trip.
+ * @heap_allocs:  Heap allocations made by avs_controller. Once conferences have come and gone a few times they stop growing.
+ * @heap_frees:  Heap blocks avs_controller gave back.
+ * @io:  Same as avs_get_io_counters().
+ */
+struct avs_stats
+{
+	struct avs_latency_hist latency[AVS_CMD_MAX];
+	unsigned long timeouts[AVS_CMD_MAX];
+	unsigned long parse_failures;
+	unsigned long bytes_out;
+	unsigned long bytes_in;
+	unsigned long in_flight;
+	unsigned long in_flight_max;
+	unsigned long suppressed;
+	unsigned long coalesced;
+	unsigned long heap_allocs;
+	unsigned long heap_frees;
+	struct avs_io_counters io;
+};
+
+/**
+ * enum avs_event_type - Notifications sent by AVS without being asked, the name of the top level member of the message.
+ *
+ * @AVS_EVENT_ICE_STATE:  "iceState", ICE state of a port changed, see "state".
+ * @AVS_EVENT_DTLS_DONE:  "dtlsDone", DTLS handshake of a port finished, "code" is 0 on success.
+ * @AVS_EVENT_PORT_FAILED:  "portFailed", a port stopped working, see "code" and "message".
+ * @AVS_EVENT_PLAYSOUND_DONE:  "playSoundDone", a sound started by avs_playsound() finished.
+ */
+enum avs_event_type
+{
+	AVS_EVENT_ICE_STATE,
+	AVS_EVENT_DTLS_DONE,
+	AVS_EVENT_PORT_FAILED,
+	AVS_EVENT_PLAYSOUND_DONE,
+	AVS_EVENT_MAX
+};
+
+/**
+ * struct avs_event - A notification from AVS, e.g. {"iceState":{"conf_id":"6001","chan_id":"1","port_id":"2","state":"connected"}}.
+ *
+ * @type:  Type of the notification.
+ * @conf_id:  Conference ID.
+ * @chan_id:  Channel ID.
+ * @port_id:  Port ID.
+ * @state:  New state of ICE state changes.
+ * @code:  Result code, 0 if AVS does not send it.
+ * @message:  Description of the result.
+ *
+ * Members AVS does not send are empty.
+ */
+struct avs_event
+{
+	enum avs_event_type type;
+	char conf_id[MAX_CONFID_LEN];
+	char chan_id[MAX_CHANID_LEN];
+	char port_id[MAX_PORTID_LEN];
+	char state[MAX_EVENT_STATE_LEN];
+	unsigned int code;
+	char message[MAX_MESSAGE_REPONSE];
+};
+
+/**
+ * avs_event_cb - Handler of notifications from AVS. It is called from the event thread of avs_controller, never from the receiving thread,
+ * so a slow handler delays other notifications but never command responses.
+ * @event:  The notification, valid during the call only.
+ * @user_data:  The pointer passed to avs_subscribe_event().
+ */
+typedef void (*avs_event_cb)(const struct avs_event *event, void *user_data);
+
+/**
+ * avs_cmd_cb - Completion callback of the "avs_*_async" APIs. It is called from the receiving thread of avs_controller, so it should not block.
+ *   It must not call a blocking API: they return ERROR there, only the "_async" ones may be used. The same holds for
+ *   avs_setup_cb, avs_teardown_cb and avs_runctrl_conf_cb.
+ * @result:  SUCCESS: AVS responded and the response is decoded, ERROR: sending failed, timeout or bad response.
+ * @resp:  The response structure passed to the "avs_*_async" call. Filled only if @result is SUCCESS.
+ * @user_data:  The pointer passed to the "avs_*_async" call.
+ */
+typedef void (*avs_cmd_cb)(AVS_CMD_RESULT result, void *resp, void *user_data);
+
 /**
  * struct avs_response_common_sub_info. The common response info used by structure "avs_alloc_port_normal_resp_info""avs_alloc_port_ice_resp_info".
  *
@@ -230,10 +487,52 @@ struct avs_alloc_port_normal_resp_info
 	struct avs_response_common_sub_info resp;
 };
 
-/* Candidates. */
-struct candidate {
-	char cands_str[MAX_CANDIDATE_STR_LEN];
-	struct candidate *next;
+/**
+ * enum avs_cand_transport - Transport of an ICE candidate.
+ */
+enum avs_cand_transport
+{
+	AVS_CAND_TRANSPORT_UDP,
+	AVS_CAND_TRANSPORT_TCP
+};
+
+/**
+ * enum avs_cand_type - Type of an ICE candidate.
+ */
+enum avs_cand_type
+{
+	AVS_CAND_TYPE_HOST,
+	AVS_CAND_TYPE_SRFLX,
+	AVS_CAND_TYPE_PRFLX,
+	AVS_CAND_TYPE_RELAY
+};
+
+/**
+ * struct avs_candidate - An ICE candidate, the fields of an SDP "a=candidate" line.
+ *
+ * @priority:  Priority.
+ * @generation:  Generation, 0 when AVS does not send it.
+ * @port:  Port of @addr.
+ * @rel_port:  Related port, srflx, prflx and relay candidates only.
+ * @component:  Component id, 1 for RTP and 2 for RTCP.
+ * @transport:  enum avs_cand_transport.
+ * @type:  enum avs_cand_type.
+ * @foundation:  Foundation.
+ * @addr:  Connection address.
+ * @rel_addr:  Related address, empty for host candidates.
+ */
+struct avs_candidate
+{
+	unsigned int priority;
+	unsigned int generation;
+	unsigned short port;
+	unsigned short rel_port;
+	unsigned char component;
+	unsigned char transport;
+	unsigned char type;
+	char foundation[MAX_CAND_FOUNDATION_LEN];
+	char addr[MAX_CAND_ADDR_LEN];
+	char rel_addr[MAX_CAND_ADDR_LEN];
 };
 
 /**
@@ -244,7 +543,10 @@ struct candidate {
  * @fingerprint:  fingerprint.
  * @port_id:  Unique ID for a port resource.
  * @comm_id:  Unique ID of a commander to AVS.
- * @candidates: List of candidates.
+ * @candidates:  All the candidates AVS sent, sized from their count as the response is decoded. NULL for none.
+ * @num_candidates:  Entries of @candidates.
+ * @dropped_candidates:  Candidates AVS sent which are not in @candidates: malformed, or no memory for them.
+ * @arena:  Memory of @candidates, give it back with avs_alloc_port_ice_resp_release().
  * @resp:  Response informations from AVS. 
  */
 struct avs_alloc_port_ice_resp_info 
@@ -254,7 +556,10 @@ struct avs_alloc_port_ice_resp_info
 	char fingerprint[MAX_FINGERPRINT_LEN];
 	char port_id[MAX_PORTID_LEN];
 	char comm_id[MAX_UNIQUE_ID];
-	struct candidate *candidates;
+	struct avs_candidate *candidates;
+	unsigned int num_candidates;
+	unsigned int dropped_candidates;
+	struct arena *arena;
 	struct avs_response_common_sub_info resp;
 };
 
@@ -417,6 +722,276 @@ struct avs_playsound_chan_param
 	char comm_id[MAX_UNIQUE_ID];
 };
 
+/**
+ * struct avs_id - Handle of an ID string interned by avs_id_intern(), 8 bytes instead of the char arrays of the parameters above.
+ *
+ * @id:  Index in the string table of avs_controller, 0 for none.
+ * @len:  Length of the string.
+ */
+struct avs_id
+{
+	unsigned int id;
+	unsigned int len;
+};
+
+/**
+ * struct avs_str - A string of variable length owned by the caller, it need not be terminated.
+ *
+ * @s:  The string, NULL for an empty one.
+ * @len:  Its length.
+ */
+struct avs_str
+{
+	const char *s;
+	unsigned int len;
+};
+
+/**
+ * struct avs_chan_ref - The channel and the port of a command, by interned IDs.
+ *
+ * @conf_id:  Conference id.
+ * @chan_id:  Channel id.
+ * @port_id:  Unique ID for a port resource, unused by the commands without one: allocating, runctrl and playsound.
+ */
+struct avs_chan_ref
+{
+	struct avs_id conf_id;
+	struct avs_id chan_id;
+	struct avs_id port_id;
+};
+
+/*
+ * The "_ref" parameters below are the compact forms of the parameters above, taken by the "avs_*_ref" APIs.
+ * IDs are interned handles and long strings are referenced, both are written from where they are when the command is encoded.
+ * The strings are sent whole, they are not cut to the char arrays of the parameters above.
+ * Their "comm_id" is generated and returned in the response.
+ */
+
+/**
+ * struct avs_alloc_port_ref_param - Compact struct avs_alloc_port_normal_param or struct avs_alloc_port_ice_param.
+ */
+struct avs_alloc_port_ref_param
+{
+	struct avs_chan_ref chan;
+	unsigned int enable_dtls:1;
+};
+
+/**
+ * struct avs_set_peerport_normal_ref_param - Compact struct avs_set_peerport_normal_param.
+ */
+struct avs_set_peerport_normal_ref_param
+{
+	struct avs_chan_ref chan;
+	unsigned int rtcpmux:1;
+	unsigned int symrtp:1;
+	unsigned int srtpmode;
+	unsigned int qos;
+	struct avs_str fingerprint;
+	struct avs_str srtpsendkey;
+	struct avs_str srtprecvkey;
+	struct avs_str targetaddr;
+};
+
+/**
+ * struct avs_set_peerport_ice_ref_param - Compact struct avs_set_peerport_ice_param.
+ */
+struct avs_set_peerport_ice_ref_param
+{
+	struct avs_chan_ref chan;
+	unsigned int icerole:1;
+	unsigned int sslrole:1;
+	struct avs_str fingerprint;
+	struct avs_str ice_ufrag;
+	struct avs_str ice_pwd;
+	struct avs_str candidate;
+};
+
+/**
+ * struct avs_codec_audio_ref_param - Compact struct avs_codec_audio_param.
+ */
+struct avs_codec_audio_ref_param
+{
+	struct avs_chan_ref chan;
+	enum avs_audio_codec a_codec;
+	unsigned int audio_payloadtype;
+	unsigned int audio_transmode;
+	unsigned int ptime;
+};
+
+/**
+ * struct avs_codec_video_ref_param - Compact struct avs_codec_video_param.
+ */
+struct avs_codec_video_ref_param
+{
+	struct avs_chan_ref chan;
+	enum avs_video_codec v_codec;
+	unsigned int video_payloadtype;
+	unsigned int video_transmode;
+};
+
+/**
+ * struct avs_runctrl_chan_ref_param - Compact struct avs_runctrl_chan_param.
+ */
+struct avs_runctrl_chan_ref_param
+{
+	struct avs_chan_ref chan;
+	enum avs_runctrl_chan_opt opt;
+	enum avs_runctrl_chan_mtype mtype;
+};
+
+/**
+ * struct avs_playsound_chan_ref_param - Compact struct avs_playsound_chan_param.
+ */
+struct avs_playsound_chan_ref_param
+{
+	struct avs_chan_ref chan;
+	enum avs_playsound_chan_type ptype;
+	unsigned int action:1;
+	struct avs_str soundfile;
+};
+
+/**
+ * enum avs_chan_port_mode - Port allocating mode of a channel in a bulk setup.
+ *
+ * @AVS_CHAN_PORT_NORMAL:  Allocate port with normal mode(no ICE).
+ * @AVS_CHAN_PORT_ICE:  Allocate port with ICE mode.
+ */
+enum avs_chan_port_mode
+{
+	AVS_CHAN_PORT_NORMAL,
+	AVS_CHAN_PORT_ICE
+};
+
+/**
+ * enum avs_chan_setup_step - Steps to set up a channel, in the order they are sent to AVS.
+ *
+ * @AVS_CHAN_SETUP_ALLOC_PORT:  Allocating port resources.
+ * @AVS_CHAN_SETUP_PEER:  Setting peer port parameters.
+ * @AVS_CHAN_SETUP_AUDIO:  Setting audio codec.
+ * @AVS_CHAN_SETUP_VIDEO:  Setting video codec.
+ * @AVS_CHAN_SETUP_DONE:  All steps finished.
+ */
+enum avs_chan_setup_step
+{
+	AVS_CHAN_SETUP_ALLOC_PORT,
+	AVS_CHAN_SETUP_PEER,
+	AVS_CHAN_SETUP_AUDIO,
+	AVS_CHAN_SETUP_VIDEO,
+	AVS_CHAN_SETUP_DONE
+};
+
+/**
+ * struct avs_chan_setup_desc - Descriptor of one channel in avs_setup_conference().
+ *
+ * @mode:  Allocate port with normal mode or ICE mode.
+ * @enable_dtls:  Whether to turn on DTLS. It must be enabled in ICE mode.
+ * @set_peer:  Whether to set peer port parameters after allocating port.
+ * @set_audio:  Whether to set audio codec.
+ * @set_video:  Whether to set video codec.
+ * @chan_id:  Channel id.
+ * @peer:  Peer port parameters of @mode. "conf_id", "chan_id", "port_id" and "comm_id" are filled by avs_controller.
+ * @audio:  Audio codec parameters. The ids are filled by avs_controller.
+ * @video:  Video codec parameters. The ids are filled by avs_controller.
+ * @result:  Output. SUCCESS if every step of the channel succeeded.
+ * @failed_step:  Output. The step which failed, AVS_CHAN_SETUP_DONE on success.
+ * @port:  Output. Response of allocating port of @mode. In ICE mode, give its candidates back with avs_alloc_port_ice_resp_release().
+ * @resp:  Output. Response of the last step sent to AVS.
+ */
+struct avs_chan_setup_desc
+{
+	enum avs_chan_port_mode mode;
+	unsigned int enable_dtls:1;
+	unsigned int set_peer:1;
+	unsigned int set_audio:1;
+	unsigned int set_video:1;
+	char chan_id[MAX_CHANID_LEN];
+	union
+	{
+		struct avs_set_peerport_normal_param normal;
+		struct avs_set_peerport_ice_param ice;
+	} peer;
+	struct avs_codec_audio_param audio;
+	struct avs_codec_video_param video;
+	AVS_CMD_RESULT result;
+	enum avs_chan_setup_step failed_step;
+	union
+	{
+		struct avs_alloc_port_normal_resp_info normal;
+		struct avs_alloc_port_ice_resp_info ice;
+	} port;
+	struct avs_response_common_sub_info resp;
+};
+
+/**
+ * avs_setup_cb - Completion callback of avs_setup_conference_async(). It is called from the receiving thread of avs_controller.
+ * @result:  SUCCESS if every channel succeeded, otherwise check "result" of each descriptor.
+ * @descs:  The descriptors passed to avs_setup_conference_async().
+ * @num:  Number of descriptors.
+ * @user_data:  The pointer passed to avs_setup_conference_async().
+ */
+typedef void (*avs_setup_cb)(AVS_CMD_RESULT result, struct avs_chan_setup_desc *descs, unsigned int num, void *user_data);
+
+/**
+ * avs_teardown_cb - Completion callback of avs_destroy_conference_async(). It is called from the receiving thread of avs_controller.
+ * @result:  SUCCESS if AVS accepted the reset and the port release of every channel.
+ * @num_chans:  Channels of the conference which have been torn down.
+ * @failed:  Channels of which a command failed or was refused by AVS.
+ * @user_data:  Passed to avs_destroy_conference_async().
+ */
+typedef void (*avs_teardown_cb)(AVS_CMD_RESULT result, unsigned int num_chans, unsigned int failed, void *user_data);
+
+/**
+ * avs_runctrl_conf_cb - Completion callback of avs_runctrl_conference_async(). It is called from the receiving thread of avs_controller,
+ *   or before avs_runctrl_conference_async() returns if every channel is excepted.
+ * @result:  SUCCESS if AVS accepted the run command of every channel.
+ * @num_chans:  Channels the run command has been sent to.
+ * @failed:  Channels of which the command failed or was refused by AVS.
+ * @user_data:  Passed to avs_runctrl_conference_async().
+ */
+typedef void (*avs_runctrl_conf_cb)(AVS_CMD_RESULT result, unsigned int num_chans, unsigned int failed, void *user_data);
+
+/**
+ * struct avs_chan_state - What avs_controller knows of a channel, from the commands AVS answered with code 0.
+ *
+ * @mode:  Mode the port was allocated with.
+ * @peer_set:  Peer port parameters have been set to the port.
+ * @audio_set:  Audio codec has been set, see @a_codec, @audio_payloadtype, @audio_transmode and @ptime.
+ * @video_set:  Video codec has been set, see @v_codec, @video_payloadtype and @video_transmode.
+ * @audio_suspended:  Audio has been suspended by runctrl, until it is resumed.
+ * @video_suspended:  Video has been suspended by runctrl, until it is resumed.
+ * @port_id:  Port of the channel.
+ * @rtp_port:  RTP port, normal mode only.
+ * @rtcp_port:  RTCP port, normal mode only.
+ * @fingerprint:  Fingerprint of the port, none if AVS gave no fingerprint.
+ * @ice_ufrag:  ICE credentials, ICE mode only.
+ * @ice_pwd:  ICE credentials, ICE mode only.
+ *
+ * The strings of the port are interned IDs, read them with avs_id_str(). A handle with the id 0 is none. The state index holds them
+ * while the channel has the port, and avs_query_chan() takes a reference to each for its caller: see avs_chan_state_release().
+ */
+struct avs_chan_state
+{
+	enum avs_chan_port_mode mode;
+	unsigned int peer_set:1;
+	unsigned int audio_set:1;
+	unsigned int video_set:1;
+	unsigned int audio_suspended:1;
+	unsigned int video_suspended:1;
+	struct avs_id port_id;
+	unsigned int rtp_port;
+	unsigned int rtcp_port;
+	struct avs_id fingerprint;
+	struct avs_id ice_ufrag;
+	struct avs_id ice_pwd;
+	enum avs_audio_codec a_codec;
+	unsigned int audio_payloadtype;
+	unsigned int audio_transmode;
+	unsigned int ptime;
+	enum avs_video_codec v_codec;
+	unsigned int video_payloadtype;
+	unsigned int video_transmode;
+};
+
 /**
  * avs_create_conn - Establish a HTTP connection to AVS. "Say hello..."
  *
@@ -424,6 +999,105 @@ struct avs_playsound_chan_param
  */
 AVS_CMD_RESULT avs_create_conn(void);
 
+/**
+ * avs_create_conn_ex - Same as avs_create_conn(), with options.
+ * @config:  Options, NULL for the defaults.
+ *
+ * Return: AVS_CMD_RESULT.
+ */
+AVS_CMD_RESULT avs_create_conn_ex(const struct avs_conn_config *config);
+
+/**
+ * avs_get_io_counters - Get a snapshot of the batched socket I/O counters.
+ * @counters:  Output.
+ *
+ * Return: AVS_CMD_RESULT.
+ */
+AVS_CMD_RESULT avs_get_io_counters(struct avs_io_counters *counters);
+
+/**
+ * avs_get_stats - Get a snapshot of the command statistics. Each counter is read atomically, but they are not read at the same instant.
+ * @stats:  Output. It is large, better not on a small stack.
+ *
+ * Return: AVS_CMD_RESULT.
+ */
+AVS_CMD_RESULT avs_get_stats(struct avs_stats *stats);
+
+/**
+ * avs_get_instance_stats - Get a snapshot of the load and the counters of each AVS instance.
+ * @stats:  Output, AVS_MAX_INSTANCES of them.
+ * @num:  Output, number of instances filled.
+ *
+ * Return: AVS_CMD_RESULT.
+ */
+AVS_CMD_RESULT avs_get_instance_stats(struct avs_instance_stats *stats, unsigned int *num);
+
+/**
+ * avs_conference_instance - Get the AVS instance a conference is placed on.
+ * @conf_id:  Conference id.
+ *
+ * Return: Index of the instance in "instance_paths" of struct avs_conn_config, -1 if the conference has neither a port nor a command in flight.
+ */
+int avs_conference_instance(const char *conf_id);
+
+/**
+ * enum avs_log_level - Levels of the messages of avs_controller, each level includes the ones before it.
+ */
+enum avs_log_level
+{
+	AVS_LOG_ERROR,
+	AVS_LOG_WARN,
+	AVS_LOG_INFO,	/* The default. */
+	AVS_LOG_DEBUG	/* Every command and response. Not compiled in release builds (NDEBUG). */
+};
+
+/**
+ * avs_set_log_level - Set the most verbose level written, it can be changed at any time.
+ *   Messages are written to stdout by a background thread between avs_create_conn() and avs_shutdown().
+ */
+void avs_set_log_level(enum avs_log_level level);
+
+/**
+ * avs_stats_percentile - Get a percentile of a latency histogram.
+ * @hist:  The histogram.
+ * @percentile:  0 to 100, e.g. 99.9.
+ *
+ * Return: The latency in microseconds, at most 1/16 above the real one. 0 if the histogram is empty.
+ */
+unsigned long avs_stats_percentile(const struct avs_latency_hist *hist, double percentile);
+
+/**
+ * avs_stats_dump - Format the statistics as text, one line per command type then the counters.
+ * @stats:  Got by avs_get_stats().
+ * @buf:  Output, always terminated by '\0'.
+ * @size:  Size of @buf.
+ *
+ * Return: Length of the whole text as snprintf(), it has been truncated if it is not less than @size.
+ */
+int avs_stats_dump(const struct avs_stats *stats, char *buf, unsigned long size);
+
+/**
+ * avs_subscribe_event - Register a handler of a type of notifications. It may be called before avs_create_conn().
+ * @type:  Type of notifications.
+ * @cb:  The handler.
+ * @user_data:  Passed to @cb.
+ *
+ * Return: AVS_CMD_RESULT. ERROR if the type is unknown or it has too many handlers.
+ */
+AVS_CMD_RESULT avs_subscribe_event(enum avs_event_type type, avs_event_cb cb, void *user_data);
+
+/**
+ * avs_unsubscribe_event - Remove a handler registered by avs_subscribe_event(). It may be called from a handler.
+ * @type:  Type of notifications.
+ * @cb:  The handler.
+ * @user_data:  The same pointer as registered.
+ *
+ * The handler is not called any more once this returns, but a call already running in the event thread may not have finished yet.
+ *
+ * Return: AVS_CMD_RESULT. ERROR if the handler is not registered.
+ */
+AVS_CMD_RESULT avs_unsubscribe_event(enum avs_event_type type, avs_event_cb cb, void *user_data);
+
 /**
  * avs_shutdown - Close the connection with AVS, and release related resources.
  *
@@ -451,6 +1125,13 @@ AVS_CMD_RESULT avs_alloc_port_normal(struct avs_alloc_port_normal_param *param,
 AVS_CMD_RESULT avs_alloc_port_ice(struct avs_alloc_port_ice_param *param, struct avs_alloc_port_ice_resp_info *resp);
 AVS_CMD_RESULT avs_dealloc_port(struct avs_dealloc_port_param *param, struct avs_common_resp_info *resp);
 
+/**
+ * avs_alloc_port_ice_resp_release - Give back the candidates of a response of avs_alloc_port_ice() or its variants, once they are used.
+ * It must be called before the response is passed to a command again. Any thread may call it.
+ * @resp:  The response, its @candidates are NULL afterwards.
+ */
+void avs_alloc_port_ice_resp_release(struct avs_alloc_port_ice_resp_info *resp);
+
 /**
  * avs_set_peerport_param_normal/avs_set_peerport_param_ice - Set peer parameters to AVS with normal mode or ICE mode.
  * @param:  The parameters of peer which set to AVS.
@@ -489,11 +1170,188 @@ AVS_CMD_RESULT avs_set_video_codec_param(struct avs_codec_video_param *param, st
 AVS_CMD_RESULT avs_runctrl_chan(struct avs_runctrl_chan_param *param, struct avs_common_resp_info *resp);
 
 /**
- * avs_playsound - Play sound on channels.
+ * avs_playsound - Play sound on channels. Not supported yet: the AVS interface protocol does not define the message,
+ *   so it returns NOT_SUPPORTED and nothing is sent. So do avs_playsound_async(), avs_playsound_ref() and avs_playsound_ref_async().
  * @param:  The parameters of playing sound on channels.
  * @resp:  The response informations returned from AVS.
  *
- * Return: AVS_CMD_RESULT.
+ * Return: NOT_SUPPORTED.
  */
 AVS_CMD_RESULT avs_playsound(struct avs_playsound_chan_param *param, struct avs_common_resp_info *resp);
+
+/**
+ * avs_set_global_param_async/avs_alloc_port_normal_async/avs_alloc_port_ice_async/avs_dealloc_port_async/avs_set_peerport_param_normal_async/
+ * avs_set_peerport_param_ice_async/avs_set_audio_codec_param_async/avs_set_video_codec_param_async/avs_runctrl_chan_async/avs_playsound_async - 
+ * Non-blocking variants of the APIs above. The blocking APIs are built on them.
+ * @param:  Same as the blocking API. It is encoded before returning, so it can be released at once.
+ * @resp:  Same as the blocking API. It must stay valid until @cb is called.
+ * @cb:  Called once when AVS responds or the command times out. Not called if the return value is not SUCCESS.
+ *   A duplicate or replaced setting also completes through it, see "keep_duplicates" of struct avs_conn_config.
+ * @user_data:  Passed to @cb.
+ *
+ * Return: SUCCESS if the command has been queued to AVS, QUEUE_FULL if the submission queue is full.
+ */
+AVS_CMD_RESULT avs_set_global_param_async(struct avs_global_param *param, struct avs_common_resp_info *resp, avs_cmd_cb cb, void *user_data);
+AVS_CMD_RESULT avs_alloc_port_normal_async(struct avs_alloc_port_normal_param *param, struct avs_alloc_port_normal_resp_info *resp, avs_cmd_cb cb, void *user_data);
+AVS_CMD_RESULT avs_alloc_port_ice_async(struct avs_alloc_port_ice_param *param, struct avs_alloc_port_ice_resp_info *resp, avs_cmd_cb cb, void *user_data);
+AVS_CMD_RESULT avs_dealloc_port_async(struct avs_dealloc_port_param *param, struct avs_common_resp_info *resp, avs_cmd_cb cb, void *user_data);
+AVS_CMD_RESULT avs_set_peerport_param_normal_async(struct avs_set_peerport_normal_param *param, struct avs_common_resp_info *resp, avs_cmd_cb cb, void *user_data);
+AVS_CMD_RESULT avs_set_peerport_param_ice_async(struct avs_set_peerport_ice_param *param, struct avs_common_resp_info *resp, avs_cmd_cb cb, void *user_data);
+AVS_CMD_RESULT avs_set_audio_codec_param_async(struct avs_codec_audio_param *param, struct avs_common_resp_info *resp, avs_cmd_cb cb, void *user_data);
+AVS_CMD_RESULT avs_set_video_codec_param_async(struct avs_codec_video_param *param, struct avs_common_resp_info *resp, avs_cmd_cb cb, void *user_data);
+AVS_CMD_RESULT avs_runctrl_chan_async(struct avs_runctrl_chan_param *param, struct avs_common_resp_info *resp, avs_cmd_cb cb, void *user_data);
+AVS_CMD_RESULT avs_playsound_async(struct avs_playsound_chan_param *param, struct avs_common_resp_info *resp, avs_cmd_cb cb, void *user_data);
+
+/**
+ * avs_setup_conference/avs_setup_conference_async - Bulk setup of channels in a conference: allocate port, set peer port parameters, 
+ * set audio and video codec for each channel. The commands of different channels are pipelined to AVS, a channel stops at its first failed step.
+ * @conf_id:  Conference id.
+ * @descs:  Channel descriptors, results are written back into them. They must stay valid until the setup completes.
+ * @num:  Number of descriptors.
+ * @cb:  Called once when all channels have finished. Not called if the return value is not SUCCESS.
+ * @user_data:  Passed to @cb.
+ *
+ * Return: avs_setup_conference: SUCCESS if every channel succeeded. avs_setup_conference_async: SUCCESS if the setup has been started.
+ */
+AVS_CMD_RESULT avs_setup_conference(const char *conf_id, struct avs_chan_setup_desc *descs, unsigned int num);
+AVS_CMD_RESULT avs_setup_conference_async(const char *conf_id, struct avs_chan_setup_desc *descs, unsigned int num, avs_setup_cb cb, void *user_data);
+
+/**
+ * avs_destroy_conference/avs_destroy_conference_async - Tear down a conference: "runctrl" reset and "delPort" of each channel
+ * known by avs_query_chan(). The commands of all the channels are pipelined to AVS, a channel whose reset fails still releases its port.
+ * @conf_id:  Conference id.
+ * @cb:  Called once when all channels have finished. Not called if the return value is not SUCCESS.
+ * @user_data:  Passed to @cb.
+ *
+ * Return: avs_destroy_conference: SUCCESS if every channel succeeded. avs_destroy_conference_async: SUCCESS if the teardown has been started,
+ * ERROR if the conference has no channel.
+ */
+AVS_CMD_RESULT avs_destroy_conference(const char *conf_id);
+AVS_CMD_RESULT avs_destroy_conference_async(const char *conf_id, avs_teardown_cb cb, void *user_data);
+
+/**
+ * avs_runctrl_conference/avs_runctrl_conference_async - Run command to all the channels of a conference the state index knows,
+ *   except some of them, e.g. suspend audio of everyone but the moderator. The commands are sent in one burst, the channels
+ *   of a very large conference over the burst are sent as the first ones complete. A full submission queue does not fail
+ *   a channel, it is sent once the queue has room.
+ * @conf_id:  Conference id.
+ * @opt:  Operation, see struct avs_runctrl_chan_param.
+ * @mtype:  Media type of a suspend or resume.
+ * @except_chan_ids:  Channels left out, NULL if @num_except is 0.
+ * @num_except:  Number of @except_chan_ids.
+ * @cb:  Called once every channel has finished, the async variant only. Not called if the return value is not SUCCESS.
+ * @user_data:  Passed to @cb.
+ *
+ * Return: AVS_CMD_RESULT. ERROR if the conference has no channel. The blocking variant returns ERROR if a channel failed.
+ */
+AVS_CMD_RESULT avs_runctrl_conference(const char *conf_id, enum avs_runctrl_chan_opt opt, enum avs_runctrl_chan_mtype mtype,
+	const char *const *except_chan_ids, unsigned int num_except);
+AVS_CMD_RESULT avs_runctrl_conference_async(const char *conf_id, enum avs_runctrl_chan_opt opt, enum avs_runctrl_chan_mtype mtype,
+	const char *const *except_chan_ids, unsigned int num_except, avs_runctrl_conf_cb cb, void *user_data);
+
+/**
+ * avs_query_chan - Get the state of a channel without asking AVS. It is updated when AVS answers
+ * addPort/setPortParam/addTrack/delPort/runctrl reset, suspend and resume with code 0, so a command still in flight is not reflected yet.
+ * @conf_id:  Conference id.
+ * @chan_id:  Channel id.
+ * @state:  Output. Give its strings back with avs_chan_state_release() on SUCCESS.
+ *
+ * Return: AVS_CMD_RESULT. ERROR if the channel has no port.
+ */
+AVS_CMD_RESULT avs_query_chan(const char *conf_id, const char *chan_id, struct avs_chan_state *state);
+
+/**
+ * avs_chan_state_release - Drop the references avs_query_chan() took to the strings of @state. They are none afterwards.
+ */
+void avs_chan_state_release(struct avs_chan_state *state);
+
+/**
+ * avs_query_conference - Get the number of channels with a port in a conference.
+ * @conf_id:  Conference id.
+ * @num_chans:  Output.
+ *
+ * Return: AVS_CMD_RESULT. ERROR if the conference has no channel.
+ */
+AVS_CMD_RESULT avs_query_conference(const char *conf_id, unsigned int *num_chans);
+
+/**
+ * avs_id_intern - Intern an ID string and take a reference to it. The same string always gets the same handle while it is referenced.
+ * @str:  The string, it need not be terminated.
+ * @len:  Its length.
+ * @id:  Output, the handle.
+ *
+ * Return: AVS_CMD_RESULT. ERROR if @str holds a '\0' or the table is full.
+ */
+AVS_CMD_RESULT avs_id_intern(const char *str, unsigned int len, struct avs_id *id);
+
+/**
+ * avs_id_hold - Take another reference to an interned ID, e.g: when its handle is stored in one more table.
+ */
+void avs_id_hold(struct avs_id id);
+
+/**
+ * avs_id_release - Drop a reference taken by avs_id_intern() or avs_id_hold(). The string is freed with the last one.
+ */
+void avs_id_release(struct avs_id id);
+
+/**
+ * avs_id_str - Get the string of an interned ID, it stays valid while a reference is held. Any thread may call it without a lock.
+ *
+ * Return: The terminated string, NULL if @id is not a handle.
+ */
+const char *avs_id_str(struct avs_id id);
+
+/**
+ * avs_*_ref - The same commands with the compact parameters, see struct avs_chan_ref.
+ * The IDs must be held until the call returns, the "_async" ones included: the command is encoded before they return.
+ *
+ * Return: AVS_CMD_RESULT. ERROR if an ID is not a handle.
+ */
+AVS_CMD_RESULT avs_alloc_port_normal_ref(const struct avs_alloc_port_ref_param *param, struct avs_alloc_port_normal_resp_info *resp);
+AVS_CMD_RESULT avs_alloc_port_ice_ref(const struct avs_alloc_port_ref_param *param, struct avs_alloc_port_ice_resp_info *resp);
+AVS_CMD_RESULT avs_dealloc_port_ref(const struct avs_chan_ref *param, struct avs_common_resp_info *resp);
+AVS_CMD_RESULT avs_set_peerport_param_normal_ref(const struct avs_set_peerport_normal_ref_param *param, struct avs_common_resp_info *resp);
+AVS_CMD_RESULT avs_set_peerport_param_ice_ref(const struct avs_set_peerport_ice_ref_param *param, struct avs_common_resp_info *resp);
+AVS_CMD_RESULT avs_set_audio_codec_param_ref(const struct avs_codec_audio_ref_param *param, struct avs_common_resp_info *resp);
+AVS_CMD_RESULT avs_set_video_codec_param_ref(const struct avs_codec_video_ref_param *param, struct avs_common_resp_info *resp);
+AVS_CMD_RESULT avs_runctrl_chan_ref(const struct avs_runctrl_chan_ref_param *param, struct avs_common_resp_info *resp);
+AVS_CMD_RESULT avs_playsound_ref(const struct avs_playsound_chan_ref_param *param, struct avs_common_resp_info *resp);
+
+AVS_CMD_RESULT avs_alloc_port_normal_ref_async(const struct avs_alloc_port_ref_param *param, struct avs_alloc_port_normal_resp_info *resp, avs_cmd_cb cb, void *user_data);
+AVS_CMD_RESULT avs_alloc_port_ice_ref_async(const struct avs_alloc_port_ref_param *param, struct avs_alloc_port_ice_resp_info *resp, avs_cmd_cb cb, void *user_data);
+AVS_CMD_RESULT avs_dealloc_port_ref_async(const struct avs_chan_ref *param, struct avs_common_resp_info *resp, avs_cmd_cb cb, void *user_data);
+AVS_CMD_RESULT avs_set_peerport_param_normal_ref_async(const struct avs_set_peerport_normal_ref_param *param, struct avs_common_resp_info *resp, avs_cmd_cb cb, void *user_data);
+AVS_CMD_RESULT avs_set_peerport_param_ice_ref_async(const struct avs_set_peerport_ice_ref_param *param, struct avs_common_resp_info *resp, avs_cmd_cb cb, void *user_data);
+AVS_CMD_RESULT avs_set_audio_codec_param_ref_async(const struct avs_codec_audio_ref_param *param, struct avs_common_resp_info *resp, avs_cmd_cb cb, void *user_data);
+AVS_CMD_RESULT avs_set_video_codec_param_ref_async(const struct avs_codec_video_ref_param *param, struct avs_common_resp_info *resp, avs_cmd_cb cb, void *user_data);
+AVS_CMD_RESULT avs_runctrl_chan_ref_async(const struct avs_runctrl_chan_ref_param *param, struct avs_common_resp_info *resp, avs_cmd_cb cb, void *user_data);
+AVS_CMD_RESULT avs_playsound_ref_async(const struct avs_playsound_chan_ref_param *param, struct avs_common_resp_info *resp, avs_cmd_cb cb, void *user_data);
+
+/**
+ * avs_candidate_parse - Parse an ICE candidate attribute, e.g: "candidate:1 1 udp 2122260223 10.0.0.1 20000 typ host generation 0".
+ *   The "a=" prefix, the "candidate:" prefix and the line end are optional. Unknown extensions are skipped.
+ * @str:  The attribute, it need not be terminated.
+ * @len:  Length of @str.
+ * @cand:  Output.
+ *
+ * Return: 0, -1 if a mandatory field is missing or malformed.
+ */
+int avs_candidate_parse(const char *str, unsigned long len, struct avs_candidate *cand);
+
+/**
+ * avs_candidate_to_sdp - Format a candidate as an SDP "a=candidate" line ended by "\r\n", then terminate it.
+ * @cand:  The candidate.
+ * @buf:  Output buffer.
+ * @size:  Size of @buf.
+ *
+ * Return: Length of the line, -1 if @buf is too small.
+ */
+int avs_candidate_to_sdp(const struct avs_candidate *cand, char *buf, unsigned long size);
+
+/**
+ * avs_candidates_to_sdp - Format @num candidates as consecutive SDP lines, e.g: the candidates of an avs_alloc_port_ice_resp_info.
+ *
+ * Return: Length of the lines, -1 if @buf is too small.
+ */
+int avs_candidates_to_sdp(const struct avs_candidate *cands, unsigned int num, char *buf, unsigned long size);
 #endif /* AVS_CONTROLLER_H */
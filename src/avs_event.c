@@ -0,0 +1,263 @@
+/****************************************************************************
+ *
+ * Multiedia Controller Module(MCM).
+ *
+ * Copyright (c) 2017 by Grandstream Networks, Inc.
+ * All rights reserved.
+ *
+ * This material is proprietary to Grandstream Networks, Inc. and,
+ * in addition to the above mentioned Copyright, may be
+ * subject to protection under other intellectual property
+ * regimes, including patents, trade secrets, designs and/or
+ * trademarks.
+ *
+ * Any use of this material for any purpose, except with an
+ * express license from Grandstream Networks, Inc. is strictly
+ * prohibited.
+ *
+ *
+ * \brief Dispatching of the notifications sent by AVS.
+ *
+ *	A notification is {"<event name>":{members}} without "id". The
+ *  receiving thread decodes it into a slot of a bounded queue, or drops
+ *  it if the queue is full, so a flood of notifications or a slow handler
+ *  never holds up command responses.
+ *
+ ***************************************************************************/
+
+#include <string.h>
+#include <stdio.h>
+#include <stddef.h>
+#include <pthread.h>
+#include "avs_event.h"
+#include "avs_log.h"
+
+/* A registered handler, "cb" is NULL for a free entry. */
+struct event_handler
+{
+	avs_event_cb cb;
+	void *user_data;
+};
+
+static const char *event_names[AVS_EVENT_MAX] = {
+	[AVS_EVENT_ICE_STATE] = "iceState",
+	[AVS_EVENT_DTLS_DONE] = "dtlsDone",
+	[AVS_EVENT_PORT_FAILED] = "portFailed",
+	[AVS_EVENT_PLAYSOUND_DONE] = "playSoundDone",
+};
+
+/* Members of a notification, all of them are optional. */
+static const struct json_field event_fields[] = {
+	{ .parent = -1, .key = "conf_id", .type = JSON_FIELD_STRING, .offset = offsetof(struct avs_event, conf_id), .size = MAX_CONFID_LEN,
+		.mistyped = "error: conf_id of notification is not a string\n" },
+	{ .parent = -1, .key = "chan_id", .type = JSON_FIELD_STRING, .offset = offsetof(struct avs_event, chan_id), .size = MAX_CHANID_LEN,
+		.mistyped = "error: chan_id of notification is not a string\n" },
+	{ .parent = -1, .key = "port_id", .type = JSON_FIELD_STRING, .offset = offsetof(struct avs_event, port_id), .size = MAX_PORTID_LEN,
+		.mistyped = "error: port_id of notification is not a string\n" },
+	{ .parent = -1, .key = "state", .type = JSON_FIELD_STRING, .offset = offsetof(struct avs_event, state), .size = MAX_EVENT_STATE_LEN,
+		.mistyped = "error: state of notification is not a string\n" },
+	{ .parent = -1, .key = "code", .type = JSON_FIELD_INTEGER, .offset = offsetof(struct avs_event, code),
+		.mistyped = "error: code of notification is not an integer\n" },
+	{ .parent = -1, .key = "message", .type = JSON_FIELD_STRING, .offset = offsetof(struct avs_event, message), .size = MAX_MESSAGE_REPONSE,
+		.mistyped = "error: message of notification is not a string\n" },
+};
+
+static pthread_mutex_t ev_mutex = PTHREAD_MUTEX_INITIALIZER;	/* Protects the queue and the handlers, never held while calling a handler. */
+static pthread_cond_t ev_cond = PTHREAD_COND_INITIALIZER;	/* Signaled when a notification is queued or the thread is stopped. */
+static struct avs_event ev_queue[AVS_EVENT_QUEUE_SIZE];
+static unsigned int ev_head = 0, ev_tail = 0;	/* Free running indexes of "ev_queue". */
+static struct event_handler ev_handlers[AVS_EVENT_MAX][AVS_EVENT_MAX_HANDLERS];
+static pthread_t ev_thread;
+static int ev_running = 0;
+
+/* Call the handlers of one notification. Each entry is read under the lock just before its call, so an unsubscribed handler is not called any more. */
+static void event_dispatch(const struct avs_event *event)
+{
+	struct event_handler h;
+	unsigned int i;
+
+	for (i = 0; i < AVS_EVENT_MAX_HANDLERS; i++)
+	{
+		pthread_mutex_lock(&ev_mutex);
+		h = ev_handlers[event->type][i];
+		pthread_mutex_unlock(&ev_mutex);
+
+		if (h.cb)
+		{
+			h.cb(event, h.user_data);
+		}
+	}
+}
+
+static void *event_task(void *data)
+{
+	struct avs_event event;
+
+	(void)data;
+
+	pthread_mutex_lock(&ev_mutex);
+
+	while (ev_running)
+	{
+		if (ev_head == ev_tail)
+		{
+			pthread_cond_wait(&ev_cond, &ev_mutex);
+			continue;
+		}
+
+		/* Copy it out, the slot may be reused as soon as the lock is released. */
+		event = ev_queue[ev_head % AVS_EVENT_QUEUE_SIZE];
+		ev_head++;
+
+		pthread_mutex_unlock(&ev_mutex);
+		event_dispatch(&event);
+		pthread_mutex_lock(&ev_mutex);
+	}
+
+	pthread_mutex_unlock(&ev_mutex);
+
+	return NULL;
+}
+
+int event_start(void)
+{
+	pthread_mutex_lock(&ev_mutex);
+	ev_head = ev_tail = 0;
+	ev_running = 1;
+	pthread_mutex_unlock(&ev_mutex);
+
+	if (pthread_create(&ev_thread, NULL, event_task, NULL))
+	{
+		log_err("Create event thread failed\n");
+		ev_running = 0;
+		return -1;
+	}
+
+	return 0;
+}
+
+void event_stop(void)
+{
+	pthread_mutex_lock(&ev_mutex);
+	if (!ev_running)
+	{
+		pthread_mutex_unlock(&ev_mutex);
+		return;
+	}
+	ev_running = 0;
+	pthread_cond_signal(&ev_cond);
+	pthread_mutex_unlock(&ev_mutex);
+
+	pthread_join(ev_thread, NULL);
+
+	ev_head = ev_tail = 0;
+}
+
+enum event_post_result event_post(const struct json_doc *doc)
+{
+	struct avs_event *event;
+	int type, obj;
+
+	/* The first member names the notification, its value is an object. */
+	if (doc->num < 3 || JSON_TOK_OBJECT != doc->toks[0].type || JSON_TOK_OBJECT != doc->toks[2].type)
+	{
+		log_warn("unknown notification from AVS: %.*s\n", doc->toks[0].end, doc->js);
+		return EVENT_POST_UNKNOWN;
+	}
+
+	for (type = 0; type < AVS_EVENT_MAX; type++)
+	{
+		if ((obj = json_doc_get(doc, 0, event_names[type])) == 2)
+		{
+			break;
+		}
+	}
+
+	if (AVS_EVENT_MAX == type)
+	{
+		log_warn("unknown notification from AVS: %.*s\n", doc->toks[0].end, doc->js);
+		return EVENT_POST_UNKNOWN;
+	}
+
+	pthread_mutex_lock(&ev_mutex);
+
+	if (!ev_running || ev_tail - ev_head >= AVS_EVENT_QUEUE_SIZE)
+	{
+		pthread_mutex_unlock(&ev_mutex);
+		return EVENT_POST_DROPPED;
+	}
+
+	/* Decode straight into the slot, it is not visible to the event thread until "ev_tail" moves. */
+	event = &ev_queue[ev_tail % AVS_EVENT_QUEUE_SIZE];
+	memset(event, 0, sizeof(*event));
+	event->type = (enum avs_event_type)type;
+
+	if (json_dec_fields(doc, obj, event_fields, sizeof(event_fields) / sizeof(event_fields[0]), event) != 0)
+	{
+		pthread_mutex_unlock(&ev_mutex);
+		log_err("decode notification \"%s\" from AVS failed.\n", event_names[type]);
+		return EVENT_POST_UNKNOWN;
+	}
+
+	ev_tail++;
+	pthread_cond_signal(&ev_cond);
+	pthread_mutex_unlock(&ev_mutex);
+
+	return EVENT_POST_QUEUED;
+}
+
+AVS_CMD_RESULT avs_subscribe_event(enum avs_event_type type, avs_event_cb cb, void *user_data)
+{
+	unsigned int i;
+
+	if ((unsigned int)type >= AVS_EVENT_MAX || !cb)
+	{
+		return ERROR;
+	}
+
+	pthread_mutex_lock(&ev_mutex);
+
+	for (i = 0; i < AVS_EVENT_MAX_HANDLERS; i++)
+	{
+		if (!ev_handlers[type][i].cb)
+		{
+			ev_handlers[type][i].cb = cb;
+			ev_handlers[type][i].user_data = user_data;
+			pthread_mutex_unlock(&ev_mutex);
+			return SUCCESS;
+		}
+	}
+
+	pthread_mutex_unlock(&ev_mutex);
+
+	log_warn("too many handlers of notification \"%s\"\n", event_names[type]);
+
+	return ERROR;
+}
+
+AVS_CMD_RESULT avs_unsubscribe_event(enum avs_event_type type, avs_event_cb cb, void *user_data)
+{
+	unsigned int i;
+
+	if ((unsigned int)type >= AVS_EVENT_MAX)
+	{
+		return ERROR;
+	}
+
+	pthread_mutex_lock(&ev_mutex);
+
+	for (i = 0; i < AVS_EVENT_MAX_HANDLERS; i++)
+	{
+		if (ev_handlers[type][i].cb == cb && ev_handlers[type][i].user_data == user_data)
+		{
+			ev_handlers[type][i].cb = NULL;
+			ev_handlers[type][i].user_data = NULL;
+			pthread_mutex_unlock(&ev_mutex);
+			return SUCCESS;
+		}
+	}
+
+	pthread_mutex_unlock(&ev_mutex);
+
+	return ERROR;
+}
@@ -0,0 +1,63 @@
+/****************************************************************************
+ *
+ * Multiedia Controller Module(MCM).
+ *
+ * Copyright (c) 2017 by Grandstream Networks, Inc.
+ * All rights reserved.
+ *
+ * This material is proprietary to Grandstream Networks, Inc. and,
+ * in addition to the above mentioned Copyright, may be
+ * subject to protection under other intellectual property
+ * regimes, including patents, trade secrets, designs and/or
+ * trademarks.
+ *
+ * Any use of this material for any purpose, except with an
+ * express license from Grandstream Networks, Inc. is strictly
+ * prohibited.
+ *
+ *
+ * \brief Dispatching of the notifications sent by AVS.
+ *
+ *	The receiving thread only decodes a notification and queues it, the
+ *  handlers are called from a thread of their own.
+ *
+ ***************************************************************************/
+
+#ifndef AVS_EVENT_H
+#define AVS_EVENT_H
+
+#include "avs_controller.h"
+#include "avs_json_dec.h"
+
+#define AVS_EVENT_QUEUE_SIZE		256	/* Notifications waiting for their handlers, more are dropped. */
+#define AVS_EVENT_MAX_HANDLERS		8	/* Handlers of each type of notifications. */
+
+/* Result of event_post(). */
+enum event_post_result
+{
+	EVENT_POST_QUEUED,
+	EVENT_POST_DROPPED,	/* The queue is full. */
+	EVENT_POST_UNKNOWN	/* Not a notification this module understands. */
+};
+
+/**
+ * event_start - Start the event thread.
+ *
+ * Return: 0 on success, -1 on failure.
+ */
+int event_start(void);
+
+/**
+ * event_stop - Stop the event thread, notifications still queued are dropped. The handlers stay registered.
+ */
+void event_stop(void);
+
+/**
+ * event_post - Decode a message without "id" and queue it for the event thread. It never waits for the handlers.
+ * @doc:  The tokenized message.
+ *
+ * Return: enum event_post_result.
+ */
+enum event_post_result event_post(const struct json_doc *doc);
+
+#endif /* AVS_EVENT_H */
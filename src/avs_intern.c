@@ -0,0 +1,293 @@
+/****************************************************************************
+ *
+ * Multiedia Controller Module(MCM).
+ *
+ * Copyright (c) 2017 by Grandstream Networks, Inc.
+ * All rights reserved.
+ *
+ * This material is proprietary to Grandstream Networks, Inc. and,
+ * in addition to the above mentioned Copyright, may be
+ * subject to protection under other intellectual property
+ * regimes, including patents, trade secrets, designs and/or
+ * trademarks.
+ *
+ * Any use of this material for any purpose, except with an
+ * express license from Grandstream Networks, Inc. is strictly
+ * prohibited.
+ *
+ *
+ * \brief String table behind the struct avs_id handles.
+ *
+ *	Entries live in chunks of INTERN_CHUNK_SIZE which never move, so
+ *  avs_id_str() reads them without the lock: a caller holds a reference
+ *  to the entry it reads, which keeps its string. Entries are found by
+ *  their string through an open addressing index of their ids, from
+ *  which a removal shifts the ids of its probe back. The ids of released
+ *  entries are reused, with their string buffer when it is big enough.
+ *
+ ***************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "avs_controller.h"
+#include "avs_arena.h"
+#include "avs_log.h"
+
+#define INTERN_CHUNK_SIZE	1024	/* Entries of a chunk. */
+#define INTERN_MAX_CHUNKS	256	/* At most INTERN_CHUNK_SIZE * INTERN_MAX_CHUNKS live IDs. */
+#define INTERN_INDEX_MIN	64	/* Initial slots of the index, a power of 2. */
+#define INTERN_STR_ALIGN	32	/* String buffers are sized by multiples of it, so released ones fit more IDs. */
+
+struct intern_entry
+{
+	unsigned int hash;
+	unsigned int refs;	/* 0 if the entry is free. */
+	unsigned int next_free;	/* Next free id when the entry is free. */
+	unsigned int cap;	/* Bytes of "str", kept when the entry is freed. */
+	char *str;
+};
+
+static pthread_mutex_t intern_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct intern_entry *intern_chunks[INTERN_MAX_CHUNKS];
+static unsigned int intern_num_chunks = 0;
+static unsigned int intern_free = 0;	/* First free id, 0 if none. */
+static unsigned int *intern_index = NULL;	/* Ids, 0 for a slot never used. */
+static unsigned int intern_index_mask = 0;
+static unsigned int intern_count = 0;	/* Live entries, a probe of the index stops at the first empty slot. */
+
+/* FNV-1a hash of a string of "len" bytes. */
+static unsigned int intern_hash(const char *str, unsigned int len)
+{
+	unsigned int h = 2166136261u;
+
+	while (len--)
+	{
+		h ^= (unsigned char)*str++;
+		h *= 16777619u;
+	}
+
+	return h;
+}
+
+/* Entry of an id, 1 to INTERN_CHUNK_SIZE * intern_num_chunks. */
+static struct intern_entry *intern_entry(unsigned int id)
+{
+	unsigned int chunk = (id - 1) / INTERN_CHUNK_SIZE;
+
+	if (!id || chunk >= __atomic_load_n(&intern_num_chunks, __ATOMIC_ACQUIRE))
+	{
+		return NULL;
+	}
+
+	return &intern_chunks[chunk][(id - 1) % INTERN_CHUNK_SIZE];
+}
+
+/* Add a chunk of free entries. Called with "intern_lock" held. */
+static int intern_grow(void)
+{
+	struct intern_entry *chunk;
+	unsigned int i, base;
+
+	if (intern_num_chunks >= INTERN_MAX_CHUNKS || !(chunk = heap_calloc(INTERN_CHUNK_SIZE, sizeof(*chunk))))
+	{
+		log_err("Malloc interned ID chunk failed\n");
+		return -1;
+	}
+
+	base = intern_num_chunks * INTERN_CHUNK_SIZE;
+	for (i = INTERN_CHUNK_SIZE; i > 0; i--)
+	{
+		chunk[i - 1].next_free = intern_free;
+		intern_free = base + i;
+	}
+
+	intern_chunks[intern_num_chunks] = chunk;
+	__atomic_store_n(&intern_num_chunks, intern_num_chunks + 1, __ATOMIC_RELEASE);
+
+	return 0;
+}
+
+/* Move the ids to an index sized for "intern_count + 1" of them at most half full. */
+static int intern_index_resize(void)
+{
+	unsigned int *index, size = INTERN_INDEX_MIN, i, j;
+
+	while (size < (intern_count + 1) * 2)
+	{
+		size <<= 1;
+	}
+
+	if (!(index = heap_calloc(size, sizeof(*index))))
+	{
+		log_err("Malloc interned ID index failed\n");
+		return -1;
+	}
+
+	for (i = 0; intern_index && i <= intern_index_mask; i++)
+	{
+		if (intern_index[i])
+		{
+			for (j = intern_entry(intern_index[i])->hash & (size - 1); index[j]; j = (j + 1) & (size - 1))
+			{
+			}
+			index[j] = intern_index[i];
+		}
+	}
+
+	heap_free(intern_index);
+	intern_index = index;
+	intern_index_mask = size - 1;
+
+	return 0;
+}
+
+/* Slot of the index holding the id of a string, or the unused slot ending its probe. Called with "intern_lock" held. */
+static unsigned int *intern_find(const char *str, unsigned int len, unsigned int hash)
+{
+	struct intern_entry *e;
+	unsigned int i;
+
+	for (i = hash & intern_index_mask; intern_index[i]; i = (i + 1) & intern_index_mask)
+	{
+		e = intern_entry(intern_index[i]);
+		if (e->hash == hash && !strncmp(e->str, str, len) && !e->str[len])
+		{
+			break;
+		}
+	}
+
+	return &intern_index[i];
+}
+
+/* Remove an id from the index, the ids after it in the probe which may sit in its slot are moved back. Called with "intern_lock" held. */
+static void intern_index_remove(unsigned int id, unsigned int hash)
+{
+	unsigned int i, j, home;
+
+	for (i = hash & intern_index_mask; intern_index[i] != id; i = (i + 1) & intern_index_mask)
+	{
+		if (!intern_index[i])
+		{
+			return;
+		}
+	}
+
+	for (j = (i + 1) & intern_index_mask; intern_index[j]; j = (j + 1) & intern_index_mask)
+	{
+		/* An id whose home slot is cyclically in (i, j] is still found from it. */
+		home = intern_entry(intern_index[j])->hash & intern_index_mask;
+		if ((i <= j) ? (i < home && home <= j) : (i < home || home <= j))
+		{
+			continue;
+		}
+
+		intern_index[i] = intern_index[j];
+		i = j;
+	}
+
+	intern_index[i] = 0;
+}
+
+AVS_CMD_RESULT avs_id_intern(const char *str, unsigned int len, struct avs_id *id)
+{
+	unsigned int hash, *slot;
+	struct intern_entry *e;
+	AVS_CMD_RESULT ret = ERROR;
+
+	if (!str || !id || memchr(str, '\0', len))
+	{
+		return ERROR;
+	}
+
+	hash = intern_hash(str, len);
+
+	pthread_mutex_lock(&intern_lock);
+
+	if ((!intern_index || (intern_count + 1) * 2 > intern_index_mask + 1) && intern_index_resize() != 0)
+	{
+		goto out;
+	}
+
+	slot = intern_find(str, len, hash);
+	if (*slot)
+	{
+		intern_entry(*slot)->refs++;
+		id->id = *slot;
+		id->len = len;
+		ret = SUCCESS;
+		goto out;
+	}
+
+	if (!intern_free && intern_grow() != 0)
+	{
+		goto out;
+	}
+
+	e = intern_entry(intern_free);
+	if (e->cap < len + 1)
+	{
+		heap_free(e->str);
+		e->cap = (len + INTERN_STR_ALIGN) & ~(INTERN_STR_ALIGN - 1);
+		if (!(e->str = heap_alloc(e->cap)))
+		{
+			log_err("Malloc interned ID failed\n");
+			e->cap = 0;
+			goto out;
+		}
+	}
+	memcpy(e->str, str, len);
+	e->str[len] = '\0';
+	e->hash = hash;
+	__atomic_store_n(&e->refs, 1, __ATOMIC_RELEASE);
+
+	id->id = intern_free;
+	id->len = len;
+	intern_free = e->next_free;
+
+	*slot = id->id;
+	intern_count++;
+	ret = SUCCESS;
+
+out:
+	pthread_mutex_unlock(&intern_lock);
+
+	return ret;
+}
+
+void avs_id_hold(struct avs_id id)
+{
+	struct intern_entry *e;
+
+	pthread_mutex_lock(&intern_lock);
+	if ((e = intern_entry(id.id)) && e->refs)
+	{
+		e->refs++;
+	}
+	pthread_mutex_unlock(&intern_lock);
+}
+
+void avs_id_release(struct avs_id id)
+{
+	struct intern_entry *e;
+
+	pthread_mutex_lock(&intern_lock);
+
+	if ((e = intern_entry(id.id)) && e->refs && !--e->refs)
+	{
+		intern_index_remove(id.id, e->hash);
+		intern_count--;
+
+		e->next_free = intern_free;
+		intern_free = id.id;
+	}
+
+	pthread_mutex_unlock(&intern_lock);
+}
+
+const char *avs_id_str(struct avs_id id)
+{
+	struct intern_entry *e = intern_entry(id.id);
+
+	return (e && __atomic_load_n(&e->refs, __ATOMIC_ACQUIRE)) ? e->str : NULL;
+}
@@ -0,0 +1,831 @@
+/****************************************************************************
+ *
+ * Multiedia Controller Module(MCM).
+ *
+ * Copyright (c) 2017 by Grandstream Networks, Inc.
+ * All rights reserved.
+ *
+ * This material is proprietary to Grandstream Networks, Inc. and,
+ * in addition to the above mentioned Copyright, may be
+ * subject to protection under other intellectual property
+ * regimes, including patents, trade secrets, designs and/or
+ * trademarks.
+ *
+ * Any use of this material for any purpose, except with an
+ * express license from Grandstream Networks, Inc. is strictly
+ * prohibited.
+ *
+ *
+ * \brief JSON decoder of the messages received from AVS.
+ *
+ *	Accepts and rejects the same messages as json_loads() of jansson
+ *  without flags, within JSON_MAX_TOKENS and JSON_MAX_DEPTH.
+ *
+ ***************************************************************************/
+
+#include <string.h>
+#include <stdio.h>
+#include <limits.h>
+#include "avs_json_dec.h"
+#include "avs_json_enc.h"
+#include "avs_log.h"
+
+/* State of tokenizing one message. */
+struct json_parser
+{
+	const char *js;
+	size_t len;
+	size_t pos;
+	struct json_doc *doc;
+	struct json_error *error;
+};
+
+static int parse_value(struct json_parser *p, int parent, int depth);
+
+/* Record the first error at the current position. */
+static int parse_fail(struct json_parser *p, const char *text)
+{
+	size_t i;
+	int n;
+
+	p->error->line = 1;
+	for (i = 0; i < p->pos && i < p->len; i++)
+	{
+		if ('\n' == p->js[i])
+		{
+			p->error->line++;
+		}
+	}
+
+	if (p->pos >= p->len)
+	{
+		snprintf(p->error->text, sizeof(p->error->text), "%s near end of file", text);
+	}
+	else
+	{
+		n = (p->len - p->pos > 10) ? 10 : (int)(p->len - p->pos);
+		snprintf(p->error->text, sizeof(p->error->text), "%s near '%.*s'", text, n, p->js + p->pos);
+	}
+
+	return -1;
+}
+
+static void skip_space(struct json_parser *p)
+{
+	while (p->pos < p->len && (' ' == p->js[p->pos] || '\t' == p->js[p->pos] || '\n' == p->js[p->pos] || '\r' == p->js[p->pos]))
+	{
+		p->pos++;
+	}
+}
+
+/* Append a token, a child of "parent". Return its index, -1 if the message has too many tokens. */
+static int new_tok(struct json_parser *p, enum json_tok_type type, int parent)
+{
+	struct json_tok *tok;
+
+	if (p->doc->num >= JSON_MAX_TOKENS)
+	{
+		return parse_fail(p, "too many tokens");
+	}
+
+	tok = &p->doc->toks[p->doc->num];
+	tok->type = type;
+	tok->escaped = 0;
+	tok->start = (int)p->pos;
+	tok->end = (int)p->pos;
+	tok->size = 0;
+	tok->parent = parent;
+
+	if (parent >= 0)
+	{
+		p->doc->toks[parent].size++;
+	}
+
+	return (int)p->doc->num++;
+}
+
+static int hex4(const char *s)
+{
+	int i, v = 0;
+
+	for (i = 0; i < 4; i++)
+	{
+		v <<= 4;
+		if (s[i] >= '0' && s[i] <= '9')
+		{
+			v |= s[i] - '0';
+		}
+		else if (s[i] >= 'a' && s[i] <= 'f')
+		{
+			v |= s[i] - 'a' + 10;
+		}
+		else if (s[i] >= 'A' && s[i] <= 'F')
+		{
+			v |= s[i] - 'A' + 10;
+		}
+		else
+		{
+			return -1;
+		}
+	}
+
+	return v;
+}
+
+/* Parse a string starting at the quote. */
+static int parse_string(struct json_parser *p, int parent)
+{
+	const unsigned char *s = (const unsigned char *)p->js;
+	int t, u, u2;
+	size_t n;
+
+	p->pos++;
+	if ((t = new_tok(p, JSON_TOK_STRING, parent)) < 0)
+	{
+		return -1;
+	}
+
+	while (p->pos < p->len)
+	{
+		if ('"' == s[p->pos])
+		{
+			p->doc->toks[t].end = (int)p->pos++;
+			return t;
+		}
+
+		if (s[p->pos] < 0x20)
+		{
+			return parse_fail(p, "control character in string");
+		}
+
+		if ('\\' != s[p->pos])
+		{
+			if (!(n = utf8_seq_len(s + p->pos, p->len - p->pos)))
+			{
+				return parse_fail(p, "invalid UTF-8 in string");
+			}
+			p->pos += n;
+			continue;
+		}
+
+		p->doc->toks[t].escaped = 1;
+
+		if (p->pos + 1 >= p->len)
+		{
+			break;
+		}
+
+		if (!strchr("\"\\/bfnrtu", s[p->pos + 1]) || !s[p->pos + 1])
+		{
+			return parse_fail(p, "invalid escape");
+		}
+
+		if ('u' != s[p->pos + 1])
+		{
+			p->pos += 2;
+			continue;
+		}
+
+		if (p->pos + 6 > p->len || (u = hex4(p->js + p->pos + 2)) < 0)
+		{
+			return parse_fail(p, "invalid escape");
+		}
+
+		if (!u)
+		{
+			return parse_fail(p, "\\u0000 is not allowed");
+		}
+
+		if (u >= 0xDC00 && u <= 0xDFFF)
+		{
+			return parse_fail(p, "invalid Unicode escape");
+		}
+
+		if (u >= 0xD800 && u <= 0xDBFF)
+		{
+			/* A high surrogate must be followed by a low one. */
+			if (p->pos + 12 > p->len || '\\' != s[p->pos + 6] || 'u' != s[p->pos + 7]
+				|| (u2 = hex4(p->js + p->pos + 8)) < 0xDC00 || u2 > 0xDFFF)
+			{
+				return parse_fail(p, "invalid Unicode escape");
+			}
+			p->pos += 6;
+		}
+
+		p->pos += 6;
+	}
+
+	return parse_fail(p, "premature end of input");
+}
+
+static int is_digit(char c)
+{
+	return c >= '0' && c <= '9';
+}
+
+/* Parse a number, an integer must fit in a long long as in jansson. */
+static int parse_number(struct json_parser *p, int parent)
+{
+	const char *s = p->js;
+	size_t pos = p->pos;
+	enum json_tok_type type = JSON_TOK_INTEGER;
+	unsigned long long v = 0, limit;
+	int neg = 0, t;
+
+	if ('-' == s[pos])
+	{
+		neg = 1;
+		pos++;
+	}
+
+	if (pos >= p->len || !is_digit(s[pos]))
+	{
+		return parse_fail(p, "invalid token");
+	}
+
+	if ('0' == s[pos])
+	{
+		pos++;
+		if (pos < p->len && is_digit(s[pos]))
+		{
+			return parse_fail(p, "invalid token");
+		}
+	}
+	else
+	{
+		while (pos < p->len && is_digit(s[pos]))
+		{
+			pos++;
+		}
+	}
+
+	if (pos < p->len && '.' == s[pos])
+	{
+		type = JSON_TOK_REAL;
+		if (++pos >= p->len || !is_digit(s[pos]))
+		{
+			return parse_fail(p, "invalid token");
+		}
+		while (pos < p->len && is_digit(s[pos]))
+		{
+			pos++;
+		}
+	}
+
+	if (pos < p->len && ('e' == s[pos] || 'E' == s[pos]))
+	{
+		type = JSON_TOK_REAL;
+		pos++;
+		if (pos < p->len && ('+' == s[pos] || '-' == s[pos]))
+		{
+			pos++;
+		}
+		if (pos >= p->len || !is_digit(s[pos]))
+		{
+			return parse_fail(p, "invalid token");
+		}
+		while (pos < p->len && is_digit(s[pos]))
+		{
+			pos++;
+		}
+	}
+
+	if (JSON_TOK_INTEGER == type)
+	{
+		limit = neg ? (unsigned long long)LLONG_MAX + 1 : (unsigned long long)LLONG_MAX;
+		for (t = p->pos + neg; t < (int)pos; t++)
+		{
+			if (v > (limit - (s[t] - '0')) / 10)
+			{
+				return parse_fail(p, neg ? "too big negative integer" : "too big integer");
+			}
+			v = v * 10 + (s[t] - '0');
+		}
+	}
+
+	if ((t = new_tok(p, type, parent)) < 0)
+	{
+		return -1;
+	}
+
+	p->pos = pos;
+	p->doc->toks[t].end = (int)pos;
+
+	return t;
+}
+
+/* Parse an object or an array starting at the bracket. */
+static int parse_container(struct json_parser *p, int parent, int depth)
+{
+	int object = ('{' == p->js[p->pos]);
+	char close = object ? '}' : ']';
+	int t, key;
+
+	if (depth >= JSON_MAX_DEPTH)
+	{
+		return parse_fail(p, "maximum parsing depth reached");
+	}
+
+	if ((t = new_tok(p, object ? JSON_TOK_OBJECT : JSON_TOK_ARRAY, parent)) < 0)
+	{
+		return -1;
+	}
+	p->pos++;
+
+	skip_space(p);
+	if (p->pos < p->len && close == p->js[p->pos])
+	{
+		p->doc->toks[t].end = (int)++p->pos;
+		return t;
+	}
+
+	for (;;)
+	{
+		skip_space(p);
+
+		if (object)
+		{
+			if (p->pos >= p->len || '"' != p->js[p->pos])
+			{
+				return parse_fail(p, "string or '}' expected");
+			}
+			if ((key = parse_string(p, t)) < 0)
+			{
+				return -1;
+			}
+
+			skip_space(p);
+			if (p->pos >= p->len || ':' != p->js[p->pos])
+			{
+				return parse_fail(p, "':' expected");
+			}
+			p->pos++;
+
+			if (parse_value(p, key, depth + 1) < 0)
+			{
+				return -1;
+			}
+		}
+		else if (parse_value(p, t, depth + 1) < 0)
+		{
+			return -1;
+		}
+
+		skip_space(p);
+		if (p->pos < p->len && ',' == p->js[p->pos])
+		{
+			p->pos++;
+			continue;
+		}
+
+		if (p->pos < p->len && close == p->js[p->pos])
+		{
+			p->doc->toks[t].end = (int)++p->pos;
+			return t;
+		}
+
+		return parse_fail(p, object ? "'}' expected" : "']' expected");
+	}
+}
+
+static int parse_literal(struct json_parser *p, int parent, const char *word)
+{
+	size_t n = strlen(word);
+	int t;
+
+	if (p->len - p->pos < n || memcmp(p->js + p->pos, word, n))
+	{
+		return parse_fail(p, "invalid token");
+	}
+
+	if ((t = new_tok(p, JSON_TOK_LITERAL, parent)) < 0)
+	{
+		return -1;
+	}
+
+	p->pos += n;
+	p->doc->toks[t].end = (int)p->pos;
+
+	return t;
+}
+
+static int parse_value(struct json_parser *p, int parent, int depth)
+{
+	skip_space(p);
+
+	if (p->pos >= p->len)
+	{
+		return parse_fail(p, "unexpected end of input");
+	}
+
+	switch (p->js[p->pos])
+	{
+		case '{':
+		case '[':
+			return parse_container(p, parent, depth);
+
+		case '"':
+			return parse_string(p, parent);
+
+		case 't':
+			return parse_literal(p, parent, "true");
+
+		case 'f':
+			return parse_literal(p, parent, "false");
+
+		case 'n':
+			return parse_literal(p, parent, "null");
+
+		default:
+			if ('-' == p->js[p->pos] || is_digit(p->js[p->pos]))
+			{
+				return parse_number(p, parent);
+			}
+			return parse_fail(p, "invalid token");
+	}
+}
+
+int json_doc_parse(struct json_doc *doc, const char *js, size_t len, struct json_error *error)
+{
+	struct json_parser p;
+
+	p.js = js;
+	p.len = len;
+	p.pos = 0;
+	p.doc = doc;
+	p.error = error;
+
+	doc->js = js;
+	doc->num = 0;
+	error->line = 0;
+	error->text[0] = '\0';
+
+	skip_space(&p);
+	if (p.pos >= len || ('{' != js[p.pos] && '[' != js[p.pos]))
+	{
+		return parse_fail(&p, "'[' or '{' expected");
+	}
+
+	if (parse_container(&p, -1, 0) < 0)
+	{
+		return -1;
+	}
+
+	skip_space(&p);
+	if (p.pos < len)
+	{
+		return parse_fail(&p, "end of file expected");
+	}
+
+	return 0;
+}
+
+/* Compare a string token with "s". */
+static int tok_equal(const struct json_doc *doc, int tok, const char *s)
+{
+	const struct json_tok *t = &doc->toks[tok];
+	char buf[64];
+	size_t n = strlen(s);
+
+	if (!t->escaped)
+	{
+		return (size_t)(t->end - t->start) == n && !memcmp(doc->js + t->start, s, n);
+	}
+
+	/* Keys are short, an escaped key longer than the buffer is not one we look for. */
+	if (n >= sizeof(buf) - 1)
+	{
+		return 0;
+	}
+
+	return json_tok_copy(doc, tok, buf, sizeof(buf)) == n && !memcmp(buf, s, n);
+}
+
+int json_doc_get(const struct json_doc *doc, int obj, const char *key)
+{
+	int i, found = -1;
+
+	if (obj < 0 || JSON_TOK_OBJECT != doc->toks[obj].type)
+	{
+		return -1;
+	}
+
+	/* Tokens of the object are contiguous, its keys are its direct children. */
+	for (i = obj + 1; i < (int)doc->num && doc->toks[i].start < doc->toks[obj].end; i++)
+	{
+		if (doc->toks[i].parent == obj && tok_equal(doc, i, key))
+		{
+			found = i + 1;
+		}
+	}
+
+	return found;
+}
+
+/* Append the UTF-8 encoding of "cp" if it fits. */
+static size_t put_utf8(char *dst, size_t len, size_t size, unsigned int cp)
+{
+	char seq[4];
+	size_t n;
+
+	if (cp < 0x80)
+	{
+		seq[0] = cp;
+		n = 1;
+	}
+	else if (cp < 0x800)
+	{
+		seq[0] = 0xC0 | (cp >> 6);
+		seq[1] = 0x80 | (cp & 0x3F);
+		n = 2;
+	}
+	else if (cp < 0x10000)
+	{
+		seq[0] = 0xE0 | (cp >> 12);
+		seq[1] = 0x80 | ((cp >> 6) & 0x3F);
+		seq[2] = 0x80 | (cp & 0x3F);
+		n = 3;
+	}
+	else
+	{
+		seq[0] = 0xF0 | (cp >> 18);
+		seq[1] = 0x80 | ((cp >> 12) & 0x3F);
+		seq[2] = 0x80 | ((cp >> 6) & 0x3F);
+		seq[3] = 0x80 | (cp & 0x3F);
+		n = 4;
+	}
+
+	if (len + n >= size)
+	{
+		return 0;
+	}
+
+	memcpy(dst + len, seq, n);
+
+	return n;
+}
+
+size_t json_tok_copy(const struct json_doc *doc, int tok, char *dst, size_t size)
+{
+	const struct json_tok *t = &doc->toks[tok];
+	const char *s = doc->js + t->start;
+	const char *end = doc->js + t->end;
+	size_t len = 0, n;
+	unsigned int cp;
+
+	if (!size)
+	{
+		return 0;
+	}
+
+	if (!t->escaped)
+	{
+		len = end - s;
+		if (len >= size)
+		{
+			len = size - 1;
+		}
+		memcpy(dst, s, len);
+		dst[len] = '\0';
+		return len;
+	}
+
+	while (s < end && len < size - 1)
+	{
+		if ('\\' != *s)
+		{
+			dst[len++] = *s++;
+			continue;
+		}
+
+		switch (s[1])
+		{
+			case 'b': cp = '\b'; break;
+			case 'f': cp = '\f'; break;
+			case 'n': cp = '\n'; break;
+			case 'r': cp = '\r'; break;
+			case 't': cp = '\t'; break;
+			case 'u':
+				cp = hex4(s + 2);
+				if (cp >= 0xD800 && cp <= 0xDBFF)
+				{
+					cp = 0x10000 + ((cp - 0xD800) << 10) + (hex4(s + 8) - 0xDC00);
+					s += 6;
+				}
+				s += 4;
+				break;
+			default: cp = (unsigned char)s[1]; break;
+		}
+		s += 2;
+
+		if (!(n = put_utf8(dst, len, size, cp)))
+		{
+			break;
+		}
+		len += n;
+	}
+
+	dst[len] = '\0';
+
+	return len;
+}
+
+/* Value of an integer token, it has been range checked by the tokenizer. */
+static long long tok_integer(const struct json_doc *doc, int tok)
+{
+	const char *s = doc->js + doc->toks[tok].start;
+	const char *end = doc->js + doc->toks[tok].end;
+	unsigned long long v = 0;
+	int neg = ('-' == *s);
+
+	for (s += neg; s < end; s++)
+	{
+		v = v * 10 + (*s - '0');
+	}
+
+	return neg ? (long long)(0 - v) : (long long)v;
+}
+
+/* Leading decimal digits of a string token, as atoi() took them. */
+static unsigned int tok_string_uint(const struct json_doc *doc, int tok)
+{
+	char buf[16];
+	const char *s = buf;
+	unsigned int v = 0;
+	int neg = 0;
+
+	json_tok_copy(doc, tok, buf, sizeof(buf));
+
+	while (' ' == *s || (*s >= '\t' && *s <= '\r'))
+	{
+		s++;
+	}
+
+	if ('-' == *s || '+' == *s)
+	{
+		neg = ('-' == *s++);
+	}
+
+	while (is_digit(*s))
+	{
+		v = v * 10 + (*s++ - '0');
+	}
+
+	return neg ? 0 - v : v;
+}
+
+static int field_type_ok(enum json_field_type type, enum json_tok_type tok_type)
+{
+	switch (type)
+	{
+		case JSON_FIELD_OBJECT:
+			return JSON_TOK_OBJECT == tok_type;
+
+		case JSON_FIELD_ARRAY:
+			return JSON_TOK_ARRAY == tok_type;
+
+		case JSON_FIELD_STRING:
+		case JSON_FIELD_STRING_UINT:
+			return JSON_TOK_STRING == tok_type;
+
+		case JSON_FIELD_INTEGER:
+			return JSON_TOK_INTEGER == tok_type;
+	}
+
+	return 0;
+}
+
+int json_dec_fields(const struct json_doc *doc, int obj, const struct json_field *fields, unsigned int num, void *out)
+{
+	int bound[JSON_MAX_FIELDS];
+	char stale[JSON_MAX_FIELDS];
+	const struct json_field *f;
+	const struct json_tok *t;
+	unsigned int i, j, k;
+	int parent, tok, ok;
+
+	if (num > JSON_MAX_FIELDS || obj < 0 || JSON_TOK_OBJECT != doc->toks[obj].type)
+	{
+		return -1;
+	}
+
+	for (j = 0; j < num; j++)
+	{
+		bound[j] = -1;
+	}
+
+	/* Bind the members to the table in one pass, a later duplicate replaces the earlier one with all its members. */
+	for (i = obj + 1; i < doc->num && doc->toks[i].start < doc->toks[obj].end; i++)
+	{
+		t = &doc->toks[i];
+
+		if (t->parent < 0 || JSON_TOK_OBJECT != doc->toks[t->parent].type)
+		{
+			continue;
+		}
+
+		for (j = 0; j < num; j++)
+		{
+			parent = (fields[j].parent < 0) ? obj : bound[fields[j].parent];
+
+			if (parent >= 0 && t->parent == parent && tok_equal(doc, i, fields[j].key))
+			{
+				bound[j] = i + 1;
+
+				if (JSON_FIELD_OBJECT == fields[j].type)
+				{
+					memset(stale, 0, sizeof(stale));
+					stale[j] = 1;
+					for (k = j + 1; k < num; k++)
+					{
+						if (fields[k].parent >= 0 && stale[fields[k].parent])
+						{
+							stale[k] = 1;
+							bound[k] = -1;
+						}
+					}
+				}
+				break;
+			}
+		}
+	}
+
+	/* Check and store them in the order of the table. */
+	for (j = 0; j < num; j++)
+	{
+		f = &fields[j];
+
+		if (f->parent >= 0 && bound[f->parent] < 0)
+		{
+			continue;
+		}
+
+		if ((tok = bound[j]) < 0)
+		{
+			if (f->missing)
+			{
+				log_err("%s", f->missing);
+				return -1;
+			}
+			continue;
+		}
+
+		t = &doc->toks[tok];
+		ok = field_type_ok(f->type, t->type);
+
+		if (!ok && f->mistyped)
+		{
+			log_err("%s", f->mistyped);
+			return -1;
+		}
+
+		switch (f->type)
+		{
+			case JSON_FIELD_STRING:
+				if (ok)
+				{
+					json_tok_copy(doc, tok, (char *)out + f->offset, f->size);
+				}
+				else if (f->fallback)
+				{
+					strncpy((char *)out + f->offset, f->fallback, f->size - 1);
+					((char *)out)[f->offset + f->size - 1] = '\0';
+				}
+				break;
+
+			case JSON_FIELD_STRING_UINT:
+				*(unsigned int *)((char *)out + f->offset) = tok_string_uint(doc, tok);
+				break;
+
+			case JSON_FIELD_INTEGER:
+				if (f->echo)
+				{
+					log_dbg(f->echo, (int)tok_integer(doc, tok));
+				}
+				*(unsigned int *)((char *)out + f->offset) = (unsigned int)tok_integer(doc, tok);
+				break;
+
+			default:
+				break;
+		}
+
+		if (f->echo && JSON_FIELD_INTEGER != f->type)
+		{
+			if (ok)
+			{
+				log_dbg(f->echo, t->end - t->start, doc->js + t->start);
+			}
+			else
+			{
+				log_dbg(f->echo, 6, "(null)");
+			}
+		}
+
+		if (f->handler && f->handler(doc, tok, out) != 0)
+		{
+			return -1;
+		}
+	}
+
+	return 0;
+}
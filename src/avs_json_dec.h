@@ -0,0 +1,170 @@
+/****************************************************************************
+ *
+ * Multiedia Controller Module(MCM).
+ *
+ * Copyright (c) 2017 by Grandstream Networks, Inc.
+ * All rights reserved.
+ *
+ * This material is proprietary to Grandstream Networks, Inc. and,
+ * in addition to the above mentioned Copyright, may be
+ * subject to protection under other intellectual property
+ * regimes, including patents, trade secrets, designs and/or
+ * trademarks.
+ *
+ * Any use of this material for any purpose, except with an
+ * express license from Grandstream Networks, Inc. is strictly
+ * prohibited.
+ *
+ *
+ * \brief JSON decoder of the messages received from AVS.
+ *
+ *	A message is split into a flat array of tokens in one pass, then the
+ *  fields described by a table are copied into the response structure.
+ *  No tree is built and nothing is allocated.
+ *
+ ***************************************************************************/
+
+#ifndef AVS_JSON_DEC_H
+#define AVS_JSON_DEC_H
+
+#include <stddef.h>
+
+#define JSON_MAX_TOKENS		1024	/* Enough for an "addPort" response with hundreds of candidates, one token each. */
+#define JSON_MAX_DEPTH		32	/* Maximum nesting of objects and arrays. */
+#define JSON_MAX_FIELDS		16	/* Maximum entries of a field table. */
+
+enum json_tok_type
+{
+	JSON_TOK_OBJECT,
+	JSON_TOK_ARRAY,
+	JSON_TOK_STRING,
+	JSON_TOK_INTEGER,
+	JSON_TOK_REAL,
+	JSON_TOK_LITERAL	/* true, false or null. */
+};
+
+/**
+ * struct json_tok - A JSON value, or a key of an object.
+ * @type:  Type of the token, a key is a JSON_TOK_STRING whose parent is an object.
+ * @escaped:  A string which contains escapes, it must be unescaped before use.
+ * @start:  Offset of the first byte in the message, after the quote of a string.
+ * @end:  Offset after the last byte, before the quote of a string.
+ * @size:  Members of an object, elements of an array, 1 for a key.
+ * @parent:  Index of the enclosing object, array or key (for a value of an object), -1 for the top level.
+ *
+ * The value of a key is always the next token.
+ */
+struct json_tok
+{
+	enum json_tok_type type;
+	int escaped;
+	int start;
+	int end;
+	int size;
+	int parent;
+};
+
+/**
+ * struct json_doc - A tokenized message.
+ * @js:  The message, it must stay valid while the tokens are used.
+ * @num:  Tokens in @toks, the top level value is @toks[0].
+ */
+struct json_doc
+{
+	const char *js;
+	unsigned int num;
+	struct json_tok toks[JSON_MAX_TOKENS];
+};
+
+/**
+ * struct json_error - Where and why a message is malformed.
+ * @line:  Line of the error, starting from 1.
+ * @text:  Description of the error.
+ */
+struct json_error
+{
+	int line;
+	char text[80];
+};
+
+/**
+ * json_doc_parse - Tokenize a JSON message. The top level value must be an object or an array.
+ * @doc:  Output tokens.
+ * @js:  The message.
+ * @len:  Length of @js.
+ * @error:  Filled if the message is malformed.
+ *
+ * Return: 0 on success, -1 if the message is not valid JSON.
+ */
+int json_doc_parse(struct json_doc *doc, const char *js, size_t len, struct json_error *error);
+
+/**
+ * json_doc_get - Get a member of an object. The last one wins if the key is duplicated.
+ *
+ * Return: Index of the value token, -1 if @obj is not an object or has no such member.
+ */
+int json_doc_get(const struct json_doc *doc, int obj, const char *key);
+
+/**
+ * json_tok_copy - Copy a string token into @dst, unescaped and terminated by '\0'. It is truncated to @size - 1 bytes.
+ *
+ * Return: Length of the copied string.
+ */
+size_t json_tok_copy(const struct json_doc *doc, int tok, char *dst, size_t size);
+
+typedef int (*json_field_handler)(const struct json_doc *doc, int tok, void *out);
+
+enum json_field_type
+{
+	JSON_FIELD_OBJECT,	/* Only the presence and the type are checked, its members are other entries. */
+	JSON_FIELD_ARRAY,
+	JSON_FIELD_STRING,	/* Copied into a char array of "size" bytes. */
+	JSON_FIELD_STRING_UINT,	/* A number sent as a string, stored into an unsigned int. */
+	JSON_FIELD_INTEGER	/* Stored into an unsigned int. */
+};
+
+/**
+ * struct json_field - An entry of the table describing a response.
+ * @parent:  Index of the enclosing JSON_FIELD_OBJECT entry in the same table, -1 for a member of the top level object.
+ *		Entries are listed after their parent.
+ * @key:  Name of the member.
+ * @type:  Expected type.
+ * @offset:  Where the value is stored in the output structure.
+ * @size:  Size of a string destination.
+ * @echo:  printf format of a trace of the value, NULL for none. It takes "%.*s" for strings, "%d" for integers.
+ * @missing:  Printed and decoding fails if the member is absent, NULL if it is optional.
+ * @mistyped:  Printed and decoding fails if the value has another type.
+ * @fallback:  Stored instead of a string of another type, when @mistyped is NULL.
+ * @handler:  Called with the value token once it is checked, NULL for none.
+ *
+ * A member whose parent object is absent is skipped.
+ */
+struct json_field
+{
+	int parent;
+	const char *key;
+	enum json_field_type type;
+	size_t offset;
+	size_t size;
+	const char *echo;
+	const char *missing;
+	const char *mistyped;
+	const char *fallback;
+	json_field_handler handler;
+};
+
+/**
+ * json_dec_fields - Decode the members of object @obj described by @fields into @out.
+ * @doc:  The tokenized message.
+ * @obj:  Index of the object token.
+ * @fields:  The table, at most JSON_MAX_FIELDS entries.
+ * @num:  Entries of @fields.
+ * @out:  Output structure.
+ *
+ * Members are bound in one pass over the tokens, then checked in the order of the table.
+ *
+ * Return: 0 on success, -1 if a member is missing, mistyped or rejected by its handler.
+ */
+int json_dec_fields(const struct json_doc *doc, int obj, const struct json_field *fields, unsigned int num, void *out);
+
+#endif /* AVS_JSON_DEC_H */
@@ -0,0 +1,718 @@
+/****************************************************************************
+ *
+ * Multiedia Controller Module(MCM).
+ *
+ * Copyright (c) 2017 by Grandstream Networks, Inc.
+ * All rights reserved.
+ *
+ * This material is proprietary to Grandstream Networks, Inc. and,
+ * in addition to the above mentioned Copyright, may be
+ * subject to protection under other intellectual property
+ * regimes, including patents, trade secrets, designs and/or
+ * trademarks.
+ *
+ * Any use of this material for any purpose, except with an
+ * express license from Grandstream Networks, Inc. is strictly
+ * prohibited.
+ *
+ *
+ * \brief JSON encoder of the commands sent to AVS.
+ *
+ *	The output is byte-identical to what jansson produced with JSON_COMPACT
+ *  for the same objects: keys in insertion order, the same escaping.
+ *  Except the corrections of the jansson encoders below, avs-bench checks
+ *  everything else byte for byte:
+ *  - The transport of "addTrack" is named by transmode value as documented,
+ *    1 "sendRecv", 2 "sendOnly", 3 "recvOnly". The jansson encoders indexed
+ *    the name table with it, so 1 went out as "recvOnly", 2 as "sendRecv",
+ *    0 as "sendOnly" and 3 read past the table. 0 is now rejected.
+ *  - The "password" of the TURN server in "setParam" is turn_password. The
+ *    jansson encoder sent turn_username there as well.
+ *
+ ***************************************************************************/
+
+#include <string.h>
+#include <stdio.h>
+#include "avs_json_enc.h"
+#include "avs_log.h"
+
+/* Output cursor of the encoder. */
+struct json_writer
+{
+	char *buf;
+	size_t size;
+	size_t len;
+	int error;	/* Set once the buffer overflows or a string is rejected. */
+};
+
+static const struct codec_audio_tran {
+	enum avs_audio_codec codec;
+	const char *name;
+} codec_audio_trans[] = {
+	{ AVS_AUDIO_CODEC_PCMU, "audio/pcmu" },
+	{ AVS_AUDIO_CODEC_PCMA, "audio/pcma" },
+	{ AVS_AUDIO_CODEC_GSM, "audio/gsm" },
+	{ AVS_AUDIO_CODEC_ILBC, "audio/ilbc" },
+	{ AVS_AUDIO_CODEC_G722, "audio/g722" },
+	{ AVS_AUDIO_CODEC_G722_1, "audio/g722.1" },
+	{ AVS_AUDIO_CODEC_G722_1C, "audio/g722.1c" },
+	{ AVS_AUDIO_CODEC_G729, "audio/g729"},
+	{ AVS_AUDIO_CODEC_G723_1, "audio/g723.1"},
+	{ AVS_AUDIO_CODEC_G726, "audio/adpcm32"},
+	{ AVS_AUDIO_CODEC_OPUS, "audio/opus"},
+};
+
+static const struct codec_video_tran {
+	enum avs_video_codec codec;
+	const char *name;
+} codec_video_trans[] = {
+	{ AVS_VIDEO_CODEC_H264, "video/avc" },
+	{ AVS_VIDEO_CODEC_H265, "video/hevc" },
+	{ AVS_VIDEO_CODEC_VP8, "video/vp8" },
+	{ AVS_VIDEO_CODEC_VP9, "video/vp9" },
+};
+
+static const struct runctrl_opt_tran {
+	enum avs_runctrl_chan_opt opt;
+	const char *name;
+} runctrl_opt_trans[] = {
+	{ AVS_RUNCTRL_CHAN_OPT_START, "start" },
+	{ AVS_RUNCTRL_CHAN_OPT_RESET, "reset" },
+	{ AVS_RUNCTRL_CHAN_OPT_SUSPEND, "suspend" },
+	{ AVS_RUNCTRL_CHAN_OPT_RESUME, "resume" },
+};
+
+static const struct runctrl_mtype_tran {
+	enum avs_runctrl_chan_mtype mtype;
+	const char *name;
+} runctrl_mtype_trans[] = {
+	{ AVS_RUNCTRL_CHAN_TYPE_AUDIO, "audio" },
+	{ AVS_RUNCTRL_CHAN_TYPE_VIDEO, "video" },
+	{ AVS_RUNCTRL_CHAN_TYPE_ALL, "all" },
+};
+
+enum media_transmode
+{
+	MEDIA_TRANSMODE_SENDRECV = 1,
+	MEDIA_TRANSMODE_SENDONLY,
+	MEDIA_TRANSMODE_RECVONLY
+};
+
+static const struct transmode {
+	enum media_transmode mode;
+	const char *name;
+} transmodes[] = {
+	{ MEDIA_TRANSMODE_SENDONLY, "sendOnly" },
+	{ MEDIA_TRANSMODE_RECVONLY, "recvOnly" },
+	{ MEDIA_TRANSMODE_SENDRECV, "sendRecv" },
+};
+
+const char *codec_audio_name(enum avs_audio_codec codec)
+{
+	if ((unsigned int)codec >= sizeof(codec_audio_trans) / sizeof(codec_audio_trans[0]))
+	{
+		return NULL;
+	}
+
+	return codec_audio_trans[codec].name;
+}
+
+const char *codec_video_name(enum avs_video_codec codec)
+{
+	if ((unsigned int)codec >= sizeof(codec_video_trans) / sizeof(codec_video_trans[0]))
+	{
+		return NULL;
+	}
+
+	return codec_video_trans[codec].name;
+}
+
+const char *transmode_name(unsigned int mode)
+{
+	unsigned int i;
+
+	for (i = 0; i < sizeof(transmodes) / sizeof(transmodes[0]); i++)
+	{
+		if (transmodes[i].mode == mode)
+		{
+			return transmodes[i].name;
+		}
+	}
+
+	return NULL;
+}
+
+size_t utf8_seq_len(const unsigned char *s, size_t n)
+{
+	unsigned int cp;
+	size_t len, i;
+
+	if (s[0] < 0x80)
+	{
+		return 1;
+	}
+	else if (s[0] >= 0xC2 && s[0] <= 0xDF)
+	{
+		len = 2;
+		cp = s[0] & 0x1F;
+	}
+	else if (s[0] >= 0xE0 && s[0] <= 0xEF)
+	{
+		len = 3;
+		cp = s[0] & 0x0F;
+	}
+	else if (s[0] >= 0xF0 && s[0] <= 0xF4)
+	{
+		len = 4;
+		cp = s[0] & 0x07;
+	}
+	else
+	{
+		return 0;	/* Continuation byte, overlong 2-byte sequence or out of range. */
+	}
+
+	if (len > n)
+	{
+		return 0;
+	}
+
+	for (i = 1; i < len; i++)
+	{
+		if ((s[i] & 0xC0) != 0x80)
+		{
+			return 0;
+		}
+		cp = (cp << 6) | (s[i] & 0x3F);
+	}
+
+	if (cp > 0x10FFFF || (cp >= 0xD800 && cp <= 0xDFFF)
+		|| (3 == len && cp < 0x800) || (4 == len && cp < 0x10000))
+	{
+		return 0;
+	}
+
+	return len;
+}
+
+struct avs_str enc_str(const char *str, size_t size)
+{
+	struct avs_str ref;
+
+	ref.s = str;
+	ref.len = strnlen(str, size);
+
+	return ref;
+}
+
+/* Reference the IDs of a parameter structure, "port_id" is NULL for the commands without one. */
+static void enc_chan_ids(struct enc_chan *chan, const char *conf_id, const char *chan_id, const char *port_id, const char *comm_id)
+{
+	chan->conf_id = enc_str(conf_id, MAX_CONFID_LEN);
+	chan->chan_id = enc_str(chan_id, MAX_CHANID_LEN);
+	chan->port_id = enc_str(port_id ? port_id : "", MAX_PORTID_LEN);
+	chan->comm_id = enc_str(comm_id, MAX_UNIQUE_ID);
+}
+
+void enc_chan_alloc_port_normal(const struct avs_alloc_port_normal_param *param, struct enc_chan *chan, struct avs_alloc_port_ref_param *ref)
+{
+	enc_chan_ids(chan, param->conf_id, param->chan_id, NULL, param->comm_id);
+	ref->enable_dtls = param->enable_dtls;
+}
+
+void enc_chan_alloc_port_ice(const struct avs_alloc_port_ice_param *param, struct enc_chan *chan, struct avs_alloc_port_ref_param *ref)
+{
+	enc_chan_ids(chan, param->conf_id, param->chan_id, NULL, param->comm_id);
+	ref->enable_dtls = param->enable_dtls;
+}
+
+void enc_chan_del_port(const struct avs_dealloc_port_param *param, struct enc_chan *chan)
+{
+	enc_chan_ids(chan, param->conf_id, param->chan_id, param->port_id, param->comm_id);
+}
+
+void enc_chan_runctrl_chan(const struct avs_runctrl_chan_param *param, struct enc_chan *chan, struct avs_runctrl_chan_ref_param *ref)
+{
+	enc_chan_ids(chan, param->conf_id, param->chan_id, NULL, param->comm_id);
+	ref->opt = param->opt;
+	ref->mtype = param->mtype;
+}
+
+void enc_chan_set_peerport_normal(const struct avs_set_peerport_normal_param *param, struct enc_chan *chan, struct avs_set_peerport_normal_ref_param *ref)
+{
+	enc_chan_ids(chan, param->conf_id, param->chan_id, param->port_id, param->comm_id);
+	ref->rtcpmux = param->rtcpmux;
+	ref->symrtp = param->symrtp;
+	ref->srtpmode = param->srtpmode;
+	ref->qos = param->qos;
+	ref->fingerprint = enc_str(param->fingerprint, sizeof(param->fingerprint));
+	ref->srtpsendkey = enc_str(param->srtpsendkey, sizeof(param->srtpsendkey));
+	ref->srtprecvkey = enc_str(param->srtprecvkey, sizeof(param->srtprecvkey));
+	ref->targetaddr = enc_str(param->targetaddr, sizeof(param->targetaddr));
+}
+
+void enc_chan_set_peerport_ice(const struct avs_set_peerport_ice_param *param, struct enc_chan *chan, struct avs_set_peerport_ice_ref_param *ref)
+{
+	enc_chan_ids(chan, param->conf_id, param->chan_id, param->port_id, param->comm_id);
+	ref->icerole = param->icerole;
+	ref->sslrole = param->sslrole;
+	ref->fingerprint = enc_str(param->fingerprint, sizeof(param->fingerprint));
+	ref->ice_ufrag = enc_str(param->ice_ufrag, sizeof(param->ice_ufrag));
+	ref->ice_pwd = enc_str(param->ice_pwd, sizeof(param->ice_pwd));
+	ref->candidate = enc_str(param->candidate, sizeof(param->candidate));
+}
+
+void enc_chan_set_audio_codec(const struct avs_codec_audio_param *param, struct enc_chan *chan, struct avs_codec_audio_ref_param *ref)
+{
+	enc_chan_ids(chan, param->conf_id, param->chan_id, param->port_id, param->comm_id);
+	ref->a_codec = param->a_codec;
+	ref->audio_payloadtype = param->audio_payloadtype;
+	ref->audio_transmode = param->audio_transmode;
+	ref->ptime = param->ptime;
+}
+
+void enc_chan_set_video_codec(const struct avs_codec_video_param *param, struct enc_chan *chan, struct avs_codec_video_ref_param *ref)
+{
+	enc_chan_ids(chan, param->conf_id, param->chan_id, param->port_id, param->comm_id);
+	ref->v_codec = param->v_codec;
+	ref->video_payloadtype = param->video_payloadtype;
+	ref->video_transmode = param->video_transmode;
+}
+
+/* Append raw bytes. */
+static void jw_raw(struct json_writer *w, const char *s, size_t n)
+{
+	if (w->error)
+	{
+		return;
+	}
+
+	if (w->len + n >= w->size)
+	{
+		w->error = 1;
+		return;
+	}
+
+	memcpy(w->buf + w->len, s, n);
+	w->len += n;
+}
+
+/* Append a quoted and escaped string. */
+static void jw_str(struct json_writer *w, const char *s, size_t n)
+{
+	const unsigned char *p = (const unsigned char *)s;
+	const unsigned char *end = p + n;
+	const unsigned char *run = p;
+	char seq[7];
+	size_t len;
+
+	jw_raw(w, "\"", 1);
+
+	while (p < end && !w->error)
+	{
+		if (*p >= 0x20 && *p != '"' && *p != '\\')
+		{
+			if (!(len = utf8_seq_len(p, end - p)))
+			{
+				w->error = 1;
+				return;
+			}
+			p += len;
+			continue;
+		}
+
+		jw_raw(w, (const char *)run, p - run);
+
+		switch (*p)
+		{
+			case '"':  jw_raw(w, "\\\"", 2); break;
+			case '\\': jw_raw(w, "\\\\", 2); break;
+			case '\b': jw_raw(w, "\\b", 2); break;
+			case '\f': jw_raw(w, "\\f", 2); break;
+			case '\n': jw_raw(w, "\\n", 2); break;
+			case '\r': jw_raw(w, "\\r", 2); break;
+			case '\t': jw_raw(w, "\\t", 2); break;
+			default:
+				snprintf(seq, sizeof(seq), "\\u%04X", *p);
+				jw_raw(w, seq, 6);
+				break;
+		}
+
+		run = ++p;
+	}
+
+	jw_raw(w, (const char *)run, p - run);
+	jw_raw(w, "\"", 1);
+}
+
+/* Append "key":, preceded by a comma unless "sep" is 0 for the first member. */
+static void jw_key(struct json_writer *w, int sep, const char *key)
+{
+	if (sep)
+	{
+		jw_raw(w, ",", 1);
+	}
+	jw_str(w, key, strlen(key));
+	jw_raw(w, ":", 1);
+}
+
+/* Append "key":"value" from a referenced string. */
+static void jw_member_ref(struct json_writer *w, int sep, const char *key, struct avs_str val)
+{
+	jw_key(w, sep, key);
+	jw_str(w, val.s ? val.s : "", val.len);
+}
+
+/* Append "key":"value" from a fixed size char array of a parameter structure. */
+static void jw_member_str(struct json_writer *w, int sep, const char *key, const char *val, size_t size)
+{
+	jw_member_ref(w, sep, key, enc_str(val, size));
+}
+
+/* Append "key":"value" from a constant string. */
+static void jw_member_cstr(struct json_writer *w, int sep, const char *key, const char *val)
+{
+	jw_key(w, sep, key);
+	jw_str(w, val, strlen(val));
+}
+
+/* Append "key":"number", AVS takes numbers as strings. */
+static void jw_member_num(struct json_writer *w, int sep, const char *key, int val)
+{
+	char num[12];
+
+	jw_key(w, sep, key);
+	jw_str(w, num, snprintf(num, sizeof(num), "%d", val));
+}
+
+/* Append the trailing ,"id":"..."} of every command and terminate the message. */
+static int jw_finish(struct json_writer *w, struct avs_str comm_id)
+{
+	jw_raw(w, "}", 1);
+	jw_member_ref(w, 1, "id", comm_id);
+	jw_raw(w, "}", 1);
+
+	if (w->error)
+	{
+		return -1;
+	}
+
+	w->buf[w->len] = '\0';
+
+	return (int)w->len;
+}
+
+static void jw_init(struct json_writer *w, char *buf, size_t size)
+{
+	w->buf = buf;
+	w->size = size;
+	w->len = 0;
+	w->error = (0 == size);
+}
+
+/* Encapsulating "setParam" JSON message. */
+int enc_json_set_global_param(char *buf, size_t size, const struct avs_global_param *param)
+{
+	struct json_writer w;
+
+	jw_init(&w, buf, size);
+
+	jw_raw(&w, "{", 1);
+	jw_key(&w, 0, "setParam");
+	jw_raw(&w, "{", 1);
+	jw_key(&w, 0, "stunserver");
+	jw_raw(&w, "[{", 2);
+	jw_member_str(&w, 0, "address", param->stun_ipaddr, sizeof(param->stun_ipaddr));
+	jw_member_num(&w, 1, "port", param->stun_port);
+	jw_raw(&w, "}]", 2);
+	jw_key(&w, 1, "turnserver");
+	jw_raw(&w, "[{", 2);
+	jw_member_str(&w, 0, "address", param->turn_ipaddr, sizeof(param->turn_ipaddr));
+	jw_member_num(&w, 1, "port", param->turn_port);
+	jw_member_str(&w, 1, "username", param->turn_username, sizeof(param->turn_username));
+	jw_member_str(&w, 1, "password", param->turn_password, sizeof(param->turn_password));
+	jw_raw(&w, "}]", 2);
+
+	return jw_finish(&w, enc_str(param->comm_id, sizeof(param->comm_id)));
+}
+
+/* Encapsulating "addPort" JSON message, shared by normal mode and ICE mode. */
+int enc_json_alloc_port_ref(char *buf, size_t size, const struct enc_chan *chan, const struct avs_alloc_port_ref_param *param, int ice)
+{
+	struct json_writer w;
+
+	jw_init(&w, buf, size);
+
+	jw_raw(&w, "{", 1);
+	jw_key(&w, 0, "addPort");
+	jw_raw(&w, "{", 1);
+	jw_member_ref(&w, 0, "conf_id", chan->conf_id);
+	jw_member_ref(&w, 1, "chan_id", chan->chan_id);
+	jw_member_num(&w, 1, "ICE", ice);
+	jw_member_num(&w, 1, "DTLS", param->enable_dtls);
+
+	return jw_finish(&w, chan->comm_id);
+}
+
+/* Encapsulating "addPort" JSON message with normal mode. */
+int enc_json_alloc_port_normal(char *buf, size_t size, const struct avs_alloc_port_normal_param *param)
+{
+	struct enc_chan chan;
+	struct avs_alloc_port_ref_param ref;
+
+	enc_chan_alloc_port_normal(param, &chan, &ref);
+
+	return enc_json_alloc_port_ref(buf, size, &chan, &ref, 0);
+}
+
+/* Encapsulating "addPort" JSON message with ICE mode. */
+int enc_json_alloc_port_ice(char *buf, size_t size, const struct avs_alloc_port_ice_param *param)
+{
+	struct enc_chan chan;
+	struct avs_alloc_port_ref_param ref;
+
+	enc_chan_alloc_port_ice(param, &chan, &ref);
+
+	return enc_json_alloc_port_ref(buf, size, &chan, &ref, 1);
+}
+
+/* Encapsulating "delPort" JSON message. */
+int enc_json_del_port_ref(char *buf, size_t size, const struct enc_chan *chan)
+{
+	struct json_writer w;
+
+	jw_init(&w, buf, size);
+
+	jw_raw(&w, "{", 1);
+	jw_key(&w, 0, "delPort");
+	jw_raw(&w, "{", 1);
+	jw_member_ref(&w, 0, "conf_id", chan->conf_id);
+	jw_member_ref(&w, 1, "chan_id", chan->chan_id);
+	jw_member_ref(&w, 1, "port_id", chan->port_id);
+
+	return jw_finish(&w, chan->comm_id);
+}
+
+int enc_json_del_port(char *buf, size_t size, const struct avs_dealloc_port_param *param)
+{
+	struct enc_chan chan;
+
+	enc_chan_del_port(param, &chan);
+
+	return enc_json_del_port_ref(buf, size, &chan);
+}
+
+/* Encapsulating "runctrl" JSON message. "mediaType" only goes with suspend and resume. */
+int enc_json_runctrl_chan_ref(char *buf, size_t size, const struct enc_chan *chan, const struct avs_runctrl_chan_ref_param *param)
+{
+	struct json_writer w;
+	int with_mtype = (AVS_RUNCTRL_CHAN_OPT_SUSPEND == param->opt || AVS_RUNCTRL_CHAN_OPT_RESUME == param->opt);
+
+	if ((unsigned int)param->opt >= sizeof(runctrl_opt_trans) / sizeof(runctrl_opt_trans[0])
+		|| (with_mtype && (unsigned int)param->mtype >= sizeof(runctrl_mtype_trans) / sizeof(runctrl_mtype_trans[0])))
+	{
+		log_err("invalid runctrl opt %d or mtype %d\n", param->opt, param->mtype);
+		return -1;
+	}
+
+	jw_init(&w, buf, size);
+
+	jw_raw(&w, "{", 1);
+	jw_key(&w, 0, "runctrl");
+	jw_raw(&w, "{", 1);
+	jw_member_ref(&w, 0, "conf_id", chan->conf_id);
+	jw_member_ref(&w, 1, "chan_id", chan->chan_id);
+	jw_member_cstr(&w, 1, "opt", runctrl_opt_trans[param->opt].name);
+	if (with_mtype)
+	{
+		jw_member_cstr(&w, 1, "mediaType", runctrl_mtype_trans[param->mtype].name);
+	}
+
+	return jw_finish(&w, chan->comm_id);
+}
+
+int enc_json_runctrl_chan(char *buf, size_t size, const struct avs_runctrl_chan_param *param)
+{
+	struct enc_chan chan;
+	struct avs_runctrl_chan_ref_param ref;
+
+	enc_chan_runctrl_chan(param, &chan, &ref);
+
+	return enc_json_runctrl_chan_ref(buf, size, &chan, &ref);
+}
+
+/* Encapsulating "setPortParam" JSON message with normal mode. */
+int enc_json_set_peerport_normal_ref(char *buf, size_t size, const struct enc_chan *chan, const struct avs_set_peerport_normal_ref_param *param)
+{
+	struct json_writer w;
+
+	jw_init(&w, buf, size);
+
+	jw_raw(&w, "{", 1);
+	jw_key(&w, 0, "setPortParam");
+	jw_raw(&w, "{", 1);
+	jw_member_ref(&w, 0, "conf_id", chan->conf_id);
+	jw_member_ref(&w, 1, "chan_id", chan->chan_id);
+	jw_member_ref(&w, 1, "port_id", chan->port_id);
+	jw_key(&w, 1, "InfoPort");
+	jw_raw(&w, "{", 1);
+	jw_member_ref(&w, 0, "targetAddr", param->targetaddr);
+	jw_member_num(&w, 1, "RtcpMux", param->rtcpmux);
+	jw_member_num(&w, 1, "SymRTP", param->symrtp);
+	jw_member_num(&w, 1, "Qos", param->qos);
+	jw_member_num(&w, 1, "srtpMode", param->srtpmode);
+	jw_member_ref(&w, 1, "srtpSendKey", param->srtpsendkey);
+	jw_member_ref(&w, 1, "srtpRecvKey", param->srtprecvkey);
+	jw_member_ref(&w, 1, "fingerprint", param->fingerprint);
+	jw_raw(&w, "}", 1);
+
+	return jw_finish(&w, chan->comm_id);
+}
+
+int enc_json_set_peerport_normal(char *buf, size_t size, const struct avs_set_peerport_normal_param *param)
+{
+	struct enc_chan chan;
+	struct avs_set_peerport_normal_ref_param ref;
+
+	enc_chan_set_peerport_normal(param, &chan, &ref);
+
+	return enc_json_set_peerport_normal_ref(buf, size, &chan, &ref);
+}
+
+/* Encapsulating "setPortParam" JSON message with ICE mode. */
+int enc_json_set_peerport_ice_ref(char *buf, size_t size, const struct enc_chan *chan, const struct avs_set_peerport_ice_ref_param *param)
+{
+	struct json_writer w;
+
+	jw_init(&w, buf, size);
+
+	jw_raw(&w, "{", 1);
+	jw_key(&w, 0, "setPortParam");
+	jw_raw(&w, "{", 1);
+	jw_member_ref(&w, 0, "conf_id", chan->conf_id);
+	jw_member_ref(&w, 1, "chan_id", chan->chan_id);
+	jw_member_ref(&w, 1, "port_id", chan->port_id);
+	jw_key(&w, 1, "InfoICE");
+	jw_raw(&w, "{", 1);
+	jw_member_num(&w, 0, "IceRole", param->icerole);
+	jw_member_num(&w, 1, "SslRole", param->sslrole);
+	jw_member_ref(&w, 1, "fingerprint", param->fingerprint);
+	jw_member_ref(&w, 1, "ice_ufrag", param->ice_ufrag);
+	jw_member_ref(&w, 1, "ice_pwd", param->ice_pwd);
+	jw_member_ref(&w, 1, "candidate", param->candidate);
+	jw_raw(&w, "}", 1);
+
+	return jw_finish(&w, chan->comm_id);
+}
+
+int enc_json_set_peerport_ice(char *buf, size_t size, const struct avs_set_peerport_ice_param *param)
+{
+	struct enc_chan chan;
+	struct avs_set_peerport_ice_ref_param ref;
+
+	enc_chan_set_peerport_ice(param, &chan, &ref);
+
+	return enc_json_set_peerport_ice_ref(buf, size, &chan, &ref);
+}
+
+/* Encapsulating "addTrack" JSON message with audio param. */
+int enc_json_set_audio_codec_ref(char *buf, size_t size, const struct enc_chan *chan, const struct avs_codec_audio_ref_param *param)
+{
+	struct json_writer w;
+	const char *codec = codec_audio_name(param->a_codec);
+	const char *transmode = transmode_name(param->audio_transmode);
+
+	if (!codec || !transmode)
+	{
+		log_err("invalid audio codec %d or transmode %d\n", param->a_codec, param->audio_transmode);
+		return -1;
+	}
+
+	jw_init(&w, buf, size);
+
+	jw_raw(&w, "{", 1);
+	jw_key(&w, 0, "addTrack");
+	jw_raw(&w, "{", 1);
+	jw_member_ref(&w, 0, "conf_id", chan->conf_id);
+	jw_member_ref(&w, 1, "chan_id", chan->chan_id);
+	jw_member_ref(&w, 1, "port_id", chan->port_id);
+	jw_member_cstr(&w, 1, "track_id", "222222222222222");
+	jw_member_cstr(&w, 1, "mediaType", "audio");
+	jw_key(&w, 1, "audio_tx_param");
+	jw_raw(&w, "{", 1);
+	jw_member_cstr(&w, 0, "MainCoder", codec);
+	jw_member_num(&w, 1, "PayloadType", param->audio_payloadtype);
+	jw_member_num(&w, 1, "Ptime", param->ptime);
+	jw_raw(&w, "}", 1);
+	jw_key(&w, 1, "audio_rx_param");
+	jw_raw(&w, "{", 1);
+	jw_member_cstr(&w, 0, "Codecs", codec);
+	jw_member_num(&w, 1, "PayloadType", param->audio_payloadtype);
+	jw_raw(&w, "}", 1);
+	jw_key(&w, 1, "audio_transport");
+	jw_raw(&w, "{", 1);
+	jw_member_cstr(&w, 0, "audio_transport", transmode);
+	jw_raw(&w, "}", 1);
+
+	return jw_finish(&w, chan->comm_id);
+}
+
+int enc_json_set_audio_codec(char *buf, size_t size, const struct avs_codec_audio_param *param)
+{
+	struct enc_chan chan;
+	struct avs_codec_audio_ref_param ref;
+
+	enc_chan_set_audio_codec(param, &chan, &ref);
+
+	return enc_json_set_audio_codec_ref(buf, size, &chan, &ref);
+}
+
+/* Encapsulating "addTrack" JSON message with video param. */
+int enc_json_set_video_codec_ref(char *buf, size_t size, const struct enc_chan *chan, const struct avs_codec_video_ref_param *param)
+{
+	struct json_writer w;
+	const char *codec = codec_video_name(param->v_codec);
+	const char *transmode = transmode_name(param->video_transmode);
+
+	if (!codec || !transmode)
+	{
+		log_err("invalid video codec %d or transmode %d\n", param->v_codec, param->video_transmode);
+		return -1;
+	}
+
+	jw_init(&w, buf, size);
+
+	jw_raw(&w, "{", 1);
+	jw_key(&w, 0, "addTrack");
+	jw_raw(&w, "{", 1);
+	jw_member_ref(&w, 0, "conf_id", chan->conf_id);
+	jw_member_ref(&w, 1, "chan_id", chan->chan_id);
+	jw_member_ref(&w, 1, "port_id", chan->port_id);
+	jw_member_cstr(&w, 1, "track_id", "222222222222222");
+	jw_member_cstr(&w, 1, "mediaType", "video");
+	jw_key(&w, 1, "video_tx_param");
+	jw_raw(&w, "{", 1);
+	jw_member_cstr(&w, 0, "MainCoder", codec);
+	jw_member_num(&w, 1, "PayloadType", param->video_payloadtype);
+	jw_raw(&w, "}", 1);
+	jw_key(&w, 1, "video_rx_param");
+	jw_raw(&w, "{", 1);
+	jw_member_cstr(&w, 0, "Codecs", codec);
+	jw_member_num(&w, 1, "PayloadType", param->video_payloadtype);
+	jw_raw(&w, "}", 1);
+	jw_key(&w, 1, "video_transport");
+	jw_raw(&w, "{", 1);
+	jw_member_cstr(&w, 0, "video_transport", transmode);
+	jw_raw(&w, "}", 1);
+
+	return jw_finish(&w, chan->comm_id);
+}
+
+int enc_json_set_video_codec(char *buf, size_t size, const struct avs_codec_video_param *param)
+{
+	struct enc_chan chan;
+	struct avs_codec_video_ref_param ref;
+
+	enc_chan_set_video_codec(param, &chan, &ref);
+
+	return enc_json_set_video_codec_ref(buf, size, &chan, &ref);
+}
@@ -0,0 +1,121 @@
+/****************************************************************************
+ *
+ * Multiedia Controller Module(MCM).
+ *
+ * Copyright (c) 2017 by Grandstream Networks, Inc.
+ * All rights reserved.
+ *
+ * This material is proprietary to Grandstream Networks, Inc. and,
+ * in addition to the above mentioned Copyright, may be
+ * subject to protection under other intellectual property
+ * regimes, including patents, trade secrets, designs and/or
+ * trademarks.
+ *
+ * Any use of this material for any purpose, except with an
+ * express license from Grandstream Networks, Inc. is strictly
+ * prohibited.
+ *
+ *
+ * \brief JSON encoder of the commands sent to AVS.
+ *
+ *	Commands are written straight into a buffer supplied by the caller,
+ *  no JSON tree is built and nothing is allocated.
+ *
+ ***************************************************************************/
+
+#ifndef AVS_JSON_ENC_H
+#define AVS_JSON_ENC_H
+
+#include <stddef.h>
+#include "avs_controller.h"
+
+#define AVS_CMD_MAX_LEN		4096	/* Maximum length of an encoded command, AVS reads one datagram per command. */
+
+/**
+ * codec_audio_name/codec_video_name/transmode_name - Names of codecs and transmodes used in "addTrack".
+ *
+ * Return: The name, NULL if the value is unknown.
+ */
+const char *codec_audio_name(enum avs_audio_codec codec);
+const char *codec_video_name(enum avs_video_codec codec);
+const char *transmode_name(unsigned int mode);
+
+/**
+ * utf8_seq_len - Check the UTF-8 sequence starting at @s, the same rules as jansson.
+ * @s:  Start of the sequence.
+ * @n:  Bytes available from @s.
+ *
+ * Return: Length of the sequence, 0 if it is not valid UTF-8.
+ */
+size_t utf8_seq_len(const unsigned char *s, size_t n);
+
+/**
+ * struct enc_chan - IDs of a command being encoded, referenced where they are: in the char arrays of a parameter structure
+ *   or in the string table of the interned IDs. Nothing is copied before it is written to the message.
+ *
+ * @conf_id:  Conference id.
+ * @chan_id:  Channel id.
+ * @port_id:  Port id, empty for the commands without one.
+ * @comm_id:  Unique ID of the command.
+ */
+struct enc_chan
+{
+	struct avs_str conf_id;
+	struct avs_str chan_id;
+	struct avs_str port_id;
+	struct avs_str comm_id;
+};
+
+/**
+ * enc_str - Reference a char array of a parameter structure, up to its terminator or its size.
+ */
+struct avs_str enc_str(const char *str, size_t size);
+
+/**
+ * enc_chan_* - Reference the IDs of a parameter structure in @chan, and its other members in the compact parameter @ref.
+ *   "chan" of @ref is not set: the enc_*_ref encoders take the IDs from @chan.
+ */
+void enc_chan_alloc_port_normal(const struct avs_alloc_port_normal_param *param, struct enc_chan *chan, struct avs_alloc_port_ref_param *ref);
+void enc_chan_alloc_port_ice(const struct avs_alloc_port_ice_param *param, struct enc_chan *chan, struct avs_alloc_port_ref_param *ref);
+void enc_chan_del_port(const struct avs_dealloc_port_param *param, struct enc_chan *chan);
+void enc_chan_runctrl_chan(const struct avs_runctrl_chan_param *param, struct enc_chan *chan, struct avs_runctrl_chan_ref_param *ref);
+void enc_chan_set_peerport_normal(const struct avs_set_peerport_normal_param *param, struct enc_chan *chan, struct avs_set_peerport_normal_ref_param *ref);
+void enc_chan_set_peerport_ice(const struct avs_set_peerport_ice_param *param, struct enc_chan *chan, struct avs_set_peerport_ice_ref_param *ref);
+void enc_chan_set_audio_codec(const struct avs_codec_audio_param *param, struct enc_chan *chan, struct avs_codec_audio_ref_param *ref);
+void enc_chan_set_video_codec(const struct avs_codec_video_param *param, struct enc_chan *chan, struct avs_codec_video_ref_param *ref);
+
+/**
+ * enc_json_* - Encode a command to AVS into @buf. The output is compact JSON, keys in the same order as they have always been sent.
+ * @buf:  Output buffer, the message is terminated by '\0'.
+ * @size:  Size of @buf.
+ * @param:  Parameters of the command.
+ *
+ * Return: Length of the message without the terminating '\0'. -1 if @buf is too small, a string is not valid UTF-8 or a value is unknown.
+ */
+int enc_json_set_global_param(char *buf, size_t size, const struct avs_global_param *param);
+int enc_json_alloc_port_normal(char *buf, size_t size, const struct avs_alloc_port_normal_param *param);
+int enc_json_alloc_port_ice(char *buf, size_t size, const struct avs_alloc_port_ice_param *param);
+int enc_json_del_port(char *buf, size_t size, const struct avs_dealloc_port_param *param);
+int enc_json_runctrl_chan(char *buf, size_t size, const struct avs_runctrl_chan_param *param);
+int enc_json_set_peerport_normal(char *buf, size_t size, const struct avs_set_peerport_normal_param *param);
+int enc_json_set_peerport_ice(char *buf, size_t size, const struct avs_set_peerport_ice_param *param);
+int enc_json_set_audio_codec(char *buf, size_t size, const struct avs_codec_audio_param *param);
+int enc_json_set_video_codec(char *buf, size_t size, const struct avs_codec_video_param *param);
+
+/**
+ * enc_json_*_ref - Same as enc_json_*, from the compact parameters of the "avs_*_ref" APIs. The strings are written from where
+ *   they are referenced, whole: a command only fails if it does not fit in @buf.
+ * @chan:  IDs of the command, "chan" of @param is not read.
+ * @param:  Compact parameters of the command.
+ *
+ * Return: The same as enc_json_*.
+ */
+int enc_json_alloc_port_ref(char *buf, size_t size, const struct enc_chan *chan, const struct avs_alloc_port_ref_param *param, int ice);
+int enc_json_del_port_ref(char *buf, size_t size, const struct enc_chan *chan);
+int enc_json_runctrl_chan_ref(char *buf, size_t size, const struct enc_chan *chan, const struct avs_runctrl_chan_ref_param *param);
+int enc_json_set_peerport_normal_ref(char *buf, size_t size, const struct enc_chan *chan, const struct avs_set_peerport_normal_ref_param *param);
+int enc_json_set_peerport_ice_ref(char *buf, size_t size, const struct enc_chan *chan, const struct avs_set_peerport_ice_ref_param *param);
+int enc_json_set_audio_codec_ref(char *buf, size_t size, const struct enc_chan *chan, const struct avs_codec_audio_ref_param *param);
+int enc_json_set_video_codec_ref(char *buf, size_t size, const struct enc_chan *chan, const struct avs_codec_video_ref_param *param);
+
+#endif /* AVS_JSON_ENC_H */
@@ -0,0 +1,656 @@
+/****************************************************************************
+ *
+ * Multiedia Controller Module(MCM).
+ *
+ * Copyright (c) 2017 by Grandstream Networks, Inc.
+ * All rights reserved.
+ *
+ * This material is proprietary to Grandstream Networks, Inc. and,
+ * in addition to the above mentioned Copyright, may be
+ * subject to protection under other intellectual property
+ * regimes, including patents, trade secrets, designs and/or
+ * trademarks.
+ *
+ * Any use of this material for any purpose, except with an
+ * express license from Grandstream Networks, Inc. is strictly
+ * prohibited.
+ *
+ *
+ * \brief Closed-loop load generator of avs_controller.
+ *
+ *	N threads drive the public "avs_" APIs against AVS, usually avs-mock.
+ *  With a window of 1 a thread calls the blocking API and issues the
+ *  next command when it returns. With a larger window it keeps that many
+ *  commands in flight through the "_async" APIs. The latency of each
+ *  command is measured around the API call, then throughput and exact
+ *  p50/p99/p999 are reported:
+ *
+ *	avs-mock -l uniform:100:300 &
+ *	avs-loadgen -t 8 -w 4 -d 10 -c mix
+ *
+ *  Channels are spread on "-k" conferences, so that several AVS
+ *  instances given by "-i" share them:
+ *
+ *	avs-mock -s /tmp/avs0 & avs-mock -s /tmp/avs1 &
+ *	avs-loadgen -i /tmp/avs0 -i /tmp/avs1 -k 16 -w 8 -d 10 -c mix
+ *
+ ***************************************************************************/
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+#include <sched.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "avs_controller.h"
+
+#define LG_MAX_WINDOW		64	/* Most commands in flight per thread. */
+
+/* Commands a thread issues. */
+enum lg_cmd
+{
+	LG_CMD_ALLOC,	/* "addPort" with normal mode. */
+	LG_CMD_ICE,	/* "addPort" with ICE mode. */
+	LG_CMD_PEER,	/* "setPortParam" with normal mode. */
+	LG_CMD_GLOBAL,	/* "setParam". */
+	LG_CMD_AUDIO,	/* "addTrack" of audio. */
+	LG_CMD_VIDEO,	/* "addTrack" of video. */
+	LG_CMD_DEL,	/* "delPort". */
+	LG_CMD_MUTE,	/* "runctrl" suspending then resuming audio. */
+	LG_CMD_MIX,	/* The life of a channel: alloc, peer, audio, video then del if the window is 1. */
+	LG_CMD_MAX
+};
+
+struct lg_thread;
+
+/* A command in flight, its response must stay valid until the completion callback. */
+struct lg_req
+{
+	struct lg_thread *t;
+	enum lg_cmd cmd;
+	uint64_t start_us;
+	union
+	{
+		struct avs_common_resp_info common;
+		struct avs_alloc_port_normal_resp_info normal;
+		struct avs_alloc_port_ice_resp_info ice;
+	} resp;
+};
+
+/* A load generating thread. "mutex" protects what the completion callbacks update. */
+struct lg_thread
+{
+	unsigned int id;
+	pthread_t thread;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	struct lg_req reqs[LG_MAX_WINDOW];
+	struct lg_req *free_reqs[LG_MAX_WINDOW];
+	unsigned int nfree;
+	unsigned long issued;
+	unsigned long done;
+	unsigned long errors;
+	unsigned long queue_full;
+	uint32_t *lat;	/* Latencies in microseconds of the completed commands. */
+	unsigned long nlat;
+	unsigned long cap;
+};
+
+static const char *cmd_names[LG_CMD_MAX] = {
+	[LG_CMD_ALLOC] = "alloc",
+	[LG_CMD_ICE] = "ice",
+	[LG_CMD_PEER] = "peer",
+	[LG_CMD_GLOBAL] = "global",
+	[LG_CMD_AUDIO] = "audio",
+	[LG_CMD_VIDEO] = "video",
+	[LG_CMD_DEL] = "del",
+	[LG_CMD_MUTE] = "mute",
+	[LG_CMD_MIX] = "mix",
+};
+
+static unsigned int opt_threads = 4;
+static unsigned int opt_window = 1;
+static unsigned long opt_count = 10000;	/* Commands per thread, when no duration is given. */
+static double opt_duration = 0;	/* Seconds. */
+static enum lg_cmd opt_cmd = LG_CMD_ALLOC;
+static unsigned int opt_confs = 1;	/* Conferences the channels are spread on. */
+static volatile int stop = 0;
+
+static uint64_t now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/* Record a completed command. Call with "t->mutex" held in the asynchronous mode. */
+static void record(struct lg_thread *t, uint64_t start_us, int ok)
+{
+	if (t->nlat == t->cap)
+	{
+		t->cap = t->cap ? t->cap * 2 : 4096;
+		if (!(t->lat = realloc(t->lat, t->cap * sizeof(t->lat[0]))))
+		{
+			printf("Malloc latencies failed\n");
+			exit(1);
+		}
+	}
+
+	t->lat[t->nlat++] = (uint32_t)(now_us() - start_us);
+	t->done++;
+	if (!ok)
+	{
+		t->errors++;
+	}
+}
+
+/* The command to issue as the "seq"th of a thread. */
+static enum lg_cmd pick_cmd(unsigned long seq)
+{
+	static const enum lg_cmd life[] = { LG_CMD_ALLOC, LG_CMD_PEER, LG_CMD_AUDIO, LG_CMD_VIDEO, LG_CMD_DEL };
+	unsigned int steps = (opt_window > 1) ? 4 : 5;
+
+	return (LG_CMD_MIX == opt_cmd) ? life[seq % steps] : opt_cmd;
+}
+
+/* Code AVS answered a command with, 0 on success. */
+static unsigned int resp_code(const struct lg_req *req)
+{
+	switch (req->cmd)
+	{
+		case LG_CMD_ALLOC:
+			return req->resp.normal.resp.code;
+
+		case LG_CMD_ICE:
+			return req->resp.ice.resp.code;
+
+		default:
+			return req->resp.common.code;
+	}
+}
+
+static void async_cb(AVS_CMD_RESULT result, void *resp, void *user_data)
+{
+	struct lg_req *req = (struct lg_req *)user_data;
+	struct lg_thread *t = req->t;
+	int ok = (SUCCESS == result && 0 == resp_code(req));
+
+	(void)resp;
+
+	if (LG_CMD_ICE == req->cmd)
+	{
+		avs_alloc_port_ice_resp_release(&req->resp.ice);
+	}
+
+	pthread_mutex_lock(&t->mutex);
+	record(t, req->start_us, ok);
+	t->free_reqs[t->nfree++] = req;
+	pthread_cond_signal(&t->cond);
+	pthread_mutex_unlock(&t->mutex);
+}
+
+/* Issue one command, blocking if "req" is NULL. */
+static AVS_CMD_RESULT issue(struct lg_thread *t, enum lg_cmd cmd, unsigned long seq, struct lg_req *req, unsigned int *code)
+{
+	union
+	{
+		struct avs_alloc_port_normal_param alloc;
+		struct avs_alloc_port_ice_param ice;
+		struct avs_set_peerport_normal_param peer;
+		struct avs_global_param global;
+		struct avs_codec_audio_param audio;
+		struct avs_codec_video_param video;
+		struct avs_dealloc_port_param del;
+		struct avs_runctrl_chan_param runctrl;
+	} p;
+	struct lg_req local;
+	char comm_id[MAX_UNIQUE_ID], chan_id[32], conf_id[32];
+	AVS_CMD_RESULT ret;
+
+	if (!req)
+	{
+		req = &local;
+	}
+
+	memset(&p, 0, sizeof(p));
+	memset(&req->resp, 0, sizeof(req->resp));
+	req->cmd = cmd;
+	snprintf(comm_id, sizeof(comm_id), "lg%02u-%lx", t->id, seq);
+	snprintf(chan_id, sizeof(chan_id), "chan%u-%lu", t->id, seq / 5);
+	snprintf(conf_id, sizeof(conf_id), "loadgen%lu", (t->id + seq / 5) % opt_confs);
+
+	switch (cmd)
+	{
+		case LG_CMD_ICE:
+			strcpy(p.ice.conf_id, conf_id);
+			strcpy(p.ice.chan_id, chan_id);
+			strcpy(p.ice.comm_id, comm_id);
+			p.ice.enable_dtls = 1;
+			ret = (req != &local) ? avs_alloc_port_ice_async(&p.ice, &req->resp.ice, async_cb, req)
+				: avs_alloc_port_ice(&p.ice, &req->resp.ice);
+			break;
+
+		case LG_CMD_PEER:
+			strcpy(p.peer.conf_id, conf_id);
+			strcpy(p.peer.chan_id, chan_id);
+			strcpy(p.peer.port_id, "m0");
+			strcpy(p.peer.comm_id, comm_id);
+			strcpy(p.peer.targetaddr, "127.0.0.1:5000");
+			p.peer.qos = 46;
+			ret = (req != &local) ? avs_set_peerport_param_normal_async(&p.peer, &req->resp.common, async_cb, req)
+				: avs_set_peerport_param_normal(&p.peer, &req->resp.common);
+			break;
+
+		case LG_CMD_GLOBAL:
+			strcpy(p.global.stun_ipaddr, "127.0.0.1");
+			p.global.stun_port = 3478;
+			strcpy(p.global.turn_ipaddr, "127.0.0.1");
+			p.global.turn_port = 3478;
+			strcpy(p.global.comm_id, comm_id);
+			ret = (req != &local) ? avs_set_global_param_async(&p.global, &req->resp.common, async_cb, req)
+				: avs_set_global_param(&p.global, &req->resp.common);
+			break;
+
+		case LG_CMD_AUDIO:
+			strcpy(p.audio.conf_id, conf_id);
+			strcpy(p.audio.chan_id, chan_id);
+			strcpy(p.audio.port_id, "m0");
+			strcpy(p.audio.comm_id, comm_id);
+			p.audio.a_codec = AVS_AUDIO_CODEC_OPUS;
+			p.audio.audio_payloadtype = 111;
+			p.audio.audio_transmode = 1;
+			p.audio.ptime = 20;
+			ret = (req != &local) ? avs_set_audio_codec_param_async(&p.audio, &req->resp.common, async_cb, req)
+				: avs_set_audio_codec_param(&p.audio, &req->resp.common);
+			break;
+
+		case LG_CMD_VIDEO:
+			strcpy(p.video.conf_id, conf_id);
+			strcpy(p.video.chan_id, chan_id);
+			strcpy(p.video.port_id, "m0");
+			strcpy(p.video.comm_id, comm_id);
+			p.video.v_codec = AVS_VIDEO_CODEC_VP8;
+			p.video.video_payloadtype = 96;
+			p.video.video_transmode = 1;
+			ret = (req != &local) ? avs_set_video_codec_param_async(&p.video, &req->resp.common, async_cb, req)
+				: avs_set_video_codec_param(&p.video, &req->resp.common);
+			break;
+
+		case LG_CMD_DEL:
+			strcpy(p.del.conf_id, conf_id);
+			strcpy(p.del.chan_id, chan_id);
+			strcpy(p.del.port_id, "m0");
+			strcpy(p.del.comm_id, comm_id);
+			ret = (req != &local) ? avs_dealloc_port_async(&p.del, &req->resp.common, async_cb, req)
+				: avs_dealloc_port(&p.del, &req->resp.common);
+			break;
+
+		case LG_CMD_MUTE:
+			strcpy(p.runctrl.conf_id, conf_id);
+			strcpy(p.runctrl.chan_id, chan_id);
+			strcpy(p.runctrl.comm_id, comm_id);
+			p.runctrl.opt = (seq & 1) ? AVS_RUNCTRL_CHAN_OPT_RESUME : AVS_RUNCTRL_CHAN_OPT_SUSPEND;
+			p.runctrl.mtype = AVS_RUNCTRL_CHAN_TYPE_AUDIO;
+			ret = (req != &local) ? avs_runctrl_chan_async(&p.runctrl, &req->resp.common, async_cb, req)
+				: avs_runctrl_chan(&p.runctrl, &req->resp.common);
+			break;
+
+		default:
+			strcpy(p.alloc.conf_id, conf_id);
+			strcpy(p.alloc.chan_id, chan_id);
+			strcpy(p.alloc.comm_id, comm_id);
+			ret = (req != &local) ? avs_alloc_port_normal_async(&p.alloc, &req->resp.normal, async_cb, req)
+				: avs_alloc_port_normal(&p.alloc, &req->resp.normal);
+			break;
+	}
+
+	*code = resp_code(req);
+
+	if (req == &local && LG_CMD_ICE == cmd)
+	{
+		avs_alloc_port_ice_resp_release(&req->resp.ice);
+	}
+
+	return ret;
+}
+
+/* Blocking API, one command at a time. */
+static void run_sync(struct lg_thread *t)
+{
+	unsigned int code = 0;
+	uint64_t start;
+	AVS_CMD_RESULT ret;
+
+	while (!stop && (opt_duration > 0 || t->issued < opt_count))
+	{
+		start = now_us();
+		ret = issue(t, pick_cmd(t->issued), t->issued, NULL, &code);
+
+		if (QUEUE_FULL == ret)
+		{
+			t->queue_full++;
+			sched_yield();
+			continue;
+		}
+
+		t->issued++;
+		record(t, start, SUCCESS == ret && 0 == code);
+	}
+}
+
+/* Asynchronous APIs, up to "opt_window" commands in flight. */
+static void run_async(struct lg_thread *t)
+{
+	struct lg_req *req;
+	unsigned int code;
+	AVS_CMD_RESULT ret;
+
+	pthread_mutex_lock(&t->mutex);
+
+	while (!stop && (opt_duration > 0 || t->issued < opt_count))
+	{
+		if (!t->nfree)
+		{
+			pthread_cond_wait(&t->cond, &t->mutex);
+			continue;
+		}
+
+		req = t->free_reqs[--t->nfree];
+		pthread_mutex_unlock(&t->mutex);
+
+		req->t = t;
+		req->start_us = now_us();
+		ret = issue(t, pick_cmd(t->issued), t->issued, req, &code);
+
+		pthread_mutex_lock(&t->mutex);
+
+		if (SUCCESS != ret)
+		{
+			t->free_reqs[t->nfree++] = req;
+
+			if (QUEUE_FULL == ret)
+			{
+				t->queue_full++;
+				pthread_mutex_unlock(&t->mutex);
+				sched_yield();
+				pthread_mutex_lock(&t->mutex);
+				continue;
+			}
+
+			t->issued++;
+			record(t, req->start_us, 0);
+			continue;
+		}
+
+		t->issued++;
+	}
+
+	/* Wait for the commands in flight. */
+	while (t->nfree < opt_window)
+	{
+		pthread_cond_wait(&t->cond, &t->mutex);
+	}
+
+	pthread_mutex_unlock(&t->mutex);
+}
+
+static void *lg_task(void *data)
+{
+	struct lg_thread *t = (struct lg_thread *)data;
+
+	if (opt_window > 1)
+	{
+		run_async(t);
+	}
+	else
+	{
+		run_sync(t);
+	}
+
+	return NULL;
+}
+
+static int cmp_u32(const void *a, const void *b)
+{
+	uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+
+	return (x > y) - (x < y);
+}
+
+/* Exact percentile of sorted latencies, nearest rank. */
+static uint32_t percentile(const uint32_t *lat, unsigned long n, double p)
+{
+	unsigned long rank = (unsigned long)(p / 100 * n + 0.999999);
+
+	if (!n)
+	{
+		return 0;
+	}
+
+	return lat[(rank ? rank : 1) - 1];
+}
+
+static void usage(void)
+{
+	printf("usage: avs-loadgen [-t threads] [-w window] [-n count | -d seconds] [-c command] [-q queue] [-m transport] [-f wire]\n"
+		"                   [-i path]... [-k conferences] [-v]\n"
+		"  -t  threads, default 4\n"
+		"  -w  commands in flight per thread, 1 uses the blocking APIs, at most %d. Default 1\n"
+		"  -n  commands per thread, default 10000\n"
+		"  -d  run for a duration instead of a count\n"
+		"  -c  alloc, ice, peer, global, audio, video, del, mute or mix. Default alloc\n"
+		"  -q  capacity of the submission queue of avs_controller\n"
+		"  -m  socket or shm, the transport avs_controller tries. Default socket\n"
+		"  -f  json or tlv, the encoding avs_controller asks for. Default json\n"
+		"  -i  socket path of an AVS instance, up to %d of them. Default the single AVS\n"
+		"  -k  conferences the channels are spread on, default 1\n"
+		"  -v  print the statistics of avs_controller\n", LG_MAX_WINDOW, AVS_MAX_INSTANCES);
+}
+
+int main(int argc, char **argv)
+{
+	static struct avs_stats stats;
+	static char dump[8192];
+	struct avs_conn_config config;
+	struct avs_io_counters io;
+	struct avs_instance_stats inst[AVS_MAX_INSTANCES];
+	struct lg_thread *threads;
+	uint32_t *all;
+	unsigned long total = 0, errors = 0, queue_full = 0, n;
+	uint64_t start, elapsed;
+	unsigned int i, j, num_inst;
+	int opt, verbose = 0;
+	FILE *report;
+
+	memset(&config, 0, sizeof(config));
+
+	while ((opt = getopt(argc, argv, "t:w:n:d:c:q:m:f:i:k:vh")) != -1)
+	{
+		switch (opt)
+		{
+			case 't':
+				opt_threads = (unsigned int)atoi(optarg);
+				break;
+
+			case 'w':
+				opt_window = (unsigned int)atoi(optarg);
+				break;
+
+			case 'n':
+				opt_count = strtoul(optarg, NULL, 10);
+				break;
+
+			case 'd':
+				opt_duration = atof(optarg);
+				break;
+
+			case 'c':
+				for (i = 0; i < LG_CMD_MAX && strcmp(optarg, cmd_names[i]); i++)
+				{
+				}
+				if (LG_CMD_MAX == i)
+				{
+					usage();
+					return 1;
+				}
+				opt_cmd = (enum lg_cmd)i;
+				break;
+
+			case 'q':
+				config.queue_capacity = (unsigned int)atoi(optarg);
+				break;
+
+			case 'm':
+				if (!strcmp(optarg, "shm"))
+				{
+					config.transport = AVS_TRANSPORT_SHM;
+				}
+				else if (strcmp(optarg, "socket"))
+				{
+					usage();
+					return 1;
+				}
+				break;
+
+			case 'f':
+				if (!strcmp(optarg, "tlv"))
+				{
+					config.wire = AVS_WIRE_TLV;
+				}
+				else if (strcmp(optarg, "json"))
+				{
+					usage();
+					return 1;
+				}
+				break;
+
+			case 'i':
+				if (AVS_MAX_INSTANCES == config.num_instances)
+				{
+					usage();
+					return 1;
+				}
+				config.instance_paths[config.num_instances++] = optarg;
+				break;
+
+			case 'k':
+				opt_confs = (unsigned int)atoi(optarg);
+				break;
+
+			case 'v':
+				verbose = 1;
+				break;
+
+			default:
+				usage();
+				return opt == 'h' ? 0 : 1;
+		}
+	}
+
+	if (!opt_threads || !opt_window || opt_window > LG_MAX_WINDOW || !opt_confs)
+	{
+		usage();
+		return 1;
+	}
+
+	/* avs_controller traces every message to stdout, keep it away from the report. */
+	if (!(report = fdopen(dup(1), "w")) || !freopen("/dev/null", "w", stdout))
+	{
+		perror("redirect stdout failed");
+		return 1;
+	}
+
+	if (avs_create_conn_ex(&config) != SUCCESS)
+	{
+		fprintf(report, "Connect to AVS failed\n");
+		return 1;
+	}
+
+	if (!(threads = calloc(opt_threads, sizeof(*threads))))
+	{
+		fprintf(report, "Malloc threads failed\n");
+		return 1;
+	}
+
+	start = now_us();
+
+	for (i = 0; i < opt_threads; i++)
+	{
+		threads[i].id = i;
+		pthread_mutex_init(&threads[i].mutex, NULL);
+		pthread_cond_init(&threads[i].cond, NULL);
+		for (j = 0; j < opt_window; j++)
+		{
+			threads[i].free_reqs[j] = &threads[i].reqs[j];
+		}
+		threads[i].nfree = opt_window;
+
+		if (pthread_create(&threads[i].thread, NULL, lg_task, &threads[i]))
+		{
+			fprintf(report, "Create thread failed\n");
+			return 1;
+		}
+	}
+
+	if (opt_duration > 0)
+	{
+		usleep((useconds_t)(opt_duration * 1000000));
+		stop = 1;
+	}
+
+	for (i = 0; i < opt_threads; i++)
+	{
+		pthread_join(threads[i].thread, NULL);
+		total += threads[i].nlat;
+		errors += threads[i].errors;
+		queue_full += threads[i].queue_full;
+	}
+
+	elapsed = now_us() - start;
+
+	if (!(all = malloc((total ? total : 1) * sizeof(all[0]))))
+	{
+		fprintf(report, "Malloc latencies failed\n");
+		return 1;
+	}
+
+	for (i = 0, n = 0; i < opt_threads; i++)
+	{
+		memcpy(all + n, threads[i].lat, threads[i].nlat * sizeof(all[0]));
+		n += threads[i].nlat;
+	}
+	qsort(all, total, sizeof(all[0]), cmp_u32);
+
+	avs_get_io_counters(&io);
+	fprintf(report, "command %s, threads %u, window %u, transport %s, wire %s\n", cmd_names[opt_cmd], opt_threads, opt_window,
+		AVS_TRANSPORT_SHM == io.transport ? "shm" : "socket", AVS_WIRE_TLV == io.wire ? "tlv" : "json");
+	fprintf(report, "completed %lu in %.3f s: %.0f cmd/s, errors %lu, queue full %lu\n",
+		total, elapsed / 1e6, elapsed ? total * 1e6 / elapsed : 0.0, errors, queue_full);
+	fprintf(report, "latency us: min %u p50 %u p99 %u p999 %u max %u\n",
+		total ? all[0] : 0, percentile(all, total, 50), percentile(all, total, 99), percentile(all, total, 99.9), total ? all[total - 1] : 0);
+
+	if (config.num_instances > 1 && avs_get_instance_stats(inst, &num_inst) == SUCCESS)
+	{
+		for (i = 0; i < num_inst; i++)
+		{
+			fprintf(report, "instance %s: sent %lu, responses %lu, timeouts %lu, conferences %u, ports %u, transport %s, wire %s\n",
+				inst[i].path, inst[i].tx_msgs, inst[i].responses, inst[i].timeouts, inst[i].confs, inst[i].ports,
+				AVS_TRANSPORT_SHM == inst[i].transport ? "shm" : "socket", AVS_WIRE_TLV == inst[i].wire ? "tlv" : "json");
+		}
+	}
+
+	if (verbose && avs_get_stats(&stats) == SUCCESS)
+	{
+		avs_stats_dump(&stats, dump, sizeof(dump));
+		fprintf(report, "\n%s", dump);
+	}
+
+	fclose(report);
+	avs_shutdown();
+
+	return errors ? 2 : 0;
+}
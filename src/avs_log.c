@@ -0,0 +1,713 @@
+/****************************************************************************
+ *
+ * Multiedia Controller Module(MCM).
+ *
+ * Copyright (c) 2017 by Grandstream Networks, Inc.
+ * All rights reserved.
+ *
+ * This material is proprietary to Grandstream Networks, Inc. and,
+ * in addition to the above mentioned Copyright, may be
+ * subject to protection under other intellectual property
+ * regimes, including patents, trade secrets, designs and/or
+ * trademarks.
+ *
+ * Any use of this material for any purpose, except with an
+ * express license from Grandstream Networks, Inc. is strictly
+ * prohibited.
+ *
+ *
+ * \brief Leveled logging through per-thread rings.
+ *
+ *	A record is a struct log_rec followed by the arguments in the order
+ *  of the format: integers and pointers as 8 bytes, floating point as a
+ *  double, "*" widths and precisions as an int, strings as a 32 bit
+ *  length and their bytes. Each ring has one producer, its thread, and
+ *  one consumer, the flushing thread, so head and tail are only stored
+ *  by their owner. Rings are laid out as the shared memory rings of
+ *  avs_shm.c, a record not fitting before the end starts again at the
+ *  beginning after a wrap marker.
+ *
+ ***************************************************************************/
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include "avs_log.h"
+
+#define LOG_RING_SIZE		(64 * 1024)	/* Bytes of the ring of a thread, a power of 2. */
+#define LOG_RING_MASK		(LOG_RING_SIZE - 1)
+#define LOG_REC_MAX		2048	/* Longest record, strings are cut to fit. */
+#define LOG_LINE_MAX		4096	/* Longest formatted record. */
+#define LOG_SPEC_MAX		32	/* Longest rebuilt conversion specification. */
+#define LOG_FLUSH_INTERVAL	20	/* Milliseconds between two flushes. */
+#define LOG_CACHE_LINE		64
+#define LOG_REC_ALIGN		8
+#define LOG_REC_WRAP		0xFFFFFFFFu	/* Length of the marker sending the consumer back to the start of the ring. */
+
+/* Header of a record. "len" comes first, it is where the wrap marker is read. */
+struct log_rec
+{
+	uint32_t len;	/* Bytes of the arguments following the header. */
+	uint32_t level;
+	uint64_t ts;	/* Monotonic nanoseconds, to merge the rings in time order. */
+	const char *fmt;
+};
+
+/* Ring of a thread. */
+struct log_ring
+{
+	uint32_t head __attribute__((aligned(LOG_CACHE_LINE)));	/* Stored by the thread. */
+	unsigned long dropped;	/* Records the thread dropped because the ring was full. */
+	uint32_t tail __attribute__((aligned(LOG_CACHE_LINE)));	/* Stored by the flushing thread. */
+	unsigned long dropped_seen;	/* "dropped" already reported by the flushing thread. */
+	int dead;	/* The thread exited, the ring is freed once drained. */
+	struct log_ring *next;
+	char data[LOG_RING_SIZE] __attribute__((aligned(LOG_CACHE_LINE)));
+};
+
+/* A conversion specification of a format, "%" excluded. */
+struct log_spec
+{
+	const char *flags;
+	int nflags;
+	int width;	/* -1 for none, -2 for "*". */
+	int prec;	/* -1 for none, -2 for "*". */
+	char length;	/* 'H' for "hh", 'Q' for "ll", 'D' for "L", else the modifier itself, 0 for none. */
+	char conv;
+};
+
+/* Arguments being written into a record, or read from one. */
+struct log_args
+{
+	char *buf;
+	size_t len;
+	size_t size;
+};
+
+int log_max_level = AVS_LOG_INFO;
+
+static pthread_mutex_t log_lock = PTHREAD_MUTEX_INITIALIZER;	/* Protects the list of rings against a thread adding its ring. */
+static struct log_ring *log_rings = NULL;
+static pthread_key_t log_key;
+static pthread_once_t log_key_once = PTHREAD_ONCE_INIT;
+static __thread struct log_ring *log_self = NULL;
+
+static pthread_t log_thread;
+static int log_running = 0;
+static int log_stopping = 0;
+
+/* Bytes a record takes in the ring. */
+static uint32_t rec_size(uint32_t len)
+{
+	return (sizeof(struct log_rec) + len + LOG_REC_ALIGN - 1) & ~(uint32_t)(LOG_REC_ALIGN - 1);
+}
+
+static uint64_t log_now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/* Parse the specification after a "%", return where it ends. */
+static const char *spec_parse(const char *p, struct log_spec *s)
+{
+	s->flags = p;
+	while (*p && strchr("-+ #0'", *p))
+	{
+		p++;
+	}
+	s->nflags = p - s->flags;
+
+	s->width = -1;
+	if ('*' == *p)
+	{
+		s->width = -2;
+		p++;
+	}
+	else
+	{
+		for (; *p >= '0' && *p <= '9'; p++)
+		{
+			s->width = ((s->width < 0) ? 0 : s->width * 10) + (*p - '0');
+		}
+	}
+
+	s->prec = -1;
+	if ('.' == *p)
+	{
+		p++;
+		s->prec = 0;
+		if ('*' == *p)
+		{
+			s->prec = -2;
+			p++;
+		}
+		for (; *p >= '0' && *p <= '9'; p++)
+		{
+			s->prec = s->prec * 10 + (*p - '0');
+		}
+	}
+
+	s->length = 0;
+	if ('h' == p[0] && 'h' == p[1])
+	{
+		s->length = 'H';
+		p += 2;
+	}
+	else if ('l' == p[0] && 'l' == p[1])
+	{
+		s->length = 'Q';
+		p += 2;
+	}
+	else if ('L' == *p)
+	{
+		s->length = 'D';
+		p++;
+	}
+	else if (*p && strchr("hlzjt", *p))
+	{
+		s->length = *p++;
+	}
+
+	s->conv = *p;
+
+	return *p ? p + 1 : p;
+}
+
+static void args_put(struct log_args *a, const void *v, size_t n)
+{
+	if (a->len + n > a->size)
+	{
+		a->len = a->size;	/* Nothing more fits, the reader finds the end. */
+		return;
+	}
+
+	memcpy(a->buf + a->len, v, n);
+	a->len += n;
+}
+
+static int args_get(struct log_args *a, void *v, size_t n)
+{
+	if (a->len + n > a->size)
+	{
+		memset(v, 0, n);
+		return -1;
+	}
+
+	memcpy(v, a->buf + a->len, n);
+	a->len += n;
+
+	return 0;
+}
+
+static void args_put_str(struct log_args *a, const char *s, int prec)
+{
+	size_t room = (a->size - a->len > sizeof(uint32_t)) ? a->size - a->len - sizeof(uint32_t) : 0;
+	uint32_t n;
+
+	if (!s)
+	{
+		s = "(null)";
+	}
+
+	n = (prec >= 0) ? strnlen(s, prec) : strlen(s);
+	if (n > room)
+	{
+		n = room;
+	}
+
+	args_put(a, &n, sizeof(n));
+	args_put(a, s, n);
+}
+
+/* Copy the arguments described by @fmt. */
+static void args_encode(struct log_args *a, const char *fmt, va_list ap)
+{
+	struct log_spec s;
+	const char *p = fmt;
+	int64_t i;
+	uint64_t u;
+	double d;
+	int n, prec;
+
+	while ((p = strchr(p, '%')))
+	{
+		p = spec_parse(p + 1, &s);
+
+		if (-2 == s.width)
+		{
+			n = va_arg(ap, int);
+			args_put(a, &n, sizeof(n));
+		}
+		prec = s.prec;
+		if (-2 == s.prec)
+		{
+			prec = va_arg(ap, int);
+			args_put(a, &prec, sizeof(prec));
+		}
+
+		switch (s.conv)
+		{
+			case 'd':
+			case 'i':
+				switch (s.length)
+				{
+					case 'H': i = (signed char)va_arg(ap, int); break;
+					case 'h': i = (short)va_arg(ap, int); break;
+					case 'l': i = va_arg(ap, long); break;
+					case 'Q': i = va_arg(ap, long long); break;
+					case 'z': i = va_arg(ap, ssize_t); break;
+					case 'j': i = va_arg(ap, intmax_t); break;
+					case 't': i = va_arg(ap, ptrdiff_t); break;
+					default: i = va_arg(ap, int); break;
+				}
+				args_put(a, &i, sizeof(i));
+				break;
+
+			case 'u':
+			case 'o':
+			case 'x':
+			case 'X':
+			case 'c':
+				switch (s.length)
+				{
+					case 'H': u = (unsigned char)va_arg(ap, unsigned int); break;
+					case 'h': u = (unsigned short)va_arg(ap, unsigned int); break;
+					case 'l': u = va_arg(ap, unsigned long); break;
+					case 'Q': u = va_arg(ap, unsigned long long); break;
+					case 'z': u = va_arg(ap, size_t); break;
+					case 'j': u = va_arg(ap, uintmax_t); break;
+					case 't': u = va_arg(ap, ptrdiff_t); break;
+					default: u = va_arg(ap, unsigned int); break;
+				}
+				args_put(a, &u, sizeof(u));
+				break;
+
+			case 'e':
+			case 'E':
+			case 'f':
+			case 'F':
+			case 'g':
+			case 'G':
+			case 'a':
+			case 'A':
+				d = ('D' == s.length) ? (double)va_arg(ap, long double) : va_arg(ap, double);
+				args_put(a, &d, sizeof(d));
+				break;
+
+			case 's':
+				args_put_str(a, va_arg(ap, const char *), prec);
+				break;
+
+			case 'p':
+				u = (uintptr_t)va_arg(ap, void *);
+				args_put(a, &u, sizeof(u));
+				break;
+
+			case 'n':
+				(void)va_arg(ap, void *);
+				break;
+
+			case '%':
+				break;
+
+			default:
+				return;	/* Unknown, the following arguments cannot be found. */
+		}
+	}
+}
+
+/* Format a record into @line, return its length. */
+static size_t rec_format(const struct log_rec *rec, const char *args, char *line, size_t size)
+{
+	struct log_args a = { (char *)args, 0, rec->len };
+	struct log_spec s;
+	const char *p = rec->fmt, *q;
+	char spec[LOG_SPEC_MAX];
+	size_t len = 0, n;
+	int width, prec, sl;
+	int64_t i;
+	uint64_t u;
+	double d;
+	uint32_t slen;
+
+	while (*p && len < size - 1)
+	{
+		if (!(q = strchr(p, '%')))
+		{
+			q = p + strlen(p);
+		}
+
+		n = q - p;
+		if (n > size - 1 - len)
+		{
+			n = size - 1 - len;
+		}
+		memcpy(line + len, p, n);
+		len += n;
+
+		if (!*q)
+		{
+			break;
+		}
+
+		p = spec_parse(q + 1, &s);
+
+		width = s.width;
+		prec = s.prec;
+		if (-2 == width)
+		{
+			args_get(&a, &width, sizeof(width));
+		}
+		if (-2 == prec)
+		{
+			args_get(&a, &prec, sizeof(prec));
+		}
+
+		/* Rebuild the specification with the values of "*" and the length of the stored value. */
+		sl = snprintf(spec, sizeof(spec), "%%%.*s", (s.nflags < 8) ? s.nflags : 8, s.flags);
+		if (width >= 0 || width < -2)
+		{
+			sl += snprintf(spec + sl, sizeof(spec) - sl, "%d", width);
+		}
+
+		switch (s.conv)
+		{
+			case 'd':
+			case 'i':
+				if (prec >= 0)
+				{
+					sl += snprintf(spec + sl, sizeof(spec) - sl, ".%d", prec);
+				}
+				snprintf(spec + sl, sizeof(spec) - sl, "ll%c", s.conv);
+				args_get(&a, &i, sizeof(i));
+				n = snprintf(line + len, size - len, spec, (long long)i);
+				break;
+
+			case 'u':
+			case 'o':
+			case 'x':
+			case 'X':
+				if (prec >= 0)
+				{
+					sl += snprintf(spec + sl, sizeof(spec) - sl, ".%d", prec);
+				}
+				snprintf(spec + sl, sizeof(spec) - sl, "ll%c", s.conv);
+				args_get(&a, &u, sizeof(u));
+				n = snprintf(line + len, size - len, spec, (unsigned long long)u);
+				break;
+
+			case 'c':
+				snprintf(spec + sl, sizeof(spec) - sl, "c");
+				args_get(&a, &u, sizeof(u));
+				n = snprintf(line + len, size - len, spec, (int)u);
+				break;
+
+			case 'e':
+			case 'E':
+			case 'f':
+			case 'F':
+			case 'g':
+			case 'G':
+			case 'a':
+			case 'A':
+				if (prec >= 0)
+				{
+					sl += snprintf(spec + sl, sizeof(spec) - sl, ".%d", prec);
+				}
+				snprintf(spec + sl, sizeof(spec) - sl, "%c", s.conv);
+				args_get(&a, &d, sizeof(d));
+				n = snprintf(line + len, size - len, spec, d);
+				break;
+
+			case 's':
+				snprintf(spec + sl, sizeof(spec) - sl, ".*s");
+				if (args_get(&a, &slen, sizeof(slen)) || slen > a.size - a.len)
+				{
+					slen = 0;
+				}
+				n = snprintf(line + len, size - len, spec, (int)slen, a.buf + a.len);
+				a.len += slen;
+				break;
+
+			case 'p':
+				snprintf(spec + sl, sizeof(spec) - sl, "p");
+				args_get(&a, &u, sizeof(u));
+				n = snprintf(line + len, size - len, spec, (void *)(uintptr_t)u);
+				break;
+
+			case '%':
+				n = snprintf(line + len, size - len, "%%");
+				break;
+
+			default:
+				n = 0;
+				p += strlen(p);	/* As args_encode() did, stop at an unknown conversion. */
+				break;
+		}
+
+		len += (n < size - len) ? n : size - 1 - len;
+	}
+
+	line[len] = '\0';
+
+	return len;
+}
+
+/* Destructor of the thread specific value: the thread exits, its ring is freed by the flushing thread once drained. */
+static void log_ring_orphan(void *arg)
+{
+	struct log_ring *r = (struct log_ring *)arg;
+
+	__atomic_store_n(&r->dead, 1, __ATOMIC_RELEASE);
+}
+
+static void log_key_create(void)
+{
+	pthread_key_create(&log_key, log_ring_orphan);
+}
+
+/* The ring of the calling thread, created by its first record. */
+static struct log_ring *log_ring_self(void)
+{
+	struct log_ring *r;
+
+	if (log_self)
+	{
+		return log_self;
+	}
+
+	if (posix_memalign((void **)&r, LOG_CACHE_LINE, sizeof(*r)))
+	{
+		return NULL;
+	}
+	memset(r, 0, offsetof(struct log_ring, data));
+
+	pthread_once(&log_key_once, log_key_create);
+	pthread_setspecific(log_key, r);
+
+	pthread_mutex_lock(&log_lock);
+	r->next = log_rings;
+	__atomic_store_n(&log_rings, r, __ATOMIC_RELEASE);
+	pthread_mutex_unlock(&log_lock);
+
+	log_self = r;
+
+	return r;
+}
+
+/* Producer: copy a record into the ring. */
+static int ring_push(struct log_ring *r, const struct log_rec *rec, const char *args)
+{
+	uint32_t head = r->head;
+	uint32_t used = head - __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+	uint32_t need = rec_size(rec->len);
+	uint32_t off = head & LOG_RING_MASK;
+	uint32_t room = LOG_RING_SIZE - off;
+
+	if (room < need)
+	{
+		if (LOG_RING_SIZE - used < room + need)
+		{
+			return -1;
+		}
+
+		*(uint32_t *)(r->data + off) = LOG_REC_WRAP;
+		head += room;
+		off = 0;
+	}
+	else if (LOG_RING_SIZE - used < need)
+	{
+		return -1;
+	}
+
+	memcpy(r->data + off, rec, sizeof(*rec));
+	memcpy(r->data + off + sizeof(*rec), args, rec->len);
+
+	__atomic_store_n(&r->head, head + need, __ATOMIC_RELEASE);
+
+	return 0;
+}
+
+/* Consumer: the oldest record of a ring, NULL if it is empty. */
+static const struct log_rec *ring_peek(struct log_ring *r)
+{
+	uint32_t head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+	uint32_t off;
+
+	for (;;)
+	{
+		if (head == r->tail)
+		{
+			return NULL;
+		}
+
+		off = r->tail & LOG_RING_MASK;
+		if (LOG_REC_WRAP != *(uint32_t *)(r->data + off))
+		{
+			return (const struct log_rec *)(r->data + off);
+		}
+
+		r->tail += LOG_RING_SIZE - off;
+	}
+}
+
+static void ring_pop(struct log_ring *r, const struct log_rec *rec)
+{
+	__atomic_store_n(&r->tail, r->tail + rec_size(rec->len), __ATOMIC_RELEASE);
+}
+
+void log_write(int level, const char *fmt, ...)
+{
+	struct log_ring *r;
+	struct
+	{
+		struct log_rec rec;
+		char args[LOG_REC_MAX - sizeof(struct log_rec)];
+	} buf;
+	struct log_args a = { buf.args, 0, sizeof(buf.args) };
+	va_list ap;
+
+	va_start(ap, fmt);
+
+	if (!__atomic_load_n(&log_running, __ATOMIC_ACQUIRE) || !(r = log_ring_self()))
+	{
+		vprintf(fmt, ap);
+		va_end(ap);
+		return;
+	}
+
+	args_encode(&a, fmt, ap);
+	va_end(ap);
+
+	buf.rec.len = a.len;
+	buf.rec.level = level;
+	buf.rec.ts = log_now_ns();
+	buf.rec.fmt = fmt;
+
+	if (ring_push(r, &buf.rec, buf.args) != 0)
+	{
+		__atomic_store_n(&r->dropped, r->dropped + 1, __ATOMIC_RELAXED);
+	}
+}
+
+/* Write the records of all the rings in time order, then free the rings of the exited threads. */
+static void log_flush(void)
+{
+	static char line[LOG_LINE_MAX];	/* Only the flushing thread, or log_stop() once it is joined, formats. */
+	struct log_ring *r, *best, **pp;
+	const struct log_rec *rec, *best_rec;
+	unsigned long dropped;
+	size_t len;
+
+	for (;;)
+	{
+		best = NULL;
+		best_rec = NULL;
+
+		for (r = __atomic_load_n(&log_rings, __ATOMIC_ACQUIRE); r; r = r->next)
+		{
+			if ((rec = ring_peek(r)) && (!best_rec || rec->ts < best_rec->ts))
+			{
+				best = r;
+				best_rec = rec;
+			}
+		}
+
+		if (!best)
+		{
+			break;
+		}
+
+		len = rec_format(best_rec, (const char *)(best_rec + 1), line, sizeof(line));
+		fwrite(line, 1, len, stdout);
+		ring_pop(best, best_rec);
+	}
+
+	pthread_mutex_lock(&log_lock);
+
+	for (pp = &log_rings; (r = *pp); )
+	{
+		if ((dropped = __atomic_load_n(&r->dropped, __ATOMIC_RELAXED)) != r->dropped_seen)
+		{
+			printf("log: %lu records dropped, a ring was full.\n", dropped - r->dropped_seen);
+			r->dropped_seen = dropped;
+		}
+
+		if (__atomic_load_n(&r->dead, __ATOMIC_ACQUIRE) && !ring_peek(r))
+		{
+			*pp = r->next;
+			free(r);
+			continue;
+		}
+		pp = &r->next;
+	}
+
+	pthread_mutex_unlock(&log_lock);
+
+	fflush(stdout);
+}
+
+static void *log_task(void *arg)
+{
+	struct timespec interval = { 0, LOG_FLUSH_INTERVAL * 1000000L };
+
+	(void)arg;
+
+	while (!__atomic_load_n(&log_stopping, __ATOMIC_ACQUIRE))
+	{
+		log_flush();
+		nanosleep(&interval, NULL);
+	}
+
+	return NULL;
+}
+
+int log_start(void)
+{
+	if (__atomic_load_n(&log_running, __ATOMIC_ACQUIRE))
+	{
+		return 0;
+	}
+
+	fflush(stdout);
+	log_stopping = 0;
+
+	if (pthread_create(&log_thread, NULL, log_task, NULL) != 0)
+	{
+		printf("Create log thread failed\n");
+		return -1;
+	}
+
+	__atomic_store_n(&log_running, 1, __ATOMIC_RELEASE);
+
+	return 0;
+}
+
+void log_stop(void)
+{
+	if (!__atomic_load_n(&log_running, __ATOMIC_ACQUIRE))
+	{
+		return;
+	}
+
+	__atomic_store_n(&log_running, 0, __ATOMIC_RELEASE);
+	__atomic_store_n(&log_stopping, 1, __ATOMIC_RELEASE);
+	pthread_join(log_thread, NULL);
+
+	log_flush();
+}
+
+void avs_set_log_level(enum avs_log_level level)
+{
+	__atomic_store_n(&log_max_level, level, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,73 @@
+/****************************************************************************
+ *
+ * Multiedia Controller Module(MCM).
+ *
+ * Copyright (c) 2017 by Grandstream Networks, Inc.
+ * All rights reserved.
+ *
+ * This material is proprietary to Grandstream Networks, Inc. and,
+ * in addition to the above mentioned Copyright, may be
+ * subject to protection under other intellectual property
+ * regimes, including patents, trade secrets, designs and/or
+ * trademarks.
+ *
+ * Any use of this material for any purpose, except with an
+ * express license from Grandstream Networks, Inc. is strictly
+ * prohibited.
+ *
+ *
+ * \brief Leveled logging through per-thread rings.
+ *
+ *	A log call does not format anything: it copies the format pointer
+ *  and the binary values of its arguments, strings included, into a
+ *  ring owned by the calling thread. The flushing thread formats the
+ *  records of all the rings in time order and writes them to stdout,
+ *  so a slow console never blocks the command path. A record is dropped
+ *  when the ring of its thread is full.
+ *
+ *  Until log_start(), and after log_stop(), records are formatted and
+ *  written at once, as printf() did.
+ *
+ *  log_dbg() compiles to nothing when NDEBUG is defined (release builds).
+ *
+ ***************************************************************************/
+
+#ifndef AVS_LOG_H
+#define AVS_LOG_H
+
+#include "avs_controller.h"
+
+extern int log_max_level;	/* Records above this enum avs_log_level are not taken. */
+
+/**
+ * log_write - Take a record. Better called through the log_* macros, which check the level first.
+ * @level:  enum avs_log_level.
+ * @fmt:  printf format. It is formatted later, so it must stay valid: a literal or a static string.
+ *	%n and the long double conversions are not supported.
+ */
+void log_write(int level, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+#define log_at(level, ...)	do { if ((level) <= __atomic_load_n(&log_max_level, __ATOMIC_RELAXED)) log_write((level), __VA_ARGS__); } while (0)
+
+#define log_err(...)	log_at(AVS_LOG_ERROR, __VA_ARGS__)
+#define log_warn(...)	log_at(AVS_LOG_WARN, __VA_ARGS__)
+#define log_info(...)	log_at(AVS_LOG_INFO, __VA_ARGS__)
+#ifdef NDEBUG
+#define log_dbg(...)	do { if (0) log_write(AVS_LOG_DEBUG, __VA_ARGS__); } while (0)	/* Arguments are still checked. */
+#else
+#define log_dbg(...)	log_at(AVS_LOG_DEBUG, __VA_ARGS__)
+#endif
+
+/**
+ * log_start - Start the flushing thread. Records are taken into the rings from now on.
+ *
+ * Return: 0, -1 if the thread could not be created, records are then written at once.
+ */
+int log_start(void);
+
+/**
+ * log_stop - Write all the records left and stop the flushing thread.
+ */
+void log_stop(void);
+
+#endif /* AVS_LOG_H */
@@ -0,0 +1,759 @@
+/****************************************************************************
+ *
+ * Multiedia Controller Module(MCM).
+ *
+ * Copyright (c) 2017 by Grandstream Networks, Inc.
+ * All rights reserved.
+ *
+ * This material is proprietary to Grandstream Networks, Inc. and,
+ * in addition to the above mentioned Copyright, may be
+ * subject to protection under other intellectual property
+ * regimes, including patents, trade secrets, designs and/or
+ * trademarks.
+ *
+ * Any use of this material for any purpose, except with an
+ * express license from Grandstream Networks, Inc. is strictly
+ * prohibited.
+ *
+ *
+ * \brief A fake AVS for testing and benchmarking avs_controller.
+ *
+ *	It binds the AVS socket path and answers "addPort", "setPortParam",
+ *  "setParam", "addTrack", "delPort", "runctrl" and "playSound" after a latency
+ *  drawn from a configurable distribution, failing a configurable share of them.
+ *  Each method may have its own settings:
+ *
+ *	avs-mock -l uniform:200:800 -l addPort=exp:2000 -e 0.01 -e delPort=0
+ *
+ *  Pending replies wait in a heap ordered by due time, one thread serves
+ *  any rate of commands.
+ *
+ *  It takes the shared memory link a controller offers with "shmAttach",
+ *  then commands and replies of that controller go through the rings.
+ *  It accepts binary frames when asked with "hello", and answers each
+ *  command in the encoding it came in.
+ *
+ ***************************************************************************/
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <math.h>
+#include <time.h>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "avs_controller.h"
+#include "avs_json_dec.h"
+#include "avs_shm.h"
+#include "avs_tlv.h"
+
+#define MOCK_SOCKET_PATH	"/tmp/GSSFUSrv"	/* Same as AVS_SERVER_SOCKET_PATH of avs_controller.c. */
+#define MOCK_MSG_LEN		4096	/* Largest command accepted. */
+#define MOCK_RESP_LEN		512	/* Largest response sent. */
+
+/* Latency distributions, in microseconds. */
+enum mock_dist
+{
+	MOCK_DIST_FIXED,	/* fixed:US */
+	MOCK_DIST_UNIFORM,	/* uniform:MIN:MAX */
+	MOCK_DIST_EXP,	/* exp:MEAN */
+	MOCK_DIST_NORMAL	/* normal:MEAN:STDDEV, negative samples are 0. */
+};
+
+/* Behaviour of one method. */
+struct mock_method
+{
+	const char *name;
+	enum mock_dist dist;
+	double a;
+	double b;
+	double error_rate;	/* Share of the commands answered with an error code. */
+	unsigned long count;
+	unsigned long errors;
+};
+
+/* A response waiting for its due time. */
+struct mock_reply
+{
+	uint64_t due_us;
+	struct sockaddr_un addr;
+	socklen_t addrlen;
+	int shm;	/* The command came through the shared memory shm_peer, reply there. */
+	int len;
+	char buf[MOCK_RESP_LEN];
+};
+
+static struct mock_method methods[] = {
+	{ .name = "addPort" },
+	{ .name = "setPortParam" },
+	{ .name = "setParam" },
+	{ .name = "addTrack" },
+	{ .name = "delPort" },
+	{ .name = "runctrl" },
+	{ .name = "playSound" },
+};
+
+#define MOCK_METHODS	(sizeof(methods) / sizeof(methods[0]))
+
+/* Method of each enum tlv_method, as named in "methods". */
+static const char *tlv_methods[TLV_METHOD_MAX] = {
+	[TLV_METHOD_SET_PARAM] = "setParam",
+	[TLV_METHOD_ADD_PORT] = "addPort",
+	[TLV_METHOD_DEL_PORT] = "delPort",
+	[TLV_METHOD_SET_PORT_PARAM] = "setPortParam",
+	[TLV_METHOD_ADD_TRACK] = "addTrack",
+	[TLV_METHOD_RUNCTRL] = "runctrl",
+	[TLV_METHOD_PLAYSOUND] = "playSound",
+};
+
+static struct mock_reply **heap = NULL;	/* Min-heap on "due_us". */
+static unsigned int heap_len = 0, heap_cap = 0;
+static unsigned int seed = 1;
+static unsigned int port_seq = 0;
+static unsigned long unknown = 0;
+static struct shm_link shm_peer;	/* Shared memory link of the controller, if it offered one. */
+static int shm_on = 0;
+static unsigned long shm_cmds = 0, shm_bells = 0;
+static volatile sig_atomic_t running = 1;
+
+static uint64_t now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/* Uniform in (0, 1]. */
+static double rand_unit(void)
+{
+	return (rand_r(&seed) + 1.0) / ((double)RAND_MAX + 1.0);
+}
+
+static uint64_t sample_latency(const struct mock_method *m)
+{
+	double v;
+
+	switch (m->dist)
+	{
+		case MOCK_DIST_UNIFORM:
+			v = m->a + (m->b - m->a) * rand_unit();
+			break;
+
+		case MOCK_DIST_EXP:
+			v = -m->a * log(rand_unit());
+			break;
+
+		case MOCK_DIST_NORMAL:
+			v = m->a + m->b * sqrt(-2 * log(rand_unit())) * cos(2 * M_PI * rand_unit());
+			break;
+
+		default:
+			v = m->a;
+			break;
+	}
+
+	return v > 0 ? (uint64_t)v : 0;
+}
+
+static void heap_push(struct mock_reply *r)
+{
+	unsigned int i, p;
+
+	if (heap_len == heap_cap)
+	{
+		heap_cap = heap_cap ? heap_cap * 2 : 256;
+		if (!(heap = realloc(heap, heap_cap * sizeof(heap[0]))))
+		{
+			printf("Malloc reply heap failed\n");
+			exit(1);
+		}
+	}
+
+	for (i = heap_len++; i > 0 && heap[p = (i - 1) / 2]->due_us > r->due_us; i = p)
+	{
+		heap[i] = heap[p];
+	}
+	heap[i] = r;
+}
+
+static struct mock_reply *heap_pop(void)
+{
+	struct mock_reply *top = heap[0], *last = heap[--heap_len];
+	unsigned int i = 0, c;
+
+	while ((c = 2 * i + 1) < heap_len)
+	{
+		if (c + 1 < heap_len && heap[c + 1]->due_us < heap[c]->due_us)
+		{
+			c++;
+		}
+		if (last->due_us <= heap[c]->due_us)
+		{
+			break;
+		}
+		heap[i] = heap[c];
+		i = c;
+	}
+	heap[i] = last;
+
+	return top;
+}
+
+/* Parse "[method=]value" of an option, return the value and the method, NULL for all of them. */
+static const char *parse_target(const char *arg, struct mock_method **method)
+{
+	const char *eq = strchr(arg, '=');
+	unsigned int i;
+
+	*method = NULL;
+
+	if (!eq)
+	{
+		return arg;
+	}
+
+	for (i = 0; i < MOCK_METHODS; i++)
+	{
+		if (strlen(methods[i].name) == (size_t)(eq - arg) && !strncmp(methods[i].name, arg, eq - arg))
+		{
+			*method = &methods[i];
+			return eq + 1;
+		}
+	}
+
+	printf("unknown method in \"%s\"\n", arg);
+	exit(1);
+}
+
+static void set_latency(const char *arg)
+{
+	struct mock_method *target, m;
+	const char *v = parse_target(arg, &target);
+	unsigned int i;
+
+	memset(&m, 0, sizeof(m));
+
+	if (sscanf(v, "fixed:%lf", &m.a) == 1)
+	{
+		m.dist = MOCK_DIST_FIXED;
+	}
+	else if (sscanf(v, "uniform:%lf:%lf", &m.a, &m.b) == 2 && m.a <= m.b)
+	{
+		m.dist = MOCK_DIST_UNIFORM;
+	}
+	else if (sscanf(v, "exp:%lf", &m.a) == 1)
+	{
+		m.dist = MOCK_DIST_EXP;
+	}
+	else if (sscanf(v, "normal:%lf:%lf", &m.a, &m.b) == 2)
+	{
+		m.dist = MOCK_DIST_NORMAL;
+	}
+	else
+	{
+		printf("bad latency \"%s\"\n", v);
+		exit(1);
+	}
+
+	for (i = 0; i < MOCK_METHODS; i++)
+	{
+		if (!target || target == &methods[i])
+		{
+			methods[i].dist = m.dist;
+			methods[i].a = m.a;
+			methods[i].b = m.b;
+		}
+	}
+}
+
+static void set_error_rate(const char *arg)
+{
+	struct mock_method *target;
+	const char *v = parse_target(arg, &target);
+	double rate = atof(v);
+	unsigned int i;
+
+	for (i = 0; i < MOCK_METHODS; i++)
+	{
+		if (!target || target == &methods[i])
+		{
+			methods[i].error_rate = rate;
+		}
+	}
+}
+
+/* Build the response of a command into "buf" and find its method, NULL for a command answered at once. Return the length, -1 to ignore the command. */
+static int build_reply(const char *msg, int len, char *buf, struct mock_method **method)
+{
+	static struct json_doc doc;
+	struct json_error error;
+	char id[MAX_UNIQUE_ID];
+	struct mock_method *m = NULL;
+	int tok, obj, n, ice = 0;
+	unsigned int i;
+
+	if (json_doc_parse(&doc, msg, len, &error) != 0 || JSON_TOK_OBJECT != doc.toks[0].type)
+	{
+		unknown++;
+		return -1;
+	}
+
+	if ((tok = json_doc_get(&doc, 0, "id")) < 0 || JSON_TOK_STRING != doc.toks[tok].type)
+	{
+		unknown++;
+		return -1;
+	}
+	json_tok_copy(&doc, tok, id, sizeof(id));
+
+	/* Binary frames are always accepted, the method has no latency. */
+	if (json_doc_get(&doc, 0, TLV_HELLO_METHOD) >= 0)
+	{
+		*method = NULL;
+		return snprintf(buf, MOCK_RESP_LEN, "{\"id\":\"%s\",\"error\":{\"code\":0,\"message\":\"OK\"},\"" TLV_HELLO_METHOD "\":{\"wire\":\"tlv\"}}", id);
+	}
+
+	for (i = 0; i < MOCK_METHODS && !m; i++)
+	{
+		if ((obj = json_doc_get(&doc, 0, methods[i].name)) >= 0)
+		{
+			m = &methods[i];
+		}
+	}
+
+	if (!m)
+	{
+		unknown++;
+		return -1;
+	}
+
+	m->count++;
+	*method = m;
+
+	if (m->error_rate > 0 && rand_unit() <= m->error_rate)
+	{
+		m->errors++;
+		return snprintf(buf, MOCK_RESP_LEN, "{\"id\":\"%s\",\"error\":{\"code\":1,\"message\":\"mock error\"}}", id);
+	}
+
+	n = snprintf(buf, MOCK_RESP_LEN, "{\"id\":\"%s\",\"error\":{\"code\":0,\"message\":\"OK\"}", id);
+
+	if (!strcmp(m->name, "addPort"))
+	{
+		if ((tok = json_doc_get(&doc, obj, "ICE")) >= 0)
+		{
+			ice = atoi(doc.js + doc.toks[tok].start);
+		}
+
+		if (ice)
+		{
+			n += snprintf(buf + n, MOCK_RESP_LEN - n, ",\"port_id\":\"m%u\",\"InfoICE\":{\"candidate\":"
+				"[\"candidate:1 1 udp 2122260223 127.0.0.1 %u typ host generation 0\","
+				"\"candidate:2 1 udp 1686052607 203.0.113.7 %u typ srflx raddr 127.0.0.1 rport %u generation 0\"],"
+				"\"fingerprint\":\"sha-256 4A:AD:B9:B1:3F:82\",\"ice_ufrag\":\"8hhY\",\"ice_pwd\":\"asd88fgpdd777uzjYhagZg\"}",
+				port_seq, 20000 + (port_seq % 20000) * 2, 20000 + (port_seq % 20000) * 2, 20000 + (port_seq % 20000) * 2);
+		}
+		else
+		{
+			n += snprintf(buf + n, MOCK_RESP_LEN - n, ",\"port_id\":\"m%u\",\"InfoPort\":{\"rtp_port\":\"%u\",\"rtcp_port\":\"%u\","
+				"\"fingerprint\":\"sha-256 4A:AD:B9:B1:3F:82\"}",
+				port_seq, 20000 + (port_seq % 20000) * 2, 20001 + (port_seq % 20000) * 2);
+		}
+		port_seq++;
+	}
+
+	n += snprintf(buf + n, MOCK_RESP_LEN - n, "}");
+
+	return n < MOCK_RESP_LEN ? n : -1;
+}
+
+/* Build the response of a binary command, see build_reply(). */
+static int build_tlv_reply(const char *msg, int len, char *buf, struct mock_method **method)
+{
+	struct tlv_resp resp;
+	struct mock_method *m = NULL;
+	const char *val;
+	size_t off = TLV_HDR_LEN;
+	unsigned int tag, vlen, i;
+	uint32_t ice = 0;
+	int type;
+
+	memset(&resp, 0, sizeof(resp));
+
+	if ((type = tlv_frame_method(msg, len)) < 0)
+	{
+		unknown++;
+		return -1;
+	}
+
+	while (tlv_next(msg, len, &off, &tag, &val, &vlen) > 0)
+	{
+		if (TLV_TAG_ID == tag && vlen < sizeof(resp.id))
+		{
+			memcpy(resp.id, val, vlen);
+			resp.present |= (uint64_t)1 << TLV_TAG_ID;
+		}
+		else if (TLV_TAG_ICE == tag)
+		{
+			tlv_get_u32(val, vlen, &ice);
+		}
+	}
+
+	for (i = 0; i < MOCK_METHODS && tlv_methods[type]; i++)
+	{
+		if (!strcmp(methods[i].name, tlv_methods[type]))
+		{
+			m = &methods[i];
+		}
+	}
+
+	if (!m || !TLV_HAS(&resp, TLV_TAG_ID))
+	{
+		unknown++;
+		return -1;
+	}
+
+	m->count++;
+	*method = m;
+
+	resp.present |= ((uint64_t)1 << TLV_TAG_CODE) | ((uint64_t)1 << TLV_TAG_MESSAGE);
+
+	if (m->error_rate > 0 && rand_unit() <= m->error_rate)
+	{
+		m->errors++;
+		resp.code = 1;
+		strcpy(resp.message, "mock error");
+		return enc_tlv_resp(buf, MOCK_RESP_LEN, &resp);
+	}
+
+	strcpy(resp.message, "OK");
+
+	if (TLV_METHOD_ADD_PORT == type)
+	{
+		snprintf(resp.port_id, sizeof(resp.port_id), "m%u", port_seq);
+		strcpy(resp.fingerprint, "sha-256 4A:AD:B9:B1:3F:82");
+		resp.present |= ((uint64_t)1 << TLV_TAG_PORT_ID) | ((uint64_t)1 << TLV_TAG_FINGERPRINT);
+
+		if (ice)
+		{
+			snprintf(resp.candidate, sizeof(resp.candidate), "candidate:1 1 udp 2122260223 127.0.0.1 %u typ host generation 0",
+				20000 + (port_seq % 20000) * 2);
+			strcpy(resp.ice_ufrag, "8hhY");
+			strcpy(resp.ice_pwd, "asd88fgpdd777uzjYhagZg");
+			resp.present |= ((uint64_t)1 << TLV_TAG_CANDIDATE) | ((uint64_t)1 << TLV_TAG_ICE_UFRAG) | ((uint64_t)1 << TLV_TAG_ICE_PWD);
+		}
+		else
+		{
+			resp.rtp_port = 20000 + (port_seq % 20000) * 2;
+			resp.rtcp_port = resp.rtp_port + 1;
+			resp.present |= ((uint64_t)1 << TLV_TAG_RTP_PORT) | ((uint64_t)1 << TLV_TAG_RTCP_PORT);
+		}
+		port_seq++;
+	}
+
+	return enc_tlv_resp(buf, MOCK_RESP_LEN, &resp);
+}
+
+/* Take the shared memory link offered by a "shmAttach" command, replacing the previous one. Return the length of the response. */
+static int attach_link(const char *msg, int len, const int *fds, int nfds, char *buf)
+{
+	static struct json_doc doc;
+	struct json_error error;
+	char id[MAX_UNIQUE_ID];
+	int tok, code = 1;
+
+	if (json_doc_parse(&doc, msg, len, &error) != 0 || JSON_TOK_OBJECT != doc.toks[0].type
+		|| (tok = json_doc_get(&doc, 0, "id")) < 0 || JSON_TOK_STRING != doc.toks[tok].type)
+	{
+		unknown++;
+		while (nfds--)
+		{
+			close(fds[nfds]);
+		}
+		return -1;
+	}
+	json_tok_copy(&doc, tok, id, sizeof(id));
+
+	if (shm_on)
+	{
+		shm_link_close(&shm_peer);
+		shm_on = 0;
+	}
+
+	if (json_doc_get(&doc, 0, SHM_ATTACH_METHOD) >= 0 && SHM_FD_MAX == nfds)
+	{
+		shm_on = (shm_link_attach(&shm_peer, fds) == 0);
+		code = shm_on ? 0 : 1;
+	}
+	else
+	{
+		while (nfds--)
+		{
+			close(fds[nfds]);
+		}
+	}
+
+	printf("shared memory link %s\n", shm_on ? "attached" : "refused");
+	fflush(stdout);
+
+	if (code)
+	{
+		return snprintf(buf, MOCK_RESP_LEN, "{\"id\":\"%s\",\"error\":{\"code\":1,\"message\":\"shared memory refused\"}}", id);
+	}
+
+	return snprintf(buf, MOCK_RESP_LEN, "{\"id\":\"%s\",\"error\":{\"code\":0,\"message\":\"OK\"},\"" SHM_ATTACH_METHOD "\":{\"version\":\"%d\"}}",
+		id, SHM_VERSION);
+}
+
+/* Send a response where its command came from. The ring is not given up on while the controller drains it, like a blocking send. */
+static void send_reply(int fd, const struct mock_reply *r)
+{
+	if (!r->shm)
+	{
+		if (sendto(fd, r->buf, r->len, 0, (const struct sockaddr *)&r->addr, r->addrlen) < 0)
+		{
+			perror("sendto failed");
+		}
+		return;
+	}
+
+	if (!shm_on)
+	{
+		return;
+	}
+
+	while (shm_send(&shm_peer, r->buf, r->len) != 0 && running)
+	{
+		if (shm_ring_bell(&shm_peer))
+		{
+			shm_bells++;
+		}
+		usleep(50);
+	}
+}
+
+/* Wake the controller up for the responses published so far. */
+static void ring_bell(void)
+{
+	if (shm_on && shm_ring_bell(&shm_peer))
+	{
+		shm_bells++;
+	}
+}
+
+/* Answer a command now or queue its response. Return 0 if "r" has been queued, it belongs to the heap then. */
+static int take_cmd(int fd, struct mock_reply *r, const char *msg, int len)
+{
+	struct mock_method *m;
+	uint64_t latency;
+
+	if ((r->len = (len && TLV_MAGIC == (unsigned char)msg[0] ? build_tlv_reply : build_reply)(msg, len, r->buf, &m)) < 0)
+	{
+		return -1;
+	}
+
+	if (!m || !(latency = sample_latency(m)))
+	{
+		send_reply(fd, r);
+		return -1;
+	}
+
+	r->due_us = now_us() + latency;
+	heap_push(r);
+
+	return 0;
+}
+
+static void on_signal(int sig)
+{
+	(void)sig;
+
+	running = 0;
+}
+
+static void usage(void)
+{
+	printf("usage: avs-mock [-s path] [-l [method=]latency]... [-e [method=]rate]...\n"
+		"  -s  socket path, default " MOCK_SOCKET_PATH "\n"
+		"  -l  latency in microseconds: fixed:US, uniform:MIN:MAX, exp:MEAN or normal:MEAN:STDDEV. Default fixed:0\n"
+		"  -e  share of the commands answered with an error, 0 to 1. Default 0\n"
+		"  method is one of addPort, setPortParam, setParam, addTrack, delPort, runctrl, playSound, all of them if omitted.\n"
+		"  A controller offering shared memory with \"" SHM_ATTACH_METHOD "\" is answered through it.\n"
+		"  A controller asking for binary frames with \"" TLV_HELLO_METHOD "\" gets them.\n");
+}
+
+int main(int argc, char **argv)
+{
+	const char *path = MOCK_SOCKET_PATH;
+	struct sockaddr_un addr;
+	struct mock_reply *r = NULL, *due;
+	struct pollfd pfd[2];
+	char msg[MOCK_MSG_LEN];
+	uint64_t now, val;
+	ssize_t len;
+	int fd, opt, timeout, fds[SHM_FD_MAX], nfds, shm_len;
+	unsigned int i;
+
+	while ((opt = getopt(argc, argv, "s:l:e:h")) != -1)
+	{
+		switch (opt)
+		{
+			case 's':
+				path = optarg;
+				break;
+
+			case 'l':
+				set_latency(optarg);
+				break;
+
+			case 'e':
+				set_error_rate(optarg);
+				break;
+
+			default:
+				usage();
+				return opt == 'h' ? 0 : 1;
+		}
+	}
+
+	if ((fd = socket(AF_UNIX, SOCK_DGRAM, 0)) < 0)
+	{
+		perror("socket failed");
+		return 1;
+	}
+
+	unlink(path);
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+
+	if (bind(fd, (const struct sockaddr *)&addr, sizeof(addr)) < 0)
+	{
+		perror("bind socket failed");
+		return 1;
+	}
+
+	signal(SIGINT, on_signal);
+	signal(SIGTERM, on_signal);
+	seed = (unsigned int)now_us();
+
+	printf("avs-mock listening on %s\n", path);
+	fflush(stdout);
+
+	pfd[0].fd = fd;
+	pfd[0].events = POLLIN;
+	pfd[1].events = POLLIN;
+
+	while (running)
+	{
+		now = now_us();
+
+		/* Send the replies which are due. Sends block while the controller's receive queue is full, a real AVS does not drop responses either. */
+		while (heap_len && heap[0]->due_us <= now)
+		{
+			due = heap_pop();
+			send_reply(fd, due);
+			free(due);
+		}
+		ring_bell();
+
+		timeout = heap_len ? (int)((heap[0]->due_us - now + 999) / 1000) : -1;
+		if (shm_on && shm_prepare_sleep(&shm_peer))
+		{
+			timeout = 0;
+		}
+		pfd[1].fd = shm_on ? shm_peer.rx_bell : -1;
+
+		if (poll(pfd, 2, timeout) < 0)
+		{
+			if (EINTR != errno)
+			{
+				perror("poll failed");
+			}
+			continue;
+		}
+
+		if (shm_on)
+		{
+			shm_wake(&shm_peer);
+			if ((pfd[1].revents & POLLIN) && read(shm_peer.rx_bell, &val, sizeof(val)) < 0 && EAGAIN != errno)
+			{
+				perror("read doorbell failed");
+			}
+		}
+
+		/* Take all the queued commands, from the socket and then from the ring. */
+		for (;;)
+		{
+			if (!r && !(r = malloc(sizeof(*r))))
+			{
+				printf("Malloc reply failed\n");
+				return 1;
+			}
+
+			r->shm = 0;
+			r->addrlen = sizeof(r->addr);
+			if (!(pfd[0].revents & POLLIN)
+				|| (len = shm_recv_fds(fd, msg, sizeof(msg) - 1, &r->addr, &r->addrlen, fds, &nfds)) < 0)
+			{
+				break;
+			}
+			msg[len] = '\0';
+
+			if (nfds)
+			{
+				if ((r->len = attach_link(msg, (int)len, fds, nfds, r->buf)) >= 0)
+				{
+					send_reply(fd, r);
+				}
+				continue;
+			}
+
+			if (take_cmd(fd, r, msg, (int)len) == 0)
+			{
+				r = NULL;
+			}
+		}
+
+		while (shm_on && (shm_len = shm_recv(&shm_peer, msg, sizeof(msg) - 1)) >= 0)
+		{
+			if (!r && !(r = malloc(sizeof(*r))))
+			{
+				printf("Malloc reply failed\n");
+				return 1;
+			}
+
+			msg[shm_len] = '\0';
+			shm_cmds++;
+			r->shm = 1;
+			if (take_cmd(fd, r, msg, shm_len) == 0)
+			{
+				r = NULL;
+			}
+		}
+		ring_bell();
+	}
+
+	printf("\n%-14s %10s %10s\n", "method", "commands", "errors");
+	for (i = 0; i < MOCK_METHODS; i++)
+	{
+		printf("%-14s %10lu %10lu\n", methods[i].name, methods[i].count, methods[i].errors);
+	}
+	printf("unknown %lu\n", unknown);
+	printf("shared memory commands %lu doorbells %lu\n", shm_cmds, shm_bells);
+
+	if (shm_on)
+	{
+		shm_link_close(&shm_peer);
+	}
+	close(fd);
+	unlink(path);
+
+	return 0;
+}
@@ -0,0 +1,135 @@
+/****************************************************************************
+ *
+ * Multiedia Controller Module(MCM).
+ *
+ * Copyright (c) 2017 by Grandstream Networks, Inc.
+ * All rights reserved.
+ *
+ * This material is proprietary to Grandstream Networks, Inc. and,
+ * in addition to the above mentioned Copyright, may be
+ * subject to protection under other intellectual property
+ * regimes, including patents, trade secrets, designs and/or
+ * trademarks.
+ *
+ * Any use of this material for any purpose, except with an
+ * express license from Grandstream Networks, Inc. is strictly
+ * prohibited.
+ *
+ *
+ * \brief Bounded lock-free multi-producer single-consumer queue.
+ *
+ *	The sequence number of the cell at position "pos" is "pos" while it
+ *  is free, "pos + 1" once published, and "pos + capacity" once released,
+ *  which makes it free for the producer of the next lap.
+ *
+ ***************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include "avs_queue.h"
+
+#define CELL_ALIGN		64	/* Cells start on their own cache line, producers of neighbour cells do not share one. */
+
+static unsigned int *cell_seq(struct mpsc_queue *q, unsigned int pos)
+{
+	return (unsigned int *)(q->cells + (size_t)(pos & q->mask) * q->stride);
+}
+
+static void *cell_elem(struct mpsc_queue *q, unsigned int pos)
+{
+	return q->cells + (size_t)(pos & q->mask) * q->stride + CELL_ALIGN;
+}
+
+int mpsc_init(struct mpsc_queue *q, unsigned int capacity, size_t elem_size)
+{
+	unsigned int size = 1, i;
+
+	while (size < capacity)
+	{
+		size <<= 1;
+	}
+
+	/* The sequence number takes the first cache line, the element the following ones. */
+	q->stride = CELL_ALIGN + ((elem_size + CELL_ALIGN - 1) & ~(size_t)(CELL_ALIGN - 1));
+	q->mask = size - 1;
+	q->enqueue_pos = 0;
+	q->dequeue_pos = 0;
+
+	if (posix_memalign((void **)&q->cells, CELL_ALIGN, q->stride * size) != 0)
+	{
+		q->cells = NULL;
+		return -1;
+	}
+
+	for (i = 0; i < size; i++)
+	{
+		*cell_seq(q, i) = i;
+	}
+
+	return 0;
+}
+
+void mpsc_destroy(struct mpsc_queue *q)
+{
+	free(q->cells);
+	q->cells = NULL;
+}
+
+void *mpsc_reserve(struct mpsc_queue *q, unsigned int *pos)
+{
+	unsigned int p = __atomic_load_n(&q->enqueue_pos, __ATOMIC_RELAXED);
+	unsigned int seq;
+	int dif;
+
+	for (;;)
+	{
+		seq = __atomic_load_n(cell_seq(q, p), __ATOMIC_ACQUIRE);
+		dif = (int)(seq - p);
+
+		if (0 == dif)
+		{
+			/* The cell is free for this lap, race the other producers for it. */
+			if (__atomic_compare_exchange_n(&q->enqueue_pos, &p, p + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+			{
+				*pos = p;
+				return cell_elem(q, p);
+			}
+		}
+		else if (dif < 0)
+		{
+			/* The consumer has not released the cell of the previous lap. */
+			return NULL;
+		}
+		else
+		{
+			p = __atomic_load_n(&q->enqueue_pos, __ATOMIC_RELAXED);
+		}
+	}
+}
+
+void mpsc_commit(struct mpsc_queue *q, unsigned int pos)
+{
+	__atomic_store_n(cell_seq(q, pos), pos + 1, __ATOMIC_RELEASE);
+}
+
+void *mpsc_peek(struct mpsc_queue *q, unsigned int pos)
+{
+	if (__atomic_load_n(cell_seq(q, pos), __ATOMIC_ACQUIRE) != pos + 1)
+	{
+		return NULL;
+	}
+
+	return cell_elem(q, pos);
+}
+
+void mpsc_release(struct mpsc_queue *q, unsigned int pos)
+{
+	unsigned int p;
+
+	for (p = q->dequeue_pos; p != pos; p++)
+	{
+		__atomic_store_n(cell_seq(q, p), p + q->mask + 1, __ATOMIC_RELEASE);
+	}
+
+	q->dequeue_pos = pos;
+}
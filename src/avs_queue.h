@@ -0,0 +1,92 @@
+/****************************************************************************
+ *
+ * Multiedia Controller Module(MCM).
+ *
+ * Copyright (c) 2017 by Grandstream Networks, Inc.
+ * All rights reserved.
+ *
+ * This material is proprietary to Grandstream Networks, Inc. and,
+ * in addition to the above mentioned Copyright, may be
+ * subject to protection under other intellectual property
+ * regimes, including patents, trade secrets, designs and/or
+ * trademarks.
+ *
+ * Any use of this material for any purpose, except with an
+ * express license from Grandstream Networks, Inc. is strictly
+ * prohibited.
+ *
+ *
+ * \brief Bounded lock-free multi-producer single-consumer queue.
+ *
+ *	Each cell carries a sequence number telling whether it is free for
+ *  the producer of a position, or published for the consumer. Producers
+ *  only contend on one compare-and-swap of the enqueue position.
+ *  Elements are written and read in place, nothing is copied.
+ *
+ ***************************************************************************/
+
+#ifndef AVS_QUEUE_H
+#define AVS_QUEUE_H
+
+#include <stddef.h>
+
+/**
+ * struct mpsc_queue - The queue.
+ * @cells:  Cells of @stride bytes, a sequence number followed by the element.
+ * @stride:  Size of a cell.
+ * @mask:  Capacity - 1, the capacity is a power of 2.
+ * @enqueue_pos:  Next position to reserve, shared by the producers.
+ * @dequeue_pos:  First position not released yet, owned by the consumer.
+ */
+struct mpsc_queue
+{
+	char *cells;
+	size_t stride;
+	unsigned int mask;
+	unsigned int enqueue_pos __attribute__((aligned(64)));
+	unsigned int dequeue_pos __attribute__((aligned(64)));
+};
+
+/**
+ * mpsc_init - Allocate the cells.
+ * @q:  The queue.
+ * @capacity:  Number of elements, rounded up to a power of 2.
+ * @elem_size:  Size of an element.
+ *
+ * Return: 0 on success, -1 on failure.
+ */
+int mpsc_init(struct mpsc_queue *q, unsigned int capacity, size_t elem_size);
+
+/**
+ * mpsc_destroy - Free the cells. No producer or consumer may use the queue any more.
+ */
+void mpsc_destroy(struct mpsc_queue *q);
+
+/**
+ * mpsc_reserve - Producer: take the next free cell.
+ * @q:  The queue.
+ * @pos:  Output, position of the cell to pass to mpsc_commit().
+ *
+ * Return: The element to fill, NULL if the queue is full.
+ */
+void *mpsc_reserve(struct mpsc_queue *q, unsigned int *pos);
+
+/**
+ * mpsc_commit - Producer: publish a cell taken by mpsc_reserve(). Every reserved cell must be committed,
+ * the consumer takes cells in order.
+ */
+void mpsc_commit(struct mpsc_queue *q, unsigned int pos);
+
+/**
+ * mpsc_peek - Consumer: get the element at @pos, at or after the dequeue position.
+ *
+ * Return: The element, NULL if it has not been published yet.
+ */
+void *mpsc_peek(struct mpsc_queue *q, unsigned int pos);
+
+/**
+ * mpsc_release - Consumer: give back the cells from the dequeue position up to @pos (excluded) to the producers.
+ */
+void mpsc_release(struct mpsc_queue *q, unsigned int pos);
+
+#endif /* AVS_QUEUE_H */
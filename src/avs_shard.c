@@ -0,0 +1,236 @@
+/****************************************************************************
+ *
+ * Multiedia Controller Module(MCM).
+ *
+ * Copyright (c) 2017 by Grandstream Networks, Inc.
+ * All rights reserved.
+ *
+ * This material is proprietary to Grandstream Networks, Inc. and,
+ * in addition to the above mentioned Copyright, may be
+ * subject to protection under other intellectual property
+ * regimes, including patents, trade secrets, designs and/or
+ * trademarks.
+ *
+ * Any use of this material for any purpose, except with an
+ * express license from Grandstream Networks, Inc. is strictly
+ * prohibited.
+ *
+ *
+ * \brief Placement of the conferences on the AVS instances.
+ *
+ *	Placed conferences are chained in SHARD_HASH_SIZE buckets by the
+ *  hash of their id. An entry is released as soon as its conference has
+ *  neither a port nor a command in flight, so the table only holds the
+ *  live conferences. Released entries are kept in a free list for the
+ *  next conferences.
+ *
+ ***************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <pthread.h>
+#include "avs_shard.h"
+#include "avs_arena.h"
+#include "avs_log.h"
+
+#define SHARD_HASH_SIZE		256	/* Buckets of the placement table, a power of 2. */
+
+/* A conference placed on an instance. */
+struct shard_conf
+{
+	char conf_id[MAX_CONFID_LEN];
+	unsigned int inst;
+	unsigned int ports;
+	unsigned int in_flight;
+	struct shard_conf *next;	/* Next conference in the same bucket, or in the free list. */
+};
+
+static pthread_mutex_t shard_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct shard_conf *shard_hash[SHARD_HASH_SIZE];
+static struct shard_conf *shard_pool;	/* Free entries. */
+static struct shard_load shard_loads[AVS_MAX_INSTANCES];
+static unsigned int shard_num = 1;
+
+/* FNV-1a hash of a conference id. */
+static unsigned int shard_hash_id(const char *conf_id)
+{
+	unsigned int h = 2166136261u;
+
+	while (*conf_id)
+	{
+		h ^= (unsigned char)*conf_id++;
+		h *= 16777619u;
+	}
+
+	return h & (SHARD_HASH_SIZE - 1);
+}
+
+/* Find the entry of a conference and the link pointing to it. Called with "shard_lock" held. */
+static struct shard_conf *shard_find(const char *conf_id, struct shard_conf ***link)
+{
+	struct shard_conf **pp;
+
+	for (pp = &shard_hash[shard_hash_id(conf_id)]; *pp; pp = &(*pp)->next)
+	{
+		if (!strncmp((*pp)->conf_id, conf_id, sizeof((*pp)->conf_id) - 1))
+		{
+			break;
+		}
+	}
+
+	if (link)
+	{
+		*link = pp;
+	}
+
+	return *pp;
+}
+
+/* Release the entry of a conference which has nothing left on its instance. Called with "shard_lock" held. */
+static void shard_put(struct shard_conf *conf, struct shard_conf **link)
+{
+	if (conf->ports || conf->in_flight)
+	{
+		return;
+	}
+
+	*link = conf->next;
+	shard_loads[conf->inst].confs--;
+	conf->next = shard_pool;
+	shard_pool = conf;
+}
+
+/* The instance with the fewest ports and commands in flight, the one with fewer conferences on a tie. */
+static unsigned int shard_least_loaded(void)
+{
+	unsigned int i, best = 0, load, best_load = ~0u;
+
+	for (i = 0; i < shard_num; i++)
+	{
+		load = shard_loads[i].ports + shard_loads[i].in_flight;
+
+		if (load < best_load || (load == best_load && shard_loads[i].confs < shard_loads[best].confs))
+		{
+			best = i;
+			best_load = load;
+		}
+	}
+
+	return best;
+}
+
+void shard_reset(unsigned int num)
+{
+	struct shard_conf *conf;
+	unsigned int i;
+
+	pthread_mutex_lock(&shard_lock);
+
+	for (i = 0; i < SHARD_HASH_SIZE; i++)
+	{
+		while ((conf = shard_hash[i]))
+		{
+			shard_hash[i] = conf->next;
+			heap_free(conf);
+		}
+	}
+
+	while ((conf = shard_pool))
+	{
+		shard_pool = conf->next;
+		heap_free(conf);
+	}
+
+	memset(shard_loads, 0, sizeof(shard_loads));
+	shard_num = (num && num <= AVS_MAX_INSTANCES) ? num : 1;
+
+	pthread_mutex_unlock(&shard_lock);
+}
+
+int shard_acquire(const char *conf_id)
+{
+	struct shard_conf *conf, **link;
+	int inst = -1;
+
+	pthread_mutex_lock(&shard_lock);
+
+	if (!(conf = shard_find(conf_id, &link)))
+	{
+		if ((conf = shard_pool))
+		{
+			shard_pool = conf->next;
+		}
+		else if (!(conf = heap_alloc(sizeof(*conf))))
+		{
+			log_err("Malloc conference placement failed\n");
+			goto out;
+		}
+
+		memset(conf, 0, sizeof(*conf));
+		strncpy(conf->conf_id, conf_id, sizeof(conf->conf_id) - 1);
+		conf->inst = shard_least_loaded();
+		shard_loads[conf->inst].confs++;
+		*link = conf;
+	}
+
+	conf->in_flight++;
+	shard_loads[conf->inst].in_flight++;
+	inst = (int)conf->inst;
+
+out:
+	pthread_mutex_unlock(&shard_lock);
+
+	return inst;
+}
+
+void shard_release(const char *conf_id)
+{
+	struct shard_conf *conf, **link;
+
+	pthread_mutex_lock(&shard_lock);
+
+	if ((conf = shard_find(conf_id, &link)) && conf->in_flight)
+	{
+		conf->in_flight--;
+		shard_loads[conf->inst].in_flight--;
+		shard_put(conf, link);
+	}
+
+	pthread_mutex_unlock(&shard_lock);
+}
+
+void shard_set_ports(const char *conf_id, unsigned int ports)
+{
+	struct shard_conf *conf, **link;
+
+	pthread_mutex_lock(&shard_lock);
+
+	if ((conf = shard_find(conf_id, &link)))
+	{
+		shard_loads[conf->inst].ports += ports - conf->ports;
+		conf->ports = ports;
+		shard_put(conf, link);
+	}
+
+	pthread_mutex_unlock(&shard_lock);
+}
+
+int shard_lookup(const char *conf_id)
+{
+	struct shard_conf *conf;
+	int inst;
+
+	pthread_mutex_lock(&shard_lock);
+	inst = (conf = shard_find(conf_id, NULL)) ? (int)conf->inst : -1;
+	pthread_mutex_unlock(&shard_lock);
+
+	return inst;
+}
+
+void shard_get_load(unsigned int inst, struct shard_load *load)
+{
+	pthread_mutex_lock(&shard_lock);
+	*load = shard_loads[inst];
+	pthread_mutex_unlock(&shard_lock);
+}
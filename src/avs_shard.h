@@ -0,0 +1,88 @@
+/****************************************************************************
+ *
+ * Multiedia Controller Module(MCM).
+ *
+ * Copyright (c) 2017 by Grandstream Networks, Inc.
+ * All rights reserved.
+ *
+ * This material is proprietary to Grandstream Networks, Inc. and,
+ * in addition to the above mentioned Copyright, may be
+ * subject to protection under other intellectual property
+ * regimes, including patents, trade secrets, designs and/or
+ * trademarks.
+ *
+ * Any use of this material for any purpose, except with an
+ * express license from Grandstream Networks, Inc. is strictly
+ * prohibited.
+ *
+ *
+ * \brief Placement of the conferences on the AVS instances.
+ *
+ *	A conference is placed on the least loaded instance by its first
+ *  command, and stays there while it has a port or a command in flight.
+ *  The load of an instance is its live ports plus its commands in
+ *  flight. Callers place commands, the receiving thread releases them
+ *  and reports the ports, so the table is locked.
+ *
+ ***************************************************************************/
+
+#ifndef AVS_SHARD_H
+#define AVS_SHARD_H
+
+#include "avs_controller.h"
+
+/**
+ * struct shard_load - Load of an instance.
+ * @confs:  Conferences placed on it.
+ * @ports:  Live ports of these conferences.
+ * @in_flight:  Commands placed on it which have not completed.
+ */
+struct shard_load
+{
+	unsigned int confs;
+	unsigned int ports;
+	unsigned int in_flight;
+};
+
+/**
+ * shard_reset - Forget all the placements.
+ * @num:  Number of instances, 1 to AVS_MAX_INSTANCES.
+ */
+void shard_reset(unsigned int num);
+
+/**
+ * shard_acquire - Place a command of a conference. The conference is placed on the least loaded instance if it is not placed yet.
+ * @conf_id:  Conference id, not empty.
+ *
+ * Return: Index of the instance, to give back to shard_release() once the command completes. -1 if the allocation failed.
+ */
+int shard_acquire(const char *conf_id);
+
+/**
+ * shard_release - A command placed by shard_acquire() has completed, or has not been sent.
+ * @conf_id:  Conference id.
+ */
+void shard_release(const char *conf_id);
+
+/**
+ * shard_set_ports - Live ports of a conference changed. Nothing is done if it is not placed.
+ * @conf_id:  Conference id.
+ * @ports:  Ports it has now.
+ */
+void shard_set_ports(const char *conf_id, unsigned int ports);
+
+/**
+ * shard_lookup - Get the instance of a conference.
+ *
+ * Return: Its index, -1 if it is not placed.
+ */
+int shard_lookup(const char *conf_id);
+
+/**
+ * shard_get_load - Get the load of an instance.
+ * @inst:  Its index.
+ * @load:  Output.
+ */
+void shard_get_load(unsigned int inst, struct shard_load *load);
+
+#endif /* AVS_SHARD_H */
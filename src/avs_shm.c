@@ -0,0 +1,396 @@
+/****************************************************************************
+ *
+ * Multiedia Controller Module(MCM).
+ *
+ * Copyright (c) 2017 by Grandstream Networks, Inc.
+ * All rights reserved.
+ *
+ * This material is proprietary to Grandstream Networks, Inc. and,
+ * in addition to the above mentioned Copyright, may be
+ * subject to protection under other intellectual property
+ * regimes, including patents, trade secrets, designs and/or
+ * trademarks.
+ *
+ * Any use of this material for any purpose, except with an
+ * express license from Grandstream Networks, Inc. is strictly
+ * prohibited.
+ *
+ *
+ * \brief Shared memory transport between avs_controller and AVS.
+ *
+ *	A record is a 32 bit length followed by the message, padded to
+ *  SHM_REC_ALIGN bytes. The producer publishes records by moving "head"
+ *  with release semantics, the consumer frees them by moving "tail".
+ *
+ ***************************************************************************/
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/eventfd.h>
+#include "avs_shm.h"
+#include "avs_log.h"
+
+#define SHM_PATH_TEMPLATE	"/dev/shm/avs-mcm-XXXXXX"
+#define SHM_REC_ALIGN		8
+#define SHM_REC_WRAP		0xFFFFFFFFu	/* Length of the marker sending the consumer back to the start of the ring. */
+#define SHM_MSG_MAX		(SHM_RING_SIZE / 4)	/* Longest message, so a full ring always takes one after it drains. */
+#define RING_MASK		(SHM_RING_SIZE - 1)
+
+/* Bytes a message takes in the ring. */
+static uint32_t rec_size(uint32_t len)
+{
+	return (sizeof(uint32_t) + len + SHM_REC_ALIGN - 1) & ~(uint32_t)(SHM_REC_ALIGN - 1);
+}
+
+static void link_init(struct shm_link *link)
+{
+	int i;
+
+	memset(link, 0, sizeof(*link));
+	for (i = 0; i < SHM_FD_MAX; i++)
+	{
+		link->fds[i] = -1;
+	}
+	link->tx_bell = link->rx_bell = -1;
+}
+
+int shm_link_create(struct shm_link *link)
+{
+	char path[] = SHM_PATH_TEMPLATE;
+	void *map;
+
+	link_init(link);
+
+	/* The file only lives until the mapping is passed to AVS, a crash does not leave it behind. */
+	if ((link->fds[SHM_FD_AREA] = mkstemp(path)) < 0)
+	{
+		perror("create shared memory failed");
+		return -1;
+	}
+	unlink(path);
+
+	if (ftruncate(link->fds[SHM_FD_AREA], sizeof(struct shm_area)) < 0)
+	{
+		perror("size shared memory failed");
+		goto fail;
+	}
+
+	if ((map = mmap(NULL, sizeof(struct shm_area), PROT_READ | PROT_WRITE, MAP_SHARED, link->fds[SHM_FD_AREA], 0)) == MAP_FAILED)
+	{
+		perror("map shared memory failed");
+		goto fail;
+	}
+	link->area = (struct shm_area *)map;
+
+	if ((link->fds[SHM_FD_BELL_TO_AVS] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0
+		|| (link->fds[SHM_FD_BELL_TO_MCM] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0)
+	{
+		perror("eventfd failed");
+		goto fail;
+	}
+
+	/* ftruncate() zeroed the rings. */
+	link->area->magic = SHM_MAGIC;
+	link->area->version = SHM_VERSION;
+	link->area->ring_size = SHM_RING_SIZE;
+
+	link->tx = &link->area->rings[SHM_RING_TO_AVS];
+	link->rx = &link->area->rings[SHM_RING_TO_MCM];
+	link->tx_bell = link->fds[SHM_FD_BELL_TO_AVS];
+	link->rx_bell = link->fds[SHM_FD_BELL_TO_MCM];
+
+	return 0;
+
+fail:
+	shm_link_close(link);
+	return -1;
+}
+
+int shm_link_attach(struct shm_link *link, const int fds[SHM_FD_MAX])
+{
+	struct stat st;
+	void *map;
+
+	link_init(link);
+	memcpy(link->fds, fds, sizeof(link->fds));
+
+	if (fstat(link->fds[SHM_FD_AREA], &st) < 0 || st.st_size < (off_t)sizeof(struct shm_area))
+	{
+		log_err("shared memory is too small.\n");
+		goto fail;
+	}
+
+	if ((map = mmap(NULL, sizeof(struct shm_area), PROT_READ | PROT_WRITE, MAP_SHARED, link->fds[SHM_FD_AREA], 0)) == MAP_FAILED)
+	{
+		perror("map shared memory failed");
+		goto fail;
+	}
+	link->area = (struct shm_area *)map;
+
+	if (SHM_MAGIC != link->area->magic || SHM_VERSION != link->area->version || SHM_RING_SIZE != link->area->ring_size)
+	{
+		log_err("shared memory version %u ring size %u is not supported.\n", link->area->version, link->area->ring_size);
+		goto fail;
+	}
+
+	link->tx = &link->area->rings[SHM_RING_TO_MCM];
+	link->rx = &link->area->rings[SHM_RING_TO_AVS];
+	link->tx_bell = link->fds[SHM_FD_BELL_TO_MCM];
+	link->rx_bell = link->fds[SHM_FD_BELL_TO_AVS];
+
+	return 0;
+
+fail:
+	shm_link_close(link);
+	return -1;
+}
+
+void shm_link_close(struct shm_link *link)
+{
+	int i;
+
+	if (link->area)
+	{
+		munmap(link->area, sizeof(struct shm_area));
+	}
+
+	for (i = 0; i < SHM_FD_MAX; i++)
+	{
+		if (link->fds[i] >= 0)
+		{
+			close(link->fds[i]);
+		}
+	}
+
+	link_init(link);
+}
+
+int shm_send(struct shm_link *link, const void *msg, uint32_t len)
+{
+	struct shm_ring *r = link->tx;
+	uint32_t head = r->head;
+	uint32_t used = head - __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+	uint32_t need = rec_size(len);
+	uint32_t off = head & RING_MASK;
+	uint32_t room = SHM_RING_SIZE - off;	/* Bytes before the end of the ring. */
+
+	if (len > SHM_MSG_MAX)
+	{
+		log_err("message of %u bytes is too long for shared memory.\n", len);
+		return -1;
+	}
+
+	/* A record which does not fit before the end starts again at the beginning, after a marker. Records are aligned, the marker fits. */
+	if (room < need)
+	{
+		if (SHM_RING_SIZE - used < room + need)
+		{
+			return -1;
+		}
+
+		*(uint32_t *)(r->data + off) = SHM_REC_WRAP;
+		head += room;
+		off = 0;
+	}
+	else if (SHM_RING_SIZE - used < need)
+	{
+		return -1;
+	}
+
+	*(uint32_t *)(r->data + off) = len;
+	memcpy(r->data + off + sizeof(uint32_t), msg, len);
+
+	__atomic_store_n(&r->head, head + need, __ATOMIC_RELEASE);
+
+	return 0;
+}
+
+int shm_ring_bell(struct shm_link *link)
+{
+	uint64_t one = 1;
+
+	/* Pairs with the fence of shm_prepare_sleep(): either the consumer sees the records before sleeping, or this side sees it sleeping. */
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+	if (!__atomic_load_n(&link->tx->sleeping, __ATOMIC_RELAXED) || !__atomic_exchange_n(&link->tx->sleeping, 0, __ATOMIC_RELAXED))
+	{
+		return 0;
+	}
+
+	if (write(link->tx_bell, &one, sizeof(one)) < 0 && EAGAIN != errno)
+	{
+		perror("write doorbell failed");
+	}
+
+	return 1;
+}
+
+int shm_recv_ref(struct shm_link *link, const char **msg)
+{
+	struct shm_ring *r = link->rx;
+	uint32_t tail = r->tail;
+	uint32_t head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+	uint32_t off, len;
+
+	for (;;)
+	{
+		if (head == tail)
+		{
+			return -1;
+		}
+
+		off = tail & RING_MASK;
+		len = *(uint32_t *)(r->data + off);
+
+		if (SHM_REC_WRAP != len)
+		{
+			break;
+		}
+
+		tail += SHM_RING_SIZE - off;
+	}
+
+	/* Only a broken peer writes this, drop what it published. */
+	if (len > SHM_MSG_MAX || rec_size(len) > head - tail)
+	{
+		log_err("corrupted record of %u bytes in shared memory.\n", len);
+		__atomic_store_n(&r->tail, head, __ATOMIC_RELEASE);
+		return -1;
+	}
+
+	*msg = r->data + off + sizeof(uint32_t);
+	link->rx_next = tail + rec_size(len);
+
+	return (int)len;
+}
+
+void shm_recv_release(struct shm_link *link)
+{
+	__atomic_store_n(&link->rx->tail, link->rx_next, __ATOMIC_RELEASE);
+}
+
+int shm_recv(struct shm_link *link, void *buf, size_t size)
+{
+	const char *msg;
+	int len;
+	size_t copy;
+
+	if ((len = shm_recv_ref(link, &msg)) < 0)
+	{
+		return -1;
+	}
+
+	copy = ((size_t)len < size) ? (size_t)len : size;
+	memcpy(buf, msg, copy);
+	shm_recv_release(link);
+
+	return (int)copy;
+}
+
+int shm_prepare_sleep(struct shm_link *link)
+{
+	__atomic_store_n(&link->rx->sleeping, 1, __ATOMIC_SEQ_CST);
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+	return __atomic_load_n(&link->rx->head, __ATOMIC_ACQUIRE) != link->rx->tail;
+}
+
+void shm_wake(struct shm_link *link)
+{
+	__atomic_store_n(&link->rx->sleeping, 0, __ATOMIC_RELAXED);
+}
+
+ssize_t shm_send_fds(int sock, const struct sockaddr_un *to, const void *msg, size_t len, const int *fds, int nfds)
+{
+	union
+	{
+		struct cmsghdr hdr;
+		char buf[CMSG_SPACE(sizeof(int) * SHM_FD_MAX)];
+	} ctrl;
+	struct msghdr mh;
+	struct iovec iov;
+	struct cmsghdr *cm;
+
+	memset(&mh, 0, sizeof(mh));
+	memset(&ctrl, 0, sizeof(ctrl));
+	iov.iov_base = (void *)msg;
+	iov.iov_len = len;
+	mh.msg_name = (void *)to;
+	mh.msg_namelen = sizeof(*to);
+	mh.msg_iov = &iov;
+	mh.msg_iovlen = 1;
+	mh.msg_control = ctrl.buf;
+	mh.msg_controllen = CMSG_SPACE(sizeof(int) * nfds);
+
+	cm = CMSG_FIRSTHDR(&mh);
+	cm->cmsg_level = SOL_SOCKET;
+	cm->cmsg_type = SCM_RIGHTS;
+	cm->cmsg_len = CMSG_LEN(sizeof(int) * nfds);
+	memcpy(CMSG_DATA(cm), fds, sizeof(int) * nfds);
+
+	return sendmsg(sock, &mh, 0);
+}
+
+ssize_t shm_recv_fds(int sock, void *buf, size_t size, struct sockaddr_un *from, socklen_t *fromlen, int *fds, int *nfds)
+{
+	union
+	{
+		struct cmsghdr hdr;
+		char buf[CMSG_SPACE(sizeof(int) * SHM_FD_MAX)];
+	} ctrl;
+	struct msghdr mh;
+	struct iovec iov;
+	struct cmsghdr *cm;
+	ssize_t len;
+	int i, n;
+
+	memset(&mh, 0, sizeof(mh));
+	iov.iov_base = buf;
+	iov.iov_len = size;
+	mh.msg_name = from;
+	mh.msg_namelen = *fromlen;
+	mh.msg_iov = &iov;
+	mh.msg_iovlen = 1;
+	mh.msg_control = ctrl.buf;
+	mh.msg_controllen = sizeof(ctrl.buf);
+
+	*nfds = 0;
+
+	if ((len = recvmsg(sock, &mh, MSG_DONTWAIT | MSG_CMSG_CLOEXEC)) < 0)
+	{
+		return len;
+	}
+
+	*fromlen = mh.msg_namelen;
+
+	for (cm = CMSG_FIRSTHDR(&mh); cm; cm = CMSG_NXTHDR(&mh, cm))
+	{
+		if (SOL_SOCKET != cm->cmsg_level || SCM_RIGHTS != cm->cmsg_type)
+		{
+			continue;
+		}
+
+		n = (cm->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+		for (i = 0; i < n; i++)
+		{
+			int fd;
+
+			memcpy(&fd, CMSG_DATA(cm) + i * sizeof(int), sizeof(int));
+			if (*nfds < SHM_FD_MAX)
+			{
+				fds[(*nfds)++] = fd;
+			}
+			else
+			{
+				close(fd);
+			}
+		}
+	}
+
+	return len;
+}
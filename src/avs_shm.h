@@ -0,0 +1,218 @@
+/****************************************************************************
+ *
+ * Multiedia Controller Module(MCM).
+ *
+ * Copyright (c) 2017 by Grandstream Networks, Inc.
+ * All rights reserved.
+ *
+ * This material is proprietary to Grandstream Networks, Inc. and,
+ * in addition to the above mentioned Copyright, may be
+ * subject to protection under other intellectual property
+ * regimes, including patents, trade secrets, designs and/or
+ * trademarks.
+ *
+ * Any use of this material for any purpose, except with an
+ * express license from Grandstream Networks, Inc. is strictly
+ * prohibited.
+ *
+ *
+ * \brief Shared memory transport between avs_controller and AVS.
+ *
+ *	A mapping in /dev/shm holds one single producer single consumer ring
+ *  per direction. Each side has an eventfd doorbell, which the producer
+ *  rings only when the consumer announced that it is going to sleep, so
+ *  a busy link exchanges messages without any system call.
+ *
+ *  avs_controller creates the link and passes the mapping and the
+ *  doorbells to AVS with SCM_RIGHTS on the AVS socket, in a "shmAttach"
+ *  command. AVS takes the link by answering it with code 0 and the
+ *  version it attached, {"shmAttach":{"version":"1"}}.
+ *
+ ***************************************************************************/
+
+#ifndef AVS_SHM_H
+#define AVS_SHM_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#define SHM_RING_SIZE		(256 * 1024)	/* Bytes of each ring, a power of 2. Holds the commands of a full pending table. */
+#define SHM_CACHE_LINE		64
+#define SHM_MAGIC		0x41565352	/* "AVSR" */
+#define SHM_VERSION		1
+#define SHM_ATTACH_METHOD	"shmAttach"	/* Command offering the link to AVS. */
+
+/* Rings of the mapping, by the side consuming them. */
+enum shm_ring_dir
+{
+	SHM_RING_TO_AVS,
+	SHM_RING_TO_MCM,
+	SHM_RING_MAX
+};
+
+/* File descriptors passed to AVS, in this order. */
+enum shm_fd
+{
+	SHM_FD_AREA,
+	SHM_FD_BELL_TO_AVS,
+	SHM_FD_BELL_TO_MCM,
+	SHM_FD_MAX
+};
+
+/**
+ * struct shm_ring - A ring of length prefixed records, in shared memory. A record never wraps, a marker sends the consumer back to the start.
+ * @head:  Bytes published by the producer, free running.
+ * @tail:  Bytes taken by the consumer, free running.
+ * @sleeping:  The consumer is going to wait for its doorbell, the producer must ring it.
+ * @data:  The records.
+ */
+struct shm_ring
+{
+	uint32_t head __attribute__((aligned(SHM_CACHE_LINE)));
+	uint32_t tail __attribute__((aligned(SHM_CACHE_LINE)));
+	uint32_t sleeping __attribute__((aligned(SHM_CACHE_LINE)));
+	char data[SHM_RING_SIZE] __attribute__((aligned(SHM_CACHE_LINE)));
+};
+
+/**
+ * struct shm_area - Layout of the mapping.
+ * @magic:  SHM_MAGIC.
+ * @version:  SHM_VERSION.
+ * @ring_size:  SHM_RING_SIZE.
+ * @rings:  By enum shm_ring_dir.
+ */
+struct shm_area
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t ring_size;
+	struct shm_ring rings[SHM_RING_MAX] __attribute__((aligned(SHM_CACHE_LINE)));
+};
+
+/**
+ * struct shm_link - One side of a link.
+ * @area:  The mapping.
+ * @tx:  Ring this side produces.
+ * @rx:  Ring this side consumes.
+ * @fds:  The mapping and the doorbells, by enum shm_fd.
+ * @tx_bell:  Doorbell of the other side.
+ * @rx_bell:  Doorbell of this side, readable when the other side rang it.
+ * @rx_next:  Tail of the ring of this side past the message got by shm_recv_ref().
+ */
+struct shm_link
+{
+	struct shm_area *area;
+	struct shm_ring *tx;
+	struct shm_ring *rx;
+	int fds[SHM_FD_MAX];
+	int tx_bell;
+	int rx_bell;
+	uint32_t rx_next;	/* "tail" of the ring of this side once the message got by shm_recv_ref() is released. */
+};
+
+/**
+ * shm_link_create - Create a link for avs_controller: a mapping in /dev/shm, already unlinked, and the doorbells.
+ * @link:  Output.
+ *
+ * Return: 0, -1 on failure.
+ */
+int shm_link_create(struct shm_link *link);
+
+/**
+ * shm_link_attach - Take a link created by avs_controller, for AVS.
+ * @link:  Output.
+ * @fds:  Received file descriptors by enum shm_fd, they belong to the link even on failure.
+ *
+ * Return: 0, -1 if the mapping is not a valid area.
+ */
+int shm_link_attach(struct shm_link *link, const int fds[SHM_FD_MAX]);
+
+/**
+ * shm_link_close - Unmap the area and close the file descriptors. Nothing is done for a link which is not open.
+ */
+void shm_link_close(struct shm_link *link);
+
+/**
+ * shm_send - Publish a message in the ring of the other side. shm_ring_bell() must follow a batch of them.
+ * @link:  The link.
+ * @msg:  The message.
+ * @len:  Its length.
+ *
+ * Return: 0, -1 if the ring is full.
+ */
+int shm_send(struct shm_link *link, const void *msg, uint32_t len);
+
+/**
+ * shm_ring_bell - Wake the other side up if it sleeps.
+ *
+ * Return: 1 if the doorbell has been rung, 0 if the other side was awake.
+ */
+int shm_ring_bell(struct shm_link *link);
+
+/**
+ * shm_recv - Take a message from the ring of this side.
+ * @link:  The link.
+ * @buf:  Output, the message is not terminated.
+ * @size:  Size of @buf, a longer message is truncated.
+ *
+ * Return: Length copied, -1 if the ring is empty.
+ */
+int shm_recv(struct shm_link *link, void *buf, size_t size);
+
+/**
+ * shm_recv_ref - Get the next message of the ring of this side where it is, without copying it. shm_recv_release() must follow.
+ * @link:  The link.
+ * @msg:  Output, the message. It is not terminated, and the other side does not overwrite it until it is released.
+ *
+ * Return: Its length, -1 if the ring is empty.
+ */
+int shm_recv_ref(struct shm_link *link, const char **msg);
+
+/**
+ * shm_recv_release - Give the room of the message got by shm_recv_ref() back to the other side.
+ */
+void shm_recv_release(struct shm_link *link);
+
+/**
+ * shm_prepare_sleep - Announce that this side is going to wait for its doorbell. shm_wake() must follow.
+ *
+ * Return: 1 if messages are already waiting, this side must not sleep. Otherwise 0.
+ */
+int shm_prepare_sleep(struct shm_link *link);
+
+/**
+ * shm_wake - This side is awake again, the other side does not need to ring the doorbell.
+ */
+void shm_wake(struct shm_link *link);
+
+/**
+ * shm_send_fds - Send a datagram with file descriptors attached by SCM_RIGHTS.
+ * @sock:  Unix datagram socket.
+ * @to:  Destination.
+ * @msg:  The datagram.
+ * @len:  Its length.
+ * @fds:  File descriptors.
+ * @nfds:  Number of them, SHM_FD_MAX at most.
+ *
+ * Return: Same as sendmsg().
+ */
+ssize_t shm_send_fds(int sock, const struct sockaddr_un *to, const void *msg, size_t len, const int *fds, int nfds);
+
+/**
+ * shm_recv_fds - Receive a datagram, and the file descriptors attached to it.
+ * @sock:  Unix datagram socket.
+ * @buf:  Output.
+ * @size:  Size of @buf.
+ * @from:  Output, sender.
+ * @fromlen:  Size of @from on input, its length on output.
+ * @fds:  Output, SHM_FD_MAX of them. Attached descriptors beyond SHM_FD_MAX are closed.
+ * @nfds:  Output, number of descriptors received.
+ *
+ * Return: Same as recvmsg(), with MSG_DONTWAIT.
+ */
+ssize_t shm_recv_fds(int sock, void *buf, size_t size, struct sockaddr_un *from, socklen_t *fromlen, int *fds, int *nfds);
+
+#endif /* AVS_SHM_H */
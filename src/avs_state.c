@@ -0,0 +1,847 @@
+/****************************************************************************
+ *
+ * Multiedia Controller Module(MCM).
+ *
+ * Copyright (c) 2017 by Grandstream Networks, Inc.
+ * All rights reserved.
+ *
+ * This material is proprietary to Grandstream Networks, Inc. and,
+ * in addition to the above mentioned Copyright, may be
+ * subject to protection under other intellectual property
+ * regimes, including patents, trade secrets, designs and/or
+ * trademarks.
+ *
+ * Any use of this material for any purpose, except with an
+ * express license from Grandstream Networks, Inc. is strictly
+ * prohibited.
+ *
+ *
+ * \brief Index of the conferences, channels and ports known to AVS.
+ *
+ *	ID strings are interned once, then conferences and channels are
+ *  found by the address of their interned IDs. Three open addressing
+ *  tables with linear probing hold the IDs, the conferences and the
+ *  channels keyed by (conference, channel), so each lookup is one hash
+ *  and a short probe. A removal shifts the entries of its probe back
+ *  instead of leaving a tombstone, so tables only grow with their count.
+ *
+ *  Removed entries are kept in free lists, IDs by size class, and the
+ *  tables keep their slots when they empty: channels and conferences
+ *  coming and going make no heap call once they have been seen.
+ *
+ ***************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <pthread.h>
+#include "avs_state.h"
+#include "avs_log.h"
+
+#define TABLE_MIN_SIZE		16	/* Initial slots of a table, a power of 2. */
+#define ID_CLASS_MIN		32	/* Bytes of the smallest size class of the IDs, a power of 2. */
+#define ID_CLASSES		5	/* Size classes of 32 to 512 bytes, up to MAX_CHANID_LEN. Longer IDs are not kept. */
+
+/* An interned ID string, shared by the conferences and channels with this ID. */
+struct state_id
+{
+	unsigned int hash;
+	unsigned int refs;
+	unsigned int cls;	/* Size class, ID_CLASSES if none. */
+	struct state_id *next_free;
+	char str[];
+};
+
+struct state_chan;
+
+/* A conference with at least one channel. */
+struct state_conf
+{
+	struct state_id *id;
+	unsigned int num_chans;
+	struct state_chan *chans;
+	struct state_conf *next_free;
+};
+
+/* A channel with a port, linked in the list of its conference, or in the free list by "next". */
+struct state_chan
+{
+	struct state_conf *conf;
+	struct state_id *id;
+	unsigned int hash;
+	struct state_chan *prev;
+	struct state_chan *next;
+	struct avs_chan_state st;
+	unsigned int applied[STATE_SETTING_MAX];	/* Hash of each setting AVS accepted, valid if its "_set" flag is set. */
+	unsigned int applied_seq[STATE_SETTING_MAX];	/* Sequence of the command which set it. */
+};
+
+/* Key of the channel table. */
+struct chan_key
+{
+	const struct state_id *conf;
+	const struct state_id *chan;
+};
+
+/* A slot of an open addressing table. */
+struct state_slot
+{
+	unsigned int hash;
+	void *entry;	/* NULL if the slot has never been used. */
+};
+
+/* An open addressing table. */
+struct state_table
+{
+	struct state_slot *slots;
+	unsigned int mask;
+	unsigned int count;	/* Entries, a probe stops at the first empty slot. */
+};
+
+/* Whether an entry has the key being looked up. */
+typedef int (*state_match)(const void *entry, const void *key);
+
+static pthread_rwlock_t state_lock = PTHREAD_RWLOCK_INITIALIZER;	/* Written by the receiving thread, read by the callers of the queries. */
+static struct state_table ids;	/* struct state_id, keyed by the string. */
+static struct state_table confs;	/* struct state_conf, keyed by the interned ID. */
+static struct state_table chans;	/* struct state_chan, keyed by struct chan_key. */
+static struct state_id *id_pool[ID_CLASSES];	/* Free IDs by size class. */
+static struct state_conf *conf_pool;	/* Free conferences. */
+static struct state_chan *chan_pool;	/* Free channels. */
+
+/* FNV-1a hash of an ID. */
+static unsigned int hash_str(const char *str)
+{
+	unsigned int h = 2166136261u;
+
+	while (*str)
+	{
+		h ^= (unsigned char)*str++;
+		h *= 16777619u;
+	}
+
+	return h;
+}
+
+static unsigned int hash_chan(const struct state_id *conf, const struct state_id *chan)
+{
+	unsigned int h = conf->hash * 0x9e3779b1u ^ chan->hash;
+
+	return h ^ (h >> 16);
+}
+
+static int match_id(const void *entry, const void *key)
+{
+	return !strcmp(((const struct state_id *)entry)->str, (const char *)key);
+}
+
+static int match_conf(const void *entry, const void *key)
+{
+	return ((const struct state_conf *)entry)->id == key;
+}
+
+static int match_chan(const void *entry, const void *key)
+{
+	const struct state_chan *chan = (const struct state_chan *)entry;
+	const struct chan_key *k = (const struct chan_key *)key;
+
+	return chan->conf->id == k->conf && chan->id == k->chan;
+}
+
+static void *table_find(const struct state_table *t, unsigned int hash, state_match match, const void *key)
+{
+	const struct state_slot *slot;
+	unsigned int i;
+
+	if (!t->slots)
+	{
+		return NULL;
+	}
+
+	for (i = hash & t->mask; (slot = &t->slots[i])->entry; i = (i + 1) & t->mask)
+	{
+		if (slot->hash == hash && match(slot->entry, key))
+		{
+			return slot->entry;
+		}
+	}
+
+	return NULL;
+}
+
+/* Move the entries to a table sized for "count + 1" of them at most half full. */
+static int table_resize(struct state_table *t)
+{
+	struct state_slot *slots;
+	unsigned int size = TABLE_MIN_SIZE, i, j;
+
+	while (size < (t->count + 1) * 2)
+	{
+		size <<= 1;
+	}
+
+	if (!(slots = heap_calloc(size, sizeof(*slots))))
+	{
+		log_err("Malloc state table failed\n");
+		return -1;
+	}
+
+	for (i = 0; t->slots && i <= t->mask; i++)
+	{
+		if (t->slots[i].entry)
+		{
+			for (j = t->slots[i].hash & (size - 1); slots[j].entry; j = (j + 1) & (size - 1))
+			{
+			}
+			slots[j] = t->slots[i];
+		}
+	}
+
+	heap_free(t->slots);
+	t->slots = slots;
+	t->mask = size - 1;
+
+	return 0;
+}
+
+/* Insert an entry whose key is not in the table. */
+static int table_insert(struct state_table *t, unsigned int hash, void *entry)
+{
+	unsigned int i;
+
+	/* Keep it at most 3/4 full, so probes stay short and always end. */
+	if ((!t->slots || (t->count + 1) * 4 > (t->mask + 1) * 3) && table_resize(t) != 0)
+	{
+		return -1;
+	}
+
+	for (i = hash & t->mask; t->slots[i].entry; i = (i + 1) & t->mask)
+	{
+	}
+
+	t->slots[i].hash = hash;
+	t->slots[i].entry = entry;
+	t->count++;
+
+	return 0;
+}
+
+/* Remove an entry, the entries after it in the probe which may sit in its slot are moved back, one by one. */
+static void table_remove(struct state_table *t, unsigned int hash, void *entry)
+{
+	unsigned int i, j, home;
+
+	if (!t->slots)
+	{
+		return;
+	}
+
+	for (i = hash & t->mask; t->slots[i].entry != entry; i = (i + 1) & t->mask)
+	{
+		if (!t->slots[i].entry)
+		{
+			return;
+		}
+	}
+
+	for (j = (i + 1) & t->mask; t->slots[j].entry; j = (j + 1) & t->mask)
+	{
+		/* An entry whose home slot is cyclically in (i, j] is still found from it. */
+		home = t->slots[j].hash & t->mask;
+		if ((i <= j) ? (i < home && home <= j) : (i < home || home <= j))
+		{
+			continue;
+		}
+
+		t->slots[i] = t->slots[j];
+		i = j;
+	}
+
+	t->slots[i].entry = NULL;
+	t->count--;
+}
+
+static void table_free(struct state_table *t)
+{
+	unsigned int i;
+
+	for (i = 0; t->slots && i <= t->mask; i++)
+	{
+		heap_free(t->slots[i].entry);
+	}
+
+	heap_free(t->slots);
+	memset(t, 0, sizeof(*t));
+}
+
+static struct state_id *id_find(const char *str)
+{
+	return table_find(&ids, hash_str(str), match_id, str);
+}
+
+/* Size class of an ID of "len" characters, ID_CLASSES if it is too long for one. */
+static unsigned int id_class(size_t len)
+{
+	size_t size = ID_CLASS_MIN;
+	unsigned int cls = 0;
+
+	while (cls < ID_CLASSES && size < sizeof(struct state_id) + len + 1)
+	{
+		size <<= 1;
+		cls++;
+	}
+
+	return cls;
+}
+
+/* Free an ID, or keep it in the free list of its size class. */
+static void id_free(struct state_id *id)
+{
+	if (!id || id->cls >= ID_CLASSES)
+	{
+		heap_free(id);
+		return;
+	}
+
+	id->next_free = id_pool[id->cls];
+	id_pool[id->cls] = id;
+}
+
+/* Intern an ID and take a reference to it. */
+static struct state_id *id_get(const char *str)
+{
+	unsigned int hash = hash_str(str), cls;
+	struct state_id *id;
+	size_t len;
+
+	if ((id = table_find(&ids, hash, match_id, str)))
+	{
+		id->refs++;
+		return id;
+	}
+
+	len = strlen(str);
+	cls = id_class(len);
+
+	if (cls < ID_CLASSES && id_pool[cls])
+	{
+		id = id_pool[cls];
+		id_pool[cls] = id->next_free;
+	}
+	else if (!(id = heap_alloc(cls < ID_CLASSES ? (size_t)ID_CLASS_MIN << cls : sizeof(*id) + len + 1)))
+	{
+		log_err("Malloc state id failed\n");
+		return NULL;
+	}
+
+	id->hash = hash;
+	id->refs = 1;
+	id->cls = cls;
+	memcpy(id->str, str, len + 1);
+
+	if (table_insert(&ids, hash, id) != 0)
+	{
+		id_free(id);
+		return NULL;
+	}
+
+	return id;
+}
+
+static void id_put(struct state_id *id)
+{
+	if (--id->refs)
+	{
+		return;
+	}
+
+	table_remove(&ids, id->hash, id);
+	id_free(id);
+}
+
+static struct state_chan *chan_find(const char *conf_id, const char *chan_id)
+{
+	struct chan_key key;
+
+	if (!(key.conf = id_find(conf_id)) || !(key.chan = id_find(chan_id)))
+	{
+		return NULL;
+	}
+
+	return table_find(&chans, hash_chan(key.conf, key.chan), match_chan, &key);
+}
+
+/* The channel if it uses the port, updates for an older port are ignored. */
+static struct state_chan *chan_find_port(const char *conf_id, const char *chan_id, const char *port_id)
+{
+	struct state_chan *chan = chan_find(conf_id, chan_id);
+
+	const char *port;
+
+	return (chan && (port = avs_id_str(chan->st.port_id)) && !strcmp(port, port_id)) ? chan : NULL;
+}
+
+/* Drop the references to the strings of a port. */
+static void port_strs_release(const struct avs_chan_state *st)
+{
+	avs_id_release(st->port_id);
+	avs_id_release(st->fingerprint);
+	avs_id_release(st->ice_ufrag);
+	avs_id_release(st->ice_pwd);
+}
+
+static void conf_free(struct state_conf *conf)
+{
+	table_remove(&confs, conf->id->hash, conf);
+	id_put(conf->id);
+	conf->next_free = conf_pool;
+	conf_pool = conf;
+}
+
+static struct state_conf *conf_get(const char *conf_id)
+{
+	struct state_conf *conf;
+	struct state_id *id;
+
+	if (!(id = id_get(conf_id)))
+	{
+		return NULL;
+	}
+
+	/* The conference holds a reference of its ID, one taken by a lookup is given back. */
+	if ((conf = table_find(&confs, id->hash, match_conf, id)))
+	{
+		id_put(id);
+		return conf;
+	}
+
+	if ((conf = conf_pool))
+	{
+		conf_pool = conf->next_free;
+	}
+	else if (!(conf = heap_alloc(sizeof(*conf))))
+	{
+		log_err("Malloc state conference failed\n");
+		id_put(id);
+		return NULL;
+	}
+
+	memset(conf, 0, sizeof(*conf));
+	conf->id = id;
+
+	if (table_insert(&confs, id->hash, conf) != 0)
+	{
+		id_put(id);
+		conf->next_free = conf_pool;
+		conf_pool = conf;
+		return NULL;
+	}
+
+	return conf;
+}
+
+static void chan_free(struct state_chan *chan)
+{
+	struct state_conf *conf = chan->conf;
+
+	table_remove(&chans, chan->hash, chan);
+
+	if (chan->prev)
+	{
+		chan->prev->next = chan->next;
+	}
+	else
+	{
+		conf->chans = chan->next;
+	}
+
+	if (chan->next)
+	{
+		chan->next->prev = chan->prev;
+	}
+
+	id_put(chan->id);
+	avs_chan_state_release(&chan->st);
+	chan->next = chan_pool;
+	chan_pool = chan;
+
+	if (!--conf->num_chans)
+	{
+		conf_free(conf);
+	}
+}
+
+static struct state_chan *chan_get(const char *conf_id, const char *chan_id)
+{
+	struct state_chan *chan;
+	struct state_conf *conf;
+
+	if ((chan = chan_find(conf_id, chan_id)))
+	{
+		return chan;
+	}
+
+	if (!(conf = conf_get(conf_id)))
+	{
+		return NULL;
+	}
+
+	if ((chan = chan_pool))
+	{
+		chan_pool = chan->next;
+	}
+	else if (!(chan = heap_alloc(sizeof(*chan))))
+	{
+		log_err("Malloc state channel failed\n");
+		goto fail;
+	}
+
+	memset(chan, 0, sizeof(*chan));
+
+	if (!(chan->id = id_get(chan_id)))
+	{
+		goto fail;
+	}
+
+	chan->conf = conf;
+	chan->hash = hash_chan(conf->id, chan->id);
+
+	if (table_insert(&chans, chan->hash, chan) != 0)
+	{
+		id_put(chan->id);
+		goto fail;
+	}
+
+	chan->next = conf->chans;
+	if (chan->next)
+	{
+		chan->next->prev = chan;
+	}
+	conf->chans = chan;
+	conf->num_chans++;
+
+	return chan;
+
+fail:
+	if (chan)
+	{
+		chan->next = chan_pool;
+		chan_pool = chan;
+	}
+	if (!conf->num_chans)
+	{
+		conf_free(conf);
+	}
+	return NULL;
+}
+
+/* Responses may come back out of order, a setting is not replaced by one sent before it. */
+static int setting_newer(const struct state_chan *chan, int set, enum state_setting setting, unsigned int seq)
+{
+	return !set || (int)(seq - chan->applied_seq[setting]) > 0;
+}
+
+void state_reset(void)
+{
+	struct state_conf *conf;
+	struct state_chan *chan;
+	struct state_id *id;
+	unsigned int i;
+
+	pthread_rwlock_wrlock(&state_lock);
+
+	/* The channels still in the table give back the strings of their port, the free ones hold none. */
+	for (i = 0; chans.slots && i <= chans.mask; i++)
+	{
+		if ((chan = chans.slots[i].entry))
+		{
+			port_strs_release(&chan->st);
+		}
+	}
+
+	table_free(&chans);
+	table_free(&confs);
+	table_free(&ids);
+
+	while ((chan = chan_pool))
+	{
+		chan_pool = chan->next;
+		heap_free(chan);
+	}
+
+	while ((conf = conf_pool))
+	{
+		conf_pool = conf->next_free;
+		heap_free(conf);
+	}
+
+	for (i = 0; i < ID_CLASSES; i++)
+	{
+		while ((id = id_pool[i]))
+		{
+			id_pool[i] = id->next_free;
+			heap_free(id);
+		}
+	}
+
+	pthread_rwlock_unlock(&state_lock);
+}
+
+void state_port_add(const char *conf_id, const char *chan_id, const struct avs_chan_state *port)
+{
+	struct state_chan *chan;
+
+	pthread_rwlock_wrlock(&state_lock);
+
+	if ((chan = chan_get(conf_id, chan_id)))
+	{
+		port_strs_release(&chan->st);
+		memset(&chan->st, 0, sizeof(chan->st));
+		memset(chan->applied, 0, sizeof(chan->applied));
+		memset(chan->applied_seq, 0, sizeof(chan->applied_seq));
+		chan->st.mode = port->mode;
+		chan->st.port_id = port->port_id;
+		chan->st.rtp_port = port->rtp_port;
+		chan->st.rtcp_port = port->rtcp_port;
+		chan->st.fingerprint = port->fingerprint;
+		chan->st.ice_ufrag = port->ice_ufrag;
+		chan->st.ice_pwd = port->ice_pwd;
+	}
+	else
+	{
+		port_strs_release(port);
+	}
+
+	pthread_rwlock_unlock(&state_lock);
+}
+
+void state_port_del(const char *conf_id, const char *chan_id, const char *port_id)
+{
+	struct state_chan *chan;
+
+	pthread_rwlock_wrlock(&state_lock);
+
+	if ((chan = chan_find_port(conf_id, chan_id, port_id)))
+	{
+		chan_free(chan);
+	}
+
+	pthread_rwlock_unlock(&state_lock);
+}
+
+void state_chan_del(const char *conf_id, const char *chan_id)
+{
+	struct state_chan *chan;
+
+	pthread_rwlock_wrlock(&state_lock);
+
+	if ((chan = chan_find(conf_id, chan_id)))
+	{
+		chan_free(chan);
+	}
+
+	pthread_rwlock_unlock(&state_lock);
+}
+
+struct state_chan_ref *state_conf_chans(const char *conf_id, struct arena *arena, unsigned int *num)
+{
+	struct state_chan_ref *refs = NULL;
+	struct state_conf *conf;
+	struct state_chan *chan;
+	struct state_id *id;
+	const char *port;
+	unsigned int i = 0;
+
+	*num = 0;
+
+	pthread_rwlock_rdlock(&state_lock);
+
+	if ((id = id_find(conf_id)) && (conf = table_find(&confs, id->hash, match_conf, id)))
+	{
+		if ((refs = arena_alloc(arena, conf->num_chans * sizeof(*refs))))
+		{
+			for (chan = conf->chans; chan; chan = chan->next, i++)
+			{
+				snprintf(refs[i].chan_id, sizeof(refs[i].chan_id), "%s", chan->id->str);
+				port = avs_id_str(chan->st.port_id);
+				snprintf(refs[i].port_id, sizeof(refs[i].port_id), "%s", port ? port : "");
+			}
+			*num = i;
+		}
+		else
+		{
+			log_err("Malloc state channel list failed\n");
+		}
+	}
+
+	pthread_rwlock_unlock(&state_lock);
+
+	return refs;
+}
+
+void state_peer_set(const char *conf_id, const char *chan_id, const char *port_id, unsigned int hash, unsigned int seq)
+{
+	struct state_chan *chan;
+
+	pthread_rwlock_wrlock(&state_lock);
+
+	if ((chan = chan_find_port(conf_id, chan_id, port_id)) && setting_newer(chan, chan->st.peer_set, STATE_SETTING_PEER, seq))
+	{
+		chan->st.peer_set = 1;
+		chan->applied[STATE_SETTING_PEER] = hash;
+		chan->applied_seq[STATE_SETTING_PEER] = seq;
+	}
+
+	pthread_rwlock_unlock(&state_lock);
+}
+
+void state_audio_set(const char *conf_id, const char *chan_id, const char *port_id,
+	enum avs_audio_codec codec, unsigned int payloadtype, unsigned int transmode, unsigned int ptime, unsigned int hash, unsigned int seq)
+{
+	struct state_chan *chan;
+
+	pthread_rwlock_wrlock(&state_lock);
+
+	if ((chan = chan_find_port(conf_id, chan_id, port_id)) && setting_newer(chan, chan->st.audio_set, STATE_SETTING_AUDIO, seq))
+	{
+		chan->st.audio_set = 1;
+		chan->st.a_codec = codec;
+		chan->st.audio_payloadtype = payloadtype;
+		chan->st.audio_transmode = transmode;
+		chan->st.ptime = ptime;
+		chan->applied[STATE_SETTING_AUDIO] = hash;
+		chan->applied_seq[STATE_SETTING_AUDIO] = seq;
+	}
+
+	pthread_rwlock_unlock(&state_lock);
+}
+
+void state_media_suspend(const char *conf_id, const char *chan_id, enum avs_runctrl_chan_mtype mtype, int suspended)
+{
+	struct state_chan *chan;
+
+	pthread_rwlock_wrlock(&state_lock);
+
+	if ((chan = chan_find(conf_id, chan_id)))
+	{
+		if (AVS_RUNCTRL_CHAN_TYPE_VIDEO != mtype)
+		{
+			chan->st.audio_suspended = !!suspended;
+		}
+		if (AVS_RUNCTRL_CHAN_TYPE_AUDIO != mtype)
+		{
+			chan->st.video_suspended = !!suspended;
+		}
+	}
+
+	pthread_rwlock_unlock(&state_lock);
+}
+
+void state_video_set(const char *conf_id, const char *chan_id, const char *port_id,
+	enum avs_video_codec codec, unsigned int payloadtype, unsigned int transmode, unsigned int hash, unsigned int seq)
+{
+	struct state_chan *chan;
+
+	pthread_rwlock_wrlock(&state_lock);
+
+	if ((chan = chan_find_port(conf_id, chan_id, port_id)) && setting_newer(chan, chan->st.video_set, STATE_SETTING_VIDEO, seq))
+	{
+		chan->st.video_set = 1;
+		chan->st.v_codec = codec;
+		chan->st.video_payloadtype = payloadtype;
+		chan->st.video_transmode = transmode;
+		chan->applied[STATE_SETTING_VIDEO] = hash;
+		chan->applied_seq[STATE_SETTING_VIDEO] = seq;
+	}
+
+	pthread_rwlock_unlock(&state_lock);
+}
+
+int state_setting_applied(const char *conf_id, const char *chan_id, const char *port_id, enum state_setting setting, unsigned int hash)
+{
+	struct state_chan *chan;
+	int applied = 0;
+
+	pthread_rwlock_rdlock(&state_lock);
+
+	if ((chan = chan_find_port(conf_id, chan_id, port_id)))
+	{
+		switch (setting)
+		{
+			case STATE_SETTING_PEER:
+				applied = chan->st.peer_set && chan->applied[setting] == hash;
+				break;
+
+			case STATE_SETTING_AUDIO:
+				applied = chan->st.audio_set && chan->applied[setting] == hash;
+				break;
+
+			case STATE_SETTING_VIDEO:
+				applied = chan->st.video_set && chan->applied[setting] == hash;
+				break;
+
+			default:
+				break;
+		}
+	}
+
+	pthread_rwlock_unlock(&state_lock);
+
+	return applied;
+}
+
+AVS_CMD_RESULT avs_query_chan(const char *conf_id, const char *chan_id, struct avs_chan_state *state)
+{
+	struct state_chan *chan;
+
+	if (!conf_id || !chan_id || !state)
+	{
+		return ERROR;
+	}
+
+	pthread_rwlock_rdlock(&state_lock);
+
+	if ((chan = chan_find(conf_id, chan_id)))
+	{
+		*state = chan->st;
+		avs_id_hold(state->port_id);
+		avs_id_hold(state->fingerprint);
+		avs_id_hold(state->ice_ufrag);
+		avs_id_hold(state->ice_pwd);
+	}
+
+	pthread_rwlock_unlock(&state_lock);
+
+	return chan ? SUCCESS : ERROR;
+}
+
+void avs_chan_state_release(struct avs_chan_state *state)
+{
+	port_strs_release(state);
+	state->port_id.id = state->port_id.len = 0;
+	state->fingerprint.id = state->fingerprint.len = 0;
+	state->ice_ufrag.id = state->ice_ufrag.len = 0;
+	state->ice_pwd.id = state->ice_pwd.len = 0;
+}
+
+AVS_CMD_RESULT avs_query_conference(const char *conf_id, unsigned int *num_chans)
+{
+	struct state_conf *conf = NULL;
+	struct state_id *id;
+
+	if (!conf_id || !num_chans)
+	{
+		return ERROR;
+	}
+
+	pthread_rwlock_rdlock(&state_lock);
+
+	if ((id = id_find(conf_id)) && (conf = table_find(&confs, id->hash, match_conf, id)))
+	{
+		*num_chans = conf->num_chans;
+	}
+
+	pthread_rwlock_unlock(&state_lock);
+
+	return conf ? SUCCESS : ERROR;
+}
@@ -0,0 +1,124 @@
+/****************************************************************************
+ *
+ * Multiedia Controller Module(MCM).
+ *
+ * Copyright (c) 2017 by Grandstream Networks, Inc.
+ * All rights reserved.
+ *
+ * This material is proprietary to Grandstream Networks, Inc. and,
+ * in addition to the above mentioned Copyright, may be
+ * subject to protection under other intellectual property
+ * regimes, including patents, trade secrets, designs and/or
+ * trademarks.
+ *
+ * Any use of this material for any purpose, except with an
+ * express license from Grandstream Networks, Inc. is strictly
+ * prohibited.
+ *
+ *
+ * \brief Index of the conferences, channels and ports known to AVS.
+ *
+ *	Only the receiving thread updates it, from the responses of AVS.
+ *  Any thread may query it through avs_query_chan() and
+ *  avs_query_conference().
+ *
+ ***************************************************************************/
+
+#ifndef AVS_STATE_H
+#define AVS_STATE_H
+
+#include "avs_controller.h"
+#include "avs_arena.h"
+
+/* Settings of a port which are remembered to skip sending them again. */
+enum state_setting
+{
+	STATE_SETTING_NONE,
+	STATE_SETTING_PEER,
+	STATE_SETTING_AUDIO,
+	STATE_SETTING_VIDEO,
+	STATE_SETTING_MAX
+};
+
+/* A channel of a conference and its port, see state_conf_chans(). */
+struct state_chan_ref
+{
+	char chan_id[MAX_CHANID_LEN];
+	char port_id[MAX_PORTID_LEN];
+};
+
+/**
+ * state_reset - Forget all the conferences, e.g. when the connection is created or shut down.
+ */
+void state_reset(void);
+
+/**
+ * state_port_add - A port has been allocated to a channel. It replaces the previous port of the channel.
+ * @conf_id:  Conference id.
+ * @chan_id:  Channel id.
+ * @port:  Mode and members of the port, the "_set" flags and codecs are ignored. The references to its strings are taken over,
+ *   they are dropped with the port.
+ */
+void state_port_add(const char *conf_id, const char *chan_id, const struct avs_chan_state *port);
+
+/**
+ * state_port_del - A port has been released. The channel, and the conference once it has no channel, are removed.
+ * @port_id:  Port released, nothing is done if the channel uses another one.
+ */
+void state_port_del(const char *conf_id, const char *chan_id, const char *port_id);
+
+/**
+ * state_chan_del - A channel has been reset, it is removed with its port. The conference is removed once it has no channel.
+ */
+void state_chan_del(const char *conf_id, const char *chan_id);
+
+/**
+ * state_conf_chans - Take a copy of the channels of a conference.
+ * @conf_id:  Conference id.
+ * @arena:  Arena the copy is carved out of, it is released with it.
+ * @num:  Output, number of channels.
+ *
+ * Return: The channels. NULL if the conference has no channel or the allocation failed.
+ */
+struct state_chan_ref *state_conf_chans(const char *conf_id, struct arena *arena, unsigned int *num);
+
+/**
+ * state_peer_set - Peer port parameters have been set to the port of a channel.
+ * @hash:  Hash of the parameters, see state_setting_applied().
+ * @seq:  Sequence of the command in sending order. Nothing is done if a later command already set it.
+ */
+void state_peer_set(const char *conf_id, const char *chan_id, const char *port_id, unsigned int hash, unsigned int seq);
+
+/**
+ * state_audio_set - Audio codec has been set to the port of a channel.
+ * @hash:  Hash of the parameters, see state_setting_applied().
+ * @seq:  Sequence of the command, see state_peer_set().
+ */
+void state_audio_set(const char *conf_id, const char *chan_id, const char *port_id,
+	enum avs_audio_codec codec, unsigned int payloadtype, unsigned int transmode, unsigned int ptime, unsigned int hash, unsigned int seq);
+
+/**
+ * state_video_set - Video codec has been set to the port of a channel.
+ * @hash:  Hash of the parameters, see state_setting_applied().
+ * @seq:  Sequence of the command, see state_peer_set().
+ */
+void state_video_set(const char *conf_id, const char *chan_id, const char *port_id,
+	enum avs_video_codec codec, unsigned int payloadtype, unsigned int transmode, unsigned int hash, unsigned int seq);
+
+/**
+ * state_media_suspend - Media of a channel has been suspended or resumed by runctrl.
+ * @mtype:  Audio, video or both.
+ * @suspended:  1 when suspended, 0 when resumed.
+ */
+void state_media_suspend(const char *conf_id, const char *chan_id, enum avs_runctrl_chan_mtype mtype, int suspended);
+
+/**
+ * state_setting_applied - Whether the last setting AVS accepted for a port had the same parameters.
+ * @setting:  Which setting.
+ * @hash:  Hash of the parameters, given to state_peer_set()/state_audio_set()/state_video_set() when they were accepted.
+ *
+ * Return: 1 if the channel still uses the port and its setting has @hash, otherwise 0.
+ */
+int state_setting_applied(const char *conf_id, const char *chan_id, const char *port_id, enum state_setting setting, unsigned int hash);
+
+#endif /* AVS_STATE_H */
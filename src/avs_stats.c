@@ -0,0 +1,328 @@
+/****************************************************************************
+ *
+ * Multiedia Controller Module(MCM).
+ *
+ * Copyright (c) 2017 by Grandstream Networks, Inc.
+ * All rights reserved.
+ *
+ * This material is proprietary to Grandstream Networks, Inc. and,
+ * in addition to the above mentioned Copyright, may be
+ * subject to protection under other intellectual property
+ * regimes, including patents, trade secrets, designs and/or
+ * trademarks.
+ *
+ * Any use of this material for any purpose, except with an
+ * express license from Grandstream Networks, Inc. is strictly
+ * prohibited.
+ *
+ *
+ * \brief Statistics of the commands sent to AVS.
+ *
+ *	Latencies go to log-linear buckets like HdrHistogram: the bucket of a
+ *  value is found from its highest set bit and the AVS_HIST_SUB_BITS bits
+ *  below it, without any search.
+ *
+ ***************************************************************************/
+
+#include <string.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <time.h>
+#include "avs_stats.h"
+
+#define HIST_SUB_COUNT		(1u << AVS_HIST_SUB_BITS)
+
+static struct avs_stats stats;	/* "io" is not used, the controller fills it. */
+
+static const char *cmd_type_names[AVS_CMD_MAX] = {
+	[AVS_CMD_SET_GLOBAL_PARAM] = "set_global_param",
+	[AVS_CMD_ALLOC_PORT_NORMAL] = "alloc_port_normal",
+	[AVS_CMD_ALLOC_PORT_ICE] = "alloc_port_ice",
+	[AVS_CMD_DEALLOC_PORT] = "dealloc_port",
+	[AVS_CMD_SET_PEERPORT_PARAM_NORMAL] = "set_peerport_normal",
+	[AVS_CMD_SET_PEERPORT_PARAM_ICE] = "set_peerport_ice",
+	[AVS_CMD_SET_AUDIO_CODEC_PARAM] = "set_audio_codec",
+	[AVS_CMD_SET_VIDEO_CODEC_PARAM] = "set_video_codec",
+	[AVS_CMD_RUNCTRL_CHAN] = "runctrl_chan",
+	[AVS_CMD_PLAYSOUND] = "playsound",
+};
+
+/* Bucket of a value. Values over 32 bits go to the last bucket. */
+static unsigned int hist_index(uint64_t v)
+{
+	unsigned int e;
+
+	if (v > UINT32_MAX)
+	{
+		v = UINT32_MAX;
+	}
+
+	if (v < HIST_SUB_COUNT)
+	{
+		return (unsigned int)v;
+	}
+
+	/* "e" low bits are dropped, the AVS_HIST_SUB_BITS + 1 remaining ones select the bucket. */
+	e = (31 - __builtin_clz((unsigned int)v)) - AVS_HIST_SUB_BITS;
+
+	return ((e + 1) << AVS_HIST_SUB_BITS) + (unsigned int)(v >> e) - HIST_SUB_COUNT;
+}
+
+/* Largest value which goes to a bucket. */
+static uint64_t hist_highest(unsigned int idx)
+{
+	unsigned int e;
+
+	if (idx < HIST_SUB_COUNT)
+	{
+		return idx;
+	}
+
+	e = (idx >> AVS_HIST_SUB_BITS) - 1;
+
+	return ((uint64_t)((idx & (HIST_SUB_COUNT - 1)) + HIST_SUB_COUNT) << e) + ((uint64_t)1 << e) - 1;
+}
+
+static void counter_add(unsigned long *c, unsigned long n)
+{
+	__atomic_fetch_add(c, n, __ATOMIC_RELAXED);
+}
+
+static void counter_max(unsigned long *c, unsigned long n)
+{
+	unsigned long old = __atomic_load_n(c, __ATOMIC_RELAXED);
+
+	while (n > old && !__atomic_compare_exchange_n(c, &old, n, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+	{
+	}
+}
+
+static unsigned long counter_get(const unsigned long *c)
+{
+	return __atomic_load_n(c, __ATOMIC_RELAXED);
+}
+
+void stats_reset(void)
+{
+	memset(&stats, 0, sizeof(stats));
+}
+
+uint64_t stats_now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+void stats_record_latency(unsigned int type, uint64_t us)
+{
+	struct avs_latency_hist *hist;
+
+	if (type >= AVS_CMD_MAX)
+	{
+		return;
+	}
+
+	hist = &stats.latency[type];
+	counter_add(&hist->buckets[hist_index(us)], 1);
+	counter_add(&hist->sum_us, (unsigned long)us);
+	counter_max(&hist->max_us, (unsigned long)us);
+	counter_add(&hist->count, 1);
+}
+
+void stats_count_timeout(unsigned int type)
+{
+	if (type < AVS_CMD_MAX)
+	{
+		counter_add(&stats.timeouts[type], 1);
+	}
+}
+
+void stats_count_parse_failure(void)
+{
+	counter_add(&stats.parse_failures, 1);
+}
+
+void stats_count_suppressed(void)
+{
+	counter_add(&stats.suppressed, 1);
+}
+
+void stats_count_coalesced(void)
+{
+	counter_add(&stats.coalesced, 1);
+}
+
+void stats_count_alloc(void)
+{
+	counter_add(&stats.heap_allocs, 1);
+}
+
+void stats_count_free(void)
+{
+	counter_add(&stats.heap_frees, 1);
+}
+
+void stats_add_bytes(size_t out, size_t in)
+{
+	if (out)
+	{
+		counter_add(&stats.bytes_out, out);
+	}
+
+	if (in)
+	{
+		counter_add(&stats.bytes_in, in);
+	}
+}
+
+void stats_set_in_flight(unsigned long n)
+{
+	__atomic_store_n(&stats.in_flight, n, __ATOMIC_RELAXED);
+	counter_max(&stats.in_flight_max, n);
+}
+
+void stats_snapshot(struct avs_stats *out)
+{
+	unsigned int t, i;
+
+	for (t = 0; t < AVS_CMD_MAX; t++)
+	{
+		out->latency[t].count = counter_get(&stats.latency[t].count);
+		out->latency[t].sum_us = counter_get(&stats.latency[t].sum_us);
+		out->latency[t].max_us = counter_get(&stats.latency[t].max_us);
+
+		for (i = 0; i < AVS_HIST_BUCKETS; i++)
+		{
+			out->latency[t].buckets[i] = counter_get(&stats.latency[t].buckets[i]);
+		}
+
+		out->timeouts[t] = counter_get(&stats.timeouts[t]);
+	}
+
+	out->parse_failures = counter_get(&stats.parse_failures);
+	out->bytes_out = counter_get(&stats.bytes_out);
+	out->bytes_in = counter_get(&stats.bytes_in);
+	out->in_flight = counter_get(&stats.in_flight);
+	out->in_flight_max = counter_get(&stats.in_flight_max);
+	out->suppressed = counter_get(&stats.suppressed);
+	out->coalesced = counter_get(&stats.coalesced);
+	out->heap_allocs = counter_get(&stats.heap_allocs);
+	out->heap_frees = counter_get(&stats.heap_frees);
+}
+
+unsigned long avs_stats_percentile(const struct avs_latency_hist *hist, double percentile)
+{
+	unsigned long total = 0, rank, seen = 0;
+	double r;
+	uint64_t v;
+	unsigned int i;
+
+	/* Count the buckets rather than trusting "count", a snapshot may be taken between the two updates. */
+	for (i = 0; i < AVS_HIST_BUCKETS; i++)
+	{
+		total += hist->buckets[i];
+	}
+
+	if (!total)
+	{
+		return 0;
+	}
+
+	if (percentile < 0)
+	{
+		percentile = 0;
+	}
+	else if (percentile > 100)
+	{
+		percentile = 100;
+	}
+
+	/* Rank of the value, 1 based: the smallest value which is not below "percentile" percent of them. */
+	r = percentile / 100 * total;
+	rank = (unsigned long)r;
+	if (rank < r || rank < 1)
+	{
+		rank++;
+	}
+
+	for (i = 0; i < AVS_HIST_BUCKETS; i++)
+	{
+		seen += hist->buckets[i];
+		if (seen >= rank)
+		{
+			break;
+		}
+	}
+
+	v = hist_highest(i < AVS_HIST_BUCKETS ? i : AVS_HIST_BUCKETS - 1);
+
+	return (hist->max_us && v > hist->max_us) ? hist->max_us : (unsigned long)v;
+}
+
+/* snprintf() at the end of the text, it keeps counting the length once "buf" is full. */
+static void dump_printf(char *buf, unsigned long size, int *len, const char *fmt, ...)
+{
+	va_list ap;
+	unsigned long at = (unsigned long)*len;
+	int n;
+
+	va_start(ap, fmt);
+	n = vsnprintf(buf + (at < size ? at : size), at < size ? size - at : 0, fmt, ap);
+	va_end(ap);
+
+	if (n > 0)
+	{
+		*len += n;
+	}
+}
+
+int avs_stats_dump(const struct avs_stats *s, char *buf, unsigned long size)
+{
+	const struct avs_latency_hist *h;
+	unsigned int t;
+	int len = 0;
+
+	if (!s || (!buf && size))
+	{
+		return -1;
+	}
+
+	if (size)
+	{
+		buf[0] = '\0';
+	}
+
+	dump_printf(buf, size, &len, "%-20s %10s %8s %9s %9s %9s %9s %9s\n",
+		"command(us)", "count", "timeout", "mean", "p50", "p99", "p999", "max");
+
+	for (t = 0; t < AVS_CMD_MAX; t++)
+	{
+		h = &s->latency[t];
+
+		if (!h->count && !s->timeouts[t])
+		{
+			continue;
+		}
+
+		dump_printf(buf, size, &len, "%-20s %10lu %8lu %9lu %9lu %9lu %9lu %9lu\n",
+			cmd_type_names[t], h->count, s->timeouts[t], h->count ? h->sum_us / h->count : 0,
+			avs_stats_percentile(h, 50), avs_stats_percentile(h, 99), avs_stats_percentile(h, 99.9), h->max_us);
+	}
+
+	dump_printf(buf, size, &len, "parse_failures %lu\n", s->parse_failures);
+	dump_printf(buf, size, &len, "bytes_out %lu bytes_in %lu\n", s->bytes_out, s->bytes_in);
+	dump_printf(buf, size, &len, "in_flight %lu in_flight_max %lu\n", s->in_flight, s->in_flight_max);
+	dump_printf(buf, size, &len, "suppressed %lu coalesced %lu\n", s->suppressed, s->coalesced);
+	dump_printf(buf, size, &len, "heap_allocs %lu heap_frees %lu\n", s->heap_allocs, s->heap_frees);
+	dump_printf(buf, size, &len, "tx_msgs %lu tx_batches %lu tx_max_batch %lu tx_retries %lu tx_queue_full %lu\n",
+		s->io.tx_msgs, s->io.tx_batches, s->io.tx_max_batch, s->io.tx_retries, s->io.tx_queue_full);
+	dump_printf(buf, size, &len, "rx_msgs %lu rx_batches %lu rx_max_batch %lu rx_events %lu rx_events_dropped %lu rx_truncated %lu\n",
+		s->io.rx_msgs, s->io.rx_batches, s->io.rx_max_batch, s->io.rx_events, s->io.rx_events_dropped, s->io.rx_truncated);
+	dump_printf(buf, size, &len, "transport %s tx_bells %lu wire %s\n", AVS_TRANSPORT_SHM == s->io.transport ? "shm" : "socket", s->io.tx_bells,
+		AVS_WIRE_TLV == s->io.wire ? "tlv" : "json");
+
+	return len;
+}
@@ -0,0 +1,99 @@
+/****************************************************************************
+ *
+ * Multiedia Controller Module(MCM).
+ *
+ * Copyright (c) 2017 by Grandstream Networks, Inc.
+ * All rights reserved.
+ *
+ * This material is proprietary to Grandstream Networks, Inc. and,
+ * in addition to the above mentioned Copyright, may be
+ * subject to protection under other intellectual property
+ * regimes, including patents, trade secrets, designs and/or
+ * trademarks.
+ *
+ * Any use of this material for any purpose, except with an
+ * express license from Grandstream Networks, Inc. is strictly
+ * prohibited.
+ *
+ *
+ * \brief Statistics of the commands sent to AVS.
+ *
+ *	Every counter is updated by a relaxed atomic add, so recording costs
+ *  a few instructions and never takes a lock. avs_get_stats() reads them
+ *  the same way while they are being updated.
+ *
+ ***************************************************************************/
+
+#ifndef AVS_STATS_H
+#define AVS_STATS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "avs_controller.h"
+
+/**
+ * stats_reset - Clear all the statistics, e.g. when the connection is created.
+ */
+void stats_reset(void);
+
+/**
+ * stats_now_us - Current time of CLOCK_MONOTONIC in microseconds, the time base of the latencies.
+ */
+uint64_t stats_now_us(void);
+
+/**
+ * stats_record_latency - Record the latency of a command which got its response.
+ * @type:  enum avs_cmd_type of the command, others are ignored.
+ * @us:  Microseconds from sending it to receiving the response.
+ */
+void stats_record_latency(unsigned int type, uint64_t us);
+
+/**
+ * stats_count_timeout - Count a command AVS did not respond to in time.
+ * @type:  enum avs_cmd_type of the command, others are ignored.
+ */
+void stats_count_timeout(unsigned int type);
+
+/**
+ * stats_count_parse_failure - Count a message from AVS which could not be decoded.
+ */
+void stats_count_parse_failure(void);
+
+/**
+ * stats_count_suppressed - Count a setting completed without sending it.
+ */
+void stats_count_suppressed(void);
+
+/**
+ * stats_count_coalesced - Count a setting not sent because a newer one replaced it.
+ */
+void stats_count_coalesced(void);
+
+/**
+ * stats_count_alloc - Count a heap allocation, see heap_alloc().
+ */
+void stats_count_alloc(void);
+
+/**
+ * stats_count_free - Count a heap block given back, see heap_free().
+ */
+void stats_count_free(void);
+
+/**
+ * stats_add_bytes - Count bytes exchanged with AVS.
+ * @out:  Bytes sent.
+ * @in:  Bytes received.
+ */
+void stats_add_bytes(size_t out, size_t in);
+
+/**
+ * stats_set_in_flight - Update the number of commands waiting for AVS responses.
+ */
+void stats_set_in_flight(unsigned long n);
+
+/**
+ * stats_snapshot - Copy the statistics, except "io" which belongs to the caller.
+ */
+void stats_snapshot(struct avs_stats *stats);
+
+#endif /* AVS_STATS_H */
@@ -0,0 +1,168 @@
+/****************************************************************************
+ *
+ * Multiedia Controller Module(MCM).
+ *
+ * Copyright (c) 2017 by Grandstream Networks, Inc.
+ * All rights reserved.
+ *
+ * This material is proprietary to Grandstream Networks, Inc. and,
+ * in addition to the above mentioned Copyright, may be
+ * subject to protection under other intellectual property
+ * regimes, including patents, trade secrets, designs and/or
+ * trademarks.
+ *
+ * Any use of this material for any purpose, except with an
+ * express license from Grandstream Networks, Inc. is strictly
+ * prohibited.
+ *
+ *
+ * \brief Hashed timer wheel of millisecond deadlines.
+ *
+ *	A timer sits in the slot of its deadline tick modulo the wheel size.
+ *  Expiring walks the ticks from the last one expired up to now, and
+ *  takes the timers of each slot whose deadline has come; timers of a
+ *  later lap stay in the slot.
+ *
+ ***************************************************************************/
+
+#include <string.h>
+#include <time.h>
+#include "avs_timer.h"
+
+#define SLOT_MASK		(TIMER_WHEEL_SLOTS - 1)
+
+uint64_t wheel_now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+void wheel_init(struct timer_wheel *w, uint64_t now)
+{
+	memset(w->slots, 0, sizeof(w->slots));
+	w->now = now;
+	w->count = 0;
+}
+
+void wheel_add(struct timer_wheel *w, struct timer_node *node, uint64_t expires)
+{
+	struct timer_node **slot;
+
+	node->expires = expires;
+
+	/* A deadline which has passed goes to the current tick, which the next expiry visits first. */
+	slot = &w->slots[(expires > w->now ? expires : w->now) & SLOT_MASK];
+
+	node->next = *slot;
+	if (node->next)
+	{
+		node->next->pprev = &node->next;
+	}
+	node->pprev = slot;
+	*slot = node;
+
+	w->count++;
+}
+
+void wheel_del(struct timer_wheel *w, struct timer_node *node)
+{
+	if (!node->pprev)
+	{
+		return;
+	}
+
+	*node->pprev = node->next;
+	if (node->next)
+	{
+		node->next->pprev = node->pprev;
+	}
+
+	node->next = NULL;
+	node->pprev = NULL;
+	w->count--;
+}
+
+struct timer_node *wheel_expire(struct timer_wheel *w, uint64_t now)
+{
+	struct timer_node *node;
+
+	if (!w->count)
+	{
+		if (now > w->now)
+		{
+			w->now = now;
+		}
+		return NULL;
+	}
+
+	/* After a long sleep one lap visits every slot, there is no need to walk the others. */
+	if (now > w->now + TIMER_WHEEL_SLOTS)
+	{
+		w->now = now - TIMER_WHEEL_SLOTS;
+	}
+
+	for (;;)
+	{
+		for (node = w->slots[w->now & SLOT_MASK]; node; node = node->next)
+		{
+			if (node->expires <= now)
+			{
+				wheel_del(w, node);
+				return node;
+			}
+		}
+
+		if (w->now >= now)
+		{
+			return NULL;
+		}
+
+		w->now++;
+	}
+}
+
+uint64_t wheel_next(const struct timer_wheel *w)
+{
+	const struct timer_node *node;
+	uint64_t tick, next = 0;
+	unsigned int i;
+
+	if (!w->count)
+	{
+		return 0;
+	}
+
+	/* Timers due within one lap are found at the slot of their tick, the first slot holding one has the earliest. */
+	for (tick = w->now; tick < w->now + TIMER_WHEEL_SLOTS; tick++)
+	{
+		for (node = w->slots[tick & SLOT_MASK]; node; node = node->next)
+		{
+			if (node->expires <= tick && (!next || node->expires < next))
+			{
+				next = node->expires;
+			}
+		}
+
+		if (next)
+		{
+			return next;
+		}
+	}
+
+	/* All of them are in later laps. */
+	for (i = 0; i < TIMER_WHEEL_SLOTS; i++)
+	{
+		for (node = w->slots[i]; node; node = node->next)
+		{
+			if (!next || node->expires < next)
+			{
+				next = node->expires;
+			}
+		}
+	}
+
+	return next;
+}
@@ -0,0 +1,102 @@
+/****************************************************************************
+ *
+ * Multiedia Controller Module(MCM).
+ *
+ * Copyright (c) 2017 by Grandstream Networks, Inc.
+ * All rights reserved.
+ *
+ * This material is proprietary to Grandstream Networks, Inc. and,
+ * in addition to the above mentioned Copyright, may be
+ * subject to protection under other intellectual property
+ * regimes, including patents, trade secrets, designs and/or
+ * trademarks.
+ *
+ * Any use of this material for any purpose, except with an
+ * express license from Grandstream Networks, Inc. is strictly
+ * prohibited.
+ *
+ *
+ * \brief Hashed timer wheel of millisecond deadlines.
+ *
+ *	Times are milliseconds of CLOCK_MONOTONIC, so stepping the wall clock
+ *  does not move deadlines. Adding and deleting a timer is O(1), expiring
+ *  visits the slots of the elapsed ticks only. The wheel is not locked,
+ *  it belongs to one thread.
+ *
+ ***************************************************************************/
+
+#ifndef AVS_TIMER_H
+#define AVS_TIMER_H
+
+#include <stdint.h>
+
+#define TIMER_WHEEL_SLOTS	512	/* Ticks of one lap, must be a power of 2. Later deadlines wait for their lap in the slot. */
+
+/**
+ * struct timer_node - A timer, embedded in the object it times.
+ * @expires:  Deadline in milliseconds.
+ * @next:  Next timer in the same slot.
+ * @pprev:  Link pointing to this timer, NULL if the timer is not in a wheel.
+ */
+struct timer_node
+{
+	uint64_t expires;
+	struct timer_node *next;
+	struct timer_node **pprev;
+};
+
+/**
+ * struct timer_wheel - The wheel.
+ * @slots:  Timers whose deadline falls on the tick of the slot, in any lap.
+ * @now:  Tick up to which the timers have been expired.
+ * @count:  Timers in the wheel.
+ */
+struct timer_wheel
+{
+	struct timer_node *slots[TIMER_WHEEL_SLOTS];
+	uint64_t now;
+	unsigned int count;
+};
+
+/**
+ * wheel_now_ms - Current time of CLOCK_MONOTONIC in milliseconds, the time base of the wheel.
+ */
+uint64_t wheel_now_ms(void);
+
+/**
+ * wheel_init - Empty the wheel.
+ * @w:  The wheel.
+ * @now:  Current time, wheel_now_ms().
+ */
+void wheel_init(struct timer_wheel *w, uint64_t now);
+
+/**
+ * wheel_add - Start a timer which is not in the wheel.
+ * @w:  The wheel.
+ * @node:  The timer.
+ * @expires:  Deadline. A deadline which has passed expires at the next wheel_expire().
+ */
+void wheel_add(struct timer_wheel *w, struct timer_node *node, uint64_t expires);
+
+/**
+ * wheel_del - Stop a timer. Nothing is done if it is not in the wheel.
+ */
+void wheel_del(struct timer_wheel *w, struct timer_node *node);
+
+/**
+ * wheel_expire - Take one timer whose deadline has come, call it until NULL is returned.
+ * @w:  The wheel.
+ * @now:  Current time.
+ *
+ * Return: The timer, removed from the wheel. NULL if none has expired.
+ */
+struct timer_node *wheel_expire(struct timer_wheel *w, uint64_t now);
+
+/**
+ * wheel_next - Earliest deadline, to sleep until. Only valid after wheel_expire() returned NULL.
+ *
+ * Return: The deadline, 0 if the wheel is empty.
+ */
+uint64_t wheel_next(const struct timer_wheel *w);
+
+#endif /* AVS_TIMER_H */
@@ -0,0 +1,552 @@
+/****************************************************************************
+ *
+ * Multiedia Controller Module(MCM).
+ *
+ * Copyright (c) 2017 by Grandstream Networks, Inc.
+ * All rights reserved.
+ *
+ * This material is proprietary to Grandstream Networks, Inc. and,
+ * in addition to the above mentioned Copyright, may be
+ * subject to protection under other intellectual property
+ * regimes, including patents, trade secrets, designs and/or
+ * trademarks.
+ *
+ * Any use of this material for any purpose, except with an
+ * express license from Grandstream Networks, Inc. is strictly
+ * prohibited.
+ *
+ *
+ * \brief Binary TLV encoding of the commands sent to AVS and their responses.
+ *
+ *	Like avs_json_enc.c, frames are written straight into the buffer of
+ *  the caller. Numbers are copied as they are, no text conversion is done
+ *  on either side.
+ *
+ ***************************************************************************/
+
+#include <string.h>
+#include <stdio.h>
+#include "avs_tlv.h"
+#include "avs_json_enc.h"
+#include "avs_log.h"
+
+#define TLV_MAX_VALUE		0xFFFF
+
+/* Output cursor of the encoder. */
+struct tlv_writer
+{
+	char *buf;
+	size_t size;
+	size_t len;
+	int error;	/* Set once the buffer overflows. */
+};
+
+/* Start a frame with its header. */
+static void tw_init(struct tlv_writer *w, char *buf, size_t size, enum tlv_method method)
+{
+	w->buf = buf;
+	w->size = size;
+	w->len = TLV_HDR_LEN;
+	w->error = (size < TLV_HDR_LEN);
+
+	if (!w->error)
+	{
+		buf[0] = (char)TLV_MAGIC;
+		buf[1] = TLV_VERSION;
+		buf[2] = (char)method;
+		buf[3] = 0;
+	}
+}
+
+/* Append a record. */
+static void tw_rec(struct tlv_writer *w, enum tlv_tag tag, const void *val, size_t n)
+{
+	uint16_t len = (uint16_t)n;
+
+	if (w->error)
+	{
+		return;
+	}
+
+	if (n > TLV_MAX_VALUE || w->len + TLV_REC_HDR_LEN + n > w->size)
+	{
+		w->error = 1;
+		return;
+	}
+
+	w->buf[w->len] = (char)tag;
+	memcpy(w->buf + w->len + 1, &len, sizeof(len));
+	memcpy(w->buf + w->len + TLV_REC_HDR_LEN, val, n);
+	w->len += TLV_REC_HDR_LEN + n;
+}
+
+/* Append a referenced string. */
+static void tw_ref(struct tlv_writer *w, enum tlv_tag tag, struct avs_str val)
+{
+	tw_rec(w, tag, val.s ? val.s : "", val.len);
+}
+
+/* Append a string from a fixed size char array of a parameter structure. */
+static void tw_str(struct tlv_writer *w, enum tlv_tag tag, const char *val, size_t size)
+{
+	tw_rec(w, tag, val, strnlen(val, size));
+}
+
+static void tw_u32(struct tlv_writer *w, enum tlv_tag tag, uint32_t val)
+{
+	tw_rec(w, tag, &val, sizeof(val));
+}
+
+/* Append the id of every command. */
+static int tw_finish(struct tlv_writer *w, struct avs_str comm_id)
+{
+	tw_ref(w, TLV_TAG_ID, comm_id);
+
+	return w->error ? -1 : (int)w->len;
+}
+
+/* Encapsulating "setParam" frame. */
+int enc_tlv_set_global_param(char *buf, size_t size, const struct avs_global_param *param)
+{
+	struct tlv_writer w;
+
+	tw_init(&w, buf, size, TLV_METHOD_SET_PARAM);
+	tw_str(&w, TLV_TAG_STUN_ADDR, param->stun_ipaddr, sizeof(param->stun_ipaddr));
+	tw_u32(&w, TLV_TAG_STUN_PORT, param->stun_port);
+	tw_str(&w, TLV_TAG_TURN_ADDR, param->turn_ipaddr, sizeof(param->turn_ipaddr));
+	tw_u32(&w, TLV_TAG_TURN_PORT, param->turn_port);
+	tw_str(&w, TLV_TAG_TURN_USER, param->turn_username, sizeof(param->turn_username));
+	tw_str(&w, TLV_TAG_TURN_PASS, param->turn_password, sizeof(param->turn_password));
+
+	return tw_finish(&w, enc_str(param->comm_id, sizeof(param->comm_id)));
+}
+
+/* Encapsulating "addPort" frame, shared by normal mode and ICE mode. */
+int enc_tlv_alloc_port_ref(char *buf, size_t size, const struct enc_chan *chan, const struct avs_alloc_port_ref_param *param, int ice)
+{
+	struct tlv_writer w;
+
+	tw_init(&w, buf, size, TLV_METHOD_ADD_PORT);
+	tw_ref(&w, TLV_TAG_CONF_ID, chan->conf_id);
+	tw_ref(&w, TLV_TAG_CHAN_ID, chan->chan_id);
+	tw_u32(&w, TLV_TAG_ICE, ice);
+	tw_u32(&w, TLV_TAG_DTLS, param->enable_dtls);
+
+	return tw_finish(&w, chan->comm_id);
+}
+
+int enc_tlv_alloc_port_normal(char *buf, size_t size, const struct avs_alloc_port_normal_param *param)
+{
+	struct enc_chan chan;
+	struct avs_alloc_port_ref_param ref;
+
+	enc_chan_alloc_port_normal(param, &chan, &ref);
+
+	return enc_tlv_alloc_port_ref(buf, size, &chan, &ref, 0);
+}
+
+int enc_tlv_alloc_port_ice(char *buf, size_t size, const struct avs_alloc_port_ice_param *param)
+{
+	struct enc_chan chan;
+	struct avs_alloc_port_ref_param ref;
+
+	enc_chan_alloc_port_ice(param, &chan, &ref);
+
+	return enc_tlv_alloc_port_ref(buf, size, &chan, &ref, 1);
+}
+
+/* Encapsulating "delPort" frame. */
+int enc_tlv_del_port_ref(char *buf, size_t size, const struct enc_chan *chan)
+{
+	struct tlv_writer w;
+
+	tw_init(&w, buf, size, TLV_METHOD_DEL_PORT);
+	tw_ref(&w, TLV_TAG_CONF_ID, chan->conf_id);
+	tw_ref(&w, TLV_TAG_CHAN_ID, chan->chan_id);
+	tw_ref(&w, TLV_TAG_PORT_ID, chan->port_id);
+
+	return tw_finish(&w, chan->comm_id);
+}
+
+int enc_tlv_del_port(char *buf, size_t size, const struct avs_dealloc_port_param *param)
+{
+	struct enc_chan chan;
+
+	enc_chan_del_port(param, &chan);
+
+	return enc_tlv_del_port_ref(buf, size, &chan);
+}
+
+/* Encapsulating "runctrl" frame. The media type only goes with suspend and resume. */
+int enc_tlv_runctrl_chan_ref(char *buf, size_t size, const struct enc_chan *chan, const struct avs_runctrl_chan_ref_param *param)
+{
+	struct tlv_writer w;
+	int with_mtype = (AVS_RUNCTRL_CHAN_OPT_SUSPEND == param->opt || AVS_RUNCTRL_CHAN_OPT_RESUME == param->opt);
+
+	if ((unsigned int)param->opt > AVS_RUNCTRL_CHAN_OPT_RESUME || (with_mtype && (unsigned int)param->mtype > AVS_RUNCTRL_CHAN_TYPE_ALL))
+	{
+		log_err("invalid runctrl opt %d or mtype %d\n", param->opt, param->mtype);
+		return -1;
+	}
+
+	tw_init(&w, buf, size, TLV_METHOD_RUNCTRL);
+	tw_ref(&w, TLV_TAG_CONF_ID, chan->conf_id);
+	tw_ref(&w, TLV_TAG_CHAN_ID, chan->chan_id);
+	tw_u32(&w, TLV_TAG_OPT, param->opt);
+	if (with_mtype)
+	{
+		tw_u32(&w, TLV_TAG_MEDIA_TYPE, param->mtype);
+	}
+
+	return tw_finish(&w, chan->comm_id);
+}
+
+int enc_tlv_runctrl_chan(char *buf, size_t size, const struct avs_runctrl_chan_param *param)
+{
+	struct enc_chan chan;
+	struct avs_runctrl_chan_ref_param ref;
+
+	enc_chan_runctrl_chan(param, &chan, &ref);
+
+	return enc_tlv_runctrl_chan_ref(buf, size, &chan, &ref);
+}
+
+/* Encapsulating "setPortParam" frame with normal mode. */
+int enc_tlv_set_peerport_normal_ref(char *buf, size_t size, const struct enc_chan *chan, const struct avs_set_peerport_normal_ref_param *param)
+{
+	struct tlv_writer w;
+
+	tw_init(&w, buf, size, TLV_METHOD_SET_PORT_PARAM);
+	tw_ref(&w, TLV_TAG_CONF_ID, chan->conf_id);
+	tw_ref(&w, TLV_TAG_CHAN_ID, chan->chan_id);
+	tw_ref(&w, TLV_TAG_PORT_ID, chan->port_id);
+	tw_u32(&w, TLV_TAG_ICE, 0);
+	tw_ref(&w, TLV_TAG_TARGET_ADDR, param->targetaddr);
+	tw_u32(&w, TLV_TAG_RTCP_MUX, param->rtcpmux);
+	tw_u32(&w, TLV_TAG_SYM_RTP, param->symrtp);
+	tw_u32(&w, TLV_TAG_QOS, param->qos);
+	tw_u32(&w, TLV_TAG_SRTP_MODE, param->srtpmode);
+	tw_ref(&w, TLV_TAG_SRTP_SEND_KEY, param->srtpsendkey);
+	tw_ref(&w, TLV_TAG_SRTP_RECV_KEY, param->srtprecvkey);
+	tw_ref(&w, TLV_TAG_FINGERPRINT, param->fingerprint);
+
+	return tw_finish(&w, chan->comm_id);
+}
+
+int enc_tlv_set_peerport_normal(char *buf, size_t size, const struct avs_set_peerport_normal_param *param)
+{
+	struct enc_chan chan;
+	struct avs_set_peerport_normal_ref_param ref;
+
+	enc_chan_set_peerport_normal(param, &chan, &ref);
+
+	return enc_tlv_set_peerport_normal_ref(buf, size, &chan, &ref);
+}
+
+/* Encapsulating "setPortParam" frame with ICE mode. */
+int enc_tlv_set_peerport_ice_ref(char *buf, size_t size, const struct enc_chan *chan, const struct avs_set_peerport_ice_ref_param *param)
+{
+	struct tlv_writer w;
+
+	tw_init(&w, buf, size, TLV_METHOD_SET_PORT_PARAM);
+	tw_ref(&w, TLV_TAG_CONF_ID, chan->conf_id);
+	tw_ref(&w, TLV_TAG_CHAN_ID, chan->chan_id);
+	tw_ref(&w, TLV_TAG_PORT_ID, chan->port_id);
+	tw_u32(&w, TLV_TAG_ICE, 1);
+	tw_u32(&w, TLV_TAG_ICE_ROLE, param->icerole);
+	tw_u32(&w, TLV_TAG_SSL_ROLE, param->sslrole);
+	tw_ref(&w, TLV_TAG_FINGERPRINT, param->fingerprint);
+	tw_ref(&w, TLV_TAG_ICE_UFRAG, param->ice_ufrag);
+	tw_ref(&w, TLV_TAG_ICE_PWD, param->ice_pwd);
+	tw_ref(&w, TLV_TAG_CANDIDATE, param->candidate);
+
+	return tw_finish(&w, chan->comm_id);
+}
+
+int enc_tlv_set_peerport_ice(char *buf, size_t size, const struct avs_set_peerport_ice_param *param)
+{
+	struct enc_chan chan;
+	struct avs_set_peerport_ice_ref_param ref;
+
+	enc_chan_set_peerport_ice(param, &chan, &ref);
+
+	return enc_tlv_set_peerport_ice_ref(buf, size, &chan, &ref);
+}
+
+/* Encapsulating "addTrack" frame, shared by audio and video. */
+static int enc_tlv_add_track(char *buf, size_t size, const struct enc_chan *chan, enum avs_runctrl_chan_mtype mtype,
+	unsigned int codec, unsigned int payloadtype, unsigned int transmode, unsigned int ptime)
+{
+	struct tlv_writer w;
+
+	tw_init(&w, buf, size, TLV_METHOD_ADD_TRACK);
+	tw_ref(&w, TLV_TAG_CONF_ID, chan->conf_id);
+	tw_ref(&w, TLV_TAG_CHAN_ID, chan->chan_id);
+	tw_ref(&w, TLV_TAG_PORT_ID, chan->port_id);
+	tw_str(&w, TLV_TAG_TRACK_ID, "222222222222222", MAX_UNIQUE_ID);
+	tw_u32(&w, TLV_TAG_MEDIA_TYPE, mtype);
+	tw_u32(&w, TLV_TAG_CODEC, codec);
+	tw_u32(&w, TLV_TAG_PAYLOAD_TYPE, payloadtype);
+	if (AVS_RUNCTRL_CHAN_TYPE_AUDIO == mtype)
+	{
+		tw_u32(&w, TLV_TAG_PTIME, ptime);
+	}
+	tw_u32(&w, TLV_TAG_TRANSMODE, transmode);
+
+	return tw_finish(&w, chan->comm_id);
+}
+
+int enc_tlv_set_audio_codec_ref(char *buf, size_t size, const struct enc_chan *chan, const struct avs_codec_audio_ref_param *param)
+{
+	if (!codec_audio_name(param->a_codec) || !transmode_name(param->audio_transmode))
+	{
+		log_err("invalid audio codec %d or transmode %d\n", param->a_codec, param->audio_transmode);
+		return -1;
+	}
+
+	return enc_tlv_add_track(buf, size, chan, AVS_RUNCTRL_CHAN_TYPE_AUDIO,
+		param->a_codec, param->audio_payloadtype, param->audio_transmode, param->ptime);
+}
+
+int enc_tlv_set_audio_codec(char *buf, size_t size, const struct avs_codec_audio_param *param)
+{
+	struct enc_chan chan;
+	struct avs_codec_audio_ref_param ref;
+
+	enc_chan_set_audio_codec(param, &chan, &ref);
+
+	return enc_tlv_set_audio_codec_ref(buf, size, &chan, &ref);
+}
+
+int enc_tlv_set_video_codec_ref(char *buf, size_t size, const struct enc_chan *chan, const struct avs_codec_video_ref_param *param)
+{
+	if (!codec_video_name(param->v_codec) || !transmode_name(param->video_transmode))
+	{
+		log_err("invalid video codec %d or transmode %d\n", param->v_codec, param->video_transmode);
+		return -1;
+	}
+
+	return enc_tlv_add_track(buf, size, chan, AVS_RUNCTRL_CHAN_TYPE_VIDEO,
+		param->v_codec, param->video_payloadtype, param->video_transmode, 0);
+}
+
+int enc_tlv_set_video_codec(char *buf, size_t size, const struct avs_codec_video_param *param)
+{
+	struct enc_chan chan;
+	struct avs_codec_video_ref_param ref;
+
+	enc_chan_set_video_codec(param, &chan, &ref);
+
+	return enc_tlv_set_video_codec_ref(buf, size, &chan, &ref);
+}
+
+/* Encapsulating "playsound" frame. */
+int enc_tlv_playsound_chan(char *buf, size_t size, const struct avs_playsound_chan_param *param)
+{
+	struct tlv_writer w;
+
+	tw_init(&w, buf, size, TLV_METHOD_PLAYSOUND);
+	tw_str(&w, TLV_TAG_CONF_ID, param->conf_id, sizeof(param->conf_id));
+	tw_str(&w, TLV_TAG_CHAN_ID, param->chan_id, sizeof(param->chan_id));
+	tw_u32(&w, TLV_TAG_PLAY_TYPE, param->ptype);
+	tw_u32(&w, TLV_TAG_ACTION, param->action);
+	tw_str(&w, TLV_TAG_SOUND_FILE, param->soundfile, sizeof(param->soundfile));
+
+	return tw_finish(&w, enc_str(param->comm_id, sizeof(param->comm_id)));
+}
+
+int enc_tlv_resp(char *buf, size_t size, const struct tlv_resp *resp)
+{
+	struct tlv_writer w;
+
+	tw_init(&w, buf, size, TLV_METHOD_RESPONSE);
+
+	if (TLV_HAS(resp, TLV_TAG_CODE))
+	{
+		tw_u32(&w, TLV_TAG_CODE, (uint32_t)resp->code);
+	}
+	if (TLV_HAS(resp, TLV_TAG_MESSAGE))
+	{
+		tw_str(&w, TLV_TAG_MESSAGE, resp->message, sizeof(resp->message));
+	}
+	if (TLV_HAS(resp, TLV_TAG_PORT_ID))
+	{
+		tw_str(&w, TLV_TAG_PORT_ID, resp->port_id, sizeof(resp->port_id));
+	}
+	if (TLV_HAS(resp, TLV_TAG_RTP_PORT))
+	{
+		tw_u32(&w, TLV_TAG_RTP_PORT, resp->rtp_port);
+	}
+	if (TLV_HAS(resp, TLV_TAG_RTCP_PORT))
+	{
+		tw_u32(&w, TLV_TAG_RTCP_PORT, resp->rtcp_port);
+	}
+	if (TLV_HAS(resp, TLV_TAG_FINGERPRINT))
+	{
+		tw_str(&w, TLV_TAG_FINGERPRINT, resp->fingerprint, sizeof(resp->fingerprint));
+	}
+	if (TLV_HAS(resp, TLV_TAG_ICE_UFRAG))
+	{
+		tw_str(&w, TLV_TAG_ICE_UFRAG, resp->ice_ufrag, sizeof(resp->ice_ufrag));
+	}
+	if (TLV_HAS(resp, TLV_TAG_ICE_PWD))
+	{
+		tw_str(&w, TLV_TAG_ICE_PWD, resp->ice_pwd, sizeof(resp->ice_pwd));
+	}
+	if (TLV_HAS(resp, TLV_TAG_CANDIDATE))
+	{
+		tw_str(&w, TLV_TAG_CANDIDATE, resp->candidate, sizeof(resp->candidate));
+	}
+
+	return tw_finish(&w, enc_str(resp->id, sizeof(resp->id)));
+}
+
+int tlv_frame_method(const void *buf, size_t len)
+{
+	const unsigned char *p = (const unsigned char *)buf;
+
+	if (len < TLV_HDR_LEN || TLV_MAGIC != p[0] || TLV_VERSION != p[1] || p[2] >= TLV_METHOD_MAX)
+	{
+		return -1;
+	}
+
+	return p[2];
+}
+
+int tlv_next(const void *buf, size_t len, size_t *off, unsigned int *tag, const char **val, unsigned int *vlen)
+{
+	const char *p = (const char *)buf;
+	uint16_t n;
+
+	if (*off == len)
+	{
+		return 0;
+	}
+
+	if (*off + TLV_REC_HDR_LEN > len)
+	{
+		return -1;
+	}
+
+	memcpy(&n, p + *off + 1, sizeof(n));
+	if (*off + TLV_REC_HDR_LEN + n > len)
+	{
+		return -1;
+	}
+
+	*tag = (unsigned char)p[*off];
+	*val = p + *off + TLV_REC_HDR_LEN;
+	*vlen = n;
+	*off += TLV_REC_HDR_LEN + n;
+
+	return 1;
+}
+
+int tlv_get_u32(const char *val, unsigned int vlen, uint32_t *out)
+{
+	if (sizeof(*out) != vlen)
+	{
+		return -1;
+	}
+
+	memcpy(out, val, sizeof(*out));
+
+	return 0;
+}
+
+/* Copy a string record into a char array, truncated and terminated. */
+static void tlv_get_str(const char *val, unsigned int vlen, char *dst, size_t size)
+{
+	if (vlen >= size)
+	{
+		vlen = size - 1;
+	}
+
+	memcpy(dst, val, vlen);
+	dst[vlen] = '\0';
+}
+
+int dec_tlv_resp(const void *buf, size_t len, struct tlv_resp *resp)
+{
+	size_t off = TLV_HDR_LEN;
+	unsigned int tag, vlen;
+	const char *val;
+	uint32_t num;
+	int ret;
+
+	if (tlv_frame_method(buf, len) != TLV_METHOD_RESPONSE)
+	{
+		return -1;
+	}
+
+	resp->present = 0;
+	resp->id[0] = resp->message[0] = resp->port_id[0] = resp->fingerprint[0] = '\0';
+	resp->ice_ufrag[0] = resp->ice_pwd[0] = resp->candidate[0] = '\0';
+
+	while ((ret = tlv_next(buf, len, &off, &tag, &val, &vlen)) > 0)
+	{
+		switch (tag)
+		{
+			case TLV_TAG_CODE:
+			case TLV_TAG_RTP_PORT:
+			case TLV_TAG_RTCP_PORT:
+				if (tlv_get_u32(val, vlen, &num) != 0)
+				{
+					log_err("error: tag %u is not a number\n", tag);
+					return -1;
+				}
+				if (TLV_TAG_CODE == tag)
+				{
+					resp->code = (int)num;
+				}
+				else if (TLV_TAG_RTP_PORT == tag)
+				{
+					resp->rtp_port = num;
+				}
+				else
+				{
+					resp->rtcp_port = num;
+				}
+				break;
+
+			case TLV_TAG_ID:
+				tlv_get_str(val, vlen, resp->id, sizeof(resp->id));
+				break;
+
+			case TLV_TAG_MESSAGE:
+				tlv_get_str(val, vlen, resp->message, sizeof(resp->message));
+				break;
+
+			case TLV_TAG_PORT_ID:
+				tlv_get_str(val, vlen, resp->port_id, sizeof(resp->port_id));
+				break;
+
+			case TLV_TAG_FINGERPRINT:
+				tlv_get_str(val, vlen, resp->fingerprint, sizeof(resp->fingerprint));
+				break;
+
+			case TLV_TAG_ICE_UFRAG:
+				tlv_get_str(val, vlen, resp->ice_ufrag, sizeof(resp->ice_ufrag));
+				break;
+
+			case TLV_TAG_ICE_PWD:
+				tlv_get_str(val, vlen, resp->ice_pwd, sizeof(resp->ice_pwd));
+				break;
+
+			case TLV_TAG_CANDIDATE:
+				if (TLV_HAS(resp, TLV_TAG_CANDIDATE))
+				{
+					continue;
+				}
+				tlv_get_str(val, vlen, resp->candidate, sizeof(resp->candidate));
+				break;
+
+			default:
+				continue;
+		}
+
+		resp->present |= (uint64_t)1 << tag;
+	}
+
+	return ret;
+}
@@ -0,0 +1,207 @@
+/****************************************************************************
+ *
+ * Multiedia Controller Module(MCM).
+ *
+ * Copyright (c) 2017 by Grandstream Networks, Inc.
+ * All rights reserved.
+ *
+ * This material is proprietary to Grandstream Networks, Inc. and,
+ * in addition to the above mentioned Copyright, may be
+ * subject to protection under other intellectual property
+ * regimes, including patents, trade secrets, designs and/or
+ * trademarks.
+ *
+ * Any use of this material for any purpose, except with an
+ * express license from Grandstream Networks, Inc. is strictly
+ * prohibited.
+ *
+ *
+ * \brief Binary TLV encoding of the commands sent to AVS and their responses.
+ *
+ *	A frame is a TLV_HDR_LEN bytes header followed by records of a one
+ *  byte tag, a 16 bit length and the value. Numbers are 32 bit values
+ *  and strings are not terminated. Both ends run on the same host, so
+ *  lengths and numbers are in native byte order.
+ *
+ *  The first byte of a frame is TLV_MAGIC, which no JSON message starts
+ *  with, so both encodings can share a transport. avs_controller only
+ *  sends frames once AVS has accepted a "hello" command asking for them.
+ *  Notifications from AVS stay JSON.
+ *
+ ***************************************************************************/
+
+#ifndef AVS_TLV_H
+#define AVS_TLV_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "avs_controller.h"
+#include "avs_json_enc.h"
+
+#define TLV_MAGIC		0xA5
+#define TLV_VERSION		1
+#define TLV_HDR_LEN		4	/* Magic, version, method and a reserved byte. */
+#define TLV_REC_HDR_LEN		3	/* Tag and length of a record. */
+#define TLV_HELLO_METHOD	"hello"	/* JSON command asking AVS for binary frames. */
+
+/* Methods of a frame, the third byte of the header. */
+enum tlv_method
+{
+	TLV_METHOD_RESPONSE,
+	TLV_METHOD_SET_PARAM,
+	TLV_METHOD_ADD_PORT,
+	TLV_METHOD_DEL_PORT,
+	TLV_METHOD_SET_PORT_PARAM,
+	TLV_METHOD_ADD_TRACK,
+	TLV_METHOD_RUNCTRL,
+	TLV_METHOD_PLAYSOUND,
+	TLV_METHOD_MAX
+};
+
+/* Tags of the records. Enumerations are sent as the values of avs_controller.h. */
+enum tlv_tag
+{
+	TLV_TAG_ID = 1,
+	TLV_TAG_CONF_ID,
+	TLV_TAG_CHAN_ID,
+	TLV_TAG_PORT_ID,
+	TLV_TAG_ICE,
+	TLV_TAG_DTLS,
+	TLV_TAG_STUN_ADDR,
+	TLV_TAG_STUN_PORT,
+	TLV_TAG_TURN_ADDR,
+	TLV_TAG_TURN_PORT,
+	TLV_TAG_TURN_USER,
+	TLV_TAG_TURN_PASS,
+	TLV_TAG_TARGET_ADDR,
+	TLV_TAG_RTCP_MUX,
+	TLV_TAG_SYM_RTP,
+	TLV_TAG_QOS,
+	TLV_TAG_SRTP_MODE,
+	TLV_TAG_SRTP_SEND_KEY,
+	TLV_TAG_SRTP_RECV_KEY,
+	TLV_TAG_FINGERPRINT,
+	TLV_TAG_ICE_ROLE,
+	TLV_TAG_SSL_ROLE,
+	TLV_TAG_ICE_UFRAG,
+	TLV_TAG_ICE_PWD,
+	TLV_TAG_CANDIDATE,
+	TLV_TAG_TRACK_ID,
+	TLV_TAG_MEDIA_TYPE,	/* enum avs_runctrl_chan_mtype, also the media of "addTrack". */
+	TLV_TAG_CODEC,	/* enum avs_audio_codec or enum avs_video_codec, by TLV_TAG_MEDIA_TYPE. */
+	TLV_TAG_PAYLOAD_TYPE,
+	TLV_TAG_PTIME,
+	TLV_TAG_TRANSMODE,
+	TLV_TAG_OPT,	/* enum avs_runctrl_chan_opt. */
+	TLV_TAG_PLAY_TYPE,	/* enum avs_playsound_chan_type. */
+	TLV_TAG_ACTION,
+	TLV_TAG_SOUND_FILE,
+	TLV_TAG_CODE,
+	TLV_TAG_MESSAGE,
+	TLV_TAG_RTP_PORT,
+	TLV_TAG_RTCP_PORT,
+	TLV_TAG_MAX
+};
+
+#define TLV_HAS(resp, tag)	(((resp)->present >> (tag)) & 1)
+
+/**
+ * struct tlv_resp - A response decoded by dec_tlv_resp(), or to encode by enc_tlv_resp().
+ * @present:  Bit (1 << tag) is set for each tag found, see TLV_HAS().
+ * @code:  TLV_TAG_CODE.
+ * @rtp_port:  TLV_TAG_RTP_PORT.
+ * @rtcp_port:  TLV_TAG_RTCP_PORT.
+ * @id:  TLV_TAG_ID, and the other strings of their tags. They are truncated to their size and terminated.
+ * @candidate:  First TLV_TAG_CANDIDATE, one record per candidate.
+ */
+struct tlv_resp
+{
+	uint64_t present;
+	int code;
+	unsigned int rtp_port;
+	unsigned int rtcp_port;
+	char id[MAX_UNIQUE_ID];
+	char message[MAX_MESSAGE_REPONSE];
+	char port_id[MAX_PORTID_LEN];
+	char fingerprint[MAX_FINGERPRINT_LEN];
+	char ice_ufrag[MAX_ICE_UFRAG];
+	char ice_pwd[MAX_ICE_PASSWROD];
+	char candidate[MAX_CANDIDATE_STR_LEN];
+};
+
+/**
+ * enc_tlv_* - Encode a command to AVS into @buf, the same values as the enc_json_* of avs_json_enc.h.
+ * @buf:  Output buffer.
+ * @size:  Size of @buf.
+ * @param:  Parameters of the command.
+ *
+ * Return: Length of the frame. -1 if @buf is too small or a value is unknown.
+ */
+int enc_tlv_set_global_param(char *buf, size_t size, const struct avs_global_param *param);
+int enc_tlv_alloc_port_normal(char *buf, size_t size, const struct avs_alloc_port_normal_param *param);
+int enc_tlv_alloc_port_ice(char *buf, size_t size, const struct avs_alloc_port_ice_param *param);
+int enc_tlv_del_port(char *buf, size_t size, const struct avs_dealloc_port_param *param);
+int enc_tlv_runctrl_chan(char *buf, size_t size, const struct avs_runctrl_chan_param *param);
+int enc_tlv_set_peerport_normal(char *buf, size_t size, const struct avs_set_peerport_normal_param *param);
+int enc_tlv_set_peerport_ice(char *buf, size_t size, const struct avs_set_peerport_ice_param *param);
+int enc_tlv_set_audio_codec(char *buf, size_t size, const struct avs_codec_audio_param *param);
+int enc_tlv_set_video_codec(char *buf, size_t size, const struct avs_codec_video_param *param);
+int enc_tlv_playsound_chan(char *buf, size_t size, const struct avs_playsound_chan_param *param);
+
+/**
+ * enc_tlv_*_ref - Encode a command from its compact parameters, the same values as the enc_json_*_ref of avs_json_enc.h.
+ * @chan:  IDs of the command, "chan" of @param is not read.
+ * @param:  Compact parameters of the command.
+ *
+ * Return: The same as enc_tlv_*.
+ */
+int enc_tlv_alloc_port_ref(char *buf, size_t size, const struct enc_chan *chan, const struct avs_alloc_port_ref_param *param, int ice);
+int enc_tlv_del_port_ref(char *buf, size_t size, const struct enc_chan *chan);
+int enc_tlv_runctrl_chan_ref(char *buf, size_t size, const struct enc_chan *chan, const struct avs_runctrl_chan_ref_param *param);
+int enc_tlv_set_peerport_normal_ref(char *buf, size_t size, const struct enc_chan *chan, const struct avs_set_peerport_normal_ref_param *param);
+int enc_tlv_set_peerport_ice_ref(char *buf, size_t size, const struct enc_chan *chan, const struct avs_set_peerport_ice_ref_param *param);
+int enc_tlv_set_audio_codec_ref(char *buf, size_t size, const struct enc_chan *chan, const struct avs_codec_audio_ref_param *param);
+int enc_tlv_set_video_codec_ref(char *buf, size_t size, const struct enc_chan *chan, const struct avs_codec_video_ref_param *param);
+
+/**
+ * enc_tlv_resp - Encode a response, for a peer implementing AVS. Members of @resp are sent when their bit of "present" is set.
+ *
+ * Return: Length of the frame, -1 if @buf is too small.
+ */
+int enc_tlv_resp(char *buf, size_t size, const struct tlv_resp *resp);
+
+/**
+ * tlv_frame_method - Check the header of a frame.
+ * @buf:  The frame.
+ * @len:  Its length.
+ *
+ * Return: Its enum tlv_method, -1 if it is not a frame of TLV_VERSION.
+ */
+int tlv_frame_method(const void *buf, size_t len);
+
+/**
+ * tlv_next - Iterate the records of a frame whose header has been checked.
+ * @buf:  The frame.
+ * @len:  Its length.
+ * @off:  Offset of the next record, TLV_HDR_LEN to start. It is moved past the record.
+ * @tag:  Output, tag of the record.
+ * @val:  Output, its value.
+ * @vlen:  Output, length of the value.
+ *
+ * Return: 1 if a record has been read, 0 at the end of the frame, -1 if a record overruns the frame.
+ */
+int tlv_next(const void *buf, size_t len, size_t *off, unsigned int *tag, const char **val, unsigned int *vlen);
+
+/**
+ * tlv_get_u32 - Read a number record. Return: 0, -1 if the value is not 4 bytes.
+ */
+int tlv_get_u32(const char *val, unsigned int vlen, uint32_t *out);
+
+/**
+ * dec_tlv_resp - Decode a response frame. Unknown tags are skipped.
+ *
+ * Return: 0, -1 if it is not a response frame or it is malformed.
+ */
+int dec_tlv_resp(const void *buf, size_t len, struct tlv_resp *resp);
+
+#endif /* AVS_TLV_H */